@@ -0,0 +1,641 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <mbus/mbus.h>
+
+// Input read per job, a job is decoded by one worker
+#define CHUNK_SIZE (256 * 1024)
+
+// Maximum size of a frame
+#define MAXFRAME 512
+
+#define FORMAT_XML      0
+#define FORMAT_JSON     1
+#define FORMAT_INFLUXDB 2
+
+#define JOB_FREE    0 // slot can be filled with input
+#define JOB_QUEUED  1 // waiting for a worker
+#define JOB_BUSY    2 // being decoded
+#define JOB_DONE    3 // output ready to be written
+
+//
+// A chunk of input holding whole frames (raw input) or whole lines (hex
+// input), and its output
+//
+typedef struct _job {
+    int state;
+    unsigned char *input;
+    size_t input_len;
+    size_t input_size;
+    const char *file;           // input file name, for error messages
+    unsigned long first;        // frames (raw) or lines (hex) of the file before the job
+
+    mbus_sink output;           // decoded frames
+    mbus_sink errors;           // error messages
+    unsigned long frames;
+    unsigned long failed;
+    unsigned long skipped;      // bytes outside of frames (raw input)
+} job;
+
+//
+// Worker thread with its own decode context
+//
+typedef struct _worker {
+    pthread_t thread;
+    mbus_record_arena arena;
+    mbus_frame frame;
+    mbus_frame_data frame_data;
+} worker;
+
+static int raw = 0, normalized = 0, format = FORMAT_XML, options = 0;
+
+static job *jobs;
+static size_t job_count;
+static size_t next_job = 0;     // next job to be decoded (sequence number)
+static size_t queued_jobs = 0;  // number of jobs queued so far
+static int done = 0;            // no more input
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+//------------------------------------------------------------------------------
+// Wrapper for argument parsing errors
+//------------------------------------------------------------------------------
+static void
+parse_abort(char **argv)
+{
+    fprintf(stderr, "usage: %s [-R] [-N] [-j|-i] [-w WORKERS] [--onlynumval] [file ...]\n", argv[0]);
+    fprintf(stderr, "    optional flag -R for raw binary input (default: one hex frame per line)\n");
+    fprintf(stderr, "    optional flag -N for normalized values\n");
+    fprintf(stderr, "    optional flag -j for JSON lines output\n");
+    fprintf(stderr, "    optional flag -i for InfluxDB Line Protocol output\n");
+    fprintf(stderr, "    optional flag -w for the number of decoder threads\n");
+    fprintf(stderr, "    optional flag --onlynumval for supressing records with non-numeric values\n");
+    exit(1);
+}
+
+//------------------------------------------------------------------------------
+// Size of the raw frame at data: 0 if more data is needed to tell. Bytes that
+// do not start a frame, e.g. a 0x68 without a valid 0x68 L L 0x68 header, are
+// reported as a 1 byte "frame" with *garbage set, so that the caller looks for
+// the next start byte.
+//------------------------------------------------------------------------------
+static size_t
+frame_size(const unsigned char *data, size_t len, int *garbage)
+{
+    *garbage = 0;
+
+    if (len == 0)
+        return 0;
+
+    switch (data[0])
+    {
+        case MBUS_FRAME_ACK_START:
+            return MBUS_FRAME_BASE_SIZE_ACK;
+
+        case MBUS_FRAME_SHORT_START:
+            return MBUS_FRAME_BASE_SIZE_SHORT;
+
+        case MBUS_FRAME_LONG_START:
+            if (len < 4)
+                return 0;
+
+            // the length field is sent twice, followed by the start byte again
+            if (data[1] != data[2] || data[3] != MBUS_FRAME_LONG_START)
+                break;
+
+            // the length field includes control, address and CI field
+            return MBUS_FRAME_BASE_SIZE_LONG - 3 + data[1];
+    }
+
+    *garbage = 1;
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// Decode one frame and append the output to the job. The frame is identified
+// by its number (raw input) or line (hex input) in error messages.
+//------------------------------------------------------------------------------
+static void
+decode_frame(worker *w, job *j, unsigned char *data, size_t len, unsigned long number)
+{
+    mbus_sink *sink = &(j->output);
+    const char *what = raw ? "frame" : "line";
+    int result;
+
+    j->frames++;
+
+    if ((result = mbus_parse(&(w->frame), data, len)) != 0)
+    {
+        mbus_sink_printf(&(j->errors), "%s: %s %lu: %s\n", j->file, what, number,
+                         (result > 0) ? "incomplete frame" : mbus_error_str());
+        j->failed++;
+        return;
+    }
+
+    if (mbus_frame_data_parse_arena(&(w->frame), &(w->frame_data), &(w->arena)) != 0)
+    {
+        mbus_sink_printf(&(j->errors), "%s: %s %lu: %s\n", j->file, what, number, mbus_error_str());
+        mbus_record_arena_reset(&(w->arena));
+        j->failed++;
+        return;
+    }
+
+    switch (format)
+    {
+        case FORMAT_JSON:
+            result = normalized ? mbus_frame_data_json_normalized_sink(&(w->frame_data), sink)
+                                : mbus_frame_data_json_sink(&(w->frame_data), options, sink);
+            break;
+
+        case FORMAT_INFLUXDB:
+            result = normalized ? mbus_frame_data_influxdb_normalized_sink(&(w->frame_data), sink)
+                                : mbus_frame_data_influxdb_sink(&(w->frame_data), options, sink);
+            break;
+
+        default:
+            result = normalized ? mbus_frame_data_xml_normalized_sink(&(w->frame_data), sink)
+                                : mbus_frame_data_xml_sink(&(w->frame_data), options, sink);
+            break;
+    }
+
+    if (result != 0)
+    {
+        mbus_sink_printf(&(j->errors), "%s: %s %lu: failed to write output\n", j->file, what, number);
+        j->failed++;
+    }
+
+    // the records of the frame are not needed anymore
+    mbus_record_arena_reset(&(w->arena));
+}
+
+//------------------------------------------------------------------------------
+// Decode all frames of a job
+//------------------------------------------------------------------------------
+static void
+decode_job(worker *w, job *j)
+{
+    unsigned char buff[MAXFRAME];
+    unsigned char *line, *end, *next;
+    unsigned long line_no = j->first;
+    size_t pos, size, len;
+    int garbage;
+
+    mbus_sink_reset(&(j->output));
+    mbus_sink_reset(&(j->errors));
+    j->frames = j->failed = j->skipped = 0;
+
+    if (raw)
+    {
+        for (pos = 0; pos < j->input_len; pos += size)
+        {
+            size = frame_size(j->input + pos, j->input_len - pos, &garbage);
+
+            if (garbage)
+            {
+                j->skipped++;
+                continue;
+            }
+
+            // truncated frame at the end of the input
+            if (size == 0 || size > j->input_len - pos)
+                size = j->input_len - pos;
+
+            decode_frame(w, j, j->input + pos, size, j->first + j->frames + 1);
+        }
+
+        return;
+    }
+
+    end = j->input + j->input_len;
+
+    for (line = j->input; line < end; line = next)
+    {
+        if ((next = memchr(line, '\n', end - line)) == NULL)
+            next = end;
+        else
+            next++;
+
+        line_no++;
+
+        if ((len = mbus_hex2bin(buff, sizeof(buff), line, next - line)) == 0)
+            continue;   // empty line
+
+        decode_frame(w, j, buff, len, line_no);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Worker thread: decode the queued jobs in sequence order
+//------------------------------------------------------------------------------
+static void *
+worker_main(void *arg)
+{
+    worker *w = (worker *) arg;
+    job *j;
+
+    pthread_mutex_lock(&lock);
+
+    for (;;)
+    {
+        while (next_job == queued_jobs && !done)
+            pthread_cond_wait(&work_cond, &lock);
+
+        if (next_job == queued_jobs)
+            break;
+
+        j = &jobs[next_job++ % job_count];
+        j->state = JOB_BUSY;
+
+        pthread_mutex_unlock(&lock);
+
+        decode_job(w, j);
+
+        pthread_mutex_lock(&lock);
+
+        j->state = JOB_DONE;
+        pthread_cond_broadcast(&done_cond);
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+// Make room for len more bytes of input in a job
+//------------------------------------------------------------------------------
+static int
+job_reserve(job *j, size_t len)
+{
+    unsigned char *input;
+    size_t size = j->input_size ? j->input_size : CHUNK_SIZE;
+
+    while (size - j->input_len < len)
+        size *= 2;
+
+    if (size != j->input_size)
+    {
+        if ((input = (unsigned char *) realloc(j->input, size)) == NULL)
+            return -1;
+
+        j->input = input;
+        j->input_size = size;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Length of the input of a job that holds only whole lines or frames, the rest
+// is carried over to the next job.
+//------------------------------------------------------------------------------
+static size_t
+job_cut(job *j)
+{
+    unsigned char *p;
+    size_t pos, size;
+    int garbage;
+
+    if (raw)
+    {
+        for (pos = 0; pos < j->input_len; pos += size)
+        {
+            size = frame_size(j->input + pos, j->input_len - pos, &garbage);
+
+            if (size == 0 || size > j->input_len - pos)
+                break;
+        }
+
+        return pos;
+    }
+
+    for (p = j->input + j->input_len; p > j->input; p--)
+    {
+        if (p[-1] == '\n')
+            break;
+    }
+
+    return p - j->input;
+}
+
+//------------------------------------------------------------------------------
+// Write the output of a finished job, count its frames
+//------------------------------------------------------------------------------
+static int
+job_write(job *j, mbus_sink *out, unsigned long *frames, unsigned long *failed, unsigned long *skipped)
+{
+    size_t len;
+    char *data;
+
+    if ((data = mbus_sink_buffer(&(j->errors), &len)) != NULL && len > 0)
+        fwrite(data, 1, len, stderr);
+
+    if ((data = mbus_sink_buffer(&(j->output), &len)) != NULL && len > 0)
+    {
+        if (mbus_sink_write(out, data, len) != 0)
+            return -1;
+    }
+
+    *frames  += j->frames;
+    *failed  += j->failed;
+    *skipped += j->skipped;
+
+    j->state = JOB_FREE;
+
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    worker *workers;
+    job *j;
+    mbus_sink out;
+    FILE *fp;
+    struct timespec start, end;
+    unsigned char *carry = NULL;
+    size_t carry_len = 0, carry_size = 0, cut, n, size, seq, written = 0;
+    unsigned long frames = 0, failed = 0, skipped = 0, file_frames;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int c, i, eof, garbage, first_file, file_count, result = 0;
+    double elapsed;
+    const char *file;
+
+    for (c = 1; c < argc; c++)
+    {
+        if (strcmp(argv[c], "-R") == 0)
+        {
+            raw = 1;
+        }
+        else if (strcmp(argv[c], "-N") == 0)
+        {
+            normalized = 1;
+        }
+        else if (strcmp(argv[c], "-j") == 0)
+        {
+            format = FORMAT_JSON;
+        }
+        else if (strcmp(argv[c], "-i") == 0)
+        {
+            format = FORMAT_INFLUXDB;
+        }
+        else if (strcmp(argv[c], "-w") == 0 && c + 1 < argc)
+        {
+            threads = atol(argv[++c]);
+        }
+        else if (strcmp(argv[c], "--onlynumval") == 0)
+        {
+            options = options | MBUS_VALUE_OPTION_ONLYNUMERIC;
+        }
+        else if (argv[c][0] == '-' && argv[c][1] != '\0')
+        {
+            parse_abort(argv);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (threads < 1)
+        threads = 1;
+
+    first_file = c;
+    file_count = (c < argc) ? argc - c : 1;
+
+    // enough jobs to keep all workers busy while the oldest one is written
+    job_count = 2 * threads + 2;
+
+    workers = (worker *) calloc(threads, sizeof(worker));
+    jobs = (job *) calloc(job_count, sizeof(job));
+
+    if (workers == NULL || jobs == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+    }
+
+    for (n = 0; n < job_count; n++)
+    {
+        mbus_sink_init_buffer(&(jobs[n].output), NULL, 0);
+        mbus_sink_init_buffer(&(jobs[n].errors), NULL, 0);
+    }
+
+    for (i = 0; i < threads; i++)
+    {
+        mbus_record_arena_init(&(workers[i].arena));
+
+        if (pthread_create(&(workers[i].thread), NULL, worker_main, &workers[i]) != 0)
+        {
+            fprintf(stderr, "Failed to start decoder thread\n");
+            return 1;
+        }
+    }
+
+    mbus_sink_init_fd(&out, STDOUT_FILENO);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (seq = 0, i = 0; i < file_count; i++)
+    {
+        if (first_file >= argc || strcmp(argv[first_file + i], "-") == 0)
+        {
+            file = "stdin";
+            fp = stdin;
+        }
+        else if ((fp = fopen(file = argv[first_file + i], "rb")) == NULL)
+        {
+            fprintf(stderr, "%s: failed to open '%s'\n", argv[0], file);
+            result = 1;
+            continue;
+        }
+
+        carry_len = 0;
+        file_frames = 0;
+
+        for (eof = 0; !eof; seq++)
+        {
+            j = &jobs[seq % job_count];
+
+            // wait for the slot, write finished jobs in order
+            pthread_mutex_lock(&lock);
+
+            while (j->state != JOB_FREE)
+            {
+                while (jobs[written % job_count].state != JOB_DONE)
+                    pthread_cond_wait(&done_cond, &lock);
+
+                pthread_mutex_unlock(&lock);
+
+                if (job_write(&jobs[written++ % job_count], &out, &frames, &failed, &skipped) != 0)
+                {
+                    fprintf(stderr, "%s: failed to write output\n", argv[0]);
+                    return 1;
+                }
+
+                pthread_mutex_lock(&lock);
+            }
+
+            pthread_mutex_unlock(&lock);
+
+            // input carried over from the previous chunk, then a new chunk
+            j->input_len = 0;
+
+            if (job_reserve(j, carry_len + CHUNK_SIZE) != 0)
+            {
+                fprintf(stderr, "Failed to allocate memory\n");
+                return 1;
+            }
+
+            if (carry_len > 0)
+                memcpy(j->input, carry, carry_len);
+
+            j->input_len = carry_len;
+
+            do
+            {
+                n = fread(j->input + j->input_len, 1, j->input_size - j->input_len, fp);
+                j->input_len += n;
+                eof = (n == 0);
+
+                cut = eof ? j->input_len : job_cut(j);
+
+                // a line longer than the chunk
+                if (cut == 0 && !eof && job_reserve(j, CHUNK_SIZE) != 0)
+                {
+                    fprintf(stderr, "Failed to allocate memory\n");
+                    return 1;
+                }
+            } while (cut == 0 && !eof);
+
+            carry_len = j->input_len - cut;
+
+            if (carry_len > carry_size)
+            {
+                carry_size = carry_len;
+
+                if ((carry = (unsigned char *) realloc(carry, carry_size)) == NULL)
+                {
+                    fprintf(stderr, "Failed to allocate memory\n");
+                    return 1;
+                }
+            }
+
+            if (carry_len > 0)
+                memcpy(carry, j->input + cut, carry_len);
+
+            j->input_len = cut;
+
+            if (cut == 0)
+            {
+                // nothing left in this file, reuse the slot
+                seq--;
+                continue;
+            }
+
+            // count the frames or lines of the file for the error messages
+            j->file  = file;
+            j->first = file_frames;
+
+            if (raw)
+            {
+                for (n = 0; n < cut; n += size)
+                {
+                    if ((size = frame_size(j->input + n, cut - n, &garbage)) == 0)
+                        break;
+
+                    if (!garbage)
+                        file_frames++;
+                }
+            }
+            else
+            {
+                for (n = 0; n < cut; n++)
+                {
+                    if (j->input[n] == '\n')
+                        file_frames++;
+                }
+            }
+
+            pthread_mutex_lock(&lock);
+            j->state = JOB_QUEUED;
+            queued_jobs++;
+            pthread_cond_signal(&work_cond);
+            pthread_mutex_unlock(&lock);
+        }
+
+        if (fp != stdin)
+            fclose(fp);
+    }
+
+    // write the remaining jobs
+    pthread_mutex_lock(&lock);
+    done = 1;
+    pthread_cond_broadcast(&work_cond);
+
+    while (written < seq)
+    {
+        while (jobs[written % job_count].state != JOB_DONE)
+            pthread_cond_wait(&done_cond, &lock);
+
+        pthread_mutex_unlock(&lock);
+
+        if (job_write(&jobs[written++ % job_count], &out, &frames, &failed, &skipped) != 0)
+        {
+            fprintf(stderr, "%s: failed to write output\n", argv[0]);
+            return 1;
+        }
+
+        pthread_mutex_lock(&lock);
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    if (mbus_sink_flush(&out) != 0)
+    {
+        fprintf(stderr, "%s: failed to write output\n", argv[0]);
+        result = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        mbus_record_arena_free(&(workers[i].arena));
+    }
+
+    for (n = 0; n < job_count; n++)
+    {
+        free(jobs[n].input);
+        mbus_sink_free(&(jobs[n].output));
+        mbus_sink_free(&(jobs[n].errors));
+    }
+
+    free(carry);
+    free(jobs);
+    free(workers);
+
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "%lu frames (%lu failed, %lu bytes skipped) in %.3f s, %.0f frames/s, %ld threads\n",
+            frames, failed, skipped, elapsed, (elapsed > 0) ? frames / elapsed : 0.0, threads);
+
+    return (result || failed) ? 1 : 0;
+}
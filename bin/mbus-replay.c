@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <mbus/mbus.h>
+
+#define FORMAT_XML      0
+#define FORMAT_JSON     1
+#define FORMAT_INFLUXDB 2
+
+static int debug = 0, format = FORMAT_XML, normalized = 0, options = 0;
+
+//------------------------------------------------------------------------------
+// Wrapper for argument parsing errors
+//------------------------------------------------------------------------------
+static void
+parse_abort(char **argv)
+{
+    fprintf(stderr, "usage: %s [-d] [-N] [-j|-i] [-o] [-I ID] [--onlynumval] capture-file\n", argv[0]);
+    fprintf(stderr, "    optional flag -d for debug printout\n");
+    fprintf(stderr, "    optional flag -N for normalized values\n");
+    fprintf(stderr, "    optional flag -j for JSON lines output\n");
+    fprintf(stderr, "    optional flag -i for InfluxDB Line Protocol output\n");
+    fprintf(stderr, "    optional flag -o for replaying at the original timing (default: as fast as possible)\n");
+    fprintf(stderr, "    optional flag -I for replaying only the records of one handle id\n");
+    fprintf(stderr, "    optional flag --onlynumval for supressing records with non-numeric values\n");
+    exit(1);
+}
+
+//------------------------------------------------------------------------------
+// Nanoseconds elapsed since start
+//------------------------------------------------------------------------------
+static long long
+elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000000LL + (now.tv_nsec - start->tv_nsec);
+}
+
+//------------------------------------------------------------------------------
+// Write the decoded data of a frame
+//------------------------------------------------------------------------------
+static int
+write_frame_data(mbus_frame_data *data, mbus_sink *sink)
+{
+    switch (format)
+    {
+        case FORMAT_JSON:
+            return normalized ? mbus_frame_data_json_normalized_sink(data, sink)
+                              : mbus_frame_data_json_sink(data, options, sink);
+
+        case FORMAT_INFLUXDB:
+            return normalized ? mbus_frame_data_influxdb_normalized_sink(data, sink)
+                              : mbus_frame_data_influxdb_sink(data, options, sink);
+
+        default:
+            return normalized ? mbus_frame_data_xml_normalized_sink(data, sink)
+                              : mbus_frame_data_xml_sink(data, options, sink);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Replay the received frames of a capture file through mbus_recv_frame and
+// decode them, e.g. to reproduce a problem seen in the field or to benchmark
+// the decoder with real traffic.
+//------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+    mbus_handle *handle;
+    mbus_frame frame;
+    mbus_frame_data frame_data;
+    mbus_record_arena arena;
+    mbus_sink out;
+    struct timespec start, t;
+    unsigned long frames = 0, failed = 0;
+    long long decode_ns = 0, total_ns;
+    int mode = MBUS_REPLAY_RECV_ONLY, id = MBUS_CAPTURE_ID_ANY;
+    int c, result;
+
+    for (c = 1; c < argc - 1; c++)
+    {
+        if (strcmp(argv[c], "-d") == 0)
+        {
+            debug = 1;
+        }
+        else if (strcmp(argv[c], "-N") == 0)
+        {
+            normalized = 1;
+        }
+        else if (strcmp(argv[c], "-j") == 0)
+        {
+            format = FORMAT_JSON;
+        }
+        else if (strcmp(argv[c], "-i") == 0)
+        {
+            format = FORMAT_INFLUXDB;
+        }
+        else if (strcmp(argv[c], "-o") == 0)
+        {
+            mode |= MBUS_REPLAY_REALTIME;
+        }
+        else if (strcmp(argv[c], "-I") == 0 && c + 1 < argc - 1)
+        {
+            id = atoi(argv[++c]);
+        }
+        else if (strcmp(argv[c], "--onlynumval") == 0)
+        {
+            options = options | MBUS_VALUE_OPTION_ONLYNUMERIC;
+        }
+        else
+        {
+            parse_abort(argv);
+        }
+    }
+
+    if (c != argc - 1 || id < MBUS_CAPTURE_ID_ANY || id > 0xFFFF)
+    {
+        parse_abort(argv);
+    }
+
+    if ((handle = mbus_context_replay(argv[c], id, mode)) == NULL)
+    {
+        fprintf(stderr, "Could not initialize M-Bus context: %s\n", mbus_error_str());
+        return 1;
+    }
+
+    if (debug)
+    {
+        mbus_register_recv_event(handle, &mbus_dump_recv_event);
+    }
+
+    if (mbus_connect(handle) == -1)
+    {
+        fprintf(stderr, "Failed to open capture file: %s\n", mbus_error_str());
+        mbus_context_free(handle);
+        return 1;
+    }
+
+    memset((void *)&frame, 0, sizeof(mbus_frame));
+    mbus_record_arena_init(&arena);
+    mbus_sink_init_fd(&out, STDOUT_FILENO);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((result = mbus_recv_frame(handle, &frame)) != MBUS_RECV_RESULT_RESET)
+    {
+        if (result == MBUS_RECV_RESULT_ERROR)
+        {
+            fprintf(stderr, "%s: %s\n", argv[c], mbus_error_str());
+            break;
+        }
+
+        frames++;
+
+        if (result != MBUS_RECV_RESULT_OK)
+        {
+            fprintf(stderr, "%s: frame %lu: %s\n", argv[c], frames, mbus_error_str());
+            failed++;
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t);
+
+        if (mbus_frame_data_parse_arena(&frame, &frame_data, &arena) != 0)
+        {
+            fprintf(stderr, "%s: frame %lu: %s\n", argv[c], frames, mbus_error_str());
+            mbus_record_arena_reset(&arena);
+            failed++;
+            continue;
+        }
+
+        if (write_frame_data(&frame_data, &out) != 0)
+        {
+            fprintf(stderr, "%s: frame %lu: failed to write output\n", argv[c], frames);
+            failed++;
+        }
+
+        decode_ns += elapsed_ns(&t);
+        mbus_record_arena_reset(&arena);
+
+        if (mode & MBUS_REPLAY_REALTIME)
+            mbus_sink_flush(&out);
+    }
+
+    mbus_sink_flush(&out);
+    total_ns = elapsed_ns(&start);
+
+    fprintf(stderr, "%lu frames (%lu failed) in %.3f s, decoding %.0f ns/frame\n",
+            frames, failed, total_ns / 1e9,
+            (frames > failed) ? (double) decode_ns / (frames - failed) : 0.0);
+
+    mbus_sink_free(&out);
+    mbus_record_arena_free(&arena);
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+
+    return (result == MBUS_RECV_RESULT_ERROR || failed > 0) ? 1 : 0;
+}
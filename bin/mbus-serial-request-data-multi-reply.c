@@ -46,15 +46,58 @@ init_slaves(mbus_handle *handle)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+// Load a link profile and attach it to the handle. A device that is not in the
+// profile yet is probed for its highest baudrate first.
+//------------------------------------------------------------------------------
+static mbus_link_profile *
+load_link_profile(mbus_handle *handle, const char *path, const char *addr_str, long baudrate)
+{
+    mbus_link_profile *profile;
+    long max_baudrate;
+
+    if ((profile = mbus_link_profile_new()) == NULL ||
+        mbus_link_profile_load(profile, path) == -1)
+    {
+        fprintf(stderr, "Failed to load link profile: %s\n", mbus_error_str());
+        mbus_link_profile_free(profile);
+        return NULL;
+    }
+
+    if (mbus_link_profile_get(profile, addr_str) == 0)
+    {
+        if ((max_baudrate = mbus_link_probe(handle, addr_str, baudrate)) == -1)
+        {
+            fprintf(stderr, "Failed to probe the baudrate of %s: %s\n", addr_str, mbus_error_str());
+        }
+        else if (max_baudrate > 0)
+        {
+            if (debug)
+                printf("%s: debug: %s works at up to %ld baud\n", __PRETTY_FUNCTION__, addr_str, max_baudrate);
+
+            if (mbus_link_profile_set(profile, addr_str, max_baudrate) == -1 ||
+                mbus_link_profile_save(profile, path) == -1)
+            {
+                fprintf(stderr, "Failed to save link profile: %s\n", mbus_error_str());
+            }
+        }
+    }
+
+    mbus_link_attach(handle, profile, baudrate);
+
+    return profile;
+}
+
 //------------------------------------------------------------------------------
 // Wrapper for argument parsing errors
 //------------------------------------------------------------------------------
 static void
 parse_abort(char **argv)
 {
-    fprintf(stderr, "usage: %s [-d] [-b BAUDRATE] [-f FRAMES] [-j|-i] [--onlynumval] device mbus-address\n", argv[0]);
+    fprintf(stderr, "usage: %s [-d] [-b BAUDRATE] [-P PROFILE] [-f FRAMES] [-j|-i] [--onlynumval] device mbus-address\n", argv[0]);
     fprintf(stderr, "    optional flag -d for debug printout\n");
     fprintf(stderr, "    optional flag -b for selecting baudrate\n");
+    fprintf(stderr, "    optional flag -P for reading secondary addresses at the baudrate of a link profile\n");
     fprintf(stderr, "    optional flag -f for selecting the maximal number of frames\n");
     fprintf(stderr, "    optional flag -j for json output\n");
     fprintf(stderr, "    optional flag -i for InfluxDB Line Protocol output\n");
@@ -71,8 +114,9 @@ main(int argc, char **argv)
     mbus_frame reply;
     mbus_handle *handle = NULL;
 
-    char *device, *addr_str, *result_str;
-    int address;
+    mbus_link_profile *profile = NULL;
+    char *device, *addr_str, *result_str, *profile_path = NULL;
+    int address, ret;
     long baudrate = 9600;
     int maxframes = MAXFRAMES;
     int json = 0, influxdb = 0, options = 0;
@@ -90,6 +134,11 @@ main(int argc, char **argv)
             c++;
             baudrate = atol(argv[c]);
         }
+        else if (strcmp(argv[c], "-P") == 0)
+        {
+            c++;
+            profile_path = argv[c];
+        }
         else if (strcmp(argv[c], "-f") == 0)
         {
             c++;
@@ -159,8 +208,6 @@ main(int argc, char **argv)
     {
         // secondary addressing
 
-        int ret;
-
         ret = mbus_select_secondary_address(handle, addr_str);
 
         if (ret == MBUS_PROBE_COLLISION)
@@ -186,6 +233,9 @@ main(int argc, char **argv)
         }
         // else MBUS_PROBE_SINGLE
 
+        if (profile_path)
+            profile = load_link_profile(handle, profile_path, addr_str, baudrate);
+
         address = MBUS_ADDRESS_NETWORK_LAYER;
     }
     else
@@ -196,7 +246,12 @@ main(int argc, char **argv)
 
     // instead of the send and recv, use this sendrecv function that
     // takes care of the possibility of multi-telegram replies (limit = 16 frames)
-    if (mbus_sendrecv_request(handle, address, &reply, maxframes) != 0)
+    ret = mbus_sendrecv_request(handle, address, &reply, maxframes);
+
+    mbus_link_attach(handle, NULL, 0);
+    mbus_link_profile_free(profile);
+
+    if (ret != 0)
     {
         fprintf(stderr, "Failed to send/receive M-Bus request.\n");
         mbus_disconnect(handle);
@@ -15,35 +15,30 @@
 
 static int debug = 0;
 
-int ping_address(mbus_handle *handle, mbus_frame *reply, int address)
+//------------------------------------------------------------------------------
+// Print the addresses with a reply.
+//------------------------------------------------------------------------------
+static void
+found_event(mbus_handle *handle, int address, int result)
 {
-    int i, ret = MBUS_RECV_RESULT_ERROR;
+    (void) handle;
 
-    memset((void *)reply, 0, sizeof(mbus_frame));
+    if (result == MBUS_PROBE_COLLISION)
+        printf("Collision at address %d\n", address);
+    else
+        printf("Found a M-Bus device at address %d\n", address);
+}
 
-    for (i = 0; i <= handle->max_search_retry; i++)
-    {
-        if (debug)
-        {
-            printf("%d ", address);
-            fflush(stdout);
-        }
-
-        if (mbus_send_ping_frame(handle, address, 0) == -1)
-        {
-            fprintf(stderr,"Scan failed. Could not send ping frame: %s\n", mbus_error_str());
-            return MBUS_RECV_RESULT_ERROR;
-        }
-
-        ret = mbus_recv_frame(handle, reply);
-
-        if (ret != MBUS_RECV_RESULT_TIMEOUT)
-        {
-            return ret;
-        }
-    }
+//------------------------------------------------------------------------------
+// Print every address pinged (debug mode).
+//------------------------------------------------------------------------------
+static void
+progress_event(mbus_handle *handle, const char *address)
+{
+    (void) handle;
 
-    return ret;
+    printf("%s ", address);
+    fflush(stdout);
 }
 
 //------------------------------------------------------------------------------
@@ -54,9 +49,8 @@ main(int argc, char **argv)
 {
     mbus_handle *handle;
     char *device;
-    int address, retries = 0;
+    int retries = 0;
     long baudrate = 9600;
-    int ret;
 
     if (argc == 2)
     {
@@ -118,6 +112,7 @@ main(int argc, char **argv)
     {
         mbus_register_send_event(handle, &mbus_dump_send_event);
         mbus_register_recv_event(handle, &mbus_dump_recv_event);
+        mbus_register_scan_progress(handle, &progress_event);
     }
 
     if (mbus_connect(handle) == -1)
@@ -141,36 +136,9 @@ main(int argc, char **argv)
     if (debug)
         printf("Scanning primary addresses:\n");
 
-    for (address = 0; address <= MBUS_MAX_PRIMARY_SLAVES; address++)
+    if (mbus_scan_primary(handle, 0, MBUS_MAX_PRIMARY_SLAVES, found_event) == -1)
     {
-        mbus_frame reply;
-
-        ret = ping_address(handle, &reply, address);
-
-        if (ret == MBUS_RECV_RESULT_TIMEOUT)
-        {
-            continue;
-        }
-
-        if (ret == MBUS_RECV_RESULT_INVALID)
-        {
-            /* check for more data (collision) */
-            mbus_purge_frames(handle);
-            printf("Collision at address %d\n", address);
-            continue;
-        }
-
-        if (mbus_frame_type(&reply) == MBUS_FRAME_TYPE_ACK)
-        {
-            /* check for more data (collision) */
-            if (mbus_purge_frames(handle))
-            {
-                printf("Collision at address %d\n", address);
-                continue;
-            }
-
-            printf("Found a M-Bus device at address %d\n", address);
-        }
+        fprintf(stderr, "Primary address scan failed\n");
     }
 
     mbus_disconnect(handle);
@@ -22,6 +22,7 @@ main(int argc, char **argv)
 {
     mbus_handle *handle;
     mbus_frame reply;
+    char addr_buff[32];
     char *device, *addr = NULL;
     int ret;
     long baudrate = 9600;
@@ -111,7 +112,7 @@ main(int argc, char **argv)
         if (mbus_frame_type(&reply) != MBUS_FRAME_TYPE_ACK)
         {
             printf("Recieved a reply from secondarily addressed device: Searched for [%s] and found [%s].\n",
-                   argv[2], mbus_frame_get_secondary_address(&reply));
+                   argv[2], mbus_frame_get_secondary_address_r(&reply, addr_buff, sizeof(addr_buff)));
         }
     }
     else
@@ -0,0 +1,751 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <mbus/mbus.h>
+
+static int debug = 0;
+
+// Default value for the maximum number of frames
+#define MAXFRAMES 16
+
+// Maximum length of a line in the configuration file
+#define MAXLINE 4096
+
+// Steps of a readout
+#define STEP_PING    0 // SND_NKE to a primary address (optional)
+#define STEP_SELECT  1 // select a secondary address
+#define STEP_REQUEST 2 // REQ_UD2, collect the reply
+#define STEP_CONNECT 3 // (re)connect the gateway
+
+//
+// A gateway with its addresses and the state of the current readout
+//
+typedef struct _gateway {
+    int id;                     // line of the gateway in the config file
+    char *host;
+    long port;
+    char **address;
+    int address_count;
+
+    mbus_handle *handle;
+    char connected;
+    mbus_async req;
+    mbus_frame reply;
+
+    int current;                // index of the address being read out
+    int step;                   // STEP_* of the current readout
+    int rounds;                 // number of finished rounds
+    struct timespec round_start;
+    struct timespec readout_start;
+
+    // statistics
+    long readouts;
+    long failures;
+    double latency_sum;
+    double latency_min;
+    double latency_max;
+} gateway;
+
+static volatile sig_atomic_t stop = 0;
+
+static int influxdb = 0, maxframes = MAXFRAMES, reset = 0;
+static int retries = -1;
+static long timeout = 0;
+static int max_rounds = 1;
+static double interval = 0;
+static mbus_capture *capture = NULL;
+static mbus_sink influxdb_sink;
+
+//------------------------------------------------------------------------------
+// Wrapper for argument parsing errors
+//------------------------------------------------------------------------------
+static void
+parse_abort(char **argv)
+{
+    fprintf(stderr, "usage: %s [-d] [-j|-i] [-f FRAMES] [-r RETRIES] [-n ROUNDS] [-t INTERVAL] [-T TIMEOUT] [-s] [-c CAPTURE] config-file\n", argv[0]);
+    fprintf(stderr, "    optional flag -d for debug printout\n");
+    fprintf(stderr, "    optional flag -j for JSON lines output (default)\n");
+    fprintf(stderr, "    optional flag -i for InfluxDb Line Protocol output\n");
+    fprintf(stderr, "    optional flag -f for selecting the maximal number of frames\n");
+    fprintf(stderr, "    optional flag -r for the number of retries of a request\n");
+    fprintf(stderr, "    optional flag -n for the number of polling rounds (0 = until interrupted, default 1)\n");
+    fprintf(stderr, "    optional flag -t for the minimal time between the starts of two rounds in seconds\n");
+    fprintf(stderr, "    optional flag -T for the connect and reply timeout in ms\n");
+    fprintf(stderr, "    optional flag -s for sending SND_NKE before reading out a primary address\n");
+    fprintf(stderr, "    optional flag -c for appending the traffic to a capture file (handle id = line of the gateway)\n");
+    fprintf(stderr, "    each line of the config-file holds: host port mbus-address [mbus-address ...]\n");
+    exit(1);
+}
+
+static void
+stop_handler(int signum)
+{
+    (void) signum;
+    stop = 1;
+}
+
+//------------------------------------------------------------------------------
+// Time in seconds elapsed between two points in time
+//------------------------------------------------------------------------------
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+//------------------------------------------------------------------------------
+// Read the gateways and their addresses from the config file
+//------------------------------------------------------------------------------
+static gateway *
+read_config(const char *path, int *count)
+{
+    FILE *fp;
+    char line[MAXLINE], *token, *save;
+    gateway *gateways = NULL, *new_gateways, *gw;
+    int line_no = 0;
+
+    *count = 0;
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        fprintf(stderr, "Failed to open config file %s\n", path);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line_no++;
+
+        if ((token = strchr(line, '#')) != NULL)
+            *token = '\0';
+
+        if ((token = strtok_r(line, " \t\r\n", &save)) == NULL)
+            continue;
+
+        if ((new_gateways = realloc(gateways, (*count + 1) * sizeof(gateway))) == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory\n");
+            fclose(fp);
+            return NULL;
+        }
+
+        gateways = new_gateways;
+        gw = &gateways[*count];
+        memset((void *)gw, 0, sizeof(gateway));
+
+        gw->id = line_no;
+        gw->host = strdup(token);
+
+        if ((token = strtok_r(NULL, " \t\r\n", &save)) == NULL ||
+            (gw->port = atol(token)) <= 0 || gw->port > 0xFFFF)
+        {
+            fprintf(stderr, "%s:%d: Invalid port\n", path, line_no);
+            fclose(fp);
+            return NULL;
+        }
+
+        while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            if (!mbus_is_secondary_address(token) &&
+                !mbus_is_primary_address(atoi(token)))
+            {
+                fprintf(stderr, "%s:%d: Invalid address %s\n", path, line_no, token);
+                fclose(fp);
+                return NULL;
+            }
+
+            gw->address = realloc(gw->address, (gw->address_count + 1) * sizeof(char *));
+            gw->address[gw->address_count++] = strdup(token);
+        }
+
+        if (gw->address_count == 0)
+        {
+            fprintf(stderr, "%s:%d: No address for gateway %s\n", path, line_no, gw->host);
+            fclose(fp);
+            return NULL;
+        }
+
+        gw->latency_min = -1;
+        (*count)++;
+    }
+
+    fclose(fp);
+
+    if (*count == 0)
+    {
+        fprintf(stderr, "No gateways in config file %s\n", path);
+        return NULL;
+    }
+
+    return gateways;
+}
+
+//------------------------------------------------------------------------------
+// Start to (re)connect the gateway, without waiting for the connection
+//------------------------------------------------------------------------------
+static int
+gateway_connect(gateway *gw)
+{
+    if (gw->handle == NULL)
+    {
+        if ((gw->handle = mbus_context_tcp(gw->host, gw->port)) == NULL)
+        {
+            fprintf(stderr, "Could not initialize M-Bus context: %s\n", mbus_error_str());
+            return -1;
+        }
+
+        if (debug)
+        {
+            mbus_register_send_event(gw->handle, &mbus_dump_send_event);
+            mbus_register_recv_event(gw->handle, &mbus_dump_recv_event);
+        }
+
+        if (capture)
+            mbus_capture_attach(gw->handle, capture, gw->id);
+
+        if (retries >= 0)
+            mbus_context_set_option(gw->handle, MBUS_OPTION_MAX_DATA_RETRY, retries);
+
+        if (timeout > 0)
+        {
+            mbus_context_set_option(gw->handle, MBUS_OPTION_TCP_CONNECT_TIMEOUT, timeout);
+            mbus_context_set_option(gw->handle, MBUS_OPTION_TCP_READ_TIMEOUT, timeout);
+        }
+
+        // end the purge after a reply on line silence, not on a timeout
+        mbus_context_set_option(gw->handle, MBUS_OPTION_PURGE_MODE, MBUS_PURGE_MODE_SILENCE);
+
+        mbus_async_init(&gw->req, gw->handle);
+    }
+
+    gw->step = STEP_CONNECT;
+
+    if (mbus_async_connect(&gw->req) == -1)
+    {
+        fprintf(stderr, "%s:%ld: Failed to setup connection to M-bus gateway: %s\n",
+                gw->host, gw->port, mbus_error_str());
+        return -1;
+    }
+
+    if (!mbus_async_busy(&gw->req))
+        gw->connected = 1;
+
+    return 0;
+}
+
+static void
+gateway_disconnect(gateway *gw)
+{
+    if (gw->connected)
+    {
+        mbus_disconnect(gw->handle);
+        gw->connected = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Print a successful readout as JSON line
+//------------------------------------------------------------------------------
+static void
+print_json(gateway *gw, double latency)
+{
+    mbus_frame_data frame_data;
+    mbus_frame *frame;
+    unsigned char str_encoded[768];
+    char *str;
+    int i;
+
+    mbus_str_json_encode(str_encoded, (unsigned char *) gw->host, sizeof(str_encoded));
+
+    printf("{\"Gateway\": \"%s:%ld\", \"Address\": \"%s\", \"Timestamp\": %ld, \"Latency\": %.3f, \"Frames\": [",
+           str_encoded, gw->port, gw->address[gw->current], (long) gw->reply.timestamp, latency * 1000);
+
+    for (frame = &gw->reply, i = 0; frame; frame = frame->next, i++)
+    {
+        memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+
+        str = NULL;
+
+        if (mbus_frame_data_parse(frame, &frame_data) != -1)
+        {
+            str = mbus_frame_data_json_normalized(&frame_data);
+
+            if (frame_data.data_var.record)
+                mbus_data_record_free(frame_data.data_var.record);
+        }
+
+        // the object without the newline that ends it
+        printf("%s%.*s", (i > 0) ? ", " : "", str ? (int) strcspn(str, "\n") : 4, str ? str : "null");
+        free(str);
+    }
+
+    printf("]}\n");
+}
+
+//------------------------------------------------------------------------------
+// Print a successful readout as InfluxDB Line Protocol, tagged with the
+// gateway and address
+//------------------------------------------------------------------------------
+static void
+print_influxdb(gateway *gw)
+{
+    unsigned char host_encoded[768], address_encoded[64];
+    mbus_frame_data frame_data;
+    mbus_frame *frame;
+    char *str, *line, *end;
+    int ret;
+
+    mbus_sink_reset(&influxdb_sink);
+
+    for (frame = &gw->reply; frame; frame = frame->next)
+    {
+        memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+
+        ret = mbus_frame_data_parse(frame, &frame_data);
+
+        if (ret != -1)
+            ret = mbus_frame_data_influxdb_normalized_sink(&frame_data, &influxdb_sink);
+
+        if (frame_data.data_var.record)
+            mbus_data_record_free(frame_data.data_var.record);
+
+        if (ret == -1)
+        {
+            fprintf(stderr, "%s:%ld: %s: Failed to generate InfluxDB Line Protocol: %s\n",
+                    gw->host, gw->port, gw->address[gw->current], mbus_error_str());
+            return;
+        }
+    }
+
+    if ((str = mbus_sink_buffer(&influxdb_sink, NULL)) == NULL)
+        return;
+
+    mbus_str_influxdb_encode_header(host_encoded, (unsigned char *) gw->host, sizeof(host_encoded));
+    mbus_str_influxdb_encode_header(address_encoded, (unsigned char *) gw->address[gw->current], sizeof(address_encoded));
+
+    for (line = str; *line; line = end)
+    {
+        if ((end = strchr(line, '\n')) == NULL)
+            end = line + strlen(line);
+        else
+            end++;
+
+        // insert the gateway tags after the measurement name
+        if (strncmp(line, "MBusData,", 9) == 0)
+        {
+            printf("MBusData,Gateway=%s:%ld,Address=%s,%.*s",
+                   host_encoded, gw->port, address_encoded, (int) (end - line - 9), line + 9);
+        }
+        else
+        {
+            printf("%.*s", (int) (end - line), line);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Start the current step of the readout
+//------------------------------------------------------------------------------
+static int
+gateway_step(gateway *gw)
+{
+    const char *address = gw->address[gw->current];
+
+    switch (gw->step)
+    {
+        case STEP_PING:
+            return mbus_async_ping(&gw->req, atoi(address));
+
+        case STEP_SELECT:
+            return mbus_async_select_secondary(&gw->req, address);
+
+        default:
+            memset((void *)&gw->reply, 0, sizeof(mbus_frame));
+            return mbus_async_request_data(&gw->req,
+                                           mbus_is_secondary_address(address) ?
+                                           MBUS_ADDRESS_NETWORK_LAYER : atoi(address),
+                                           &gw->reply, maxframes);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Start the readout of the next address, return 0 at the end of the round
+//------------------------------------------------------------------------------
+static int
+gateway_next(gateway *gw)
+{
+    while (gw->connected && gw->current < gw->address_count)
+    {
+        if (mbus_is_secondary_address(gw->address[gw->current]))
+            gw->step = STEP_SELECT;
+        else
+            gw->step = reset ? STEP_PING : STEP_REQUEST;
+
+        clock_gettime(CLOCK_MONOTONIC, &gw->readout_start);
+
+        if (gateway_step(gw) == 0)
+            return 1;
+
+        fprintf(stderr, "%s:%ld: %s: Failed to send M-Bus request: %s\n",
+                gw->host, gw->port, gw->address[gw->current], mbus_error_str());
+        gw->failures++;
+        gw->current++;
+        gateway_disconnect(gw);
+    }
+
+    gw->failures += gw->address_count - gw->current;
+    gw->rounds++;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Start a new round, i.e. read out all addresses of the gateway
+//------------------------------------------------------------------------------
+static int
+gateway_round(gateway *gw)
+{
+    clock_gettime(CLOCK_MONOTONIC, &gw->round_start);
+    gw->current = 0;
+
+    // the readout starts once the connection is established
+    if (!gw->connected && gateway_connect(gw) == 0 && mbus_async_busy(&gw->req))
+        return 1;
+
+    return gateway_next(gw);
+}
+
+//------------------------------------------------------------------------------
+// Handle a finished step, return non zero while the round is active
+//------------------------------------------------------------------------------
+static int
+gateway_done(gateway *gw)
+{
+    struct timespec now;
+    const char *address = gw->address[gw->current];
+    double latency;
+    int result = gw->req.result;
+
+    switch (gw->step)
+    {
+        case STEP_CONNECT:
+            if (result == 0)
+                gw->connected = 1;
+            else
+                fprintf(stderr, "%s:%ld: Failed to setup connection to M-bus gateway: %s\n",
+                        gw->host, gw->port, mbus_error_str());
+
+            return gateway_next(gw);
+
+        case STEP_PING:
+            // the reply is not required, some slaves do not acknowledge
+            if (result == MBUS_RECV_RESULT_ERROR || result == MBUS_RECV_RESULT_RESET)
+                break;
+
+            gw->step = STEP_REQUEST;
+            if (gateway_step(gw) == 0)
+                return 1;
+            break;
+
+        case STEP_SELECT:
+            if (result == MBUS_PROBE_SINGLE)
+            {
+                gw->step = STEP_REQUEST;
+                if (gateway_step(gw) == 0)
+                    return 1;
+                break;
+            }
+
+            if (result == MBUS_PROBE_COLLISION)
+                fprintf(stderr, "%s:%ld: %s: The address mask matches more than one device.\n",
+                        gw->host, gw->port, address);
+            else if (result == MBUS_PROBE_NOTHING)
+                fprintf(stderr, "%s:%ld: %s: The address does not match any device.\n",
+                        gw->host, gw->port, address);
+            else
+                break;
+
+            gw->failures++;
+            gw->current++;
+            return gateway_next(gw);
+
+        default:
+            if (result == 0)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                latency = elapsed(&gw->readout_start, &now);
+
+                if (debug)
+                    mbus_frame_print(&gw->reply);
+
+                if (influxdb)
+                    print_influxdb(gw);
+                else
+                    print_json(gw, latency);
+
+                fflush(stdout);
+
+                gw->readouts++;
+                gw->latency_sum += latency;
+                if (gw->latency_min < 0 || latency < gw->latency_min)
+                    gw->latency_min = latency;
+                if (latency > gw->latency_max)
+                    gw->latency_max = latency;
+            }
+            else if (result == 1)
+            {
+                fprintf(stderr, "%s:%ld: %s: Failed to receive M-Bus response: %s\n",
+                        gw->host, gw->port, address, mbus_error_str());
+                gw->failures++;
+            }
+
+            mbus_frame_free(gw->reply.next);
+            gw->reply.next = NULL;
+
+            if (result == -1)
+                break;
+
+            gw->current++;
+            return gateway_next(gw);
+    }
+
+    // transport error, reconnect in the next round
+    fprintf(stderr, "%s:%ld: Connection to M-bus gateway failed: %s\n",
+            gw->host, gw->port, mbus_error_str());
+    gw->failures++;
+    gw->current++;
+    gateway_disconnect(gw);
+
+    return gateway_next(gw);
+}
+
+//------------------------------------------------------------------------------
+// Print the statistics of all gateways
+//------------------------------------------------------------------------------
+static void
+print_statistics(gateway *gateways, int count, const struct timespec *start)
+{
+    struct timespec now;
+    double runtime;
+    long readouts = 0, failures = 0;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    runtime = elapsed(start, &now);
+
+    for (i = 0; i < count; i++)
+    {
+        gateway *gw = &gateways[i];
+
+        fprintf(stderr, "%s:%ld: %ld readouts, %ld failed, %.2f readouts/s, latency avg %.1f ms, min %.1f ms, max %.1f ms\n",
+                gw->host, gw->port, gw->readouts, gw->failures,
+                (runtime > 0) ? gw->readouts / runtime : 0.0,
+                gw->readouts ? gw->latency_sum * 1000 / gw->readouts : 0.0,
+                gw->readouts ? gw->latency_min * 1000 : 0.0,
+                gw->latency_max * 1000);
+
+        readouts += gw->readouts;
+        failures += gw->failures;
+    }
+
+    fprintf(stderr, "total: %d gateways, %ld readouts, %ld failed in %.3f s, %.2f readouts/s\n",
+            count, readouts, failures, runtime, (runtime > 0) ? readouts / runtime : 0.0);
+}
+
+//------------------------------------------------------------------------------
+// Poll all gateways of the config file concurrently.
+//------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+    gateway *gateways, *gw;
+    struct pollfd *pfds;
+    int *pfd_gateway;
+    struct timespec start, now;
+    int count, nfds, active, wait, t, i, c;
+    double next, delay;
+
+    for (c = 1; c < argc - 1; c++)
+    {
+        if (strcmp(argv[c], "-d") == 0)
+        {
+            debug = 1;
+        }
+        else if (strcmp(argv[c], "-j") == 0)
+        {
+            influxdb = 0;
+        }
+        else if (strcmp(argv[c], "-i") == 0)
+        {
+            influxdb = 1;
+        }
+        else if (strcmp(argv[c], "-f") == 0 && c + 1 < argc - 1)
+        {
+            maxframes = atoi(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-r") == 0 && c + 1 < argc - 1)
+        {
+            retries = atoi(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-n") == 0 && c + 1 < argc - 1)
+        {
+            max_rounds = atoi(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-t") == 0 && c + 1 < argc - 1)
+        {
+            interval = atof(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-T") == 0 && c + 1 < argc - 1)
+        {
+            timeout = atol(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-s") == 0)
+        {
+            reset = 1;
+        }
+        else if (strcmp(argv[c], "-c") == 0 && c + 1 < argc - 1)
+        {
+            if ((capture = mbus_capture_open(argv[++c])) == NULL)
+            {
+                fprintf(stderr, "Failed to open capture file: %s\n", mbus_error_str());
+                return 1;
+            }
+        }
+        else
+        {
+            parse_abort(argv);
+        }
+    }
+
+    if (c != argc - 1 || max_rounds < 0 || interval < 0 || timeout < 0)
+    {
+        parse_abort(argv);
+    }
+
+    if ((gateways = read_config(argv[c], &count)) == NULL)
+    {
+        return 1;
+    }
+
+    pfds = (struct pollfd *) calloc(count, sizeof(struct pollfd));
+    pfd_gateway = (int *) calloc(count, sizeof(int));
+
+    if (pfds == NULL || pfd_gateway == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+    }
+
+    mbus_sink_init_buffer(&influxdb_sink, NULL, 0);
+
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (!stop)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        nfds = 0;
+        active = 0;
+        wait = -1;
+
+        for (i = 0; i < count; i++)
+        {
+            gw = &gateways[i];
+
+            if (!mbus_async_busy(&gw->req))
+            {
+                if (max_rounds > 0 && gw->rounds >= max_rounds)
+                    continue;
+
+                // start of the next round, wait at least a second before
+                // reconnecting to a gateway that failed
+                delay = (!gw->connected && interval < 1) ? 1 : interval;
+                next = (gw->rounds == 0) ? 0 : delay - elapsed(&gw->round_start, &now);
+
+                if (next > 0 || gateway_round(gw) == 0)
+                {
+                    // round is not due yet (or finished immediately)
+                    if (max_rounds > 0 && gw->rounds >= max_rounds)
+                        continue;
+
+                    active++;
+
+                    t = (next > 0) ? (int) (next * 1000) + 1 : 0;
+                    if (wait < 0 || t < wait)
+                        wait = t;
+                    continue;
+                }
+            }
+
+            active++;
+            pfds[nfds].fd = mbus_async_fd(&gw->req);
+            pfds[nfds].events = mbus_async_events(&gw->req);
+            pfds[nfds].revents = 0;
+            pfd_gateway[nfds] = i;
+            nfds++;
+
+            t = mbus_async_timeout(&gw->req);
+            if (wait < 0 || t < wait)
+                wait = t;
+        }
+
+        if (active == 0)
+            break;
+
+        if (poll(pfds, nfds, wait) == -1)
+            continue; // interrupted
+
+        for (i = 0; i < nfds; i++)
+        {
+            gw = &gateways[pfd_gateway[i]];
+
+            if (!mbus_async_process(&gw->req, pfds[i].revents))
+            {
+                gateway_done(gw);
+            }
+        }
+    }
+
+    print_statistics(gateways, count, &start);
+
+    for (i = 0; i < count; i++)
+    {
+        gw = &gateways[i];
+
+        gateway_disconnect(gw);
+        if (gw->handle)
+            mbus_context_free(gw->handle);
+        mbus_frame_free(gw->reply.next);
+
+        for (c = 0; c < gw->address_count; c++)
+            free(gw->address[c]);
+        free(gw->address);
+        free(gw->host);
+    }
+
+    mbus_capture_close(capture);
+    mbus_sink_free(&influxdb_sink);
+
+    free(gateways);
+    free(pfds);
+    free(pfd_gateway);
+
+    return 0;
+}
@@ -21,16 +21,33 @@ static int debug = 0;
 int
 main(int argc, char **argv)
 {
-    char *host, *addr_mask = NULL;
+    char *host, *addr_mask = NULL, *cache = NULL;
+    int adaptive = 0;
     long port;
     mbus_handle *handle = NULL;
     mbus_frame *frame = NULL, reply;
 
     memset((void *)&reply, 0, sizeof(mbus_frame));
 
+    if (argc > 1 && strcmp(argv[1], "-a") == 0)
+    {
+        adaptive = 1;
+        argv++;
+        argc--;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "-C") == 0)
+    {
+        cache = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+
     if (argc != 4 && argc != 3)
     {
-        fprintf(stderr, "usage: %s host port [address-mask]\n", argv[0]);
+        fprintf(stderr, "usage: %s [-a] [-C CACHE] host port [address-mask]\n", argv[0]);
+        fprintf(stderr, "\toptional flag -a for splitting collisions on all address fields\n");
+        fprintf(stderr, "\toptional flag -C for rescanning from the devices of a cache file\n");
         fprintf(stderr, "\trestrict the search by supplying an optional address mask on the form\n");
         fprintf(stderr, "\t'FFFFFFFFFFFFFFFF' where F is a wildcard character\n");
         return 0;
@@ -101,7 +118,20 @@ main(int argc, char **argv)
         return 1;
     }
 
-    mbus_scan_2nd_address_range(handle, 0, addr_mask);
+    if (cache)
+    {
+        if (mbus_scan_2nd_address_cached(handle, addr_mask, cache) == -1)
+            fprintf(stderr, "Secondary address scan failed\n");
+    }
+    else if (adaptive)
+    {
+        if (mbus_scan_2nd_address_adaptive(handle, addr_mask) == -1)
+            fprintf(stderr, "Secondary address scan failed\n");
+    }
+    else
+    {
+        mbus_scan_2nd_address_range(handle, 0, addr_mask);
+    }
 
     mbus_disconnect(handle);
     mbus_context_free(handle);
@@ -0,0 +1,594 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <stdio.h>
+#include <mbus/mbus.h>
+
+// Size of the request and reply buffers of a connection
+#define BUFF_SIZE 2048
+
+//
+// A simulated gateway: a listening port with its own bus of meters
+//
+typedef struct _gateway {
+    int port;
+    int fd;
+    mbus_sim_bus *bus;
+    long long busy_until;       // end of the last reply on the bus (ns)
+
+    // statistics
+    long requests;
+    long replies;
+    long long service_sum;
+    long long service_max;
+} gateway;
+
+//
+// A connection of a master to a gateway with the reply being sent
+//
+typedef struct _client {
+    int fd;
+    gateway *gw;
+    unsigned char in[BUFF_SIZE];
+    size_t in_len;
+    unsigned char out[BUFF_SIZE];
+    size_t out_len;
+    size_t out_pos;
+    long long received;         // time the request was complete (ns)
+    long long first_byte;       // time the first reply byte is due (ns)
+    long long byte_time;        // transmission time of a byte (ns), 0 for no pacing
+    size_t request_len;
+    int address;
+    int control;
+} client;
+
+static volatile sig_atomic_t stop = 0;
+
+static int debug = 0, quiet = 0;
+static long baudrate = 2400, latency = 0;
+
+//------------------------------------------------------------------------------
+// Wrapper for argument parsing errors
+//------------------------------------------------------------------------------
+static void
+parse_abort(char **argv)
+{
+    fprintf(stderr, "usage: %s [-d] [-q] [-b BAUDRATE] [-l LATENCY] [-L LOSS] [-g GATEWAYS] [-m METERS] port frame-file[,frame-file...] ...\n", argv[0]);
+    fprintf(stderr, "    optional flag -d for debug printout\n");
+    fprintf(stderr, "    optional flag -q for not logging every request\n");
+    fprintf(stderr, "    optional flag -b for the simulated baudrate (default 2400, 0 = no pacing)\n");
+    fprintf(stderr, "    optional flag -l for the response latency of the meters in ms\n");
+    fprintf(stderr, "    optional flag -L for the lost bytes per million\n");
+    fprintf(stderr, "    optional flag -g for the number of gateways on consecutive ports (default 1)\n");
+    fprintf(stderr, "    optional flag -m for the number of meters per gateway (default: one per frame-file)\n");
+    exit(1);
+}
+
+static void
+stop_handler(int signum)
+{
+    (void) signum;
+
+    stop = 1;
+}
+
+//------------------------------------------------------------------------------
+// Current time in nanoseconds
+//------------------------------------------------------------------------------
+static long long
+now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// Open a non-blocking listening socket on a port
+//------------------------------------------------------------------------------
+static int
+listen_port(int port)
+{
+    struct sockaddr_in addr;
+    int fd, on = 1;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset((void *)&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(fd, 64) < 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+//------------------------------------------------------------------------------
+// Add the meters to the bus of a gateway. Meter i replies with frame-file
+// i modulo the number of files and gets a secondary address of its own (id
+// = gateway * 10000 + i + 1), so a secondary scan finds all of them.
+//------------------------------------------------------------------------------
+static int
+gateway_add_meters(gateway *gw, int index, int meters, char **files, int file_count)
+{
+    mbus_sim_slave *slave;
+    char *list, *file, *save;
+    long id;
+    int i, j;
+
+    for (i = 0; i < meters; i++)
+    {
+        // primary addresses 1 - 250, further meters only by secondary address
+        if ((slave = mbus_sim_bus_add_slave(gw->bus, (i < 250) ? i + 1 : MBUS_SIM_NO_PRIMARY, NULL)) == NULL)
+        {
+            fprintf(stderr, "%s\n", mbus_error_str());
+            return -1;
+        }
+
+        if ((list = strdup(files[i % file_count])) == NULL)
+        {
+            fprintf(stderr, "Failed to allocate memory\n");
+            return -1;
+        }
+
+        for (file = strtok_r(list, ",", &save); file; file = strtok_r(NULL, ",", &save))
+        {
+            if (mbus_sim_slave_load_hex(slave, file) == -1 && index == 0 && i < file_count)
+            {
+                // the meter only acknowledges
+                fprintf(stderr, "%s: %s\n", file, mbus_error_str());
+            }
+        }
+
+        free(list);
+
+        if (slave->has_secondary)
+        {
+            // BCD id, least significant byte first
+            id = index * 10000L + i + 1;
+
+            for (j = 0; j < 4; j++, id /= 100)
+                slave->secondary[j] = (unsigned char) (((id / 10) % 10) << 4 | (id % 10));
+
+            slave->patch_secondary = 1;
+        }
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Accept the pending connections of a gateway
+//------------------------------------------------------------------------------
+static void
+gateway_accept(gateway *gw, client **clients, int *count, int max)
+{
+    client *cl;
+    int fd, on = 1;
+
+    while (*count < max && (fd = accept(gw->fd, NULL, NULL)) >= 0)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        // every paced byte goes out as soon as it is due
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        if ((cl = (client *) calloc(1, sizeof(client))) == NULL)
+        {
+            close(fd);
+            continue;
+        }
+
+        cl->fd = fd;
+        cl->gw = gw;
+        clients[(*count)++] = cl;
+
+        if (debug)
+            fprintf(stderr, "%d: connection %d accepted\n", gw->port, fd);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Log the service time of a request and add it to the statistics
+//------------------------------------------------------------------------------
+static void
+client_log(client *cl, long long done, long long start)
+{
+    gateway *gw = cl->gw;
+    long long service = done - cl->received;
+
+    gw->requests++;
+    gw->service_sum += service;
+
+    if (service > gw->service_max)
+        gw->service_max = service;
+
+    if (cl->out_len > 0)
+        gw->replies++;
+
+    if (!quiet)
+    {
+        printf("%.6f port=%d conn=%d address=%d control=0x%02X request=%zu reply=%zu service=%.3f ms\n",
+               (done - start) / 1e9, gw->port, cl->fd, cl->address, cl->control,
+               cl->request_len, cl->out_len, service / 1e6);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Process the next complete request of a connection: let the meters answer
+// and schedule the reply after the request and the latency, once the bus of
+// the gateway is free. Bytes after the request (pipelined by the master) are
+// kept for the next call. Returns 1 if a request was taken, 0 if there is no
+// complete request yet.
+//------------------------------------------------------------------------------
+static int
+client_request(client *cl, long long now, long long start)
+{
+    gateway *gw = cl->gw;
+    mbus_parser parser;
+    mbus_frame frame;
+    long long begin;
+    size_t size;
+    int len, result;
+
+    memset((void *)&frame, 0, sizeof(mbus_frame));
+    mbus_parser_init(&parser, &frame);
+
+    if ((result = mbus_parser_feed(&parser, cl->in, cl->in_len, &size)) > 0)
+        return 0; // incomplete
+
+    if (result < 0)
+    {
+        // garbage, the meters cannot make sense of it
+        if (debug)
+            fprintf(stderr, "%d: connection %d: %s\n", gw->port, cl->fd, mbus_error_str());
+        cl->in_len = 0;
+        return 0;
+    }
+
+    cl->received = now;
+    cl->request_len = size;
+    cl->address = frame.address;
+    cl->control = frame.control;
+    cl->byte_time = (baudrate > 0) ? 11 * 1000000000LL / baudrate : 0;
+
+    if ((len = mbus_sim_bus_process(gw->bus, cl->in, size, cl->out, sizeof(cl->out))) < 0)
+        len = 0;
+
+    cl->in_len -= size;
+    memmove(cl->in, cl->in + size, cl->in_len);
+
+    cl->out_len = len;
+    cl->out_pos = 0;
+
+    // the request is transmitted on the bus when it is free
+    begin = (gw->busy_until > now) ? gw->busy_until : now;
+    begin += cl->request_len * cl->byte_time;
+
+    if (len == 0)
+    {
+        gw->busy_until = begin;
+        client_log(cl, begin, start);
+        return 1;
+    }
+
+    cl->first_byte = begin + latency * 1000000LL + cl->byte_time;
+    gw->busy_until = cl->first_byte + (len - 1) * cl->byte_time;
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// Send the reply bytes that are due, returns -1 if the connection failed
+//------------------------------------------------------------------------------
+static int
+client_send(client *cl, long long now, long long start)
+{
+    size_t due;
+    ssize_t n;
+
+    if (now < cl->first_byte)
+        return 0;
+
+    due = (cl->byte_time > 0) ? (size_t) ((now - cl->first_byte) / cl->byte_time) + 1 : cl->out_len;
+
+    if (due > cl->out_len)
+        due = cl->out_len;
+
+    if (due <= cl->out_pos)
+        return 0;
+
+    if ((n = write(cl->fd, cl->out + cl->out_pos, due - cl->out_pos)) < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+    cl->out_pos += n;
+
+    if (cl->out_pos == cl->out_len)
+    {
+        client_log(cl, now, start);
+        cl->out_len = cl->out_pos = 0;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Read the request bytes of a connection, returns -1 if it was closed
+//------------------------------------------------------------------------------
+static int
+client_recv(client *cl)
+{
+    ssize_t n;
+
+    if (cl->in_len >= sizeof(cl->in))
+        cl->in_len = 0; // no request is that long
+
+    if ((n = read(cl->fd, cl->in + cl->in_len, sizeof(cl->in) - cl->in_len)) <= 0)
+        return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) ? 0 : -1;
+
+    cl->in_len += n;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Print the statistics of all gateways
+//------------------------------------------------------------------------------
+static void
+print_statistics(gateway *gateways, int count)
+{
+    long requests = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        gateway *gw = &gateways[i];
+
+        fprintf(stderr, "%d: %ld requests, %ld replies, %lu collisions, service avg %.3f ms, max %.3f ms\n",
+                gw->port, gw->requests, gw->replies, gw->bus->stats.collisions,
+                gw->requests ? gw->service_sum / 1e6 / gw->requests : 0.0,
+                gw->service_max / 1e6);
+
+        requests += gw->requests;
+    }
+
+    fprintf(stderr, "total: %d gateways, %ld requests\n", count, requests);
+}
+
+//------------------------------------------------------------------------------
+// Simulate M-Bus TCP gateways with many meters on consecutive ports, e.g. for
+// load tests of masters.
+//------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+    gateway *gateways, *gw;
+    client **clients, *cl;
+    struct pollfd *pfds;
+    long long start, now, due, wait_ns;
+    long loss = 0;
+    int count = 1, meters = 0, max_clients = 1024, client_count = 0;
+    int port, nfds, wait, i, c;
+
+    for (c = 1; c < argc && argv[c][0] == '-'; c++)
+    {
+        if (strcmp(argv[c], "-d") == 0)
+        {
+            debug = 1;
+        }
+        else if (strcmp(argv[c], "-q") == 0)
+        {
+            quiet = 1;
+        }
+        else if (strcmp(argv[c], "-b") == 0 && c + 1 < argc)
+        {
+            baudrate = atol(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-l") == 0 && c + 1 < argc)
+        {
+            latency = atol(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-L") == 0 && c + 1 < argc)
+        {
+            loss = atol(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-g") == 0 && c + 1 < argc)
+        {
+            count = atoi(argv[++c]);
+        }
+        else if (strcmp(argv[c], "-m") == 0 && c + 1 < argc)
+        {
+            meters = atoi(argv[++c]);
+        }
+        else
+        {
+            parse_abort(argv);
+        }
+    }
+
+    if (argc - c < 2 || count < 1 || meters < 0 || baudrate < 0 || latency < 0 || loss < 0 ||
+        (port = atoi(argv[c])) <= 0 || port + count - 1 > 65535)
+    {
+        parse_abort(argv);
+    }
+
+    c++;
+
+    if (meters == 0)
+        meters = argc - c;
+
+    gateways = (gateway *) calloc(count, sizeof(gateway));
+    clients = (client **) calloc(max_clients, sizeof(client *));
+    pfds = (struct pollfd *) calloc(count + max_clients, sizeof(struct pollfd));
+
+    if (gateways == NULL || clients == NULL || pfds == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        gw = &gateways[i];
+        gw->port = port + i;
+
+        if ((gw->bus = mbus_sim_bus_new()) == NULL ||
+            (baudrate > 0 && mbus_sim_bus_set_option(gw->bus, MBUS_SIM_OPTION_BAUDRATE, baudrate) == -1) ||
+            mbus_sim_bus_set_option(gw->bus, MBUS_SIM_OPTION_LOSS_RATE, loss) == -1 ||
+            mbus_sim_bus_set_option(gw->bus, MBUS_SIM_OPTION_SEED, gw->port) == -1)
+        {
+            fprintf(stderr, "Invalid bus options\n");
+            return 1;
+        }
+
+        if (gateway_add_meters(gw, i, meters, &argv[c], argc - c) == -1)
+            return 1;
+
+        if ((gw->fd = listen_port(gw->port)) < 0)
+        {
+            fprintf(stderr, "Failed to listen on port %d: %s\n", gw->port, strerror(errno));
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "%d gateways with %d meters each on ports %d - %d\n",
+            count, meters, port, port + count - 1);
+
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    // the request log is followed while the program runs
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    start = now_ns();
+
+    while (!stop)
+    {
+        now = now_ns();
+        nfds = 0;
+        wait_ns = -1;
+
+        // accept only as many connections as there are slots
+        for (i = 0; i < count; i++)
+        {
+            pfds[nfds].fd = (client_count < max_clients) ? gateways[i].fd : -1;
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            nfds++;
+        }
+
+        for (i = 0; i < client_count; i++)
+        {
+            cl = clients[i];
+
+            pfds[nfds].fd = cl->fd;
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            nfds++;
+
+            if (cl->out_len > 0)
+            {
+                // time of the next paced byte
+                due = cl->first_byte + cl->out_pos * cl->byte_time;
+                if (wait_ns < 0 || due - now < wait_ns)
+                    wait_ns = (due > now) ? due - now : 0;
+            }
+        }
+
+        wait = (wait_ns < 0) ? -1 : (int) ((wait_ns + 999999) / 1000000);
+
+        if (poll(pfds, nfds, wait) == -1)
+            continue; // interrupted
+
+        now = now_ns();
+
+        for (i = 0; i < count; i++)
+        {
+            if (pfds[i].revents & POLLIN)
+                gateway_accept(&gateways[i], clients, &client_count, max_clients);
+        }
+
+        for (i = 0; i < nfds - count; i++)
+        {
+            cl = clients[i];
+
+            if (((pfds[count + i].revents & (POLLIN | POLLHUP | POLLERR)) && client_recv(cl) == -1) ||
+                (cl->out_len > 0 && client_send(cl, now, start) == -1))
+            {
+                if (debug)
+                    fprintf(stderr, "%d: connection %d closed\n", cl->gw->port, cl->fd);
+
+                close(cl->fd);
+                free(cl);
+                clients[i] = NULL;
+                continue;
+            }
+
+            // one request at a time per connection, like a master waiting
+            // for the reply; requests without a reply do not hold up the
+            // ones buffered behind them
+            while (cl->out_len == 0 && cl->in_len > 0 && client_request(cl, now, start))
+                client_send(cl, now, start);
+        }
+
+        // compact the connections, keeping the new ones accepted above
+        for (i = 0, c = 0; i < client_count; i++)
+        {
+            if (clients[i])
+                clients[c++] = clients[i];
+        }
+        client_count = c;
+    }
+
+    print_statistics(gateways, count);
+
+    for (i = 0; i < client_count; i++)
+    {
+        close(clients[i]->fd);
+        free(clients[i]);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        close(gateways[i].fd);
+        mbus_sim_bus_free(gateways[i].bus);
+    }
+
+    free(gateways);
+    free(clients);
+    free(pfds);
+
+    return 0;
+}
@@ -0,0 +1,668 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "mbus-async.h"
+#include "mbus-serial.h"
+#include "mbus-tcp.h"
+#include "mbus-capture.h"
+
+//------------------------------------------------------------------------------
+/// Return the receive buffer of the transport behind the handle.
+//------------------------------------------------------------------------------
+static mbus_recv_buffer *
+mbus_async_buffer(mbus_handle *handle)
+{
+    if (handle == NULL || handle->auxdata == NULL)
+        return NULL;
+
+    if (handle->open == mbus_serial_connect)
+        return &((mbus_serial_data *) handle->auxdata)->recv_buffer;
+
+    if (handle->open == mbus_tcp_connect)
+        return &((mbus_tcp_data *) handle->auxdata)->recv_buffer;
+
+    return NULL; // no asynchronous requests on other transports
+}
+
+//------------------------------------------------------------------------------
+/// Set the deadline of the current step to timeout_ms from now.
+//------------------------------------------------------------------------------
+static void
+mbus_async_set_deadline(mbus_async *req, long timeout_ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, &req->deadline);
+
+    req->deadline.tv_sec  += timeout_ms / 1000;
+    req->deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+
+    if (req->deadline.tv_nsec >= 1000000000)
+    {
+        req->deadline.tv_sec++;
+        req->deadline.tv_nsec -= 1000000000;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Time (ms) to wait for the reply of a slave.
+//------------------------------------------------------------------------------
+static long
+mbus_async_recv_timeout(mbus_handle *handle)
+{
+    if (handle->is_serial)
+        return mbus_serial_recv_timeout(handle);
+
+    return mbus_tcp_recv_timeout(handle);
+}
+
+//------------------------------------------------------------------------------
+/// Time (ms) of line silence that ends the purge after a reply, the same
+/// as used by mbus_purge_frames.
+//------------------------------------------------------------------------------
+static long
+mbus_async_purge_timeout(mbus_handle *handle)
+{
+    if (handle->purge_mode == MBUS_PURGE_MODE_SILENCE)
+        return mbus_purge_silence_time(handle);
+
+    return mbus_async_recv_timeout(handle);
+}
+
+//------------------------------------------------------------------------------
+/// Finish the transaction with the given result.
+//------------------------------------------------------------------------------
+static void
+mbus_async_finish(mbus_async *req, int result)
+{
+    req->state = MBUS_ASYNC_STATE_DONE;
+    req->result = result;
+}
+
+//------------------------------------------------------------------------------
+/// Reset the request frame to an empty frame of the given type (like
+/// mbus_frame_new does for allocated frames).
+//------------------------------------------------------------------------------
+static void
+mbus_async_request_init(mbus_async *req, int frame_type)
+{
+    mbus_frame *frame = &req->request;
+
+    memset((void *)frame, 0, sizeof(mbus_frame));
+
+    frame->type = frame_type;
+    frame->stop = MBUS_FRAME_STOP;
+
+    if (frame_type == MBUS_FRAME_TYPE_SHORT)
+    {
+        frame->start1 = MBUS_FRAME_SHORT_START;
+    }
+    else
+    {
+        frame->start1 = MBUS_FRAME_LONG_START;
+        frame->start2 = MBUS_FRAME_LONG_START;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Start receiving a new frame into frame.
+//------------------------------------------------------------------------------
+static void
+mbus_async_recv_start(mbus_async *req, mbus_frame *frame)
+{
+    req->raw_len = 0;
+    mbus_parser_init(&req->parser, frame);
+}
+
+//------------------------------------------------------------------------------
+/// Call the receive event function for the raw data of the current frame.
+//------------------------------------------------------------------------------
+static void
+mbus_async_recv_event(mbus_async *req)
+{
+    if (req->handle->recv_event && req->raw_len > 0)
+    {
+        req->handle->recv_event(req->handle->is_serial ? MBUS_HANDLE_TYPE_SERIAL : MBUS_HANDLE_TYPE_TCP,
+                                (const char *) req->raw, req->raw_len);
+    }
+
+    if (req->handle->capture && req->raw_len > 0)
+        mbus_capture_handle_data(req->handle, MBUS_CAPTURE_RECV, req->raw, req->raw_len);
+
+    req->raw_len = 0;
+}
+
+//------------------------------------------------------------------------------
+/// (Re)send the request frame and wait for the reply.
+//------------------------------------------------------------------------------
+static int
+mbus_async_send(mbus_async *req)
+{
+    req->echo_purged = 0;
+    req->purged = 0;
+
+    mbus_async_recv_start(req, req->frame);
+
+    if (req->handle->send(req->handle, &req->request) == -1)
+    {
+        mbus_error_set(MBUS_ERR_SEND, "Failed to send M-Bus frame.");
+        mbus_async_finish(req, req->type == MBUS_ASYNC_TYPE_SELECT ? MBUS_PROBE_ERROR : -1);
+        return -1;
+    }
+
+    req->state = MBUS_ASYNC_STATE_RECV;
+    mbus_async_set_deadline(req, mbus_async_recv_timeout(req->handle));
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Retry a data request or give up when max_data_retry is exceeded.
+//------------------------------------------------------------------------------
+static void
+mbus_async_retry(mbus_async *req)
+{
+    req->retry++;
+
+    if (req->retry > req->handle->max_data_retry)
+    {
+        mbus_async_finish(req, 1);
+        return;
+    }
+
+    mbus_async_send(req);
+}
+
+//------------------------------------------------------------------------------
+/// Handle a complete reply frame of a data request, after the line has been
+/// purged. Requests the next frame of a multi-telegram response if required.
+//------------------------------------------------------------------------------
+static void
+mbus_async_request_done(mbus_async *req)
+{
+    mbus_frame *next_frame;
+    int more_frames, more_records;
+
+    if (req->reply_result == MBUS_RECV_RESULT_INVALID)
+    {
+        mbus_error_set(MBUS_ERR_FRAME_INVALID, "Received invalid M-Bus response frame.");
+        mbus_async_retry(req);
+        return;
+    }
+
+    req->retry = 0;
+    req->frame_count++;
+
+    //
+    // We need to parse the data in the received frame to be able to tell
+    // if more records are available or not.
+    //
+    if ((more_records = mbus_frame_more_records_follow(req->frame)) == -1)
+    {
+        mbus_async_finish(req, 1);
+        return;
+    }
+
+    more_frames = more_records && (req->max_frames > 0) && (req->frame_count < req->max_frames);
+
+    if (!more_frames)
+    {
+        mbus_async_finish(req, 0);
+        return;
+    }
+
+    if ((next_frame = mbus_frame_new(MBUS_FRAME_TYPE_ANY)) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "Failed to allocate M-Bus frame.");
+        mbus_async_finish(req, -1);
+        return;
+    }
+
+    req->frame->next = next_frame;
+    req->frame = next_frame;
+
+    // toggle FCB bit
+    req->request.control ^= MBUS_CONTROL_MASK_FCB;
+
+    mbus_async_send(req);
+}
+
+//------------------------------------------------------------------------------
+/// The purge after a reply has finished: complete the current step.
+//------------------------------------------------------------------------------
+static void
+mbus_async_purge_done(mbus_async *req)
+{
+    switch (req->type)
+    {
+        case MBUS_ASYNC_TYPE_REQUEST:
+            mbus_async_request_done(req);
+            break;
+
+        case MBUS_ASYNC_TYPE_PING:
+            mbus_async_finish(req, req->reply_result);
+            break;
+
+        case MBUS_ASYNC_TYPE_SELECT:
+            if (req->reply_result == MBUS_RECV_RESULT_INVALID || req->purged)
+                mbus_async_finish(req, MBUS_PROBE_COLLISION);
+            else
+                mbus_async_finish(req, MBUS_PROBE_SINGLE);
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Handle the end of the reply: result is a MBUS_RECV_RESULT_* code.
+//------------------------------------------------------------------------------
+static void
+mbus_async_reply(mbus_async *req, int result)
+{
+    if (result == MBUS_RECV_RESULT_OK || result == MBUS_RECV_RESULT_INVALID)
+    {
+        time(&(req->frame->timestamp));
+    }
+
+    if (result == MBUS_RECV_RESULT_TIMEOUT)
+    {
+        mbus_error_set(MBUS_ERR_TIMEOUT, "No M-Bus response frame received.");
+
+        switch (req->type)
+        {
+            case MBUS_ASYNC_TYPE_REQUEST:
+                mbus_async_retry(req);
+                break;
+
+            case MBUS_ASYNC_TYPE_PING:
+                mbus_async_finish(req, MBUS_RECV_RESULT_TIMEOUT);
+                break;
+
+            case MBUS_ASYNC_TYPE_SELECT:
+                mbus_async_finish(req, MBUS_PROBE_NOTHING);
+                break;
+        }
+        return;
+    }
+
+    if (result == MBUS_RECV_RESULT_OK && req->type != MBUS_ASYNC_TYPE_REQUEST &&
+        mbus_frame_type(req->frame) != MBUS_FRAME_TYPE_ACK)
+    {
+        if (req->type == MBUS_ASYNC_TYPE_SELECT)
+        {
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "Unexpected reply for address selection.");
+            mbus_async_finish(req, MBUS_PROBE_NOTHING);
+            return;
+        }
+
+        result = MBUS_RECV_RESULT_INVALID;
+    }
+
+    // check for more data (collision) before the next step
+    req->reply_result = result;
+    req->state = MBUS_ASYNC_STATE_PURGE;
+    mbus_async_recv_start(req, &req->scratch);
+    mbus_async_set_deadline(req, mbus_async_purge_timeout(req->handle));
+}
+
+//------------------------------------------------------------------------------
+/// Feed buffered data to the parser of the current step.
+//------------------------------------------------------------------------------
+static void
+mbus_async_input(mbus_async *req, mbus_recv_buffer *buffer)
+{
+    int result;
+
+    while (buffer->count > 0 &&
+           (req->state == MBUS_ASYNC_STATE_RECV || req->state == MBUS_ASYNC_STATE_PURGE))
+    {
+        if (req->state == MBUS_ASYNC_STATE_PURGE)
+            req->purged = 1;
+
+        result = mbus_recv_buffer_parse(buffer, &req->parser, req->raw, sizeof(req->raw), &req->raw_len);
+
+        if (result > 0)
+            break;
+
+        mbus_async_recv_event(req);
+
+        if (req->state == MBUS_ASYNC_STATE_PURGE)
+        {
+            // discard the frame and wait for line silence
+            mbus_async_recv_start(req, &req->scratch);
+            continue;
+        }
+
+        if (result == 0 && !req->echo_purged &&
+            ((mbus_frame_direction(req->frame) == MBUS_CONTROL_MASK_DIR_M2S &&
+              req->handle->purge_first_frame == MBUS_FRAME_PURGE_M2S) ||
+             (mbus_frame_direction(req->frame) == MBUS_CONTROL_MASK_DIR_S2M &&
+              req->handle->purge_first_frame == MBUS_FRAME_PURGE_S2M)))
+        {
+            // purge echo and retry
+            req->echo_purged = 1;
+            mbus_async_recv_start(req, req->frame);
+            continue;
+        }
+
+        mbus_async_reply(req, result == 0 ? MBUS_RECV_RESULT_OK : MBUS_RECV_RESULT_INVALID);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Start a new transaction of the given type.
+//------------------------------------------------------------------------------
+static int
+mbus_async_start(mbus_async *req, int type, mbus_frame *reply)
+{
+    req->type = type;
+    req->retry = 0;
+    req->frame_count = 0;
+    req->reply = reply;
+    req->frame = reply;
+
+    return mbus_async_send(req);
+}
+
+//------------------------------------------------------------------------------
+// Initialize the state of an asynchronous transaction.
+//------------------------------------------------------------------------------
+int
+mbus_async_init(mbus_async *req, mbus_handle *handle)
+{
+    if (req == NULL || handle == NULL || mbus_async_buffer(handle) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid M-Bus handle for asynchronous request.");
+        return -1;
+    }
+
+    memset((void *)req, 0, sizeof(mbus_async));
+    req->handle = handle;
+    req->state = MBUS_ASYNC_STATE_IDLE;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Start a data request and collect the reply (replies) from the slave.
+//------------------------------------------------------------------------------
+int
+mbus_async_request_data(mbus_async *req, int address, mbus_frame *reply, int max_frames)
+{
+    if (req == NULL || req->handle == NULL || reply == NULL || mbus_async_busy(req))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid asynchronous request.");
+        return -1;
+    }
+
+    if (mbus_is_primary_address(address) == 0)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid address %d.", address);
+        return -1;
+    }
+
+    mbus_async_request_init(req, MBUS_FRAME_TYPE_SHORT);
+    req->request.control = MBUS_CONTROL_MASK_REQ_UD2 |
+                           MBUS_CONTROL_MASK_DIR_M2S |
+                           MBUS_CONTROL_MASK_FCV     |
+                           MBUS_CONTROL_MASK_FCB;
+    req->request.address = address;
+    req->max_frames = max_frames;
+
+    return mbus_async_start(req, MBUS_ASYNC_TYPE_REQUEST, reply);
+}
+
+//------------------------------------------------------------------------------
+// Start a ping (SND_NKE) and wait for the acknowledge of the slave.
+//------------------------------------------------------------------------------
+int
+mbus_async_ping(mbus_async *req, int address)
+{
+    if (req == NULL || req->handle == NULL || mbus_async_busy(req))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid asynchronous request.");
+        return -1;
+    }
+
+    if (mbus_is_primary_address(address) == 0)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid address %d.", address);
+        return -1;
+    }
+
+    mbus_async_request_init(req, MBUS_FRAME_TYPE_SHORT);
+    req->request.control = MBUS_CONTROL_MASK_SND_NKE | MBUS_CONTROL_MASK_DIR_M2S;
+    req->request.address = address;
+
+    return mbus_async_start(req, MBUS_ASYNC_TYPE_PING, &req->scratch);
+}
+
+//------------------------------------------------------------------------------
+// Start the selection of a device using the supplied secondary address (mask).
+//------------------------------------------------------------------------------
+int
+mbus_async_select_secondary(mbus_async *req, const char *mask)
+{
+    if (req == NULL || req->handle == NULL || mbus_async_busy(req) ||
+        mask == NULL || strlen(mask) != 16)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid address mask.");
+        return -1;
+    }
+
+    mbus_async_request_init(req, MBUS_FRAME_TYPE_LONG);
+
+    if (mbus_frame_select_secondary_pack(&req->request, (char *) mask) == -1)
+    {
+        return -1;
+    }
+
+    return mbus_async_start(req, MBUS_ASYNC_TYPE_SELECT, &req->scratch);
+}
+
+//------------------------------------------------------------------------------
+// Start to (re)connect the handle.
+//------------------------------------------------------------------------------
+int
+mbus_async_connect(mbus_async *req)
+{
+    int ret;
+
+    if (req == NULL || req->handle == NULL || mbus_async_busy(req))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid asynchronous request.");
+        return -1;
+    }
+
+    req->type = MBUS_ASYNC_TYPE_CONNECT;
+
+    if (req->handle->open != mbus_tcp_connect)
+    {
+        // opening a serial device does not block
+        ret = mbus_connect(req->handle);
+    }
+    else if ((ret = mbus_tcp_connect_start(req->handle)) == 1)
+    {
+        req->state = MBUS_ASYNC_STATE_CONNECT;
+        mbus_async_set_deadline(req, mbus_tcp_connect_timeout(req->handle));
+        return 0;
+    }
+
+    mbus_async_finish(req, ret);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/// Advance a connect: the socket became writable or the deadline expired.
+//------------------------------------------------------------------------------
+static int
+mbus_async_connect_process(mbus_async *req, int revents)
+{
+    int ret;
+
+    if (revents & (POLLOUT | POLLERR | POLLHUP))
+    {
+        // the next address of the host may be tried, keeping the deadline
+        if ((ret = mbus_tcp_connect_finish(req->handle)) != 1)
+        {
+            mbus_async_finish(req, ret);
+            return 0;
+        }
+    }
+
+    if (mbus_async_timeout(req) == 0)
+    {
+        mbus_tcp_connect_abort(req->handle);
+        mbus_error_set(MBUS_ERR_TIMEOUT, "M-Bus tcp transport layer connect timeout has been reached.");
+        mbus_async_finish(req, -1);
+        return 0;
+    }
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// File descriptor to wait on.
+//------------------------------------------------------------------------------
+int
+mbus_async_fd(mbus_async *req)
+{
+    if (req == NULL || req->handle == NULL)
+        return -1;
+
+    return req->handle->fd;
+}
+
+//------------------------------------------------------------------------------
+// Events to wait for on the file descriptor.
+//------------------------------------------------------------------------------
+int
+mbus_async_events(mbus_async *req)
+{
+    if (req != NULL && req->state == MBUS_ASYNC_STATE_CONNECT)
+        return POLLOUT;
+
+    return POLLIN;
+}
+
+//------------------------------------------------------------------------------
+// Time (ms) until the current step expires.
+//------------------------------------------------------------------------------
+int
+mbus_async_timeout(mbus_async *req)
+{
+    struct timespec now;
+    long remaining;
+
+    if (!mbus_async_busy(req))
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    remaining = (req->deadline.tv_sec - now.tv_sec) * 1000 +
+                (req->deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+
+    return remaining > 0 ? (int) remaining : 0;
+}
+
+//------------------------------------------------------------------------------
+// Advance the transaction.
+//------------------------------------------------------------------------------
+int
+mbus_async_process(mbus_async *req, int revents)
+{
+    mbus_recv_buffer *buffer;
+    ssize_t nread;
+
+    if (!mbus_async_busy(req))
+        return 0;
+
+    if (req->state == MBUS_ASYNC_STATE_CONNECT)
+        return mbus_async_connect_process(req, revents);
+
+    if ((buffer = mbus_async_buffer(req->handle)) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid M-Bus handle for asynchronous request.");
+        mbus_async_finish(req, req->type == MBUS_ASYNC_TYPE_SELECT ? MBUS_PROBE_ERROR : -1);
+        return 0;
+    }
+
+    if (revents & (POLLIN | POLLERR | POLLHUP))
+    {
+        // the descriptor is readable, a single read does not block
+        nread = mbus_recv_buffer_fill(buffer, req->handle->fd);
+
+        if (nread > 0)
+        {
+            // each received chunk restarts the timeout
+            mbus_async_set_deadline(req, req->state == MBUS_ASYNC_STATE_PURGE ?
+                                         mbus_async_purge_timeout(req->handle) :
+                                         mbus_async_recv_timeout(req->handle));
+        }
+        else if ((nread == 0 && !req->handle->is_serial) ||
+                 (nread == -1 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            if (nread == 0)
+                mbus_error_set(MBUS_ERR_CONNECTION_CLOSED, "M-Bus tcp transport layer connection closed by remote host.");
+            else
+                mbus_error_set(MBUS_ERR_RECV, "M-Bus transport layer failed to read data.");
+
+            switch (req->type)
+            {
+                case MBUS_ASYNC_TYPE_REQUEST:
+                    mbus_async_finish(req, -1);
+                    break;
+                case MBUS_ASYNC_TYPE_PING:
+                    mbus_async_finish(req, nread == 0 ? MBUS_RECV_RESULT_RESET : MBUS_RECV_RESULT_ERROR);
+                    break;
+                case MBUS_ASYNC_TYPE_SELECT:
+                    mbus_async_finish(req, MBUS_PROBE_ERROR);
+                    break;
+            }
+            return 0;
+        }
+    }
+
+    mbus_async_input(req, buffer);
+
+    // handle expired steps, a retry or the next request starts a new one
+    while (mbus_async_busy(req) && mbus_async_timeout(req) == 0)
+    {
+        if (req->state == MBUS_ASYNC_STATE_PURGE)
+        {
+            mbus_async_recv_event(req);
+            mbus_async_purge_done(req);
+        }
+        else
+        {
+            // an incomplete frame is invalid, otherwise nothing was received
+            mbus_async_recv_event(req);
+            mbus_async_reply(req, req->parser.pos > 0 ? MBUS_RECV_RESULT_INVALID : MBUS_RECV_RESULT_TIMEOUT);
+        }
+
+        mbus_async_input(req, buffer);
+    }
+
+    return mbus_async_busy(req);
+}
+
+//------------------------------------------------------------------------------
+// Check whether a transaction is active.
+//------------------------------------------------------------------------------
+int
+mbus_async_busy(mbus_async *req)
+{
+    return req != NULL &&
+           (req->state == MBUS_ASYNC_STATE_RECV || req->state == MBUS_ASYNC_STATE_PURGE ||
+            req->state == MBUS_ASYNC_STATE_CONNECT);
+}
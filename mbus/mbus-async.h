@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-async.h
+ *
+ * @brief  Non-blocking request/response state machine for event loops.
+ *
+ * The functions in mbus-protocol-aux.h block the calling thread until a
+ * transaction is complete. The asynchronous API splits a transaction into
+ * steps so that a single thread can drive many handles (e.g. thousands of
+ * TCP gateways) from one poll/epoll loop:
+ *
+\verbatim
+mbus_async req;
+mbus_frame reply;
+
+mbus_async_init(&req, handle);
+mbus_async_request_data(&req, address, &reply, 16);
+
+while (mbus_async_busy(&req))
+{
+    struct pollfd pfd = { mbus_async_fd(&req), mbus_async_events(&req), 0 };
+
+    poll(&pfd, 1, mbus_async_timeout(&req));
+    mbus_async_process(&req, pfd.revents);
+}
+
+if (req.result == 0)
+    ... reply contains the (multi-telegram) response ...
+\endverbatim
+ *
+ * Sending a request writes a frame of at most a few hundred bytes to the
+ * handle, which may block for the time the serial line or the socket
+ * buffer needs to accept it. Receiving never blocks, neither does
+ * (re)connecting a TCP handle with mbus_async_connect, apart from resolving
+ * the host name.
+ */
+
+#ifndef _MBUS_ASYNC_H_
+#define _MBUS_ASYNC_H_
+
+#include <time.h>
+
+#include "mbus-protocol.h"
+#include "mbus-protocol-aux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Transaction types
+//
+#define MBUS_ASYNC_TYPE_NONE    0
+#define MBUS_ASYNC_TYPE_REQUEST 1 // REQ_UD2, optionally multi-telegram
+#define MBUS_ASYNC_TYPE_PING    2 // SND_NKE, wait for the ACK
+#define MBUS_ASYNC_TYPE_SELECT  3 // select a secondary address
+#define MBUS_ASYNC_TYPE_CONNECT 4 // (re)connect the handle
+
+//
+// States of a transaction
+//
+#define MBUS_ASYNC_STATE_IDLE   0 // nothing started
+#define MBUS_ASYNC_STATE_RECV   1 // request sent, waiting for the reply
+#define MBUS_ASYNC_STATE_PURGE  2 // reply received, waiting for line silence
+#define MBUS_ASYNC_STATE_DONE   3 // finished, result is valid
+#define MBUS_ASYNC_STATE_CONNECT 4 // TCP connection being established
+
+#define MBUS_ASYNC_RAW_SIZE 2048
+
+/**
+ * State of an asynchronous transaction on a handle. Only one transaction can
+ * be active on a handle at a time.
+ */
+typedef struct _mbus_async {
+    mbus_handle *handle;
+    int type;                   /**< MBUS_ASYNC_TYPE_* */
+    int state;                  /**< MBUS_ASYNC_STATE_* */
+    int result;                 /**< Result, valid in state MBUS_ASYNC_STATE_DONE */
+    int retry;                  /**< Retries of the current request */
+    int reply_result;           /**< MBUS_RECV_RESULT_* of the last reply */
+    int frame_count;            /**< Number of received reply frames */
+    int max_frames;             /**< Maximum number of frames to read out */
+    char echo_purged;           /**< Echo of the current request discarded */
+    char purged;                /**< Data received while purging */
+    mbus_frame request;         /**< Request frame, resent on retries */
+    mbus_frame *reply;          /**< Caller supplied reply frame (chain head) */
+    mbus_frame *frame;          /**< Frame currently being received */
+    mbus_frame scratch;         /**< Frame for echo, purged and ACK frames */
+    mbus_parser parser;
+    unsigned char raw[MBUS_ASYNC_RAW_SIZE]; /**< Raw data of the current frame */
+    size_t raw_len;
+    struct timespec deadline;   /**< CLOCK_MONOTONIC time the current step expires */
+} mbus_async;
+
+/**
+ * Initialize an asynchronous transaction for the given (connected) handle.
+ *
+ * @param req    Transaction state
+ * @param handle Initialized and connected handle
+ *
+ * @return Zero on success, -1 on error.
+ */
+int mbus_async_init(mbus_async *req, mbus_handle *handle);
+
+/**
+ * Start a data request (REQ_UD2) to a primary address and collect the reply,
+ * or the replies of a multi-telegram response (toggling FCB for each
+ * frame). Failed requests are repeated up to max_data_retry times.
+ *
+ * On completion result is 0 on success, 1 when the slave did not (properly)
+ * reply and -1 on errors, the same as mbus_sendrecv_request. Additional
+ * frames are linked to reply and have to be freed by the caller.
+ *
+ * @param req        Initialized transaction state
+ * @param address    Primary address (or MBUS_ADDRESS_NETWORK_LAYER)
+ * @param reply      Frame to store the response in
+ * @param max_frames Maximum number of frames to read out
+ *
+ * @return Zero if the request was sent, -1 on error.
+ */
+int mbus_async_request_data(mbus_async *req, int address, mbus_frame *reply, int max_frames);
+
+/**
+ * Start a ping (SND_NKE) to a primary address and wait for the ACK.
+ *
+ * On completion result is MBUS_RECV_RESULT_OK when the slave acknowledged,
+ * MBUS_RECV_RESULT_TIMEOUT when nothing was received, MBUS_RECV_RESULT_INVALID
+ * on an invalid or unexpected reply and MBUS_RECV_RESULT_ERROR/RESET on
+ * transport errors.
+ *
+ * @param req     Initialized transaction state
+ * @param address Primary address
+ *
+ * @return Zero if the request was sent, -1 on error.
+ */
+int mbus_async_ping(mbus_async *req, int address);
+
+/**
+ * Start the selection of a device by secondary address (mask). Read out
+ * a selected device with mbus_async_request_data and
+ * MBUS_ADDRESS_NETWORK_LAYER afterwards.
+ *
+ * On completion result is one of MBUS_PROBE_SINGLE, MBUS_PROBE_COLLISION,
+ * MBUS_PROBE_NOTHING or MBUS_PROBE_ERROR, the same as
+ * mbus_select_secondary_address.
+ *
+ * @param req  Initialized transaction state
+ * @param mask Secondary address mask (16 characters)
+ *
+ * @return Zero if the request was sent, -1 on error.
+ */
+int mbus_async_select_secondary(mbus_async *req, const char *mask);
+
+/**
+ * Start to (re)connect the handle. A TCP connection is established in the
+ * background, other handles are opened right away (the transaction is
+ * finished on return then).
+ *
+ * On completion result is 0 when the handle is connected and -1 on errors,
+ * including the connect timeout of the handle.
+ *
+ * @param req Initialized transaction state
+ *
+ * @return Zero if the connect was started (or succeeded), -1 on error.
+ */
+int mbus_async_connect(mbus_async *req);
+
+/**
+ * File descriptor to wait on for mbus_async_events.
+ *
+ * @param req Transaction state
+ *
+ * @return File descriptor of the handle, -1 on error.
+ */
+int mbus_async_fd(mbus_async *req);
+
+/**
+ * Events to wait for on mbus_async_fd: POLLOUT while a TCP connection is
+ * being established, POLLIN otherwise.
+ *
+ * @param req Transaction state
+ *
+ * @return Poll events.
+ */
+int mbus_async_events(mbus_async *req);
+
+/**
+ * Time until the current step of the transaction expires, to be used as poll
+ * timeout. Call mbus_async_process when it has elapsed, even without events.
+ *
+ * @param req Transaction state
+ *
+ * @return Milliseconds until the deadline (0 if expired), -1 if the transaction is not active.
+ */
+int mbus_async_timeout(mbus_async *req);
+
+/**
+ * Advance the transaction: read available data (if revents signals readiness),
+ * handle complete frames and expired deadlines and send follow-up requests.
+ *
+ * @param req     Transaction state
+ * @param revents Events returned by poll for mbus_async_fd (0 on timeout)
+ *
+ * @return Non zero while the transaction is active, zero when it is finished
+ *         (see result).
+ */
+int mbus_async_process(mbus_async *req, int revents);
+
+/**
+ * Check whether a transaction is active.
+ *
+ * @param req Transaction state
+ *
+ * @return Non zero while the transaction is active.
+ */
+int mbus_async_busy(mbus_async *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_ASYNC_H_ */
@@ -0,0 +1,672 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mbus-capture.h"
+
+#define PACKET_BUFF_SIZE 2048
+
+//------------------------------------------------------------------------------
+/// Encode/decode little endian integers of the file format.
+//------------------------------------------------------------------------------
+static void
+mbus_capture_put_le(unsigned char *p, unsigned long long value, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        p[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static unsigned long long
+mbus_capture_get_le(const unsigned char *p, size_t size)
+{
+    unsigned long long value = 0;
+    size_t i;
+
+    for (i = size; i > 0; i--)
+    {
+        value = (value << 8) | p[i - 1];
+    }
+
+    return value;
+}
+
+//------------------------------------------------------------------------------
+/// Write a complete buffer, retrying on interrupts and short writes.
+//------------------------------------------------------------------------------
+static int
+mbus_capture_write_all(int fd, const unsigned char *buff, size_t len)
+{
+    ssize_t ret;
+
+    while (len > 0)
+    {
+        if ((ret = write(fd, buff, len)) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        buff += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Check the file header.
+//------------------------------------------------------------------------------
+static int
+mbus_capture_check_header(const unsigned char *header)
+{
+    return (memcmp(header, MBUS_CAPTURE_MAGIC, MBUS_CAPTURE_HEADER_SIZE - 1) == 0 &&
+            header[MBUS_CAPTURE_HEADER_SIZE - 1] >= 1 &&
+            header[MBUS_CAPTURE_HEADER_SIZE - 1] <= MBUS_CAPTURE_VERSION) ? 0 : -1;
+}
+
+//------------------------------------------------------------------------------
+// Open a capture file for appending records.
+//------------------------------------------------------------------------------
+mbus_capture *
+mbus_capture_open(const char *path)
+{
+    mbus_capture *capture;
+    unsigned char header[MBUS_CAPTURE_HEADER_SIZE];
+    struct stat st;
+    int fd;
+
+    if (path == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid file name.", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((fd = open(path, O_RDWR | O_APPEND | O_CREAT, 0644)) == -1)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to open %s: %s", __PRETTY_FUNCTION__, path, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to stat %s: %s", __PRETTY_FUNCTION__, path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size == 0)
+    {
+        memcpy(header, MBUS_CAPTURE_MAGIC, MBUS_CAPTURE_HEADER_SIZE - 1);
+        header[MBUS_CAPTURE_HEADER_SIZE - 1] = MBUS_CAPTURE_VERSION;
+
+        if (mbus_capture_write_all(fd, header, sizeof(header)) == -1)
+        {
+            mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to write %s: %s", __PRETTY_FUNCTION__, path, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+    }
+    else if (pread(fd, header, sizeof(header), 0) != sizeof(header) ||
+             mbus_capture_check_header(header) == -1)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: %s is no capture file.", __PRETTY_FUNCTION__, path);
+        close(fd);
+        return NULL;
+    }
+
+    if ((capture = (mbus_capture *) calloc(1, sizeof(mbus_capture))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate capture.", __PRETTY_FUNCTION__);
+        close(fd);
+        return NULL;
+    }
+
+    capture->fd = fd;
+    capture->file = NULL;
+
+    return capture;
+}
+
+//------------------------------------------------------------------------------
+// Open a capture file for reading its records.
+//------------------------------------------------------------------------------
+mbus_capture *
+mbus_capture_open_read(const char *path)
+{
+    mbus_capture *capture;
+    unsigned char header[MBUS_CAPTURE_HEADER_SIZE];
+    FILE *file;
+
+    if (path == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid file name.", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((file = fopen(path, "rb")) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to open %s: %s", __PRETTY_FUNCTION__, path, strerror(errno));
+        return NULL;
+    }
+
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        mbus_capture_check_header(header) == -1)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: %s is no capture file.", __PRETTY_FUNCTION__, path);
+        fclose(file);
+        return NULL;
+    }
+
+    if ((capture = (mbus_capture *) calloc(1, sizeof(mbus_capture))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate capture.", __PRETTY_FUNCTION__);
+        fclose(file);
+        return NULL;
+    }
+
+    capture->fd = -1;
+    capture->file = file;
+
+    return capture;
+}
+
+//------------------------------------------------------------------------------
+// Close a capture file.
+//------------------------------------------------------------------------------
+void
+mbus_capture_close(mbus_capture *capture)
+{
+    if (capture)
+    {
+        if (capture->file)
+            fclose(capture->file);
+
+        if (capture->fd != -1)
+            close(capture->fd);
+
+        free(capture);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Current time of a capture record.
+//------------------------------------------------------------------------------
+long long
+mbus_capture_timestamp(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// Append a record to a capture file. Header and data go out in one write, so
+// records of concurrent writers do not interleave.
+//------------------------------------------------------------------------------
+int
+mbus_capture_write(mbus_capture *capture, unsigned int id, int direction,
+                   const unsigned char *data, size_t len, long long timestamp)
+{
+    unsigned char buff[MBUS_CAPTURE_RECORD_SIZE + PACKET_BUFF_SIZE], *record;
+    int result;
+
+    if (capture == NULL || capture->fd == -1 || (data == NULL && len > 0) ||
+        len > MBUS_CAPTURE_DATA_SIZE || id > 0xFFFF ||
+        (direction != MBUS_CAPTURE_SEND && direction != MBUS_CAPTURE_RECV))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid capture record.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if (timestamp == 0)
+        timestamp = mbus_capture_timestamp();
+
+    // records are at most one frame long, larger ones use the heap
+    if (len <= PACKET_BUFF_SIZE)
+    {
+        record = buff;
+    }
+    else if ((record = (unsigned char *) malloc(MBUS_CAPTURE_RECORD_SIZE + len)) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate record.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    mbus_capture_put_le(record, (unsigned long long) timestamp, 8);
+    mbus_capture_put_le(record + 8, id, 2);
+    record[10] = (unsigned char) direction;
+    mbus_capture_put_le(record + 11, len, 2);
+
+    if (len > 0)
+        memcpy(record + MBUS_CAPTURE_RECORD_SIZE, data, len);
+
+    if ((result = mbus_capture_write_all(capture->fd, record, MBUS_CAPTURE_RECORD_SIZE + len)) == -1)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to write record: %s", __PRETTY_FUNCTION__, strerror(errno));
+    }
+    else
+    {
+        capture->records++;
+    }
+
+    if (record != buff)
+        free(record);
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+// Read the next record of a capture file.
+//------------------------------------------------------------------------------
+int
+mbus_capture_read(mbus_capture *capture, mbus_capture_record *record)
+{
+    unsigned char header[MBUS_CAPTURE_RECORD_SIZE];
+    size_t n;
+
+    if (capture == NULL || capture->file == NULL || record == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((n = fread(header, 1, sizeof(header), capture->file)) == 0 && feof(capture->file))
+    {
+        return 0;
+    }
+
+    if (n != sizeof(header))
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Truncated record %zu.", __PRETTY_FUNCTION__, capture->records + 1);
+        return -1;
+    }
+
+    record->timestamp = (long long) mbus_capture_get_le(header, 8);
+    record->id        = (unsigned int) mbus_capture_get_le(header + 8, 2);
+    record->direction = header[10];
+    record->len       = (size_t) mbus_capture_get_le(header + 11, 2);
+
+    if ((record->direction != MBUS_CAPTURE_SEND && record->direction != MBUS_CAPTURE_RECV) ||
+        fread(record->data, 1, record->len, capture->file) != record->len)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Damaged record %zu.", __PRETTY_FUNCTION__, capture->records + 1);
+        return -1;
+    }
+
+    capture->records++;
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// Record the traffic of a handle.
+//------------------------------------------------------------------------------
+int
+mbus_capture_attach(mbus_handle *handle, mbus_capture *capture, unsigned int id)
+{
+    if (handle == NULL || id > 0xFFFF || (capture && capture->fd == -1))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    handle->capture = capture;
+    handle->capture_id = capture ? id : 0;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Record data of a handle. Failures must not disturb the communication, they
+// are ignored.
+//------------------------------------------------------------------------------
+void
+mbus_capture_handle_data(mbus_handle *handle, int direction, const unsigned char *data, size_t len)
+{
+    if (handle && handle->capture)
+    {
+        mbus_capture_write(handle->capture, handle->capture_id, direction, data, len, 0);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Make the next record of the replayed handle id available in
+/// replay_data->record. Returns 1 if there is one, 0 at the end of the file
+/// and -1 on errors.
+//------------------------------------------------------------------------------
+static int
+mbus_replay_peek(mbus_replay_data *replay_data)
+{
+    int ret;
+
+    if (replay_data->pending)
+        return 1;
+
+    while ((ret = mbus_capture_read(replay_data->capture, &replay_data->record)) == 1)
+    {
+        if (replay_data->id != MBUS_CAPTURE_ID_ANY &&
+            replay_data->record.id != (unsigned int) replay_data->id)
+            continue;
+
+        if ((replay_data->mode & MBUS_REPLAY_RECV_ONLY) &&
+            replay_data->record.direction != MBUS_CAPTURE_RECV)
+            continue;
+
+        replay_data->pending = 1;
+        return 1;
+    }
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/// Replay time (CLOCK_MONOTONIC ns) of the next record. The first record
+/// without a request before it is replayed immediately.
+//------------------------------------------------------------------------------
+static long long
+mbus_replay_due(mbus_replay_data *replay_data)
+{
+    if (!replay_data->anchored)
+    {
+        replay_data->offset = mbus_capture_timestamp() - replay_data->record.timestamp;
+        replay_data->anchored = 1;
+    }
+
+    return replay_data->record.timestamp + replay_data->offset;
+}
+
+//------------------------------------------------------------------------------
+/// Sleep until the given time (CLOCK_MONOTONIC ns).
+//------------------------------------------------------------------------------
+static void
+mbus_replay_sleep_until(long long t)
+{
+    struct timespec ts;
+
+    ts.tv_sec = t / 1000000000LL;
+    ts.tv_nsec = t % 1000000000LL;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+//------------------------------------------------------------------------------
+/// Open (or rewind) the capture file of a replay handle.
+//------------------------------------------------------------------------------
+static int
+mbus_replay_connect(mbus_handle *handle)
+{
+    mbus_replay_data *replay_data;
+
+    if (handle == NULL || (replay_data = (mbus_replay_data *) handle->auxdata) == NULL)
+        return -1;
+
+    mbus_capture_close(replay_data->capture);
+
+    if ((replay_data->capture = mbus_capture_open_read(replay_data->path)) == NULL)
+        return -1;
+
+    handle->fd = fileno(replay_data->capture->file);
+    replay_data->pending = 0;
+    replay_data->anchored = 0;
+    replay_data->mismatches = 0;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Close the capture file of a replay handle.
+//------------------------------------------------------------------------------
+static int
+mbus_replay_disconnect(mbus_handle *handle)
+{
+    mbus_replay_data *replay_data;
+
+    if (handle == NULL || (replay_data = (mbus_replay_data *) handle->auxdata) == NULL)
+        return -1;
+
+    mbus_capture_close(replay_data->capture);
+    replay_data->capture = NULL;
+    handle->fd = -1;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Consume the recorded request, if it comes next, and restart the timing
+/// from it.
+//------------------------------------------------------------------------------
+static int
+mbus_replay_send_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    unsigned char buff[PACKET_BUFF_SIZE];
+    mbus_replay_data *replay_data;
+    int len;
+
+    if (handle == NULL || frame == NULL ||
+        (replay_data = (mbus_replay_data *) handle->auxdata) == NULL)
+    {
+        return -1;
+    }
+
+    if (replay_data->capture == NULL)
+    {
+        mbus_error_set(MBUS_ERR_SEND, "%s: Capture file is not open.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((len = mbus_frame_pack(frame, buff, sizeof(buff))) == -1)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if (mbus_replay_peek(replay_data) == 1 &&
+        replay_data->record.direction == MBUS_CAPTURE_SEND)
+    {
+        if (replay_data->record.len != (size_t) len ||
+            memcmp(replay_data->record.data, buff, len) != 0)
+        {
+            replay_data->mismatches++;
+        }
+
+        replay_data->offset = mbus_capture_timestamp() - replay_data->record.timestamp;
+        replay_data->anchored = 1;
+        replay_data->pending = 0;
+    }
+
+    if (handle->send_event)
+        handle->send_event(MBUS_HANDLE_TYPE_TCP, (const char *) buff, len);
+
+    if (handle->capture)
+        mbus_capture_handle_data(handle, MBUS_CAPTURE_SEND, buff, len);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Return the frame of the next received record.
+//------------------------------------------------------------------------------
+static int
+mbus_replay_recv_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    mbus_replay_data *replay_data;
+    mbus_capture_record *record;
+    int ret;
+
+    if (handle == NULL || frame == NULL ||
+        (replay_data = (mbus_replay_data *) handle->auxdata) == NULL ||
+        replay_data->capture == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return MBUS_RECV_RESULT_ERROR;
+    }
+
+    if ((ret = mbus_replay_peek(replay_data)) == -1)
+    {
+        return MBUS_RECV_RESULT_ERROR;
+    }
+
+    if (ret == 0)
+    {
+        mbus_error_set(MBUS_ERR_CONNECTION_CLOSED, "End of capture file reached.");
+        return MBUS_RECV_RESULT_RESET;
+    }
+
+    record = &replay_data->record;
+
+    if (replay_data->mode & MBUS_REPLAY_REALTIME)
+        mbus_replay_sleep_until(mbus_replay_due(replay_data));
+
+    if (record->direction == MBUS_CAPTURE_SEND)
+    {
+        // nothing (more) was received before the next request
+        mbus_error_set(MBUS_ERR_TIMEOUT, "M-Bus replay response timeout has been reached.");
+        return MBUS_RECV_RESULT_TIMEOUT;
+    }
+
+    replay_data->pending = 0;
+
+    if (handle->recv_event)
+        handle->recv_event(MBUS_HANDLE_TYPE_TCP, (const char *) record->data, record->len);
+
+    if (handle->capture)
+        mbus_capture_handle_data(handle, MBUS_CAPTURE_RECV, record->data, record->len);
+
+    if ((ret = mbus_parse(frame, record->data, record->len)) != 0)
+    {
+        if (ret > 0)
+            mbus_error_set(MBUS_ERR_FRAME_INVALID, "M-Bus layer received an incomplete frame.");
+
+        return MBUS_RECV_RESULT_INVALID;
+    }
+
+    return MBUS_RECV_RESULT_OK;
+}
+
+//------------------------------------------------------------------------------
+/// Wait until a reply is due or the timeout (in ms) expired.
+//------------------------------------------------------------------------------
+static int
+mbus_replay_wait_recv(mbus_handle *handle, long timeout_ms)
+{
+    mbus_replay_data *replay_data;
+    long long deadline;
+    int ret;
+
+    if (handle == NULL || (replay_data = (mbus_replay_data *) handle->auxdata) == NULL ||
+        replay_data->capture == NULL)
+    {
+        return -1;
+    }
+
+    if ((ret = mbus_replay_peek(replay_data)) == -1)
+        return -1;
+
+    if (!(replay_data->mode & MBUS_REPLAY_REALTIME))
+        return (ret == 1 && replay_data->record.direction == MBUS_CAPTURE_RECV) ? 1 : 0;
+
+    deadline = mbus_capture_timestamp() + (long long) timeout_ms * 1000000LL;
+
+    if (ret == 1 && replay_data->record.direction == MBUS_CAPTURE_RECV &&
+        mbus_replay_due(replay_data) <= deadline)
+    {
+        return 1;
+    }
+
+    mbus_replay_sleep_until(deadline);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Free the transport data of a replay handle.
+//------------------------------------------------------------------------------
+static void
+mbus_replay_data_free(mbus_handle *handle)
+{
+    mbus_replay_data *replay_data;
+
+    if (handle && (replay_data = (mbus_replay_data *) handle->auxdata) != NULL)
+    {
+        mbus_capture_close(replay_data->capture);
+        free(replay_data->path);
+        free(replay_data);
+        handle->auxdata = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Allocate a handle that replays a capture file.
+//------------------------------------------------------------------------------
+mbus_handle *
+mbus_context_replay(const char *path, int id, int mode)
+{
+    mbus_handle *handle;
+    mbus_replay_data *replay_data;
+
+    if (path == NULL || id < MBUS_CAPTURE_ID_ANY || id > 0xFFFF)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((handle = (mbus_handle *) malloc(sizeof(mbus_handle))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((replay_data = (mbus_replay_data *) calloc(1, sizeof(mbus_replay_data))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
+        free(handle);
+        return NULL;
+    }
+
+    mbus_context_init(handle);
+    handle->auxdata = replay_data;
+    handle->open = mbus_replay_connect;
+    handle->close = mbus_replay_disconnect;
+    handle->recv = mbus_replay_recv_frame;
+    handle->wait_recv = mbus_replay_wait_recv;
+    handle->set_baudrate = NULL;
+    handle->send = mbus_replay_send_frame;
+    handle->free_auxdata = mbus_replay_data_free;
+
+    replay_data->id = id;
+    replay_data->mode = mode;
+
+    if ((replay_data->path = strdup(path)) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for path\n", __PRETTY_FUNCTION__);
+        free(replay_data);
+        free(handle);
+        return NULL;
+    }
+
+    return handle;
+}
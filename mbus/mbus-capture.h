@@ -0,0 +1,228 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-capture.h
+ *
+ * @brief  Capture files of the raw M-Bus traffic of a handle and a transport
+ *         that replays them.
+ *
+ * A capture file starts with the 8 byte header "MBUSCAP" + version (1),
+ * followed by records that are only ever appended:
+ *
+\verbatim
+offset  size  content (integers little endian)
+     0     8  timestamp, CLOCK_MONOTONIC in nanoseconds
+     8     2  handle id, set when the recorder was attached
+    10     1  direction, MBUS_CAPTURE_SEND or MBUS_CAPTURE_RECV
+    11     2  length of the data
+    13     n  data, the bytes written to / read from the transport
+\endverbatim
+ *
+ * A record is written with a single write() to a file opened with O_APPEND,
+ * so several handles (and processes) can share one capture file. A received
+ * record holds the bytes of one call of the transport receive function (one
+ * frame, or the garbage read instead of it).
+ *
+\verbatim
+mbus_capture *capture = mbus_capture_open("field.cap");
+
+mbus_capture_attach(handle, capture, 1);
+... requests ...
+mbus_capture_attach(handle, NULL, 0);
+mbus_capture_close(capture);
+\endverbatim
+ *
+ * A replay handle (mbus_context_replay) feeds the received records back
+ * through mbus_recv_frame, either as fast as possible or at the original
+ * timing.
+ */
+
+#ifndef _MBUS_CAPTURE_H_
+#define _MBUS_CAPTURE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "mbus-protocol.h"
+#include "mbus-protocol-aux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_CAPTURE_MAGIC          "MBUSCAP"
+#define MBUS_CAPTURE_VERSION        1
+#define MBUS_CAPTURE_HEADER_SIZE    8
+#define MBUS_CAPTURE_RECORD_SIZE    13     // record header without the data
+#define MBUS_CAPTURE_DATA_SIZE      0xFFFF // maximum data length of a record
+
+//
+// Record directions
+//
+#define MBUS_CAPTURE_SEND           0
+#define MBUS_CAPTURE_RECV           1
+
+#define MBUS_CAPTURE_ID_ANY         -1     // replay the records of all handles
+
+//
+// Replay modes (flags)
+//
+#define MBUS_REPLAY_FAST            0x00   // as fast as possible
+#define MBUS_REPLAY_REALTIME        0x01   // at the original timing
+#define MBUS_REPLAY_RECV_ONLY       0x02   // ignore the recorded requests
+
+/**
+ * Capture file
+ */
+typedef struct _mbus_capture {
+    int fd;                     /**< File descriptor of a recorder, -1 for a reader */
+    FILE *file;                 /**< File of a reader, NULL for a recorder */
+    size_t records;             /**< Records written or read */
+} mbus_capture;
+
+/**
+ * Capture record
+ */
+typedef struct _mbus_capture_record {
+    long long timestamp;        /**< CLOCK_MONOTONIC in nanoseconds */
+    unsigned int id;            /**< Handle id */
+    int direction;              /**< MBUS_CAPTURE_SEND or MBUS_CAPTURE_RECV */
+    size_t len;                 /**< Length of the data */
+    unsigned char data[MBUS_CAPTURE_DATA_SIZE]; /**< Raw bytes */
+} mbus_capture_record;
+
+/**
+ * Transport data of a replay handle
+ */
+typedef struct _mbus_replay_data {
+    char *path;                 /**< Capture file */
+    int id;                     /**< Handle id to replay, MBUS_CAPTURE_ID_ANY for all */
+    int mode;                   /**< MBUS_REPLAY_* */
+    mbus_capture *capture;      /**< Open capture file */
+    mbus_capture_record record; /**< Next record */
+    int pending;                /**< Next record has been read */
+    long long offset;           /**< Replay time - capture time (ns) */
+    int anchored;               /**< offset is set */
+    size_t mismatches;          /**< Sent frames that differ from the recorded ones */
+} mbus_replay_data;
+
+/**
+ * Open a capture file for appending records. A new (or empty) file gets the
+ * file header, the header of an existing file is checked.
+ *
+ * @param path File name
+ *
+ * @return Capture file, NULL on errors.
+ */
+mbus_capture *mbus_capture_open(const char *path);
+
+/**
+ * Open a capture file for reading its records.
+ *
+ * @param path File name
+ *
+ * @return Capture file, NULL on errors (or if it is no capture file).
+ */
+mbus_capture *mbus_capture_open_read(const char *path);
+
+/**
+ * Close a capture file.
+ *
+ * @param capture Capture file
+ */
+void mbus_capture_close(mbus_capture *capture);
+
+/**
+ * Append a record to a capture file.
+ *
+ * @param capture   Capture file opened with mbus_capture_open
+ * @param id        Handle id
+ * @param direction MBUS_CAPTURE_SEND or MBUS_CAPTURE_RECV
+ * @param data      Raw bytes
+ * @param len       Number of bytes (at most MBUS_CAPTURE_DATA_SIZE)
+ * @param timestamp CLOCK_MONOTONIC in nanoseconds, 0 for the current time
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_capture_write(mbus_capture *capture, unsigned int id, int direction,
+                       const unsigned char *data, size_t len, long long timestamp);
+
+/**
+ * Read the next record of a capture file.
+ *
+ * @param capture Capture file opened with mbus_capture_open_read
+ * @param record  Record
+ *
+ * @return 1 if a record was read, 0 at the end of the file, -1 on errors
+ *         (truncated or damaged file).
+ */
+int mbus_capture_read(mbus_capture *capture, mbus_capture_record *record);
+
+/**
+ * Record the traffic of a handle. Attaching NULL stops the recording. The
+ * capture file is not owned by the handle and has to stay open while it is
+ * attached.
+ *
+ * @param handle  Handle
+ * @param capture Capture file opened with mbus_capture_open, NULL to detach
+ * @param id      Handle id written to the records (0 - 65535)
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_capture_attach(mbus_handle *handle, mbus_capture *capture, unsigned int id);
+
+/**
+ * Record data of a handle, if a capture file is attached. Called by the
+ * transports next to the send/receive events.
+ *
+ * @param handle    Handle
+ * @param direction MBUS_CAPTURE_SEND or MBUS_CAPTURE_RECV
+ * @param data      Raw bytes
+ * @param len       Number of bytes
+ */
+void mbus_capture_handle_data(mbus_handle *handle, int direction, const unsigned char *data, size_t len);
+
+/**
+ * Current time of a capture record.
+ *
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+long long mbus_capture_timestamp(void);
+
+/**
+ * Allocate a handle that replays a capture file. mbus_connect opens (or
+ * rewinds) the file.
+ *
+ * mbus_recv_frame returns the frame of the next received record. A recorded
+ * request that comes first ends the reply with MBUS_RECV_RESULT_TIMEOUT, it
+ * is consumed by the next mbus_send_frame (sent frames are compared with the
+ * recorded ones, see mbus_replay_data). At the end of the file
+ * MBUS_RECV_RESULT_RESET is returned. With MBUS_REPLAY_RECV_ONLY all sent
+ * records are skipped and every mbus_recv_frame returns the next reply.
+ *
+ * With MBUS_REPLAY_REALTIME a reply is returned at its original delay after
+ * the request (or after the first record with MBUS_REPLAY_RECV_ONLY).
+ *
+ * Replay handles do not support the asynchronous requests (mbus-async.h).
+ *
+ * @param path File name
+ * @param id   Handle id to replay, MBUS_CAPTURE_ID_ANY for all records
+ * @param mode MBUS_REPLAY_*
+ *
+ * @return Handle, NULL on errors.
+ */
+mbus_handle *mbus_context_replay(const char *path, int id, int mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_CAPTURE_H_ */
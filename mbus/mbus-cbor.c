@@ -0,0 +1,622 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mbus-cbor.h"
+#include "mbus-protocol-aux.h"
+
+//
+// CBOR major types
+//
+#define MBUS_CBOR_MAJOR_UINT    0
+#define MBUS_CBOR_MAJOR_NINT    1
+#define MBUS_CBOR_MAJOR_BYTES   2
+#define MBUS_CBOR_MAJOR_TEXT    3
+#define MBUS_CBOR_MAJOR_ARRAY   4
+#define MBUS_CBOR_MAJOR_MAP     5
+
+#define MBUS_CBOR_NULL          0xF6
+#define MBUS_CBOR_FLOAT32       0xFA
+#define MBUS_CBOR_FLOAT64       0xFB
+#define MBUS_CBOR_ARRAY_INDEF   0x9F
+#define MBUS_CBOR_BREAK         0xFF
+
+//
+// Output buffer, len counts on beyond size to report the required size
+//
+typedef struct _mbus_cbor_writer {
+    unsigned char *buff;
+    size_t size;
+    size_t len;
+} mbus_cbor_writer;
+
+//------------------------------------------------------------------------------
+/// Append raw bytes.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_put(mbus_cbor_writer *w, const unsigned char *data, size_t len)
+{
+    if (w->len + len <= w->size)
+    {
+        memcpy(w->buff + w->len, data, len);
+    }
+
+    w->len += len;
+}
+
+//------------------------------------------------------------------------------
+/// Append a single byte.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_byte(mbus_cbor_writer *w, unsigned char byte)
+{
+    mbus_cbor_put(w, &byte, 1);
+}
+
+//------------------------------------------------------------------------------
+/// Append the initial byte(s) of a data item: major type and argument.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_head(mbus_cbor_writer *w, int major, uint64_t arg)
+{
+    unsigned char head[9];
+    size_t len, i;
+
+    if (arg < 24)
+    {
+        head[0] = (unsigned char) (major << 5 | arg);
+        len = 1;
+    }
+    else
+    {
+        len = (arg <= 0xFF) ? 1 : (arg <= 0xFFFF) ? 2 : (arg <= 0xFFFFFFFFu) ? 4 : 8;
+
+        head[0] = (unsigned char) (major << 5 | ((len == 1) ? 24 : (len == 2) ? 25 : (len == 4) ? 26 : 27));
+
+        for (i = len; i > 0; i--, arg >>= 8)
+        {
+            head[i] = (unsigned char) (arg & 0xFF);
+        }
+
+        len++;
+    }
+
+    mbus_cbor_put(w, head, len);
+}
+
+//------------------------------------------------------------------------------
+/// Append a (signed) integer.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_int(mbus_cbor_writer *w, long long value)
+{
+    if (value < 0)
+    {
+        mbus_cbor_head(w, MBUS_CBOR_MAJOR_NINT, (uint64_t) (-(value + 1)));
+    }
+    else
+    {
+        mbus_cbor_head(w, MBUS_CBOR_MAJOR_UINT, (uint64_t) value);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Append a string, as text if it is plain ASCII (valid UTF-8), else as a
+/// byte string.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_string(mbus_cbor_writer *w, const char *str, size_t len)
+{
+    int major = MBUS_CBOR_MAJOR_TEXT;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        if ((unsigned char) str[i] >= 0x80)
+        {
+            major = MBUS_CBOR_MAJOR_BYTES;
+            break;
+        }
+    }
+
+    mbus_cbor_head(w, major, len);
+    mbus_cbor_put(w, (const unsigned char *) str, len);
+}
+
+//------------------------------------------------------------------------------
+/// Append a float, single precision if that holds the value exactly.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_float(mbus_cbor_writer *w, double value)
+{
+    unsigned char buff[9];
+    uint64_t bits64;
+    uint32_t bits32;
+    float value32;
+    int i;
+
+    if (isnan(value) || (fabs(value) <= FLT_MAX && (double) (float) value == value) || isinf(value))
+    {
+        value32 = (float) value;
+        memcpy(&bits32, &value32, sizeof(bits32));
+
+        buff[0] = MBUS_CBOR_FLOAT32;
+
+        for (i = 4; i > 0; i--, bits32 >>= 8)
+        {
+            buff[i] = (unsigned char) (bits32 & 0xFF);
+        }
+
+        mbus_cbor_put(w, buff, 5);
+        return;
+    }
+
+    memcpy(&bits64, &value, sizeof(bits64));
+
+    buff[0] = MBUS_CBOR_FLOAT64;
+
+    for (i = 8; i > 0; i--, bits64 >>= 8)
+    {
+        buff[i] = (unsigned char) (bits64 & 0xFF);
+    }
+
+    mbus_cbor_put(w, buff, 9);
+}
+
+//------------------------------------------------------------------------------
+/// Append a decoded record value with its native type.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_value(mbus_cbor_writer *w, const mbus_data_value *value)
+{
+    char str_buff[256];
+
+    switch (value->type)
+    {
+        case MBUS_DATA_VALUE_NONE:
+
+            mbus_cbor_byte(w, MBUS_CBOR_NULL);
+            break;
+
+        case MBUS_DATA_VALUE_BCD:
+
+            if (value->bcd_error)
+            {
+                // not a valid number, keep the text representation
+                mbus_data_value_format_r(value, str_buff, sizeof(str_buff));
+                mbus_cbor_string(w, str_buff, strlen(str_buff));
+                break;
+            }
+            /*@fallthrough@*/
+
+        case MBUS_DATA_VALUE_INTEGER:
+
+            mbus_cbor_int(w, value->value.integer);
+            break;
+
+        case MBUS_DATA_VALUE_REAL:
+
+            mbus_cbor_float(w, value->value.real);
+            break;
+
+        case MBUS_DATA_VALUE_BINARY:
+
+            mbus_cbor_head(w, MBUS_CBOR_MAJOR_BYTES, value->data_len);
+            mbus_cbor_put(w, value->data, value->data_len);
+            break;
+
+        default:
+
+            // dates, strings and values of unknown type as text
+            mbus_data_value_format_r(value, str_buff, sizeof(str_buff));
+            mbus_cbor_string(w, str_buff, strlen(str_buff));
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Append a variable data record, unless it is skipped by the options.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_variable_record(mbus_cbor_writer *w, mbus_data_record *record, int record_cnt, int frame_cnt, int options, int normalized)
+{
+    mbus_data_value value;
+    const char *unit, *quantity;
+    double real_val = 0.0;
+    int numeric, special, function, unit_code = -1, custom_vif, scaled = 0;
+    long tariff = -1;
+    size_t n;
+
+    mbus_data_record_value_decode(record, &value);
+    numeric = mbus_data_value_is_numeric(&value);
+
+    if ((options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !numeric)
+    {
+        return;
+    }
+
+    special = (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC ||
+               record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW);
+
+    if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC)
+    {
+        function = MBUS_CBOR_FUNCTION_MANUFACTURER;
+    }
+    else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    {
+        function = MBUS_CBOR_FUNCTION_MORE_RECORDS;
+    }
+    else
+    {
+        function = (record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_FUNCTION) >> 4;
+    }
+
+    custom_vif = (record->drh.vib.vif == 0x7C || record->drh.vib.vif == 0xFC);
+
+    if (!special)
+    {
+        tariff = mbus_data_record_tariff(record);
+        unit_code = mbus_vib_unit_code(&(record->drh.vib));
+
+        if (normalized && (value.type == MBUS_DATA_VALUE_INTEGER || value.type == MBUS_DATA_VALUE_REAL ||
+                           (value.type == MBUS_DATA_VALUE_BCD && !value.bcd_error)))
+        {
+            real_val = (value.type == MBUS_DATA_VALUE_REAL) ? value.value.real : (double) value.value.integer;
+            scaled = (mbus_vib_unit_normalize(&(record->drh.vib), real_val, &unit, &real_val, &quantity) == 0);
+        }
+    }
+
+    // id, function, value
+    n = 3;
+
+    if (frame_cnt >= 0)
+        n++;
+
+    if (!special)
+        n += 1 + ((tariff >= 0) ? 2 : 0) + ((unit_code >= 0 || custom_vif) ? 1 : 0);
+
+    if (record->timestamp > 0)
+        n++;
+
+    mbus_cbor_head(w, MBUS_CBOR_MAJOR_MAP, n);
+
+    mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_ID);
+    mbus_cbor_int(w, record_cnt);
+
+    if (frame_cnt >= 0)
+    {
+        mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_FRAME);
+        mbus_cbor_int(w, frame_cnt);
+    }
+
+    mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_FUNCTION);
+    mbus_cbor_int(w, function);
+
+    if (!special)
+    {
+        mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_STORAGE_NUMBER);
+        mbus_cbor_int(w, mbus_data_record_storage_number(record));
+
+        if (tariff >= 0)
+        {
+            mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_TARIFF);
+            mbus_cbor_int(w, tariff);
+            mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_DEVICE);
+            mbus_cbor_int(w, mbus_data_record_device(record));
+        }
+
+        if (unit_code >= 0)
+        {
+            mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_UNIT);
+            mbus_cbor_int(w, unit_code);
+        }
+        else if (custom_vif)
+        {
+            mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_UNIT_TEXT);
+            mbus_cbor_string(w, (const char *) record->drh.vib.custom_vif,
+                             strlen((const char *) record->drh.vib.custom_vif));
+        }
+    }
+
+    mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_VALUE);
+
+    if (scaled)
+    {
+        mbus_cbor_float(w, real_val);
+    }
+    else
+    {
+        mbus_cbor_value(w, &value);
+    }
+
+    if (record->timestamp > 0)
+    {
+        mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_TIMESTAMP);
+        mbus_cbor_int(w, (long long) record->timestamp);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Append the keys and values of a variable data header (without records).
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_variable_header(mbus_cbor_writer *w, mbus_data_variable_header *header)
+{
+    char manufacturer[8];
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_TYPE);
+    mbus_cbor_int(w, MBUS_DATA_TYPE_VARIABLE);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_ID);
+    mbus_cbor_int(w, mbus_data_bcd_decode(header->id_bcd, 4));
+
+    mbus_decode_manufacturer_r(header->manufacturer[0], header->manufacturer[1], manufacturer, sizeof(manufacturer));
+    mbus_cbor_int(w, MBUS_CBOR_KEY_MANUFACTURER);
+    mbus_cbor_string(w, manufacturer, strlen(manufacturer));
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_VERSION);
+    mbus_cbor_int(w, header->version);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_MEDIUM);
+    mbus_cbor_int(w, header->medium);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_ACCESS_NUMBER);
+    mbus_cbor_int(w, header->access_no);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_STATUS);
+    mbus_cbor_int(w, header->status);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_SIGNATURE);
+    mbus_cbor_int(w, (header->signature[1] << 8) | header->signature[0]);
+}
+
+//------------------------------------------------------------------------------
+/// Append a counter of fixed data.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_fixed_record(mbus_cbor_writer *w, mbus_data_fixed *data, int id, int type, unsigned char *cnt_val, int normalized)
+{
+    const char *unit, *quantity;
+    double real_val;
+    int val;
+
+    mbus_cbor_head(w, MBUS_CBOR_MAJOR_MAP, 4);
+
+    mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_ID);
+    mbus_cbor_int(w, id);
+
+    mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_FUNCTION);
+    mbus_cbor_int(w, ((data->status & MBUS_DATA_FIXED_STATUS_DATE_MASK) == MBUS_DATA_FIXED_STATUS_DATE_STORED) ?
+                     MBUS_CBOR_FUNCTION_STORED : MBUS_CBOR_FUNCTION_ACTUAL);
+
+    mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_FIXED_UNIT);
+    mbus_cbor_int(w, type & 0x3F);
+
+    mbus_cbor_int(w, MBUS_CBOR_RECORD_KEY_VALUE);
+
+    if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+    {
+        val = (int) mbus_data_bcd_decode(cnt_val, 4);
+    }
+    else
+    {
+        mbus_data_int_decode(cnt_val, 4, &val);
+    }
+
+    if (normalized && mbus_data_fixed_normalize(type, val, &unit, &real_val, &quantity) == 0)
+    {
+        mbus_cbor_float(w, real_val);
+    }
+    else
+    {
+        mbus_cbor_int(w, val);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Append fixed data.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_fixed(mbus_cbor_writer *w, mbus_data_fixed *data, int normalized)
+{
+    mbus_cbor_head(w, MBUS_CBOR_MAJOR_MAP, 6);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_TYPE);
+    mbus_cbor_int(w, MBUS_DATA_TYPE_FIXED);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_ID);
+    mbus_cbor_int(w, mbus_data_bcd_decode(data->id_bcd, 4));
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_MEDIUM);
+    mbus_cbor_int(w, (data->cnt1_type & 0xC0) >> 6 | (data->cnt2_type & 0xC0) >> 4);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_ACCESS_NUMBER);
+    mbus_cbor_int(w, data->tx_cnt);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_STATUS);
+    mbus_cbor_int(w, data->status);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_RECORDS);
+    mbus_cbor_head(w, MBUS_CBOR_MAJOR_ARRAY, 2);
+
+    mbus_cbor_fixed_record(w, data, 0, data->cnt1_type, data->cnt1_val, normalized);
+    mbus_cbor_fixed_record(w, data, 1, data->cnt2_type, data->cnt2_val, normalized);
+}
+
+//------------------------------------------------------------------------------
+/// Append a general application error.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_error(mbus_cbor_writer *w, int error)
+{
+    mbus_cbor_head(w, MBUS_CBOR_MAJOR_MAP, 2);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_TYPE);
+    mbus_cbor_int(w, MBUS_DATA_TYPE_ERROR);
+
+    mbus_cbor_int(w, MBUS_CBOR_KEY_ERROR);
+    mbus_cbor_int(w, error);
+}
+
+//------------------------------------------------------------------------------
+/// Encode frame data, return the length of the encoding.
+//------------------------------------------------------------------------------
+static int
+mbus_cbor_frame_data(mbus_frame_data *data, int options, int normalized, unsigned char *buff, size_t buff_size)
+{
+    mbus_cbor_writer w;
+    mbus_data_record *record;
+    int i;
+
+    if (data == NULL || (buff == NULL && buff_size > 0))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid parameter.");
+        return -1;
+    }
+
+    w.buff = buff;
+    w.size = buff_size;
+    w.len  = 0;
+
+    switch (data->type)
+    {
+        case MBUS_DATA_TYPE_ERROR:
+
+            mbus_cbor_error(&w, data->error);
+            break;
+
+        case MBUS_DATA_TYPE_FIXED:
+
+            mbus_cbor_fixed(&w, &(data->data_fix), normalized);
+            break;
+
+        case MBUS_DATA_TYPE_VARIABLE:
+
+            mbus_cbor_head(&w, MBUS_CBOR_MAJOR_MAP, 9);
+            mbus_cbor_variable_header(&w, &(data->data_var.header));
+
+            // the number of records depends on the options
+            mbus_cbor_int(&w, MBUS_CBOR_KEY_RECORDS);
+            mbus_cbor_byte(&w, MBUS_CBOR_ARRAY_INDEF);
+
+            for (record = data->data_var.record, i = 0; record; record = record->next, i++)
+            {
+                mbus_cbor_variable_record(&w, record, i, -1, options, normalized);
+            }
+
+            mbus_cbor_byte(&w, MBUS_CBOR_BREAK);
+            break;
+
+        default:
+
+            mbus_error_set(MBUS_ERR_UNSUPPORTED, "Unknown frame data type.");
+            return -1;
+    }
+
+    return (int) w.len;
+}
+
+//------------------------------------------------------------------------------
+// Encode frame data.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_cbor(mbus_frame_data *data, int options, unsigned char *buff, size_t buff_size)
+{
+    return mbus_cbor_frame_data(data, options, 0, buff, buff_size);
+}
+
+//------------------------------------------------------------------------------
+// Encode frame data with normalized values.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_cbor_normalized(mbus_frame_data *data, int options, unsigned char *buff, size_t buff_size)
+{
+    return mbus_cbor_frame_data(data, options, 1, buff, buff_size);
+}
+
+//------------------------------------------------------------------------------
+// Encode the data of a frame and the frames linked to it.
+//------------------------------------------------------------------------------
+int
+mbus_frame_cbor(mbus_frame *frame, int options, int normalized, unsigned char *buff, size_t buff_size)
+{
+    mbus_frame_data frame_data;
+    mbus_record_arena arena;
+    mbus_cbor_writer w;
+    mbus_frame *iter;
+    mbus_data_record *record;
+    int record_cnt = 0, frame_cnt;
+
+    if (frame == NULL || (buff == NULL && buff_size > 0))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid parameter.");
+        return -1;
+    }
+
+    memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+    mbus_record_arena_init(&arena);
+
+    if (mbus_frame_data_parse_arena(frame, &frame_data, &arena) == -1)
+    {
+        mbus_record_arena_free(&arena);
+        mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus data parse error.");
+        return -1;
+    }
+
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        mbus_record_arena_free(&arena);
+        return mbus_cbor_frame_data(&frame_data, options, normalized, buff, buff_size);
+    }
+
+    w.buff = buff;
+    w.size = buff_size;
+    w.len  = 0;
+
+    // include the frame number if more than one frame is available
+    frame_cnt = (frame->next == NULL) ? -1 : 0;
+
+    mbus_cbor_head(&w, MBUS_CBOR_MAJOR_MAP, 9);
+
+    // header of the first frame (should be the same for each frame in a
+    // sequence of a multi-telegram transfer)
+    mbus_cbor_variable_header(&w, &(frame_data.data_var.header));
+
+    mbus_cbor_int(&w, MBUS_CBOR_KEY_RECORDS);
+    mbus_cbor_byte(&w, MBUS_CBOR_ARRAY_INDEF);
+
+    for (iter = frame; iter; iter = iter->next, frame_cnt++)
+    {
+        if (iter != frame && mbus_frame_data_parse_arena(iter, &frame_data, &arena) == -1)
+        {
+            mbus_record_arena_free(&arena);
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus variable data parse error.");
+            return -1;
+        }
+
+        for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
+        {
+            mbus_cbor_variable_record(&w, record, record_cnt, frame_cnt, options, normalized);
+        }
+
+        // release all records of the frame
+        mbus_record_arena_reset(&arena);
+    }
+
+    mbus_cbor_byte(&w, MBUS_CBOR_BREAK);
+
+    mbus_record_arena_free(&arena);
+
+    return (int) w.len;
+}
@@ -0,0 +1,167 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-cbor.h
+ *
+ * @brief  Binary (CBOR, RFC 8949) encoding of M-Bus frame data.
+ *
+ * The encoders write into a caller supplied buffer. Encoding parsed frame
+ * data (mbus_frame_data_cbor*) does not allocate memory, mbus_frame_cbor
+ * parses the frames into a record arena first, which does. Like snprintf
+ * they return the length of the complete encoding; if it is larger than the
+ * buffer the output is incomplete and the call has to be repeated with a
+ * buffer of (at least) that size. A NULL buffer of size 0 can be used to get
+ * the required size.
+ *
+ * Frame data is encoded as a map with small integer keys:
+ *
+\verbatim
+key  MBUS_CBOR_KEY_*        value
+  0  TYPE                   MBUS_DATA_TYPE_FIXED / _VARIABLE / _ERROR
+  1  ID                     identification number (unsigned)
+  2  MANUFACTURER           manufacturer (text, variable data only)
+  3  VERSION                version (variable data only)
+  4  MEDIUM                 medium code
+  5  ACCESS_NUMBER          access number
+  6  STATUS                 status
+  7  SIGNATURE              signature (variable data only)
+  8  RECORDS                array of records
+  9  ERROR                  error code (MBUS_ERROR_DATA_*, error type only)
+\endverbatim
+ *
+ * and every record as a map with the keys:
+ *
+\verbatim
+key  MBUS_CBOR_RECORD_KEY_* value
+  0  ID                     record number (counted over all frames)
+  1  FRAME                  frame number (multi-frame output only)
+  2  FUNCTION               MBUS_CBOR_FUNCTION_*
+  3  STORAGE_NUMBER         storage number
+  4  TARIFF                 tariff (if present)
+  5  DEVICE                 device (if present)
+  6  UNIT                   unit/quantity code of variable data, see below
+  7  UNIT_TEXT              unit (text) of records with a plain text VIF
+  8  VALUE                  value, see below
+  9  TIMESTAMP              timestamp (seconds since the epoch, if set)
+ 10  FIXED_UNIT             unit/quantity code of fixed data, see below
+\endverbatim
+ *
+ * The unit code of variable data records is the code used by
+ * mbus_vif_unit_normalize (the VIF without extension bit, | 0x100 for VIF
+ * 0xFD extensions, | 0x200 for VIF 0xFB extensions), which translates it
+ * into unit and quantity text. Fixed data records carry the 6 bit unit code
+ * of the counter instead, see mbus_data_fixed_unit; the two code tables
+ * differ, hence the separate keys.
+ *
+ * Values are encoded with their native type: integers as CBOR integers,
+ * 32 bit reals as single precision floats, dates and strings as text and
+ * binary data as byte strings. The normalized variant scales numeric values
+ * to the unit of their unit code and encodes them as the shortest float that
+ * holds them exactly.
+ */
+
+#ifndef _MBUS_CBOR_H_
+#define _MBUS_CBOR_H_
+
+#include <stddef.h>
+
+#include "mbus-protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Frame data map keys
+//
+#define MBUS_CBOR_KEY_TYPE              0
+#define MBUS_CBOR_KEY_ID                1
+#define MBUS_CBOR_KEY_MANUFACTURER      2
+#define MBUS_CBOR_KEY_VERSION           3
+#define MBUS_CBOR_KEY_MEDIUM            4
+#define MBUS_CBOR_KEY_ACCESS_NUMBER     5
+#define MBUS_CBOR_KEY_STATUS            6
+#define MBUS_CBOR_KEY_SIGNATURE         7
+#define MBUS_CBOR_KEY_RECORDS           8
+#define MBUS_CBOR_KEY_ERROR             9
+
+//
+// Record map keys
+//
+#define MBUS_CBOR_RECORD_KEY_ID             0
+#define MBUS_CBOR_RECORD_KEY_FRAME          1
+#define MBUS_CBOR_RECORD_KEY_FUNCTION       2
+#define MBUS_CBOR_RECORD_KEY_STORAGE_NUMBER 3
+#define MBUS_CBOR_RECORD_KEY_TARIFF         4
+#define MBUS_CBOR_RECORD_KEY_DEVICE         5
+#define MBUS_CBOR_RECORD_KEY_UNIT           6
+#define MBUS_CBOR_RECORD_KEY_UNIT_TEXT      7
+#define MBUS_CBOR_RECORD_KEY_VALUE          8
+#define MBUS_CBOR_RECORD_KEY_TIMESTAMP      9
+#define MBUS_CBOR_RECORD_KEY_FIXED_UNIT     10
+
+//
+// Record functions
+//
+#define MBUS_CBOR_FUNCTION_INSTANTANEOUS    0
+#define MBUS_CBOR_FUNCTION_MAXIMUM          1
+#define MBUS_CBOR_FUNCTION_MINIMUM          2
+#define MBUS_CBOR_FUNCTION_ERROR_STATE      3
+#define MBUS_CBOR_FUNCTION_MANUFACTURER     4 // manufacturer specific data
+#define MBUS_CBOR_FUNCTION_MORE_RECORDS     5 // more records follow
+#define MBUS_CBOR_FUNCTION_ACTUAL           6 // fixed data: actual value
+#define MBUS_CBOR_FUNCTION_STORED           7 // fixed data: stored value
+
+/**
+ * Encode frame data.
+ *
+ * @param data      Frame data
+ * @param options   MBUS_VALUE_OPTION_*
+ * @param buff      Output buffer
+ * @param buff_size Size of buff
+ *
+ * @return Length of the encoding, -1 on errors.
+ */
+int mbus_frame_data_cbor(mbus_frame_data *data, int options, unsigned char *buff, size_t buff_size);
+
+/**
+ * Encode frame data with normalized values.
+ *
+ * @param data      Frame data
+ * @param options   MBUS_VALUE_OPTION_*
+ * @param buff      Output buffer
+ * @param buff_size Size of buff
+ *
+ * @return Length of the encoding, -1 on errors.
+ */
+int mbus_frame_data_cbor_normalized(mbus_frame_data *data, int options, unsigned char *buff, size_t buff_size);
+
+/**
+ * Encode the data of a frame and the frames linked to it (multi-telegram
+ * reply). The header is taken from the first frame, the records of all
+ * frames are combined. The frames are parsed into a record arena, which
+ * allocates memory for the records.
+ *
+ * @param frame      First frame
+ * @param options    MBUS_VALUE_OPTION_*
+ * @param normalized Nonzero for normalized values
+ * @param buff       Output buffer
+ * @param buff_size  Size of buff
+ *
+ * @return Length of the encoding, -1 on errors.
+ */
+int mbus_frame_cbor(mbus_frame *frame, int options, int normalized, unsigned char *buff, size_t buff_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_CBOR_H_ */
@@ -0,0 +1,604 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Shortest round-trip formatting of doubles, based on the Grisu2 algorithm
+// of Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers" (PLDI 2010).
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mbus-format.h"
+
+//
+// A floating point number f * 2^e with a 64 bit significand
+//
+typedef struct _mbus_diyfp {
+    uint64_t f;
+    int e;
+} mbus_diyfp;
+
+//
+// Cached power of ten: 10^k ~= f * 2^e
+//
+typedef struct _mbus_cached_power {
+    uint64_t f;
+    int e;
+    int k;
+} mbus_cached_power;
+
+#define MBUS_GRISU_ALPHA          -60
+#define MBUS_GRISU_GAMMA          -32
+#define MBUS_CACHED_POWERS_MIN_K  -300
+#define MBUS_CACHED_POWERS_STEP   8
+
+// Grisu2 results with more digits are checked for a shorter representation
+#define MBUS_GRISU_SHORTEN_LEN    16
+
+//
+// Normalized powers of ten 10^-300 .. 10^340, step 8.
+//
+static const mbus_cached_power mbus_cached_powers[] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+    { 0xEB96BF6EBADF77D9ULL,  1039,  332 },
+    { 0xAF87023B9BF0EE6BULL,  1066,  340 },
+};
+
+static const char mbus_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+//------------------------------------------------------------------------------
+/// x * y rounded to 64 bits (upper half of the 128 bit product).
+//------------------------------------------------------------------------------
+static mbus_diyfp
+mbus_diyfp_mul(mbus_diyfp x, mbus_diyfp y)
+{
+    mbus_diyfp r;
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFu;
+    uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFFu;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFFu) + (bc & 0xFFFFFFFFu);
+
+    mid += 1u << 31; // round
+
+    r.f = ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+    r.e = x.e + y.e + 64;
+
+    return r;
+}
+
+//------------------------------------------------------------------------------
+/// Shift x left until the highest bit of the significand is set.
+//------------------------------------------------------------------------------
+static mbus_diyfp
+mbus_diyfp_normalize(mbus_diyfp x)
+{
+    while ((x.f >> 63) == 0)
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+
+    return x;
+}
+
+//------------------------------------------------------------------------------
+/// Compute the (normalized) value v and its boundaries m- and m+, the
+/// midpoints to the adjacent doubles. m- has the exponent of m+.
+//------------------------------------------------------------------------------
+static void
+mbus_grisu_boundaries(double value, mbus_diyfp *v, mbus_diyfp *m_minus, mbus_diyfp *m_plus)
+{
+    const uint64_t hidden_bit = (uint64_t) 1 << 52;
+    uint64_t bits, F;
+    int E;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    E = (int) ((bits >> 52) & 0x7FF);
+    F = bits & (hidden_bit - 1);
+
+    if (E == 0)
+    {
+        // subnormal
+        v->f = F;
+        v->e = 1 - 1075;
+    }
+    else
+    {
+        v->f = F + hidden_bit;
+        v->e = E - 1075;
+    }
+
+    m_plus->f = 2 * v->f + 1;
+    m_plus->e = v->e - 1;
+
+    if (F == 0 && E > 1)
+    {
+        // the lower boundary is closer
+        m_minus->f = 4 * v->f - 1;
+        m_minus->e = v->e - 2;
+    }
+    else
+    {
+        m_minus->f = 2 * v->f - 1;
+        m_minus->e = v->e - 1;
+    }
+
+    *m_plus = mbus_diyfp_normalize(*m_plus);
+
+    m_minus->f <<= m_minus->e - m_plus->e;
+    m_minus->e = m_plus->e;
+
+    *v = mbus_diyfp_normalize(*v);
+}
+
+//------------------------------------------------------------------------------
+/// Move the last digit towards w as long as it stays within the boundaries.
+//------------------------------------------------------------------------------
+static void
+mbus_grisu_round(char *buff, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+{
+    while (rest < dist && delta - rest >= ten_k &&
+           (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+    {
+        buff[len - 1]--;
+        rest += ten_k;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Generate the shortest digits of a value in [M-, M+] closest to w.
+//------------------------------------------------------------------------------
+static int
+mbus_grisu_digits(char *buff, int *dec_exp, mbus_diyfp M_minus, mbus_diyfp w, mbus_diyfp M_plus)
+{
+    uint64_t delta = M_plus.f - M_minus.f;
+    uint64_t dist  = M_plus.f - w.f;
+    int shift = -M_plus.e;
+    uint64_t one = (uint64_t) 1 << shift;
+    uint32_t p1 = (uint32_t) (M_plus.f >> shift);
+    uint64_t p2 = M_plus.f & (one - 1);
+    uint64_t rest;
+    uint32_t pow10, d;
+    int len = 0, n, m;
+
+    // largest power of ten <= p1
+    if      (p1 >= 1000000000) { pow10 = 1000000000; n = 10; }
+    else if (p1 >=  100000000) { pow10 =  100000000; n =  9; }
+    else if (p1 >=   10000000) { pow10 =   10000000; n =  8; }
+    else if (p1 >=    1000000) { pow10 =    1000000; n =  7; }
+    else if (p1 >=     100000) { pow10 =     100000; n =  6; }
+    else if (p1 >=      10000) { pow10 =      10000; n =  5; }
+    else if (p1 >=       1000) { pow10 =       1000; n =  4; }
+    else if (p1 >=        100) { pow10 =        100; n =  3; }
+    else if (p1 >=         10) { pow10 =         10; n =  2; }
+    else                       { pow10 =          1; n =  1; }
+
+    // integral part
+    while (n > 0)
+    {
+        d = p1 / pow10;
+        p1 = p1 % pow10;
+
+        buff[len++] = (char) ('0' + d);
+        n--;
+
+        rest = ((uint64_t) p1 << shift) + p2;
+
+        if (rest <= delta)
+        {
+            *dec_exp += n;
+            mbus_grisu_round(buff, len, dist, delta, rest, (uint64_t) pow10 << shift);
+            return len;
+        }
+
+        pow10 /= 10;
+    }
+
+    // fractional part
+    for (m = 0; ; )
+    {
+        p2 *= 10;
+        d = (uint32_t) (p2 >> shift);
+        p2 &= one - 1;
+
+        buff[len++] = (char) ('0' + d);
+        m++;
+
+        delta *= 10;
+        dist  *= 10;
+
+        if (p2 <= delta)
+            break;
+    }
+
+    *dec_exp -= m;
+    mbus_grisu_round(buff, len, dist, delta, p2, one);
+
+    return len;
+}
+
+//------------------------------------------------------------------------------
+/// Shortest digits and decimal exponent of a positive finite value:
+/// value = digits * 10^dec_exp
+//------------------------------------------------------------------------------
+static int
+mbus_grisu2(double value, char *buff, int *dec_exp)
+{
+    mbus_diyfp v, m_minus, m_plus, c, w, w_minus, w_plus;
+    const mbus_cached_power *cached;
+    int f, k, idx;
+
+    mbus_grisu_boundaries(value, &v, &m_minus, &m_plus);
+
+    // select a power of ten c such that the exponent of m+ * c lies in
+    // [alpha, gamma]
+    f = MBUS_GRISU_ALPHA - m_plus.e - 1;
+    k = (f * 78913) / (1 << 18) + (f > 0);
+    idx = (-MBUS_CACHED_POWERS_MIN_K + k + (MBUS_CACHED_POWERS_STEP - 1)) / MBUS_CACHED_POWERS_STEP;
+    cached = &mbus_cached_powers[idx];
+
+    c.f = cached->f;
+    c.e = cached->e;
+
+    w       = mbus_diyfp_mul(v, c);
+    w_minus = mbus_diyfp_mul(m_minus, c);
+    w_plus  = mbus_diyfp_mul(m_plus, c);
+
+    // stay safely inside the boundaries (the products are imprecise by 1 ulp)
+    w_minus.f += 1;
+    w_plus.f  -= 1;
+
+    *dec_exp = -cached->k;
+
+    return mbus_grisu_digits(buff, dec_exp, w_minus, w, w_plus);
+}
+
+//------------------------------------------------------------------------------
+/// Cut digits * 10^dec_exp to n digits (without trailing zeros) into buff,
+/// rounding up or down, return the length.
+//------------------------------------------------------------------------------
+static int
+mbus_grisu_round_to(const char *digits, int len, int n, int up, char *buff, int *dec_exp)
+{
+    int i;
+
+    memcpy(buff, digits, n);
+    *dec_exp += len - n;
+
+    if (up)
+    {
+        for (i = n - 1; i >= 0 && buff[i] == '9'; i--)
+            buff[i] = '0';
+
+        if (i < 0)
+        {
+            // 999 -> 1000
+            buff[0] = '1';
+            memset(buff + 1, '0', n - 1);
+            (*dec_exp)++;
+        }
+        else
+        {
+            buff[i]++;
+        }
+    }
+
+    for (; n > 1 && buff[n - 1] == '0'; n--)
+        (*dec_exp)++;
+
+    return n;
+}
+
+//------------------------------------------------------------------------------
+/// Check if digits * 10^dec_exp reads back as value. Without a decimal point
+/// strtod does not depend on the locale.
+//------------------------------------------------------------------------------
+static int
+mbus_grisu_reads_back(double value, const char *digits, int len, int dec_exp)
+{
+    char buff[40];
+
+    snprintf(buff, sizeof(buff), "%.*se%d", len, digits, dec_exp);
+
+    return strtod(buff, NULL) == value;
+}
+
+//------------------------------------------------------------------------------
+/// Grisu2 misses the shortest digits now and then, mostly for values next to
+/// a short decimal like scaled meter readings (19.821021 came out as
+/// 19.821020999999998). Shorten long results to the fewest digits that still
+/// read back as the value, found by bisection (a rounding to more digits is
+/// never further off). The value may lie closer to the other neighbour of
+/// the digits than to the one they round to, so both are tried.
+//------------------------------------------------------------------------------
+static int
+mbus_grisu_shorten(double value, char *digits, int len, int *dec_exp)
+{
+    char buff[20], best[20];
+    int lo = 1, hi = len, n, n_len, n_exp, best_len = len, best_exp = *dec_exp;
+    int nearest, found;
+
+    memcpy(best, digits, len);
+
+    // invariant: hi digits read back, fewer than lo do not
+    while (lo < hi)
+    {
+        n = (lo + hi) / 2;
+        nearest = (digits[n] >= '5');
+
+        n_exp = *dec_exp;
+        n_len = mbus_grisu_round_to(digits, len, n, nearest, buff, &n_exp);
+
+        if (!(found = mbus_grisu_reads_back(value, buff, n_len, n_exp)))
+        {
+            n_exp = *dec_exp;
+            n_len = mbus_grisu_round_to(digits, len, n, !nearest, buff, &n_exp);
+            found = mbus_grisu_reads_back(value, buff, n_len, n_exp);
+        }
+
+        if (found)
+        {
+            memcpy(best, buff, n_len);
+            best_len = n_len;
+            best_exp = n_exp;
+            hi = n;
+        }
+        else
+        {
+            lo = n + 1;
+        }
+    }
+
+    memcpy(digits, best, best_len);
+    *dec_exp = best_exp;
+
+    return best_len;
+}
+
+//------------------------------------------------------------------------------
+/// Write the digits of an unsigned value, return the length.
+//------------------------------------------------------------------------------
+static size_t
+mbus_format_uint(unsigned long long value, char *buff)
+{
+    char tmp[MBUS_FORMAT_INT_SIZE];
+    char *p = tmp + sizeof(tmp);
+    size_t len;
+    unsigned i;
+
+    while (value >= 100)
+    {
+        i = (unsigned) (value % 100) * 2;
+        value /= 100;
+        *--p = mbus_digit_pairs[i + 1];
+        *--p = mbus_digit_pairs[i];
+    }
+
+    if (value >= 10)
+    {
+        i = (unsigned) value * 2;
+        *--p = mbus_digit_pairs[i + 1];
+        *--p = mbus_digit_pairs[i];
+    }
+    else
+    {
+        *--p = (char) ('0' + value);
+    }
+
+    len = tmp + sizeof(tmp) - p;
+    memcpy(buff, p, len);
+    buff[len] = '\0';
+
+    return len;
+}
+
+//------------------------------------------------------------------------------
+// Format an integer in decimal.
+//------------------------------------------------------------------------------
+size_t
+mbus_format_int(long long value, char *buff)
+{
+    if (value < 0)
+    {
+        buff[0] = '-';
+        return 1 + mbus_format_uint(0ULL - (unsigned long long) value, buff + 1);
+    }
+
+    return mbus_format_uint((unsigned long long) value, buff);
+}
+
+//------------------------------------------------------------------------------
+// Format a double with the shortest representation that round-trips.
+//------------------------------------------------------------------------------
+size_t
+mbus_format_double(double value, char *buff)
+{
+    char digits[20];
+    char *p = buff;
+    int len, dec_exp, n, i;
+
+    if (isnan(value))
+    {
+        strcpy(buff, "nan");
+        return 3;
+    }
+
+    if (signbit(value))
+    {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if (isinf(value))
+    {
+        strcpy(p, "inf");
+        return p - buff + 3;
+    }
+
+    if (value == 0.0)
+    {
+        *p++ = '0';
+        *p = '\0';
+        return p - buff;
+    }
+
+    len = mbus_grisu2(value, digits, &dec_exp);
+
+    if (len >= MBUS_GRISU_SHORTEN_LEN)
+        len = mbus_grisu_shorten(value, digits, len, &dec_exp);
+
+    // position of the decimal point relative to the first digit
+    n = len + dec_exp;
+
+    if (len <= n && n <= 21)
+    {
+        // 1234e7 -> 12340000000
+        memcpy(p, digits, len);
+        p += len;
+
+        for (i = len; i < n; i++)
+            *p++ = '0';
+    }
+    else if (0 < n && n <= 21)
+    {
+        // 1234e-2 -> 12.34
+        memcpy(p, digits, n);
+        p += n;
+        *p++ = '.';
+        memcpy(p, digits + n, len - n);
+        p += len - n;
+    }
+    else if (-6 < n && n <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        *p++ = '0';
+        *p++ = '.';
+
+        for (i = n; i < 0; i++)
+            *p++ = '0';
+
+        memcpy(p, digits, len);
+        p += len;
+    }
+    else
+    {
+        // 1234e30 -> 1.234e+33
+        *p++ = digits[0];
+
+        if (len > 1)
+        {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+
+        *p++ = 'e';
+        *p++ = (n - 1 < 0) ? '-' : '+';
+        p += mbus_format_uint((unsigned long long) ((n - 1 < 0) ? 1 - n : n - 1), p);
+    }
+
+    *p = '\0';
+
+    return p - buff;
+}
@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-format.h
+ *
+ * @brief  Locale independent number formatting for the XML/JSON/InfluxDB
+ *         writers.
+ *
+ * Doubles are written with the shortest digit string that reads back to the
+ * same value (Grisu2), in fixed notation for decimal exponents -6..21 and in
+ * exponential notation otherwise (1e-7, 1.5e+22). The decimal separator is
+ * always '.', independent of the current locale.
+ */
+
+#ifndef _MBUS_FORMAT_H_
+#define _MBUS_FORMAT_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_FORMAT_DOUBLE_SIZE 32 // buffer size sufficient for any double
+#define MBUS_FORMAT_INT_SIZE    24 // buffer size sufficient for any long long
+
+/**
+ * Format a double with the shortest representation that round-trips.
+ *
+ * @param value Value
+ * @param buff  Buffer of at least MBUS_FORMAT_DOUBLE_SIZE bytes
+ *
+ * @return Length of the zero terminated string written to buff.
+ */
+size_t mbus_format_double(double value, char *buff);
+
+/**
+ * Format an integer in decimal.
+ *
+ * @param value Value
+ * @param buff  Buffer of at least MBUS_FORMAT_INT_SIZE bytes
+ *
+ * @return Length of the zero terminated string written to buff.
+ */
+size_t mbus_format_int(long long value, char *buff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_FORMAT_H_ */
@@ -0,0 +1,495 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mbus-influxdb.h"
+#include "mbus-protocol-aux.h"
+
+//------------------------------------------------------------------------------
+/// Append a tag, tags with an empty value are left out.
+//------------------------------------------------------------------------------
+static void
+mbus_influxdb_tag(mbus_sink *sink, const char *key, const char *value)
+{
+    if (value == NULL || value[0] == '\0')
+        return;
+
+    mbus_sink_puts(sink, ",");
+    mbus_sink_puts(sink, key);
+    mbus_sink_puts(sink, "=");
+    mbus_str_influxdb_encode_header_sink(sink, value);
+}
+
+//------------------------------------------------------------------------------
+/// Append the field set and the timestamp of a line. A numeric value is
+/// written as real_val (scaled or not), also integers and readings transmitted
+/// as text: one field type for all records.
+//------------------------------------------------------------------------------
+static void
+mbus_influxdb_fields(mbus_sink *sink, const mbus_data_value *value, int numeric, double real_val, long long timestamp)
+{
+    char str_buff[768];
+
+    if (numeric)
+    {
+        mbus_sink_puts(sink, " value=");
+        mbus_sink_put_double(sink, real_val);
+    }
+    else
+    {
+        mbus_data_value_format_r(value, str_buff, sizeof(str_buff));
+
+        mbus_sink_puts(sink, " text=\"");
+        mbus_str_influxdb_encode_sink(sink, str_buff);
+        mbus_sink_puts(sink, "\"");
+    }
+
+    mbus_sink_printf(sink, " %lld\n", timestamp);
+}
+
+//------------------------------------------------------------------------------
+/// Return a numeric value as double. Readings transmitted as text are parsed
+/// like mbus_data_value_is_numeric does.
+//------------------------------------------------------------------------------
+static double
+mbus_influxdb_real(const mbus_data_value *value)
+{
+    char str_buff[768];
+
+    switch (value->type)
+    {
+        case MBUS_DATA_VALUE_REAL:
+            return value->value.real;
+
+        case MBUS_DATA_VALUE_STRING:
+            mbus_data_value_format_r(value, str_buff, sizeof(str_buff));
+            return strtod(str_buff, NULL);
+
+        default:
+            return (double) value->value.integer;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Append the line of a variable data record, unless it is skipped by the
+/// options. Returns the number of lines written.
+//------------------------------------------------------------------------------
+static int
+mbus_influxdb_variable_record(mbus_influxdb_batch *batch, const char *prefix, mbus_data_record *record, int record_cnt, long long timestamp)
+{
+    mbus_sink *sink = &(batch->sink);
+    char str_buff[768];
+    mbus_data_value value;
+    const char *unit, *quantity;
+    double real_val = 0.0, scaled_val;
+    int numeric;
+    long tariff;
+
+    mbus_data_record_value_decode(record, &value);
+    numeric = mbus_data_value_is_numeric(&value) && !(value.type == MBUS_DATA_VALUE_BCD && value.bcd_error);
+
+    if (numeric)
+    {
+        // line protocol has no float for NaN and infinity (as IEEE value or
+        // as text), these are written as text
+        real_val = mbus_influxdb_real(&value);
+        numeric = isfinite(real_val);
+    }
+
+    if ((batch->options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !numeric)
+    {
+        return 0;
+    }
+
+    mbus_sink_puts(sink, prefix);
+    mbus_sink_printf(sink, ",record=%d", record_cnt);
+
+    if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC)
+    {
+        mbus_influxdb_tag(sink, "function", "Manufacturer specific");
+    }
+    else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    {
+        mbus_influxdb_tag(sink, "function", "More records follow");
+    }
+    else
+    {
+        mbus_influxdb_tag(sink, "function", mbus_data_record_function(record));
+
+        mbus_sink_printf(sink, ",storage=%ld", mbus_data_record_storage_number(record));
+
+        if ((tariff = mbus_data_record_tariff(record)) >= 0)
+        {
+            mbus_sink_printf(sink, ",tariff=%ld", tariff);
+            mbus_sink_printf(sink, ",device=%d", mbus_data_record_device(record));
+        }
+
+        if (batch->normalized)
+        {
+            // numeric values, including readings transmitted as text, are
+            // scaled to the unit of the tag
+            if (mbus_vib_unit_normalize(&(record->drh.vib), real_val, &unit, &scaled_val, &quantity) == 0)
+            {
+                mbus_influxdb_tag(sink, "unit", unit);
+                mbus_influxdb_tag(sink, "quantity", quantity);
+
+                real_val = scaled_val;
+            }
+        }
+        else
+        {
+            mbus_influxdb_tag(sink, "unit", mbus_data_record_unit_r(record, str_buff, sizeof(str_buff)));
+        }
+    }
+
+    mbus_influxdb_fields(sink, &value, numeric, real_val, timestamp);
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Write the measurement and the meter tags of variable data into prefix.
+//------------------------------------------------------------------------------
+static void
+mbus_influxdb_variable_prefix(mbus_influxdb_batch *batch, mbus_data_variable_header *header, char *prefix, size_t prefix_size)
+{
+    char str_buff[256];
+    mbus_sink sink;
+
+    mbus_sink_init_buffer(&sink, prefix, prefix_size);
+
+    mbus_sink_puts(&sink, batch->measurement);
+    mbus_sink_printf(&sink, ",id=%lld", mbus_data_bcd_decode(header->id_bcd, 4));
+    mbus_influxdb_tag(&sink, "manufacturer",
+                      mbus_decode_manufacturer_r(header->manufacturer[0], header->manufacturer[1], str_buff, sizeof(str_buff)));
+    mbus_influxdb_tag(&sink, "medium", mbus_data_variable_medium_lookup_r(header->medium, str_buff, sizeof(str_buff)));
+}
+
+//------------------------------------------------------------------------------
+/// Append the lines of fixed data, returns the number of lines written.
+//------------------------------------------------------------------------------
+static int
+mbus_influxdb_fixed(mbus_influxdb_batch *batch, mbus_data_fixed *data, long long timestamp)
+{
+    mbus_sink *sink = &(batch->sink);
+    char prefix[512];
+    mbus_sink prefix_sink;
+    mbus_data_value value;
+    const char *unit, *quantity;
+    unsigned char *cnt_val;
+    double real_val, scaled_val;
+    int i, type, val;
+
+    mbus_sink_init_buffer(&prefix_sink, prefix, sizeof(prefix));
+    mbus_sink_puts(&prefix_sink, batch->measurement);
+    mbus_sink_printf(&prefix_sink, ",id=%lld", mbus_data_bcd_decode(data->id_bcd, 4));
+    mbus_influxdb_tag(&prefix_sink, "medium", mbus_data_fixed_medium(data));
+
+    for (i = 0; i < 2; i++)
+    {
+        type    = (i == 0) ? data->cnt1_type : data->cnt2_type;
+        cnt_val = (i == 0) ? data->cnt1_val : data->cnt2_val;
+
+        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+        {
+            val = (int) mbus_data_bcd_decode(cnt_val, 4);
+        }
+        else
+        {
+            mbus_data_int_decode(cnt_val, 4, &val);
+        }
+
+        memset(&value, 0, sizeof(value));
+        value.type = MBUS_DATA_VALUE_INTEGER;
+        value.value.integer = val;
+
+        mbus_sink_puts(sink, prefix);
+        mbus_sink_printf(sink, ",record=%d", i);
+        mbus_influxdb_tag(sink, "function", mbus_data_fixed_function(data->status));
+
+        real_val = (double) val;
+
+        if (batch->normalized && mbus_data_fixed_normalize(type, val, &unit, &scaled_val, &quantity) == 0)
+        {
+            mbus_influxdb_tag(sink, "unit", unit);
+            mbus_influxdb_tag(sink, "quantity", quantity);
+
+            real_val = scaled_val;
+        }
+        else
+        {
+            mbus_influxdb_tag(sink, "unit", mbus_data_fixed_unit(type));
+        }
+
+        mbus_influxdb_fields(sink, &value, 1, real_val, timestamp);
+    }
+
+    return 2;
+}
+
+//------------------------------------------------------------------------------
+/// Undo a partly added meter.
+//------------------------------------------------------------------------------
+static void
+mbus_influxdb_batch_truncate(mbus_influxdb_batch *batch, size_t len)
+{
+    batch->sink.error = 0;
+    batch->sink.len   = len;
+
+    if (batch->sink.size > 0)
+        batch->sink.buff[len] = '\0';
+}
+
+//------------------------------------------------------------------------------
+/// Finish adding a meter: count its lines or undo it if the buffer could not
+/// be grown.
+//------------------------------------------------------------------------------
+static int
+mbus_influxdb_batch_commit(mbus_influxdb_batch *batch, size_t len, int lines)
+{
+    if (batch->sink.error)
+    {
+        mbus_influxdb_batch_truncate(batch, len);
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "Failed to grow InfluxDB batch buffer.");
+        return -1;
+    }
+
+    batch->lines += lines;
+    batch->meters++;
+
+    return lines;
+}
+
+//------------------------------------------------------------------------------
+// Initialize a batch.
+//------------------------------------------------------------------------------
+void
+mbus_influxdb_batch_init(mbus_influxdb_batch *batch, const char *measurement, int options, int normalized)
+{
+    mbus_sink sink;
+
+    if (batch == NULL)
+        return;
+
+    mbus_sink_init_buffer(&(batch->sink), NULL, 0);
+    mbus_record_arena_init(&(batch->arena));
+
+    // commas and spaces have to be escaped in measurement names
+    mbus_sink_init_buffer(&sink, batch->measurement, sizeof(batch->measurement));
+
+    for (measurement = measurement ? measurement : MBUS_INFLUXDB_MEASUREMENT; *measurement; measurement++)
+    {
+        if (*measurement == ',' || *measurement == ' ')
+            mbus_sink_puts(&sink, "\\");
+
+        mbus_sink_write(&sink, measurement, 1);
+    }
+
+    batch->options    = options;
+    batch->normalized = normalized;
+    batch->lines      = 0;
+    batch->meters     = 0;
+}
+
+//------------------------------------------------------------------------------
+// Add the records of parsed frame data to a batch.
+//------------------------------------------------------------------------------
+int
+mbus_influxdb_batch_add_frame_data(mbus_influxdb_batch *batch, mbus_frame_data *data, long long timestamp)
+{
+    mbus_data_record *record;
+    char prefix[512];
+    size_t len;
+    int i, lines = 0;
+
+    if (batch == NULL || data == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid parameter.");
+        return -1;
+    }
+
+    if (timestamp == 0)
+        timestamp = mbus_influxdb_timestamp();
+
+    len = batch->sink.len;
+
+    switch (data->type)
+    {
+        case MBUS_DATA_TYPE_FIXED:
+
+            lines = mbus_influxdb_fixed(batch, &(data->data_fix), timestamp);
+            break;
+
+        case MBUS_DATA_TYPE_VARIABLE:
+
+            mbus_influxdb_variable_prefix(batch, &(data->data_var.header), prefix, sizeof(prefix));
+
+            for (record = data->data_var.record, i = 0; record; record = record->next, i++)
+            {
+                lines += mbus_influxdb_variable_record(batch, prefix, record, i, timestamp);
+            }
+            break;
+
+        default:
+
+            // no meter data
+            return 0;
+    }
+
+    return mbus_influxdb_batch_commit(batch, len, lines);
+}
+
+//------------------------------------------------------------------------------
+// Add the records of a frame and the frames linked to it to a batch.
+//------------------------------------------------------------------------------
+int
+mbus_influxdb_batch_add_frame(mbus_influxdb_batch *batch, mbus_frame *frame, long long timestamp)
+{
+    mbus_frame_data frame_data;
+    mbus_data_record *record;
+    mbus_frame *iter;
+    char prefix[512];
+    size_t len;
+    int record_cnt = 0, lines = 0;
+
+    if (batch == NULL || frame == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid parameter.");
+        return -1;
+    }
+
+    memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+
+    if (mbus_frame_data_parse_arena(frame, &frame_data, &(batch->arena)) == -1)
+    {
+        mbus_record_arena_reset(&(batch->arena));
+        mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus data parse error.");
+        return -1;
+    }
+
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        mbus_record_arena_reset(&(batch->arena));
+        return mbus_influxdb_batch_add_frame_data(batch, &frame_data, timestamp);
+    }
+
+    if (timestamp == 0)
+        timestamp = mbus_influxdb_timestamp();
+
+    len = batch->sink.len;
+
+    // the meter tags of the first frame apply to the whole sequence
+    mbus_influxdb_variable_prefix(batch, &(frame_data.data_var.header), prefix, sizeof(prefix));
+
+    for (iter = frame; iter; iter = iter->next)
+    {
+        if (iter != frame && mbus_frame_data_parse_arena(iter, &frame_data, &(batch->arena)) == -1)
+        {
+            mbus_record_arena_reset(&(batch->arena));
+            mbus_influxdb_batch_truncate(batch, len);
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus variable data parse error.");
+            return -1;
+        }
+
+        for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
+        {
+            lines += mbus_influxdb_variable_record(batch, prefix, record, record_cnt, timestamp);
+        }
+
+        // release all records of the frame, the arena keeps its memory
+        mbus_record_arena_reset(&(batch->arena));
+    }
+
+    return mbus_influxdb_batch_commit(batch, len, lines);
+}
+
+//------------------------------------------------------------------------------
+// Lines of a batch.
+//------------------------------------------------------------------------------
+char *
+mbus_influxdb_batch_buffer(mbus_influxdb_batch *batch, size_t *len)
+{
+    if (batch == NULL)
+        return NULL;
+
+    return mbus_sink_buffer(&(batch->sink), len);
+}
+
+//------------------------------------------------------------------------------
+// Write the lines of a batch to a sink and empty the batch.
+//------------------------------------------------------------------------------
+int
+mbus_influxdb_batch_flush(mbus_influxdb_batch *batch, mbus_sink *sink)
+{
+    if (batch == NULL || sink == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid parameter.");
+        return -1;
+    }
+
+    if (mbus_sink_write(sink, batch->sink.buff, batch->sink.len) != 0 ||
+        mbus_sink_flush(sink) != 0)
+    {
+        mbus_error_set(MBUS_ERR_SEND, "Failed to write InfluxDB batch.");
+        return -1;
+    }
+
+    mbus_influxdb_batch_reset(batch);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Empty a batch.
+//------------------------------------------------------------------------------
+void
+mbus_influxdb_batch_reset(mbus_influxdb_batch *batch)
+{
+    if (batch == NULL)
+        return;
+
+    mbus_sink_reset(&(batch->sink));
+
+    batch->lines  = 0;
+    batch->meters = 0;
+}
+
+//------------------------------------------------------------------------------
+// Free the memory of a batch.
+//------------------------------------------------------------------------------
+void
+mbus_influxdb_batch_free(mbus_influxdb_batch *batch)
+{
+    if (batch == NULL)
+        return;
+
+    mbus_sink_free(&(batch->sink));
+    mbus_record_arena_free(&(batch->arena));
+
+    batch->lines  = 0;
+    batch->meters = 0;
+}
+
+//------------------------------------------------------------------------------
+// Current time in nanoseconds since the epoch.
+//------------------------------------------------------------------------------
+long long
+mbus_influxdb_timestamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
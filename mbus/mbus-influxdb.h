@@ -0,0 +1,159 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-influxdb.h
+ *
+ * @brief  Batched InfluxDB Line Protocol export of M-Bus frames.
+ *
+ * A batch collects the readings of many meters in a reusable buffer, which
+ * is then sent in one write (or one HTTP request). Every data record becomes
+ * a line of its own, tagged with the meter and the record description:
+ *
+\verbatim
+MBusData,id=6855817,manufacturer=KAM,medium=Heat:\ Outlet,record=1,function=Instantaneous\ value,storage=0,unit=Wh,quantity=Energy value=37351000 1318339200000000000
+\endverbatim
+ *
+ * Tags: id, manufacturer (variable data only), medium, record, function,
+ * storage, tariff and device (if present), unit and quantity (normalized
+ * values only). Tags with an empty value are left out. Numeric values are
+ * written to the float field "value", other values to the string field
+ * "text". The timestamp is the receive time in nanoseconds.
+ *
+\verbatim
+mbus_influxdb_batch batch;
+
+mbus_influxdb_batch_init(&batch, NULL, 0, 1);
+
+for (each meter)
+{
+    ... receive reply ...
+    mbus_influxdb_batch_add_frame(&batch, &reply, mbus_influxdb_timestamp());
+}
+
+mbus_influxdb_batch_flush(&batch, &out);   // one write, batch is empty again
+
+mbus_influxdb_batch_free(&batch);
+\endverbatim
+ */
+
+#ifndef _MBUS_INFLUXDB_H_
+#define _MBUS_INFLUXDB_H_
+
+#include <stddef.h>
+
+#include "mbus-protocol.h"
+#include "mbus-sink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_INFLUXDB_MEASUREMENT       "MBusData" // default measurement
+#define MBUS_INFLUXDB_MEASUREMENT_SIZE  64
+
+/**
+ * Batch of InfluxDB lines
+ */
+typedef struct _mbus_influxdb_batch {
+    mbus_sink sink;             /**< Lines of the batch (growing buffer) */
+    mbus_record_arena arena;    /**< Records of the frame being added */
+    char measurement[MBUS_INFLUXDB_MEASUREMENT_SIZE]; /**< Measurement name */
+    int options;                /**< MBUS_VALUE_OPTION_* */
+    int normalized;             /**< Write normalized values */
+    size_t lines;               /**< Lines in the batch */
+    size_t meters;              /**< Meters (frames or frame sequences) in the batch */
+} mbus_influxdb_batch;
+
+/**
+ * Initialize a batch.
+ *
+ * @param batch       Batch
+ * @param measurement Measurement name, NULL for MBUS_INFLUXDB_MEASUREMENT.
+ *                    Commas and spaces are escaped.
+ * @param options     MBUS_VALUE_OPTION_*
+ * @param normalized  Nonzero to write normalized values with unit and
+ *                    quantity tags
+ */
+void mbus_influxdb_batch_init(mbus_influxdb_batch *batch, const char *measurement, int options, int normalized);
+
+/**
+ * Add the records of a frame and the frames linked to it (multi-telegram
+ * reply) to a batch. The meter tags are taken from the first frame. If the
+ * frames cannot be parsed nothing is added.
+ *
+ * @param batch     Batch
+ * @param frame     First frame
+ * @param timestamp Receive time in nanoseconds since the epoch, 0 for the
+ *                  current time
+ *
+ * @return Number of lines added, -1 on errors.
+ */
+int mbus_influxdb_batch_add_frame(mbus_influxdb_batch *batch, mbus_frame *frame, long long timestamp);
+
+/**
+ * Add the records of parsed frame data to a batch. Error data adds no lines.
+ *
+ * @param batch     Batch
+ * @param data      Frame data
+ * @param timestamp Receive time in nanoseconds since the epoch, 0 for the
+ *                  current time
+ *
+ * @return Number of lines added, -1 on errors.
+ */
+int mbus_influxdb_batch_add_frame_data(mbus_influxdb_batch *batch, mbus_frame_data *data, long long timestamp);
+
+/**
+ * Lines of a batch.
+ *
+ * @param batch Batch
+ * @param len   Length of the data (if not NULL)
+ *
+ * @return Zero terminated lines, NULL on errors.
+ */
+char *mbus_influxdb_batch_buffer(mbus_influxdb_batch *batch, size_t *len);
+
+/**
+ * Write the lines of a batch to a sink in one write, flush the sink and
+ * empty the batch.
+ *
+ * @param batch Batch
+ * @param sink  Output sink
+ *
+ * @return Zero on success, -1 on errors (the batch is kept).
+ */
+int mbus_influxdb_batch_flush(mbus_influxdb_batch *batch, mbus_sink *sink);
+
+/**
+ * Empty a batch, keeping its memory for the next batch.
+ *
+ * @param batch Batch
+ */
+void mbus_influxdb_batch_reset(mbus_influxdb_batch *batch);
+
+/**
+ * Free the memory of a batch.
+ *
+ * @param batch Batch
+ */
+void mbus_influxdb_batch_free(mbus_influxdb_batch *batch);
+
+/**
+ * Current time for a batch line.
+ *
+ * @return Nanoseconds since the epoch.
+ */
+long long mbus_influxdb_timestamp(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_INFLUXDB_H_ */
@@ -0,0 +1,412 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "mbus-link.h"
+
+#define MBUS_LINK_HEADER "# libmbus link profile"
+
+// baudrates a slave can be switched to (CI 0xB8 - 0xBF)
+static const long mbus_link_baudrates[] = { 300, 600, 1200, 2400, 4800, 9600, 19200, 38400 };
+
+//------------------------------------------------------------------------------
+/// Check if a baudrate can be switched to.
+//------------------------------------------------------------------------------
+static int
+mbus_link_valid_baudrate(long baudrate)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(mbus_link_baudrates) / sizeof(mbus_link_baudrates[0]); i++)
+    {
+        if (mbus_link_baudrates[i] == baudrate)
+            return 1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Find the entry of a secondary address, NULL if there is none.
+//------------------------------------------------------------------------------
+static mbus_link_entry *
+mbus_link_profile_find(mbus_link_profile *profile, const char *secondary)
+{
+    size_t i;
+    int j;
+
+    for (i = 0; i < profile->count; i++)
+    {
+        for (j = 0; j < 16; j++)
+        {
+            if (profile->entries[i].secondary[j] != toupper(secondary[j]))
+                break;
+        }
+
+        if (j == 16)
+            return &profile->entries[i];
+    }
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+// Allocate an empty link profile.
+//------------------------------------------------------------------------------
+mbus_link_profile *
+mbus_link_profile_new(void)
+{
+    mbus_link_profile *profile;
+
+    if ((profile = (mbus_link_profile *) calloc(1, sizeof(mbus_link_profile))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate link profile.", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    return profile;
+}
+
+//------------------------------------------------------------------------------
+// Free a link profile.
+//------------------------------------------------------------------------------
+void
+mbus_link_profile_free(mbus_link_profile *profile)
+{
+    if (profile)
+    {
+        free(profile->entries);
+        free(profile);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Baudrate of a slave, 0 if unknown.
+//------------------------------------------------------------------------------
+long
+mbus_link_profile_get(mbus_link_profile *profile, const char *secondary)
+{
+    mbus_link_entry *entry;
+
+    if (profile == NULL || secondary == NULL || !mbus_is_secondary_address(secondary))
+        return 0;
+
+    entry = mbus_link_profile_find(profile, secondary);
+
+    return entry ? entry->baudrate : 0;
+}
+
+//------------------------------------------------------------------------------
+// Set the baudrate of a slave.
+//------------------------------------------------------------------------------
+int
+mbus_link_profile_set(mbus_link_profile *profile, const char *secondary, long baudrate)
+{
+    mbus_link_entry *entry;
+    int i;
+
+    if (profile == NULL || secondary == NULL || !mbus_is_secondary_address(secondary) ||
+        !mbus_link_valid_baudrate(baudrate))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid secondary address or baudrate.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((entry = mbus_link_profile_find(profile, secondary)) == NULL)
+    {
+        entry = (mbus_link_entry *) realloc(profile->entries, (profile->count + 1) * sizeof(mbus_link_entry));
+
+        if (entry == NULL)
+        {
+            mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate link profile entry.", __PRETTY_FUNCTION__);
+            return -1;
+        }
+
+        profile->entries = entry;
+        entry = &profile->entries[profile->count++];
+
+        for (i = 0; i < 16; i++)
+            entry->secondary[i] = toupper(secondary[i]);
+
+        entry->secondary[16] = '\0';
+    }
+
+    entry->baudrate = baudrate;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Add the entries of a profile file.
+//------------------------------------------------------------------------------
+int
+mbus_link_profile_load(mbus_link_profile *profile, const char *path)
+{
+    char line[256], secondary[17];
+    long baudrate;
+    FILE *fp;
+
+    if (profile == NULL || path == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        if (errno == ENOENT)
+            return 0;
+
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to open %s: %s", __PRETTY_FUNCTION__, path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (line[0] == '#')
+            continue;
+
+        if (sscanf(line, "%16s %ld", secondary, &baudrate) != 2 ||
+            mbus_link_profile_set(profile, secondary, baudrate) == -1)
+        {
+            // skip broken lines, the next probe rewrites them
+            continue;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Write a profile to a file.
+//------------------------------------------------------------------------------
+int
+mbus_link_profile_save(mbus_link_profile *profile, const char *path)
+{
+    char tmp_path[4096];
+    FILE *fp;
+    size_t i;
+
+    if (profile == NULL || path == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    if ((fp = fopen(tmp_path, "w")) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to create %s: %s", __PRETTY_FUNCTION__, tmp_path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "%s\n", MBUS_LINK_HEADER);
+
+    for (i = 0; i < profile->count; i++)
+    {
+        fprintf(fp, "%s %ld\n", profile->entries[i].secondary, profile->entries[i].baudrate);
+    }
+
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to write %s: %s", __PRETTY_FUNCTION__, path, strerror(errno));
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Let the selected slave switch to a baudrate. It acknowledges at the
+/// current baudrate and switches afterwards. Returns zero if acknowledged.
+//------------------------------------------------------------------------------
+static int
+mbus_link_switch_slave(mbus_handle *handle, long baudrate)
+{
+    mbus_frame reply;
+
+    if (mbus_send_switch_baudrate_frame(handle, MBUS_ADDRESS_NETWORK_LAYER, baudrate) == -1)
+        return -1;
+
+    memset((void *)&reply, 0, sizeof(mbus_frame));
+
+    if (mbus_recv_frame(handle, &reply) != MBUS_RECV_RESULT_OK ||
+        mbus_frame_type(&reply) != MBUS_FRAME_TYPE_ACK)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Check if the selected slave answers a REQ_UD2. Returns zero if it does.
+//------------------------------------------------------------------------------
+static int
+mbus_link_check(mbus_handle *handle)
+{
+    mbus_frame reply;
+    int ret;
+
+    if (mbus_send_request_frame(handle, MBUS_ADDRESS_NETWORK_LAYER) == -1)
+        return -1;
+
+    memset((void *)&reply, 0, sizeof(mbus_frame));
+
+    ret = mbus_recv_frame(handle, &reply);
+    mbus_frame_free(reply.next);
+
+    if (ret != MBUS_RECV_RESULT_OK)
+    {
+        mbus_purge_frames(handle);
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Find the highest baudrate a slave works at.
+//------------------------------------------------------------------------------
+long
+mbus_link_probe(mbus_handle *handle, const char *secondary, long baudrate)
+{
+    long best;
+    size_t i;
+    int ret;
+
+    if (handle == NULL || secondary == NULL || !mbus_is_secondary_address(secondary) ||
+        !mbus_link_valid_baudrate(baudrate))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid handle, secondary address or baudrate.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if (handle->set_baudrate == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: The transport cannot switch its baudrate.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((ret = mbus_select_secondary_address(handle, secondary)) == MBUS_PROBE_ERROR)
+        return -1;
+
+    if (ret != MBUS_PROBE_SINGLE || mbus_link_check(handle) != 0)
+        return 0;
+
+    best = baudrate;
+
+    for (i = 0; i < sizeof(mbus_link_baudrates) / sizeof(mbus_link_baudrates[0]); i++)
+    {
+        if (mbus_link_baudrates[i] <= best)
+            continue;
+
+        // a slave refusing a baudrate does not acknowledge the switch
+        if (mbus_link_switch_slave(handle, mbus_link_baudrates[i]) != 0)
+            break;
+
+        if (handle->set_baudrate(handle, mbus_link_baudrates[i]) == 0 && mbus_link_check(handle) == 0)
+        {
+            best = mbus_link_baudrates[i];
+            continue;
+        }
+
+        // the slave switched but does not answer (e.g. a long cable): switch
+        // it back, in case only its replies get lost
+        mbus_link_switch_slave(handle, best);
+        handle->set_baudrate(handle, best);
+        break;
+    }
+
+    if (best != baudrate && mbus_link_switch_slave(handle, baudrate) != 0)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to switch %s back to %ld baud.", __PRETTY_FUNCTION__, secondary, baudrate);
+        handle->set_baudrate(handle, baudrate);
+        return -1;
+    }
+
+    if (handle->set_baudrate(handle, baudrate) == -1)
+        return -1;
+
+    return best;
+}
+
+//------------------------------------------------------------------------------
+// Attach a link profile to a handle.
+//------------------------------------------------------------------------------
+int
+mbus_link_attach(mbus_handle *handle, mbus_link_profile *profile, long baudrate)
+{
+    if (handle == NULL || (profile && !mbus_link_valid_baudrate(baudrate)))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    handle->link_profile = profile;
+    handle->link_baudrate = profile ? baudrate : 0;
+    handle->link_switched = 0;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Switch the selected slave to the baudrate of the profile.
+//------------------------------------------------------------------------------
+long
+mbus_link_begin(mbus_handle *handle)
+{
+    long baudrate;
+
+    if (handle == NULL || handle->link_profile == NULL || handle->set_baudrate == NULL ||
+        handle->link_switched != 0 || handle->link_selected[0] == '\0')
+    {
+        return 0;
+    }
+
+    baudrate = mbus_link_profile_get(handle->link_profile, handle->link_selected);
+
+    if (baudrate <= 0 || baudrate == handle->link_baudrate)
+        return 0;
+
+    // without an acknowledge the request goes out at the bus baudrate
+    if (mbus_link_switch_slave(handle, baudrate) != 0)
+        return 0;
+
+    if (handle->set_baudrate(handle, baudrate) == -1)
+        return 0;
+
+    handle->link_switched = baudrate;
+
+    return baudrate;
+}
+
+//------------------------------------------------------------------------------
+// Switch the selected slave back to the bus baudrate.
+//------------------------------------------------------------------------------
+void
+mbus_link_end(mbus_handle *handle)
+{
+    if (handle == NULL || handle->link_switched == 0)
+        return;
+
+    mbus_link_switch_slave(handle, handle->link_baudrate);
+    handle->set_baudrate(handle, handle->link_baudrate);
+
+    handle->link_switched = 0;
+}
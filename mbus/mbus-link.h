@@ -0,0 +1,185 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-link.h
+ *
+ * @brief  Link profiles: the highest baudrate each slave works at, keyed by
+ *         its secondary address.
+ *
+ * All slaves of a bus share a common baudrate (usually 2400), many of them
+ * can be switched to a faster one (SND_UD with CI 0xB8 - 0xBF) though. The
+ * highest baudrate that works for a slave is found by mbus_link_probe and
+ * kept in a profile, which can be saved to and loaded from a text file:
+ *
+\verbatim
+# libmbus link profile
+6655443322110407 9600
+1234567810A51603 2400
+\endverbatim
+ *
+ * With a profile attached to a handle, a request to a slave selected by its
+ * secondary address (mbus_select_secondary_address, then mbus_sendrecv_request
+ * or mbus_read_slave) switches the slave and the host port to the baudrate
+ * of the profile, and both back to the bus baudrate after the transaction.
+ * This pays off for large (multi-telegram) replies.
+ *
+\verbatim
+mbus_link_profile *profile = mbus_link_profile_new();
+
+mbus_link_profile_load(profile, "bus1.links");
+mbus_link_attach(handle, profile, 2400);
+
+mbus_select_secondary_address(handle, "6655443322110407");
+mbus_sendrecv_request(handle, MBUS_ADDRESS_NETWORK_LAYER, &reply, 16);  // at 9600 baud
+...
+mbus_link_attach(handle, NULL, 0);
+mbus_link_profile_free(profile);
+\endverbatim
+ *
+ * The baudrate of the host port is switched by the transport (serial and
+ * simulated handles), TCP gateways keep their own.
+ */
+
+#ifndef _MBUS_LINK_H_
+#define _MBUS_LINK_H_
+
+#include <stddef.h>
+
+#include "mbus-protocol.h"
+#include "mbus-protocol-aux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Link profile entry
+ */
+typedef struct _mbus_link_entry {
+    char secondary[17];         /**< Secondary address */
+    long baudrate;              /**< Highest working baudrate */
+} mbus_link_entry;
+
+/**
+ * Link profile
+ */
+typedef struct _mbus_link_profile {
+    mbus_link_entry *entries;
+    size_t count;
+} mbus_link_profile;
+
+/**
+ * Allocate an empty link profile.
+ *
+ * @return Profile, NULL on errors.
+ */
+mbus_link_profile *mbus_link_profile_new(void);
+
+/**
+ * Free a link profile. Handles using it have to be detached first.
+ *
+ * @param profile Profile
+ */
+void mbus_link_profile_free(mbus_link_profile *profile);
+
+/**
+ * Add the entries of a profile file to a profile, a missing file adds none.
+ *
+ * @param profile Profile
+ * @param path    File name
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_link_profile_load(mbus_link_profile *profile, const char *path);
+
+/**
+ * Write a profile to a file (replaced atomically).
+ *
+ * @param profile Profile
+ * @param path    File name
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_link_profile_save(mbus_link_profile *profile, const char *path);
+
+/**
+ * Baudrate of a slave.
+ *
+ * @param profile   Profile
+ * @param secondary Secondary address (16 digits)
+ *
+ * @return Baudrate, 0 if the slave is not in the profile.
+ */
+long mbus_link_profile_get(mbus_link_profile *profile, const char *secondary);
+
+/**
+ * Set the baudrate of a slave.
+ *
+ * @param profile   Profile
+ * @param secondary Secondary address (16 digits)
+ * @param baudrate  Baudrate (300 - 38400)
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_link_profile_set(mbus_link_profile *profile, const char *secondary, long baudrate);
+
+/**
+ * Find the highest baudrate a slave works at. The slave is selected by its
+ * secondary address and switched to the next higher baudrate as long as it
+ * acknowledges the switch and answers a REQ_UD2 at the new baudrate. The
+ * slave and the host port are switched back to the bus baudrate afterwards.
+ *
+ * @param handle    Initialized handle, at the bus baudrate
+ * @param secondary Secondary address (16 digits)
+ * @param baudrate  Bus baudrate
+ *
+ * @return Highest working baudrate, 0 if the slave does not answer at the
+ *         bus baudrate, -1 on errors.
+ */
+long mbus_link_probe(mbus_handle *handle, const char *secondary, long baudrate);
+
+/**
+ * Attach a link profile to a handle (or detach it with NULL), so that the
+ * request functions switch the baudrate of the slaves in the profile.
+ *
+ * @param handle   Initialized handle
+ * @param profile  Profile, NULL to detach
+ * @param baudrate Bus baudrate, the baudrate of the host port outside of the
+ *                 requests
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_link_attach(mbus_handle *handle, mbus_link_profile *profile, long baudrate);
+
+/**
+ * Switch the selected slave and the host port to the baudrate of the profile
+ * attached to the handle, called by the request functions before a request
+ * to MBUS_ADDRESS_NETWORK_LAYER.
+ *
+ * @param handle Initialized handle
+ *
+ * @return Baudrate switched to, 0 if nothing was switched.
+ */
+long mbus_link_begin(mbus_handle *handle);
+
+/**
+ * Switch the selected slave and the host port back to the bus baudrate after
+ * mbus_link_begin switched them.
+ *
+ * @param handle Initialized handle
+ */
+void mbus_link_end(mbus_handle *handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_LINK_H_ */
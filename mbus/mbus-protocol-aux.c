@@ -14,11 +14,20 @@
 #include "mbus-protocol-aux.h"
 #include "mbus-serial.h"
 #include "mbus-tcp.h"
+#include "mbus-link.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+// line silence that ends a transmission, see mbus_purge_silence_time (the
+// serial constants are in mbus-serial.h)
+#define MBUS_TCP_LATENCY_MS       50
 
 /*@ignore@*/
 #define MBUS_ERROR(...) fprintf (stderr, __VA_ARGS__)
@@ -32,6 +41,15 @@
 
 static int debug = 0;
 
+//
+// The VIF tables are indexed directly by the (extended) VIF code: primary
+// VIFs 0x000 - 0x0FF, VIFE after 0xFD 0x100 - 0x1FF and VIFE after 0xFB
+// 0x200 - 0x2FF. Unused codes have no unit. Units and quantities are returned
+// as pointers to the static strings of the tables.
+//
+#define MBUS_VIF_TABLE_SIZE   0x300
+#define MBUS_FIXED_TABLE_SIZE 0x40
+
 typedef struct _mbus_variable_vif {
     unsigned     vif;
     double       exponent;
@@ -39,712 +57,706 @@ typedef struct _mbus_variable_vif {
     const char * quantity;
 } mbus_variable_vif;
 
-mbus_variable_vif vif_table[] = {
+static const mbus_variable_vif vif_table[MBUS_VIF_TABLE_SIZE] = {
 /*  Primary VIFs (main table), range 0x00 - 0xFF */
 
     /*  E000 0nnn    Energy Wh (0.001Wh to 10000Wh) */
-    { 0x00, 1.0e-3, "Wh", "Energy" },
-    { 0x01, 1.0e-2, "Wh", "Energy" },
-    { 0x02, 1.0e-1, "Wh", "Energy" },
-    { 0x03, 1.0e0,  "Wh", "Energy" },
-    { 0x04, 1.0e1,  "Wh", "Energy" },
-    { 0x05, 1.0e2,  "Wh", "Energy" },
-    { 0x06, 1.0e3,  "Wh", "Energy" },
-    { 0x07, 1.0e4,  "Wh", "Energy" },
+    [0x00] = { 0x00, 1.0e-3, "Wh", "Energy" },
+    [0x01] = { 0x01, 1.0e-2, "Wh", "Energy" },
+    [0x02] = { 0x02, 1.0e-1, "Wh", "Energy" },
+    [0x03] = { 0x03, 1.0e0,  "Wh", "Energy" },
+    [0x04] = { 0x04, 1.0e1,  "Wh", "Energy" },
+    [0x05] = { 0x05, 1.0e2,  "Wh", "Energy" },
+    [0x06] = { 0x06, 1.0e3,  "Wh", "Energy" },
+    [0x07] = { 0x07, 1.0e4,  "Wh", "Energy" },
 
     /* E000 1nnn    Energy  J (0.001kJ to 10000kJ) */
-    { 0x08, 1.0e0, "J", "Energy" },
-    { 0x09, 1.0e1, "J", "Energy" },
-    { 0x0A, 1.0e2, "J", "Energy" },
-    { 0x0B, 1.0e3, "J", "Energy" },
-    { 0x0C, 1.0e4, "J", "Energy" },
-    { 0x0D, 1.0e5, "J", "Energy" },
-    { 0x0E, 1.0e6, "J", "Energy" },
-    { 0x0F, 1.0e7, "J", "Energy" },
+    [0x08] = { 0x08, 1.0e0, "J", "Energy" },
+    [0x09] = { 0x09, 1.0e1, "J", "Energy" },
+    [0x0A] = { 0x0A, 1.0e2, "J", "Energy" },
+    [0x0B] = { 0x0B, 1.0e3, "J", "Energy" },
+    [0x0C] = { 0x0C, 1.0e4, "J", "Energy" },
+    [0x0D] = { 0x0D, 1.0e5, "J", "Energy" },
+    [0x0E] = { 0x0E, 1.0e6, "J", "Energy" },
+    [0x0F] = { 0x0F, 1.0e7, "J", "Energy" },
 
     /* E001 0nnn    Volume m^3 (0.001l to 10000l) */
-    { 0x10, 1.0e-6, "m^3", "Volume" },
-    { 0x11, 1.0e-5, "m^3", "Volume" },
-    { 0x12, 1.0e-4, "m^3", "Volume" },
-    { 0x13, 1.0e-3, "m^3", "Volume" },
-    { 0x14, 1.0e-2, "m^3", "Volume" },
-    { 0x15, 1.0e-1, "m^3", "Volume" },
-    { 0x16, 1.0e0,  "m^3", "Volume" },
-    { 0x17, 1.0e1,  "m^3", "Volume" },
+    [0x10] = { 0x10, 1.0e-6, "m^3", "Volume" },
+    [0x11] = { 0x11, 1.0e-5, "m^3", "Volume" },
+    [0x12] = { 0x12, 1.0e-4, "m^3", "Volume" },
+    [0x13] = { 0x13, 1.0e-3, "m^3", "Volume" },
+    [0x14] = { 0x14, 1.0e-2, "m^3", "Volume" },
+    [0x15] = { 0x15, 1.0e-1, "m^3", "Volume" },
+    [0x16] = { 0x16, 1.0e0,  "m^3", "Volume" },
+    [0x17] = { 0x17, 1.0e1,  "m^3", "Volume" },
 
     /* E001 1nnn    Mass kg (0.001kg to 10000kg) */
-    { 0x18, 1.0e-3, "kg", "Mass" },
-    { 0x19, 1.0e-2, "kg", "Mass" },
-    { 0x1A, 1.0e-1, "kg", "Mass" },
-    { 0x1B, 1.0e0,  "kg", "Mass" },
-    { 0x1C, 1.0e1,  "kg", "Mass" },
-    { 0x1D, 1.0e2,  "kg", "Mass" },
-    { 0x1E, 1.0e3,  "kg", "Mass" },
-    { 0x1F, 1.0e4,  "kg", "Mass" },
+    [0x18] = { 0x18, 1.0e-3, "kg", "Mass" },
+    [0x19] = { 0x19, 1.0e-2, "kg", "Mass" },
+    [0x1A] = { 0x1A, 1.0e-1, "kg", "Mass" },
+    [0x1B] = { 0x1B, 1.0e0,  "kg", "Mass" },
+    [0x1C] = { 0x1C, 1.0e1,  "kg", "Mass" },
+    [0x1D] = { 0x1D, 1.0e2,  "kg", "Mass" },
+    [0x1E] = { 0x1E, 1.0e3,  "kg", "Mass" },
+    [0x1F] = { 0x1F, 1.0e4,  "kg", "Mass" },
 
     /* E010 00nn    On Time s */
-    { 0x20,     1.0, "s", "On time" },  /* seconds */
-    { 0x21,    60.0, "s", "On time" },  /* minutes */
-    { 0x22,  3600.0, "s", "On time" },  /* hours   */
-    { 0x23, 86400.0, "s", "On time" },  /* days    */
+    [0x20] = { 0x20,     1.0, "s", "On time" },  /* seconds */
+    [0x21] = { 0x21,    60.0, "s", "On time" },  /* minutes */
+    [0x22] = { 0x22,  3600.0, "s", "On time" },  /* hours   */
+    [0x23] = { 0x23, 86400.0, "s", "On time" },  /* days    */
 
     /* E010 01nn    Operating Time s */
-    { 0x24,     1.0, "s", "Operating time" },  /* seconds */
-    { 0x25,    60.0, "s", "Operating time" },  /* minutes */
-    { 0x26,  3600.0, "s", "Operating time" },  /* hours   */
-    { 0x27, 86400.0, "s", "Operating time" },  /* days    */
+    [0x24] = { 0x24,     1.0, "s", "Operating time" },  /* seconds */
+    [0x25] = { 0x25,    60.0, "s", "Operating time" },  /* minutes */
+    [0x26] = { 0x26,  3600.0, "s", "Operating time" },  /* hours   */
+    [0x27] = { 0x27, 86400.0, "s", "Operating time" },  /* days    */
 
     /* E010 1nnn    Power W (0.001W to 10000W) */
-    { 0x28, 1.0e-3, "W", "Power" },
-    { 0x29, 1.0e-2, "W", "Power" },
-    { 0x2A, 1.0e-1, "W", "Power" },
-    { 0x2B, 1.0e0,  "W", "Power" },
-    { 0x2C, 1.0e1,  "W", "Power" },
-    { 0x2D, 1.0e2,  "W", "Power" },
-    { 0x2E, 1.0e3,  "W", "Power" },
-    { 0x2F, 1.0e4,  "W", "Power" },
+    [0x28] = { 0x28, 1.0e-3, "W", "Power" },
+    [0x29] = { 0x29, 1.0e-2, "W", "Power" },
+    [0x2A] = { 0x2A, 1.0e-1, "W", "Power" },
+    [0x2B] = { 0x2B, 1.0e0,  "W", "Power" },
+    [0x2C] = { 0x2C, 1.0e1,  "W", "Power" },
+    [0x2D] = { 0x2D, 1.0e2,  "W", "Power" },
+    [0x2E] = { 0x2E, 1.0e3,  "W", "Power" },
+    [0x2F] = { 0x2F, 1.0e4,  "W", "Power" },
 
     /* E011 0nnn    Power J/h (0.001kJ/h to 10000kJ/h) */
-    { 0x30, 1.0e0, "J/h", "Power" },
-    { 0x31, 1.0e1, "J/h", "Power" },
-    { 0x32, 1.0e2, "J/h", "Power" },
-    { 0x33, 1.0e3, "J/h", "Power" },
-    { 0x34, 1.0e4, "J/h", "Power" },
-    { 0x35, 1.0e5, "J/h", "Power" },
-    { 0x36, 1.0e6, "J/h", "Power" },
-    { 0x37, 1.0e7, "J/h", "Power" },
+    [0x30] = { 0x30, 1.0e0, "J/h", "Power" },
+    [0x31] = { 0x31, 1.0e1, "J/h", "Power" },
+    [0x32] = { 0x32, 1.0e2, "J/h", "Power" },
+    [0x33] = { 0x33, 1.0e3, "J/h", "Power" },
+    [0x34] = { 0x34, 1.0e4, "J/h", "Power" },
+    [0x35] = { 0x35, 1.0e5, "J/h", "Power" },
+    [0x36] = { 0x36, 1.0e6, "J/h", "Power" },
+    [0x37] = { 0x37, 1.0e7, "J/h", "Power" },
 
     /* E011 1nnn    Volume Flow m3/h (0.001l/h to 10000l/h) */
-    { 0x38, 1.0e-6, "m^3/h", "Volume flow" },
-    { 0x39, 1.0e-5, "m^3/h", "Volume flow" },
-    { 0x3A, 1.0e-4, "m^3/h", "Volume flow" },
-    { 0x3B, 1.0e-3, "m^3/h", "Volume flow" },
-    { 0x3C, 1.0e-2, "m^3/h", "Volume flow" },
-    { 0x3D, 1.0e-1, "m^3/h", "Volume flow" },
-    { 0x3E, 1.0e0,  "m^3/h", "Volume flow" },
-    { 0x3F, 1.0e1,  "m^3/h", "Volume flow" },
+    [0x38] = { 0x38, 1.0e-6, "m^3/h", "Volume flow" },
+    [0x39] = { 0x39, 1.0e-5, "m^3/h", "Volume flow" },
+    [0x3A] = { 0x3A, 1.0e-4, "m^3/h", "Volume flow" },
+    [0x3B] = { 0x3B, 1.0e-3, "m^3/h", "Volume flow" },
+    [0x3C] = { 0x3C, 1.0e-2, "m^3/h", "Volume flow" },
+    [0x3D] = { 0x3D, 1.0e-1, "m^3/h", "Volume flow" },
+    [0x3E] = { 0x3E, 1.0e0,  "m^3/h", "Volume flow" },
+    [0x3F] = { 0x3F, 1.0e1,  "m^3/h", "Volume flow" },
 
     /* E100 0nnn     Volume Flow ext.  m^3/min (0.0001l/min to 1000l/min) */
-    { 0x40, 1.0e-7, "m^3/min", "Volume flow" },
-    { 0x41, 1.0e-6, "m^3/min", "Volume flow" },
-    { 0x42, 1.0e-5, "m^3/min", "Volume flow" },
-    { 0x43, 1.0e-4, "m^3/min", "Volume flow" },
-    { 0x44, 1.0e-3, "m^3/min", "Volume flow" },
-    { 0x45, 1.0e-2, "m^3/min", "Volume flow" },
-    { 0x46, 1.0e-1, "m^3/min", "Volume flow" },
-    { 0x47, 1.0e0,  "m^3/min", "Volume flow" },
+    [0x40] = { 0x40, 1.0e-7, "m^3/min", "Volume flow" },
+    [0x41] = { 0x41, 1.0e-6, "m^3/min", "Volume flow" },
+    [0x42] = { 0x42, 1.0e-5, "m^3/min", "Volume flow" },
+    [0x43] = { 0x43, 1.0e-4, "m^3/min", "Volume flow" },
+    [0x44] = { 0x44, 1.0e-3, "m^3/min", "Volume flow" },
+    [0x45] = { 0x45, 1.0e-2, "m^3/min", "Volume flow" },
+    [0x46] = { 0x46, 1.0e-1, "m^3/min", "Volume flow" },
+    [0x47] = { 0x47, 1.0e0,  "m^3/min", "Volume flow" },
 
     /* E100 1nnn     Volume Flow ext.  m^3/s (0.001ml/s to 10000ml/s) */
-    { 0x48, 1.0e-9, "m^3/s", "Volume flow" },
-    { 0x49, 1.0e-8, "m^3/s", "Volume flow" },
-    { 0x4A, 1.0e-7, "m^3/s", "Volume flow" },
-    { 0x4B, 1.0e-6, "m^3/s", "Volume flow" },
-    { 0x4C, 1.0e-5, "m^3/s", "Volume flow" },
-    { 0x4D, 1.0e-4, "m^3/s", "Volume flow" },
-    { 0x4E, 1.0e-3, "m^3/s", "Volume flow" },
-    { 0x4F, 1.0e-2, "m^3/s", "Volume flow" },
+    [0x48] = { 0x48, 1.0e-9, "m^3/s", "Volume flow" },
+    [0x49] = { 0x49, 1.0e-8, "m^3/s", "Volume flow" },
+    [0x4A] = { 0x4A, 1.0e-7, "m^3/s", "Volume flow" },
+    [0x4B] = { 0x4B, 1.0e-6, "m^3/s", "Volume flow" },
+    [0x4C] = { 0x4C, 1.0e-5, "m^3/s", "Volume flow" },
+    [0x4D] = { 0x4D, 1.0e-4, "m^3/s", "Volume flow" },
+    [0x4E] = { 0x4E, 1.0e-3, "m^3/s", "Volume flow" },
+    [0x4F] = { 0x4F, 1.0e-2, "m^3/s", "Volume flow" },
 
     /* E101 0nnn     Mass flow kg/h (0.001kg/h to 10000kg/h) */
-    { 0x50, 1.0e-3, "kg/h", "Mass flow" },
-    { 0x51, 1.0e-2, "kg/h", "Mass flow" },
-    { 0x52, 1.0e-1, "kg/h", "Mass flow" },
-    { 0x53, 1.0e0,  "kg/h", "Mass flow" },
-    { 0x54, 1.0e1,  "kg/h", "Mass flow" },
-    { 0x55, 1.0e2,  "kg/h", "Mass flow" },
-    { 0x56, 1.0e3,  "kg/h", "Mass flow" },
-    { 0x57, 1.0e4,  "kg/h", "Mass flow" },
+    [0x50] = { 0x50, 1.0e-3, "kg/h", "Mass flow" },
+    [0x51] = { 0x51, 1.0e-2, "kg/h", "Mass flow" },
+    [0x52] = { 0x52, 1.0e-1, "kg/h", "Mass flow" },
+    [0x53] = { 0x53, 1.0e0,  "kg/h", "Mass flow" },
+    [0x54] = { 0x54, 1.0e1,  "kg/h", "Mass flow" },
+    [0x55] = { 0x55, 1.0e2,  "kg/h", "Mass flow" },
+    [0x56] = { 0x56, 1.0e3,  "kg/h", "Mass flow" },
+    [0x57] = { 0x57, 1.0e4,  "kg/h", "Mass flow" },
 
     /* E101 10nn     Flow Temperature C (0.001C to 1C) */
-    { 0x58, 1.0e-3, "C", "Flow temperature" },
-    { 0x59, 1.0e-2, "C", "Flow temperature" },
-    { 0x5A, 1.0e-1, "C", "Flow temperature" },
-    { 0x5B, 1.0e0,  "C", "Flow temperature" },
+    [0x58] = { 0x58, 1.0e-3, "C", "Flow temperature" },
+    [0x59] = { 0x59, 1.0e-2, "C", "Flow temperature" },
+    [0x5A] = { 0x5A, 1.0e-1, "C", "Flow temperature" },
+    [0x5B] = { 0x5B, 1.0e0,  "C", "Flow temperature" },
 
     /* E101 11nn Return Temperature C (0.001C to 1C) */
-    { 0x5C, 1.0e-3, "C", "Return temperature" },
-    { 0x5D, 1.0e-2, "C", "Return temperature" },
-    { 0x5E, 1.0e-1, "C", "Return temperature" },
-    { 0x5F, 1.0e0,  "C", "Return temperature" },
+    [0x5C] = { 0x5C, 1.0e-3, "C", "Return temperature" },
+    [0x5D] = { 0x5D, 1.0e-2, "C", "Return temperature" },
+    [0x5E] = { 0x5E, 1.0e-1, "C", "Return temperature" },
+    [0x5F] = { 0x5F, 1.0e0,  "C", "Return temperature" },
 
     /* E110 00nn    Temperature Difference  K   (mK to  K) */
-    { 0x60, 1.0e-3, "K", "Temperature difference" },
-    { 0x61, 1.0e-2, "K", "Temperature difference" },
-    { 0x62, 1.0e-1, "K", "Temperature difference" },
-    { 0x63, 1.0e0,  "K", "Temperature difference" },
+    [0x60] = { 0x60, 1.0e-3, "K", "Temperature difference" },
+    [0x61] = { 0x61, 1.0e-2, "K", "Temperature difference" },
+    [0x62] = { 0x62, 1.0e-1, "K", "Temperature difference" },
+    [0x63] = { 0x63, 1.0e0,  "K", "Temperature difference" },
 
     /* E110 01nn     External Temperature C (0.001C to 1C) */
-    { 0x64, 1.0e-3, "C", "External temperature" },
-    { 0x65, 1.0e-2, "C", "External temperature" },
-    { 0x66, 1.0e-1, "C", "External temperature" },
-    { 0x67, 1.0e0,  "C", "External temperature" },
+    [0x64] = { 0x64, 1.0e-3, "C", "External temperature" },
+    [0x65] = { 0x65, 1.0e-2, "C", "External temperature" },
+    [0x66] = { 0x66, 1.0e-1, "C", "External temperature" },
+    [0x67] = { 0x67, 1.0e0,  "C", "External temperature" },
 
     /* E110 10nn     Pressure bar (1mbar to 1000mbar) */
-    { 0x68, 1.0e-3, "bar", "Pressure" },
-    { 0x69, 1.0e-2, "bar", "Pressure" },
-    { 0x6A, 1.0e-1, "bar", "Pressure" },
-    { 0x6B, 1.0e0,  "bar", "Pressure" },
+    [0x68] = { 0x68, 1.0e-3, "bar", "Pressure" },
+    [0x69] = { 0x69, 1.0e-2, "bar", "Pressure" },
+    [0x6A] = { 0x6A, 1.0e-1, "bar", "Pressure" },
+    [0x6B] = { 0x6B, 1.0e0,  "bar", "Pressure" },
 
     /* E110 110n     Time Point */
-    { 0x6C, 1.0e0, "-", "Time point (date)" },            /* n = 0        date, data type G */
-    { 0x6D, 1.0e0, "-", "Time point (date & time)" },     /* n = 1 time & date, data type F */
+    [0x6C] = { 0x6C, 1.0e0, "-", "Time point (date)" },            /* n = 0        date, data type G */
+    [0x6D] = { 0x6D, 1.0e0, "-", "Time point (date & time)" },     /* n = 1 time & date, data type F */
 
     /* E110 1110     Units for H.C.A. dimensionless */
-    { 0x6E, 1.0e0,  "Units for H.C.A.", "H.C.A." },
+    [0x6E] = { 0x6E, 1.0e0,  "Units for H.C.A.", "H.C.A." },
 
     /* E110 1111     Reserved */
-    { 0x6F, 0.0,  "Reserved", "Reserved" },
+    [0x6F] = { 0x6F, 0.0,  "Reserved", "Reserved" },
 
     /* E111 00nn     Averaging Duration s */
-    { 0x70,     1.0, "s", "Averaging Duration" },  /* seconds */
-    { 0x71,    60.0, "s", "Averaging Duration" },  /* minutes */
-    { 0x72,  3600.0, "s", "Averaging Duration" },  /* hours   */
-    { 0x73, 86400.0, "s", "Averaging Duration" },  /* days    */
+    [0x70] = { 0x70,     1.0, "s", "Averaging Duration" },  /* seconds */
+    [0x71] = { 0x71,    60.0, "s", "Averaging Duration" },  /* minutes */
+    [0x72] = { 0x72,  3600.0, "s", "Averaging Duration" },  /* hours   */
+    [0x73] = { 0x73, 86400.0, "s", "Averaging Duration" },  /* days    */
 
     /* E111 01nn     Actuality Duration s */
-    { 0x74,     1.0, "s", "Averaging Duration" },  /* seconds */
-    { 0x75,    60.0, "s", "Averaging Duration" },  /* minutes */
-    { 0x76,  3600.0, "s", "Averaging Duration" },  /* hours   */
-    { 0x77, 86400.0, "s", "Averaging Duration" },  /* days    */
+    [0x74] = { 0x74,     1.0, "s", "Averaging Duration" },  /* seconds */
+    [0x75] = { 0x75,    60.0, "s", "Averaging Duration" },  /* minutes */
+    [0x76] = { 0x76,  3600.0, "s", "Averaging Duration" },  /* hours   */
+    [0x77] = { 0x77, 86400.0, "s", "Averaging Duration" },  /* days    */
 
     /* Fabrication No */
-    { 0x78, 1.0, "", "Fabrication No" },
+    [0x78] = { 0x78, 1.0, "", "Fabrication No" },
 
     /* E111 1001 (Enhanced) Identification */
-    { 0x79, 1.0, "", "(Enhanced) Identification" },
+    [0x79] = { 0x79, 1.0, "", "(Enhanced) Identification" },
 
     /* E111 1010 Bus Address */
-    { 0x7A, 1.0, "", "Bus Address" },
+    [0x7A] = { 0x7A, 1.0, "", "Bus Address" },
 
     /* Any VIF: 7Eh */
-    { 0x7E, 1.0, "", "Any VIF" },
+    [0x7E] = { 0x7E, 1.0, "", "Any VIF" },
 
     /* Manufacturer specific: 7Fh */
-    { 0x7F, 1.0, "", "Manufacturer specific" },
+    [0x7F] = { 0x7F, 1.0, "", "Manufacturer specific" },
 
     /* Any VIF: 7Eh */
-    { 0xFE, 1.0, "", "Any VIF" },
+    [0xFE] = { 0xFE, 1.0, "", "Any VIF" },
 
     /* Manufacturer specific: FFh */
-    { 0xFF, 1.0, "", "Manufacturer specific" },
+    [0xFF] = { 0xFF, 1.0, "", "Manufacturer specific" },
 
 
 /* Main VIFE-Code Extension table (following VIF=FDh for primary VIF)
    See 8.4.4 a, only some of them are here. Using range 0x100 - 0x1FF */
 
     /* E000 00nn   Credit of 10nn-3 of the nominal local legal currency units */
-    { 0x100, 1.0e-3, "Currency units", "Credit" },
-    { 0x101, 1.0e-2, "Currency units", "Credit" },
-    { 0x102, 1.0e-1, "Currency units", "Credit" },
-    { 0x103, 1.0e0,  "Currency units", "Credit" },
+    [0x100] = { 0x100, 1.0e-3, "Currency units", "Credit" },
+    [0x101] = { 0x101, 1.0e-2, "Currency units", "Credit" },
+    [0x102] = { 0x102, 1.0e-1, "Currency units", "Credit" },
+    [0x103] = { 0x103, 1.0e0,  "Currency units", "Credit" },
 
     /* E000 01nn   Debit of 10nn-3 of the nominal local legal currency units */
-    { 0x104, 1.0e-3, "Currency units", "Debit" },
-    { 0x105, 1.0e-2, "Currency units", "Debit" },
-    { 0x106, 1.0e-1, "Currency units", "Debit" },
-    { 0x107, 1.0e0,  "Currency units", "Debit" },
+    [0x104] = { 0x104, 1.0e-3, "Currency units", "Debit" },
+    [0x105] = { 0x105, 1.0e-2, "Currency units", "Debit" },
+    [0x106] = { 0x106, 1.0e-1, "Currency units", "Debit" },
+    [0x107] = { 0x107, 1.0e0,  "Currency units", "Debit" },
 
     /* E000 1000 Access Number (transmission count) */
-    { 0x108, 1.0e0,  "", "Access Number (transmission count)" },
+    [0x108] = { 0x108, 1.0e0,  "", "Access Number (transmission count)" },
 
     /* E000 1001 Medium (as in fixed header) */
-    { 0x109, 1.0e0,  "", "Device type" },
+    [0x109] = { 0x109, 1.0e0,  "", "Device type" },
 
     /* E000 1010 Manufacturer (as in fixed header) */
-    { 0x10A, 1.0e0,  "", "Manufacturer" },
+    [0x10A] = { 0x10A, 1.0e0,  "", "Manufacturer" },
 
     /* E000 1011 Parameter set identification */
-    { 0x10B, 1.0e0,  "", "Parameter set identification" },
+    [0x10B] = { 0x10B, 1.0e0,  "", "Parameter set identification" },
 
     /* E000 1100 Model / Version */
-    { 0x10C, 1.0e0,  "", "Device type" },
+    [0x10C] = { 0x10C, 1.0e0,  "", "Device type" },
 
     /* E000 1101 Hardware version # */
-    { 0x10D, 1.0e0,  "", "Hardware version" },
+    [0x10D] = { 0x10D, 1.0e0,  "", "Hardware version" },
 
     /* E000 1110 Firmware version # */
-    { 0x10E, 1.0e0,  "", "Firmware version" },
+    [0x10E] = { 0x10E, 1.0e0,  "", "Firmware version" },
 
     /* E000 1111 Software version # */
-    { 0x10F, 1.0e0,  "", "Software version" },
+    [0x10F] = { 0x10F, 1.0e0,  "", "Software version" },
 
 
     /* E001 0000 Customer location */
-    { 0x110, 1.0e0,  "", "Customer location" },
+    [0x110] = { 0x110, 1.0e0,  "", "Customer location" },
 
     /* E001 0001 Customer */
-    { 0x111, 1.0e0,  "", "Customer" },
+    [0x111] = { 0x111, 1.0e0,  "", "Customer" },
 
     /* E001 0010 Access Code User */
-    { 0x112, 1.0e0,  "", "Access Code User" },
+    [0x112] = { 0x112, 1.0e0,  "", "Access Code User" },
 
     /* E001 0011 Access Code Operator */
-    { 0x113, 1.0e0,  "", "Access Code Operator" },
+    [0x113] = { 0x113, 1.0e0,  "", "Access Code Operator" },
 
     /* E001 0100 Access Code System Operator */
-    { 0x114, 1.0e0,  "", "Access Code System Operator" },
+    [0x114] = { 0x114, 1.0e0,  "", "Access Code System Operator" },
 
     /* E001 0101 Access Code Developer */
-    { 0x115, 1.0e0,  "", "Access Code Developer" },
+    [0x115] = { 0x115, 1.0e0,  "", "Access Code Developer" },
 
     /* E001 0110 Password */
-    { 0x116, 1.0e0,  "", "Password" },
+    [0x116] = { 0x116, 1.0e0,  "", "Password" },
 
     /* E001 0111 Error flags (binary) */
-    { 0x117, 1.0e0,  "", "Error flags" },
+    [0x117] = { 0x117, 1.0e0,  "", "Error flags" },
 
     /* E001 1000 Error mask */
-    { 0x118, 1.0e0,  "", "Error mask" },
+    [0x118] = { 0x118, 1.0e0,  "", "Error mask" },
 
     /* E001 1001 Reserved */
-    { 0x119, 1.0e0,  "Reserved", "Reserved" },
+    [0x119] = { 0x119, 1.0e0,  "Reserved", "Reserved" },
 
 
     /* E001 1010 Digital Output (binary) */
-    { 0x11A, 1.0e0,  "", "Digital Output" },
+    [0x11A] = { 0x11A, 1.0e0,  "", "Digital Output" },
 
     /* E001 1011 Digital Input (binary) */
-    { 0x11B, 1.0e0,  "", "Digital Input" },
+    [0x11B] = { 0x11B, 1.0e0,  "", "Digital Input" },
 
     /* E001 1100 Baudrate [Baud] */
-    { 0x11C, 1.0e0,  "Baud", "Baudrate" },
+    [0x11C] = { 0x11C, 1.0e0,  "Baud", "Baudrate" },
 
     /* E001 1101 Response delay time [bittimes] */
-    { 0x11D, 1.0e0,  "Bittimes", "Response delay time" },
+    [0x11D] = { 0x11D, 1.0e0,  "Bittimes", "Response delay time" },
 
     /* E001 1110 Retry */
-    { 0x11E, 1.0e0,  "", "Retry" },
+    [0x11E] = { 0x11E, 1.0e0,  "", "Retry" },
 
     /* E001 1111 Reserved */
-    { 0x11F, 1.0e0,  "Reserved", "Reserved" },
+    [0x11F] = { 0x11F, 1.0e0,  "Reserved", "Reserved" },
 
 
     /* E010 0000 First storage # for cyclic storage */
-    { 0x120, 1.0e0,  "", "First storage # for cyclic storage" },
+    [0x120] = { 0x120, 1.0e0,  "", "First storage # for cyclic storage" },
 
     /* E010 0001 Last storage # for cyclic storage */
-    { 0x121, 1.0e0,  "", "Last storage # for cyclic storage" },
+    [0x121] = { 0x121, 1.0e0,  "", "Last storage # for cyclic storage" },
 
     /* E010 0010 Size of storage block */
-    { 0x122, 1.0e0,  "", "Size of storage block" },
+    [0x122] = { 0x122, 1.0e0,  "", "Size of storage block" },
 
     /* E010 0011 Reserved */
-    { 0x123, 1.0e0,  "Reserved", "Reserved" },
+    [0x123] = { 0x123, 1.0e0,  "Reserved", "Reserved" },
 
     /* E010 01nn Storage interval [sec(s)..day(s)] */
-    { 0x124,        1.0,  "s", "Storage interval" },   /* second(s) */
-    { 0x125,       60.0,  "s", "Storage interval" },   /* minute(s) */
-    { 0x126,     3600.0,  "s", "Storage interval" },   /* hour(s)   */
-    { 0x127,    86400.0,  "s", "Storage interval" },   /* day(s)    */
-    { 0x128,  2629743.83, "s", "Storage interval" },   /* month(s)  */
-    { 0x129, 31556926.0,  "s", "Storage interval" },   /* year(s)   */
+    [0x124] = { 0x124,        1.0,  "s", "Storage interval" },   /* second(s) */
+    [0x125] = { 0x125,       60.0,  "s", "Storage interval" },   /* minute(s) */
+    [0x126] = { 0x126,     3600.0,  "s", "Storage interval" },   /* hour(s)   */
+    [0x127] = { 0x127,    86400.0,  "s", "Storage interval" },   /* day(s)    */
+    [0x128] = { 0x128,  2629743.83, "s", "Storage interval" },   /* month(s)  */
+    [0x129] = { 0x129, 31556926.0,  "s", "Storage interval" },   /* year(s)   */
 
     /* E010 1010 Reserved */
-    { 0x12A, 1.0e0,  "Reserved", "Reserved" },
+    [0x12A] = { 0x12A, 1.0e0,  "Reserved", "Reserved" },
 
     /* E010 1011 Reserved */
-    { 0x12B, 1.0e0,  "Reserved", "Reserved" },
+    [0x12B] = { 0x12B, 1.0e0,  "Reserved", "Reserved" },
 
     /* E010 11nn Duration since last readout [sec(s)..day(s)] */
-    { 0x12C,     1.0, "s", "Duration since last readout" },  /* seconds */
-    { 0x12D,    60.0, "s", "Duration since last readout" },  /* minutes */
-    { 0x12E,  3600.0, "s", "Duration since last readout" },  /* hours   */
-    { 0x12F, 86400.0, "s", "Duration since last readout" },  /* days    */
+    [0x12C] = { 0x12C,     1.0, "s", "Duration since last readout" },  /* seconds */
+    [0x12D] = { 0x12D,    60.0, "s", "Duration since last readout" },  /* minutes */
+    [0x12E] = { 0x12E,  3600.0, "s", "Duration since last readout" },  /* hours   */
+    [0x12F] = { 0x12F, 86400.0, "s", "Duration since last readout" },  /* days    */
 
     /* E011 0000 Start (date/time) of tariff  */
     /* The information about usage of data type F (date and time) or data type G (date) can */
     /* be derived from the datafield (0010b: type G / 0100: type F). */
-    { 0x130, 1.0e0,  "Reserved", "Reserved" }, /* ???? */
+    [0x130] = { 0x130, 1.0e0,  "Reserved", "Reserved" }, /* ???? */
 
     /* E011 00nn Duration of tariff (nn=01 ..11: min to days) */
-    { 0x131,       60.0,  "s", "Storage interval" },   /* minute(s) */
-    { 0x132,     3600.0,  "s", "Storage interval" },   /* hour(s)   */
-    { 0x133,    86400.0,  "s", "Storage interval" },   /* day(s)    */
+    [0x131] = { 0x131,       60.0,  "s", "Storage interval" },   /* minute(s) */
+    [0x132] = { 0x132,     3600.0,  "s", "Storage interval" },   /* hour(s)   */
+    [0x133] = { 0x133,    86400.0,  "s", "Storage interval" },   /* day(s)    */
 
     /* E011 01nn Period of tariff [sec(s) to day(s)]  */
-    { 0x134,        1.0, "s", "Period of tariff" },  /* seconds  */
-    { 0x135,       60.0, "s", "Period of tariff" },  /* minutes  */
-    { 0x136,     3600.0, "s", "Period of tariff" },  /* hours    */
-    { 0x137,    86400.0, "s", "Period of tariff" },  /* days     */
-    { 0x138,  2629743.83,"s", "Period of tariff" },  /* month(s) */
-    { 0x139, 31556926.0, "s", "Period of tariff" },  /* year(s)  */
+    [0x134] = { 0x134,        1.0, "s", "Period of tariff" },  /* seconds  */
+    [0x135] = { 0x135,       60.0, "s", "Period of tariff" },  /* minutes  */
+    [0x136] = { 0x136,     3600.0, "s", "Period of tariff" },  /* hours    */
+    [0x137] = { 0x137,    86400.0, "s", "Period of tariff" },  /* days     */
+    [0x138] = { 0x138,  2629743.83,"s", "Period of tariff" },  /* month(s) */
+    [0x139] = { 0x139, 31556926.0, "s", "Period of tariff" },  /* year(s)  */
 
     /* E011 1010 dimensionless / no VIF */
-    { 0x13A, 1.0e0,  "", "Dimensionless" },
+    [0x13A] = { 0x13A, 1.0e0,  "", "Dimensionless" },
 
     /* E011 1011 Reserved */
-    { 0x13B, 1.0e0,  "Reserved", "Reserved" },
+    [0x13B] = { 0x13B, 1.0e0,  "Reserved", "Reserved" },
 
     /* E011 11xx Reserved */
-    { 0x13C, 1.0e0,  "Reserved", "Reserved" },
-    { 0x13D, 1.0e0,  "Reserved", "Reserved" },
-    { 0x13E, 1.0e0,  "Reserved", "Reserved" },
-    { 0x13F, 1.0e0,  "Reserved", "Reserved" },
+    [0x13C] = { 0x13C, 1.0e0,  "Reserved", "Reserved" },
+    [0x13D] = { 0x13D, 1.0e0,  "Reserved", "Reserved" },
+    [0x13E] = { 0x13E, 1.0e0,  "Reserved", "Reserved" },
+    [0x13F] = { 0x13F, 1.0e0,  "Reserved", "Reserved" },
 
     /* E100 nnnn   Volts electrical units */
-    { 0x140, 1.0e-9, "V", "Voltage" },
-    { 0x141, 1.0e-8, "V", "Voltage" },
-    { 0x142, 1.0e-7, "V", "Voltage" },
-    { 0x143, 1.0e-6, "V", "Voltage" },
-    { 0x144, 1.0e-5, "V", "Voltage" },
-    { 0x145, 1.0e-4, "V", "Voltage" },
-    { 0x146, 1.0e-3, "V", "Voltage" },
-    { 0x147, 1.0e-2, "V", "Voltage" },
-    { 0x148, 1.0e-1, "V", "Voltage" },
-    { 0x149, 1.0e0,  "V", "Voltage" },
-    { 0x14A, 1.0e1,  "V", "Voltage" },
-    { 0x14B, 1.0e2,  "V", "Voltage" },
-    { 0x14C, 1.0e3,  "V", "Voltage" },
-    { 0x14D, 1.0e4,  "V", "Voltage" },
-    { 0x14E, 1.0e5,  "V", "Voltage" },
-    { 0x14F, 1.0e6,  "V", "Voltage" },
+    [0x140] = { 0x140, 1.0e-9, "V", "Voltage" },
+    [0x141] = { 0x141, 1.0e-8, "V", "Voltage" },
+    [0x142] = { 0x142, 1.0e-7, "V", "Voltage" },
+    [0x143] = { 0x143, 1.0e-6, "V", "Voltage" },
+    [0x144] = { 0x144, 1.0e-5, "V", "Voltage" },
+    [0x145] = { 0x145, 1.0e-4, "V", "Voltage" },
+    [0x146] = { 0x146, 1.0e-3, "V", "Voltage" },
+    [0x147] = { 0x147, 1.0e-2, "V", "Voltage" },
+    [0x148] = { 0x148, 1.0e-1, "V", "Voltage" },
+    [0x149] = { 0x149, 1.0e0,  "V", "Voltage" },
+    [0x14A] = { 0x14A, 1.0e1,  "V", "Voltage" },
+    [0x14B] = { 0x14B, 1.0e2,  "V", "Voltage" },
+    [0x14C] = { 0x14C, 1.0e3,  "V", "Voltage" },
+    [0x14D] = { 0x14D, 1.0e4,  "V", "Voltage" },
+    [0x14E] = { 0x14E, 1.0e5,  "V", "Voltage" },
+    [0x14F] = { 0x14F, 1.0e6,  "V", "Voltage" },
 
     /* E101 nnnn   A */
-    { 0x150, 1.0e-12, "A", "Current" },
-    { 0x151, 1.0e-11, "A", "Current" },
-    { 0x152, 1.0e-10, "A", "Current" },
-    { 0x153, 1.0e-9,  "A", "Current" },
-    { 0x154, 1.0e-8,  "A", "Current" },
-    { 0x155, 1.0e-7,  "A", "Current" },
-    { 0x156, 1.0e-6,  "A", "Current" },
-    { 0x157, 1.0e-5,  "A", "Current" },
-    { 0x158, 1.0e-4,  "A", "Current" },
-    { 0x159, 1.0e-3,  "A", "Current" },
-    { 0x15A, 1.0e-2,  "A", "Current" },
-    { 0x15B, 1.0e-1,  "A", "Current" },
-    { 0x15C, 1.0e0,   "A", "Current" },
-    { 0x15D, 1.0e1,   "A", "Current" },
-    { 0x15E, 1.0e2,   "A", "Current" },
-    { 0x15F, 1.0e3,   "A", "Current" },
+    [0x150] = { 0x150, 1.0e-12, "A", "Current" },
+    [0x151] = { 0x151, 1.0e-11, "A", "Current" },
+    [0x152] = { 0x152, 1.0e-10, "A", "Current" },
+    [0x153] = { 0x153, 1.0e-9,  "A", "Current" },
+    [0x154] = { 0x154, 1.0e-8,  "A", "Current" },
+    [0x155] = { 0x155, 1.0e-7,  "A", "Current" },
+    [0x156] = { 0x156, 1.0e-6,  "A", "Current" },
+    [0x157] = { 0x157, 1.0e-5,  "A", "Current" },
+    [0x158] = { 0x158, 1.0e-4,  "A", "Current" },
+    [0x159] = { 0x159, 1.0e-3,  "A", "Current" },
+    [0x15A] = { 0x15A, 1.0e-2,  "A", "Current" },
+    [0x15B] = { 0x15B, 1.0e-1,  "A", "Current" },
+    [0x15C] = { 0x15C, 1.0e0,   "A", "Current" },
+    [0x15D] = { 0x15D, 1.0e1,   "A", "Current" },
+    [0x15E] = { 0x15E, 1.0e2,   "A", "Current" },
+    [0x15F] = { 0x15F, 1.0e3,   "A", "Current" },
 
     /* E110 0000 Reset counter */
-    { 0x160, 1.0e0,  "", "Reset counter" },
+    [0x160] = { 0x160, 1.0e0,  "", "Reset counter" },
 
     /* E110 0001 Cumulation counter */
-    { 0x161, 1.0e0,  "", "Cumulation counter" },
+    [0x161] = { 0x161, 1.0e0,  "", "Cumulation counter" },
 
     /* E110 0010 Control signal */
-    { 0x162, 1.0e0,  "", "Control signal" },
+    [0x162] = { 0x162, 1.0e0,  "", "Control signal" },
 
     /* E110 0011 Day of week */
-    { 0x163, 1.0e0,  "", "Day of week" },
+    [0x163] = { 0x163, 1.0e0,  "", "Day of week" },
 
     /* E110 0100 Week number */
-    { 0x164, 1.0e0,  "", "Week number" },
+    [0x164] = { 0x164, 1.0e0,  "", "Week number" },
 
     /* E110 0101 Time point of day change */
-    { 0x165, 1.0e0,  "", "Time point of day change" },
+    [0x165] = { 0x165, 1.0e0,  "", "Time point of day change" },
 
     /* E110 0110 State of parameter activation */
-    { 0x166, 1.0e0,  "", "State of parameter activation" },
+    [0x166] = { 0x166, 1.0e0,  "", "State of parameter activation" },
 
     /* E110 0111 Special supplier information */
-    { 0x167, 1.0e0,  "", "Special supplier information" },
+    [0x167] = { 0x167, 1.0e0,  "", "Special supplier information" },
 
     /* E110 10pp Duration since last cumulation [hour(s)..years(s)] */
-    { 0x168,     3600.0, "s", "Duration since last cumulation" },  /* hours    */
-    { 0x169,    86400.0, "s", "Duration since last cumulation" },  /* days     */
-    { 0x16A,  2629743.83,"s", "Duration since last cumulation" },  /* month(s) */
-    { 0x16B, 31556926.0, "s", "Duration since last cumulation" },  /* year(s)  */
+    [0x168] = { 0x168,     3600.0, "s", "Duration since last cumulation" },  /* hours    */
+    [0x169] = { 0x169,    86400.0, "s", "Duration since last cumulation" },  /* days     */
+    [0x16A] = { 0x16A,  2629743.83,"s", "Duration since last cumulation" },  /* month(s) */
+    [0x16B] = { 0x16B, 31556926.0, "s", "Duration since last cumulation" },  /* year(s)  */
 
     /* E110 11pp Operating time battery [hour(s)..years(s)] */
-    { 0x16C,     3600.0, "s", "Operating time battery" },  /* hours    */
-    { 0x16D,    86400.0, "s", "Operating time battery" },  /* days     */
-    { 0x16E,  2629743.83,"s", "Operating time battery" },  /* month(s) */
-    { 0x16F, 31556926.0, "s", "Operating time battery" },  /* year(s)  */
+    [0x16C] = { 0x16C,     3600.0, "s", "Operating time battery" },  /* hours    */
+    [0x16D] = { 0x16D,    86400.0, "s", "Operating time battery" },  /* days     */
+    [0x16E] = { 0x16E,  2629743.83,"s", "Operating time battery" },  /* month(s) */
+    [0x16F] = { 0x16F, 31556926.0, "s", "Operating time battery" },  /* year(s)  */
 
     /* E111 0000 Date and time of battery change */
-    { 0x170, 1.0e0,  "", "Date and time of battery change" },
+    [0x170] = { 0x170, 1.0e0,  "", "Date and time of battery change" },
 
     /* E111 0001-1111 Reserved */
-    { 0x171, 1.0e0,  "Reserved", "Reserved" },
-    { 0x172, 1.0e0,  "Reserved", "Reserved" },
-    { 0x173, 1.0e0,  "Reserved", "Reserved" },
-    { 0x174, 1.0e0,  "Reserved", "Reserved" },
-    { 0x175, 1.0e0,  "Reserved", "Reserved" },
-    { 0x176, 1.0e0,  "Reserved", "Reserved" },
-    { 0x177, 1.0e0,  "Reserved", "Reserved" },
-    { 0x178, 1.0e0,  "Reserved", "Reserved" },
-    { 0x179, 1.0e0,  "Reserved", "Reserved" },
-    { 0x17A, 1.0e0,  "Reserved", "Reserved" },
-    { 0x17B, 1.0e0,  "Reserved", "Reserved" },
-    { 0x17C, 1.0e0,  "Reserved", "Reserved" },
-    { 0x17D, 1.0e0,  "Reserved", "Reserved" },
-    { 0x17E, 1.0e0,  "Reserved", "Reserved" },
-    { 0x17F, 1.0e0,  "Reserved", "Reserved" },
+    [0x171] = { 0x171, 1.0e0,  "Reserved", "Reserved" },
+    [0x172] = { 0x172, 1.0e0,  "Reserved", "Reserved" },
+    [0x173] = { 0x173, 1.0e0,  "Reserved", "Reserved" },
+    [0x174] = { 0x174, 1.0e0,  "Reserved", "Reserved" },
+    [0x175] = { 0x175, 1.0e0,  "Reserved", "Reserved" },
+    [0x176] = { 0x176, 1.0e0,  "Reserved", "Reserved" },
+    [0x177] = { 0x177, 1.0e0,  "Reserved", "Reserved" },
+    [0x178] = { 0x178, 1.0e0,  "Reserved", "Reserved" },
+    [0x179] = { 0x179, 1.0e0,  "Reserved", "Reserved" },
+    [0x17A] = { 0x17A, 1.0e0,  "Reserved", "Reserved" },
+    [0x17B] = { 0x17B, 1.0e0,  "Reserved", "Reserved" },
+    [0x17C] = { 0x17C, 1.0e0,  "Reserved", "Reserved" },
+    [0x17D] = { 0x17D, 1.0e0,  "Reserved", "Reserved" },
+    [0x17E] = { 0x17E, 1.0e0,  "Reserved", "Reserved" },
+    [0x17F] = { 0x17F, 1.0e0,  "Reserved", "Reserved" },
 
 
 /* Alternate VIFE-Code Extension table (following VIF=0FBh for primary VIF)
    See 8.4.4 b, only some of them are here. Using range 0x200 - 0x2FF */
 
     /* E000 000n Energy 10(n-1) MWh 0.1MWh to 1MWh */
-    { 0x200, 1.0e5,  "Wh", "Energy" },
-    { 0x201, 1.0e6,  "Wh", "Energy" },
+    [0x200] = { 0x200, 1.0e5,  "Wh", "Energy" },
+    [0x201] = { 0x201, 1.0e6,  "Wh", "Energy" },
 
     /* E000 001n Reserved */
-    { 0x202, 1.0e0,  "Reserved", "Reserved" },
-    { 0x203, 1.0e0,  "Reserved", "Reserved" },
+    [0x202] = { 0x202, 1.0e0,  "Reserved", "Reserved" },
+    [0x203] = { 0x203, 1.0e0,  "Reserved", "Reserved" },
 
     /* E000 01nn Reserved */
-    { 0x204, 1.0e0,  "Reserved", "Reserved" },
-    { 0x205, 1.0e0,  "Reserved", "Reserved" },
-    { 0x206, 1.0e0,  "Reserved", "Reserved" },
-    { 0x207, 1.0e0,  "Reserved", "Reserved" },
+    [0x204] = { 0x204, 1.0e0,  "Reserved", "Reserved" },
+    [0x205] = { 0x205, 1.0e0,  "Reserved", "Reserved" },
+    [0x206] = { 0x206, 1.0e0,  "Reserved", "Reserved" },
+    [0x207] = { 0x207, 1.0e0,  "Reserved", "Reserved" },
 
     /* E000 100n Energy 10(n-1) GJ 0.1GJ to 1GJ */
-    { 0x208, 1.0e8,  "Reserved", "Energy" },
-    { 0x209, 1.0e9,  "Reserved", "Energy" },
+    [0x208] = { 0x208, 1.0e8,  "Reserved", "Energy" },
+    [0x209] = { 0x209, 1.0e9,  "Reserved", "Energy" },
 
     /* E000 101n Reserved */
-    { 0x20A, 1.0e0,  "Reserved", "Reserved" },
-    { 0x20B, 1.0e0,  "Reserved", "Reserved" },
+    [0x20A] = { 0x20A, 1.0e0,  "Reserved", "Reserved" },
+    [0x20B] = { 0x20B, 1.0e0,  "Reserved", "Reserved" },
 
     /* E000 11nn Reserved */
-    { 0x20C, 1.0e0,  "Reserved", "Reserved" },
-    { 0x20D, 1.0e0,  "Reserved", "Reserved" },
-    { 0x20E, 1.0e0,  "Reserved", "Reserved" },
-    { 0x20F, 1.0e0,  "Reserved", "Reserved" },
+    [0x20C] = { 0x20C, 1.0e0,  "Reserved", "Reserved" },
+    [0x20D] = { 0x20D, 1.0e0,  "Reserved", "Reserved" },
+    [0x20E] = { 0x20E, 1.0e0,  "Reserved", "Reserved" },
+    [0x20F] = { 0x20F, 1.0e0,  "Reserved", "Reserved" },
 
     /* E001 000n Volume 10(n+2) m3 100m3 to 1000m3 */
-    { 0x210, 1.0e2,  "m^3", "Volume" },
-    { 0x211, 1.0e3,  "m^3", "Volume" },
+    [0x210] = { 0x210, 1.0e2,  "m^3", "Volume" },
+    [0x211] = { 0x211, 1.0e3,  "m^3", "Volume" },
 
     /* E001 001n Reserved */
-    { 0x212, 1.0e0,  "Reserved", "Reserved" },
-    { 0x213, 1.0e0,  "Reserved", "Reserved" },
+    [0x212] = { 0x212, 1.0e0,  "Reserved", "Reserved" },
+    [0x213] = { 0x213, 1.0e0,  "Reserved", "Reserved" },
 
     /* E001 01nn Reserved */
-    { 0x214, 1.0e0,  "Reserved", "Reserved" },
-    { 0x215, 1.0e0,  "Reserved", "Reserved" },
-    { 0x216, 1.0e0,  "Reserved", "Reserved" },
-    { 0x217, 1.0e0,  "Reserved", "Reserved" },
+    [0x214] = { 0x214, 1.0e0,  "Reserved", "Reserved" },
+    [0x215] = { 0x215, 1.0e0,  "Reserved", "Reserved" },
+    [0x216] = { 0x216, 1.0e0,  "Reserved", "Reserved" },
+    [0x217] = { 0x217, 1.0e0,  "Reserved", "Reserved" },
 
     /* E001 100n Mass 10(n+2) t 100t to 1000t */
-    { 0x218, 1.0e5,  "kg", "Mass" },
-    { 0x219, 1.0e6,  "kg", "Mass" },
+    [0x218] = { 0x218, 1.0e5,  "kg", "Mass" },
+    [0x219] = { 0x219, 1.0e6,  "kg", "Mass" },
 
     /* E001 1010 to E010 0000 Reserved */
-    { 0x21A, 1.0e0,  "Reserved", "Reserved" },
-    { 0x21B, 1.0e0,  "Reserved", "Reserved" },
-    { 0x21C, 1.0e0,  "Reserved", "Reserved" },
-    { 0x21D, 1.0e0,  "Reserved", "Reserved" },
-    { 0x21E, 1.0e0,  "Reserved", "Reserved" },
-    { 0x21F, 1.0e0,  "Reserved", "Reserved" },
-    { 0x220, 1.0e0,  "Reserved", "Reserved" },
+    [0x21A] = { 0x21A, 1.0e0,  "Reserved", "Reserved" },
+    [0x21B] = { 0x21B, 1.0e0,  "Reserved", "Reserved" },
+    [0x21C] = { 0x21C, 1.0e0,  "Reserved", "Reserved" },
+    [0x21D] = { 0x21D, 1.0e0,  "Reserved", "Reserved" },
+    [0x21E] = { 0x21E, 1.0e0,  "Reserved", "Reserved" },
+    [0x21F] = { 0x21F, 1.0e0,  "Reserved", "Reserved" },
+    [0x220] = { 0x220, 1.0e0,  "Reserved", "Reserved" },
 
     /* E010 0001 Volume 0,1 feet^3 */
-    { 0x221, 1.0e-1, "feet^3", "Volume" },
+    [0x221] = { 0x221, 1.0e-1, "feet^3", "Volume" },
 
     /* E010 001n Volume 0,1-1 american gallon */
-    { 0x222, 1.0e-1, "American gallon", "Volume" },
-    { 0x223, 1.0e-0, "American gallon", "Volume" },
+    [0x222] = { 0x222, 1.0e-1, "American gallon", "Volume" },
+    [0x223] = { 0x223, 1.0e-0, "American gallon", "Volume" },
 
     /* E010 0100    Volume flow 0,001 american gallon/min */
-    { 0x224, 1.0e-3, "American gallon/min", "Volume flow" },
+    [0x224] = { 0x224, 1.0e-3, "American gallon/min", "Volume flow" },
 
     /* E010 0101 Volume flow 1 american gallon/min */
-    { 0x225, 1.0e0,  "American gallon/min", "Volume flow" },
+    [0x225] = { 0x225, 1.0e0,  "American gallon/min", "Volume flow" },
 
     /* E010 0110 Volume flow 1 american gallon/h */
-    { 0x226, 1.0e0,  "American gallon/h", "Volume flow" },
+    [0x226] = { 0x226, 1.0e0,  "American gallon/h", "Volume flow" },
 
     /* E010 0111 Reserved */
-    { 0x227, 1.0e0, "Reserved", "Reserved" },
+    [0x227] = { 0x227, 1.0e0, "Reserved", "Reserved" },
 
     /* E010 100n Power 10(n-1) MW 0.1MW to 1MW */
-    { 0x228, 1.0e5, "W", "Power" },
-    { 0x229, 1.0e6, "W", "Power" },
+    [0x228] = { 0x228, 1.0e5, "W", "Power" },
+    [0x229] = { 0x229, 1.0e6, "W", "Power" },
 
     /* E010 101n Reserved */
-    { 0x22A, 1.0e0, "Reserved", "Reserved" },
-    { 0x22B, 1.0e0, "Reserved", "Reserved" },
+    [0x22A] = { 0x22A, 1.0e0, "Reserved", "Reserved" },
+    [0x22B] = { 0x22B, 1.0e0, "Reserved", "Reserved" },
 
     /* E010 11nn Reserved */
-    { 0x22C, 1.0e0, "Reserved", "Reserved" },
-    { 0x22D, 1.0e0, "Reserved", "Reserved" },
-    { 0x22E, 1.0e0, "Reserved", "Reserved" },
-    { 0x22F, 1.0e0, "Reserved", "Reserved" },
+    [0x22C] = { 0x22C, 1.0e0, "Reserved", "Reserved" },
+    [0x22D] = { 0x22D, 1.0e0, "Reserved", "Reserved" },
+    [0x22E] = { 0x22E, 1.0e0, "Reserved", "Reserved" },
+    [0x22F] = { 0x22F, 1.0e0, "Reserved", "Reserved" },
 
     /* E011 000n Power 10(n-1) GJ/h 0.1GJ/h to 1GJ/h */
-    { 0x230, 1.0e8, "J", "Power" },
-    { 0x231, 1.0e9, "J", "Power" },
+    [0x230] = { 0x230, 1.0e8, "J", "Power" },
+    [0x231] = { 0x231, 1.0e9, "J", "Power" },
 
     /* E011 0010 to E101 0111 Reserved */
-    { 0x232, 1.0e0, "Reserved", "Reserved" },
-    { 0x233, 1.0e0, "Reserved", "Reserved" },
-    { 0x234, 1.0e0, "Reserved", "Reserved" },
-    { 0x235, 1.0e0, "Reserved", "Reserved" },
-    { 0x236, 1.0e0, "Reserved", "Reserved" },
-    { 0x237, 1.0e0, "Reserved", "Reserved" },
-    { 0x238, 1.0e0, "Reserved", "Reserved" },
-    { 0x239, 1.0e0, "Reserved", "Reserved" },
-    { 0x23A, 1.0e0, "Reserved", "Reserved" },
-    { 0x23B, 1.0e0, "Reserved", "Reserved" },
-    { 0x23C, 1.0e0, "Reserved", "Reserved" },
-    { 0x23D, 1.0e0, "Reserved", "Reserved" },
-    { 0x23E, 1.0e0, "Reserved", "Reserved" },
-    { 0x23F, 1.0e0, "Reserved", "Reserved" },
-    { 0x240, 1.0e0, "Reserved", "Reserved" },
-    { 0x241, 1.0e0, "Reserved", "Reserved" },
-    { 0x242, 1.0e0, "Reserved", "Reserved" },
-    { 0x243, 1.0e0, "Reserved", "Reserved" },
-    { 0x244, 1.0e0, "Reserved", "Reserved" },
-    { 0x245, 1.0e0, "Reserved", "Reserved" },
-    { 0x246, 1.0e0, "Reserved", "Reserved" },
-    { 0x247, 1.0e0, "Reserved", "Reserved" },
-    { 0x248, 1.0e0, "Reserved", "Reserved" },
-    { 0x249, 1.0e0, "Reserved", "Reserved" },
-    { 0x24A, 1.0e0, "Reserved", "Reserved" },
-    { 0x24B, 1.0e0, "Reserved", "Reserved" },
-    { 0x24C, 1.0e0, "Reserved", "Reserved" },
-    { 0x24D, 1.0e0, "Reserved", "Reserved" },
-    { 0x24E, 1.0e0, "Reserved", "Reserved" },
-    { 0x24F, 1.0e0, "Reserved", "Reserved" },
-    { 0x250, 1.0e0, "Reserved", "Reserved" },
-    { 0x251, 1.0e0, "Reserved", "Reserved" },
-    { 0x252, 1.0e0, "Reserved", "Reserved" },
-    { 0x253, 1.0e0, "Reserved", "Reserved" },
-    { 0x254, 1.0e0, "Reserved", "Reserved" },
-    { 0x255, 1.0e0, "Reserved", "Reserved" },
-    { 0x256, 1.0e0, "Reserved", "Reserved" },
-    { 0x257, 1.0e0, "Reserved", "Reserved" },
+    [0x232] = { 0x232, 1.0e0, "Reserved", "Reserved" },
+    [0x233] = { 0x233, 1.0e0, "Reserved", "Reserved" },
+    [0x234] = { 0x234, 1.0e0, "Reserved", "Reserved" },
+    [0x235] = { 0x235, 1.0e0, "Reserved", "Reserved" },
+    [0x236] = { 0x236, 1.0e0, "Reserved", "Reserved" },
+    [0x237] = { 0x237, 1.0e0, "Reserved", "Reserved" },
+    [0x238] = { 0x238, 1.0e0, "Reserved", "Reserved" },
+    [0x239] = { 0x239, 1.0e0, "Reserved", "Reserved" },
+    [0x23A] = { 0x23A, 1.0e0, "Reserved", "Reserved" },
+    [0x23B] = { 0x23B, 1.0e0, "Reserved", "Reserved" },
+    [0x23C] = { 0x23C, 1.0e0, "Reserved", "Reserved" },
+    [0x23D] = { 0x23D, 1.0e0, "Reserved", "Reserved" },
+    [0x23E] = { 0x23E, 1.0e0, "Reserved", "Reserved" },
+    [0x23F] = { 0x23F, 1.0e0, "Reserved", "Reserved" },
+    [0x240] = { 0x240, 1.0e0, "Reserved", "Reserved" },
+    [0x241] = { 0x241, 1.0e0, "Reserved", "Reserved" },
+    [0x242] = { 0x242, 1.0e0, "Reserved", "Reserved" },
+    [0x243] = { 0x243, 1.0e0, "Reserved", "Reserved" },
+    [0x244] = { 0x244, 1.0e0, "Reserved", "Reserved" },
+    [0x245] = { 0x245, 1.0e0, "Reserved", "Reserved" },
+    [0x246] = { 0x246, 1.0e0, "Reserved", "Reserved" },
+    [0x247] = { 0x247, 1.0e0, "Reserved", "Reserved" },
+    [0x248] = { 0x248, 1.0e0, "Reserved", "Reserved" },
+    [0x249] = { 0x249, 1.0e0, "Reserved", "Reserved" },
+    [0x24A] = { 0x24A, 1.0e0, "Reserved", "Reserved" },
+    [0x24B] = { 0x24B, 1.0e0, "Reserved", "Reserved" },
+    [0x24C] = { 0x24C, 1.0e0, "Reserved", "Reserved" },
+    [0x24D] = { 0x24D, 1.0e0, "Reserved", "Reserved" },
+    [0x24E] = { 0x24E, 1.0e0, "Reserved", "Reserved" },
+    [0x24F] = { 0x24F, 1.0e0, "Reserved", "Reserved" },
+    [0x250] = { 0x250, 1.0e0, "Reserved", "Reserved" },
+    [0x251] = { 0x251, 1.0e0, "Reserved", "Reserved" },
+    [0x252] = { 0x252, 1.0e0, "Reserved", "Reserved" },
+    [0x253] = { 0x253, 1.0e0, "Reserved", "Reserved" },
+    [0x254] = { 0x254, 1.0e0, "Reserved", "Reserved" },
+    [0x255] = { 0x255, 1.0e0, "Reserved", "Reserved" },
+    [0x256] = { 0x256, 1.0e0, "Reserved", "Reserved" },
+    [0x257] = { 0x257, 1.0e0, "Reserved", "Reserved" },
 
     /* E101 10nn Flow Temperature 10(nn-3) F 0.001F to 1F */
-    { 0x258, 1.0e-3, "F", "Flow temperature" },
-    { 0x259, 1.0e-2, "F", "Flow temperature" },
-    { 0x25A, 1.0e-1, "F", "Flow temperature" },
-    { 0x25B, 1.0e0,  "F", "Flow temperature" },
+    [0x258] = { 0x258, 1.0e-3, "F", "Flow temperature" },
+    [0x259] = { 0x259, 1.0e-2, "F", "Flow temperature" },
+    [0x25A] = { 0x25A, 1.0e-1, "F", "Flow temperature" },
+    [0x25B] = { 0x25B, 1.0e0,  "F", "Flow temperature" },
 
     /* E101 11nn Return Temperature 10(nn-3) F 0.001F to 1F */
-    { 0x25C, 1.0e-3, "F", "Return temperature" },
-    { 0x25D, 1.0e-2, "F", "Return temperature" },
-    { 0x25E, 1.0e-1, "F", "Return temperature" },
-    { 0x25F, 1.0e0,  "F", "Return temperature" },
+    [0x25C] = { 0x25C, 1.0e-3, "F", "Return temperature" },
+    [0x25D] = { 0x25D, 1.0e-2, "F", "Return temperature" },
+    [0x25E] = { 0x25E, 1.0e-1, "F", "Return temperature" },
+    [0x25F] = { 0x25F, 1.0e0,  "F", "Return temperature" },
 
     /* E110 00nn Temperature Difference 10(nn-3) F 0.001F to 1F */
-    { 0x260, 1.0e-3, "F", "Temperature difference" },
-    { 0x261, 1.0e-2, "F", "Temperature difference" },
-    { 0x262, 1.0e-1, "F", "Temperature difference" },
-    { 0x263, 1.0e0,  "F", "Temperature difference" },
+    [0x260] = { 0x260, 1.0e-3, "F", "Temperature difference" },
+    [0x261] = { 0x261, 1.0e-2, "F", "Temperature difference" },
+    [0x262] = { 0x262, 1.0e-1, "F", "Temperature difference" },
+    [0x263] = { 0x263, 1.0e0,  "F", "Temperature difference" },
 
     /* E110 01nn External Temperature 10(nn-3) F 0.001F to 1F */
-    { 0x264, 1.0e-3, "F", "External temperature" },
-    { 0x265, 1.0e-2, "F", "External temperature" },
-    { 0x266, 1.0e-1, "F", "External temperature" },
-    { 0x267, 1.0e0,  "F", "External temperature" },
+    [0x264] = { 0x264, 1.0e-3, "F", "External temperature" },
+    [0x265] = { 0x265, 1.0e-2, "F", "External temperature" },
+    [0x266] = { 0x266, 1.0e-1, "F", "External temperature" },
+    [0x267] = { 0x267, 1.0e0,  "F", "External temperature" },
 
     /* E110 1nnn Reserved */
-    { 0x268, 1.0e0, "Reserved", "Reserved" },
-    { 0x269, 1.0e0, "Reserved", "Reserved" },
-    { 0x26A, 1.0e0, "Reserved", "Reserved" },
-    { 0x26B, 1.0e0, "Reserved", "Reserved" },
-    { 0x26C, 1.0e0, "Reserved", "Reserved" },
-    { 0x26D, 1.0e0, "Reserved", "Reserved" },
-    { 0x26E, 1.0e0, "Reserved", "Reserved" },
-    { 0x26F, 1.0e0, "Reserved", "Reserved" },
+    [0x268] = { 0x268, 1.0e0, "Reserved", "Reserved" },
+    [0x269] = { 0x269, 1.0e0, "Reserved", "Reserved" },
+    [0x26A] = { 0x26A, 1.0e0, "Reserved", "Reserved" },
+    [0x26B] = { 0x26B, 1.0e0, "Reserved", "Reserved" },
+    [0x26C] = { 0x26C, 1.0e0, "Reserved", "Reserved" },
+    [0x26D] = { 0x26D, 1.0e0, "Reserved", "Reserved" },
+    [0x26E] = { 0x26E, 1.0e0, "Reserved", "Reserved" },
+    [0x26F] = { 0x26F, 1.0e0, "Reserved", "Reserved" },
 
     /* E111 00nn Cold / Warm Temperature Limit 10(nn-3) F 0.001F to 1F */
-    { 0x270, 1.0e-3, "F", "Cold / Warm Temperature Limit" },
-    { 0x271, 1.0e-2, "F", "Cold / Warm Temperature Limit" },
-    { 0x272, 1.0e-1, "F", "Cold / Warm Temperature Limit" },
-    { 0x273, 1.0e0,  "F", "Cold / Warm Temperature Limit" },
+    [0x270] = { 0x270, 1.0e-3, "F", "Cold / Warm Temperature Limit" },
+    [0x271] = { 0x271, 1.0e-2, "F", "Cold / Warm Temperature Limit" },
+    [0x272] = { 0x272, 1.0e-1, "F", "Cold / Warm Temperature Limit" },
+    [0x273] = { 0x273, 1.0e0,  "F", "Cold / Warm Temperature Limit" },
 
     /* E111 01nn Cold / Warm Temperature Limit 10(nn-3) C 0.001C to 1C */
-    { 0x274, 1.0e-3, "C", "Cold / Warm Temperature Limit" },
-    { 0x275, 1.0e-2, "C", "Cold / Warm Temperature Limit" },
-    { 0x276, 1.0e-1, "C", "Cold / Warm Temperature Limit" },
-    { 0x277, 1.0e0,  "C", "Cold / Warm Temperature Limit" },
+    [0x274] = { 0x274, 1.0e-3, "C", "Cold / Warm Temperature Limit" },
+    [0x275] = { 0x275, 1.0e-2, "C", "Cold / Warm Temperature Limit" },
+    [0x276] = { 0x276, 1.0e-1, "C", "Cold / Warm Temperature Limit" },
+    [0x277] = { 0x277, 1.0e0,  "C", "Cold / Warm Temperature Limit" },
 
     /* E111 1nnn cumul. count max power  10(nnn-3) W 0.001W to 10000W */
-    { 0x278, 1.0e-3, "W", "Cumul count max power" },
-    { 0x279, 1.0e-3, "W", "Cumul count max power" },
-    { 0x27A, 1.0e-1, "W", "Cumul count max power" },
-    { 0x27B, 1.0e0,  "W", "Cumul count max power" },
-    { 0x27C, 1.0e1,  "W", "Cumul count max power" },
-    { 0x27D, 1.0e2,  "W", "Cumul count max power" },
-    { 0x27E, 1.0e3,  "W", "Cumul count max power" },
-    { 0x27F, 1.0e4,  "W", "Cumul count max power" },
-
-/* End of array */
-    { 0xFFFF, 0.0, "", "" },
+    [0x278] = { 0x278, 1.0e-3, "W", "Cumul count max power" },
+    [0x279] = { 0x279, 1.0e-3, "W", "Cumul count max power" },
+    [0x27A] = { 0x27A, 1.0e-1, "W", "Cumul count max power" },
+    [0x27B] = { 0x27B, 1.0e0,  "W", "Cumul count max power" },
+    [0x27C] = { 0x27C, 1.0e1,  "W", "Cumul count max power" },
+    [0x27D] = { 0x27D, 1.0e2,  "W", "Cumul count max power" },
+    [0x27E] = { 0x27E, 1.0e3,  "W", "Cumul count max power" },
+    [0x27F] = { 0x27F, 1.0e4,  "W", "Cumul count max power" },
 };
 
 
-mbus_variable_vif fixed_table[] = {
+static const mbus_variable_vif fixed_table[MBUS_FIXED_TABLE_SIZE] = {
     /* 00, 01 left out */
-    { 0x02, 1.0e0, "Wh", "Energy" },
-    { 0x03, 1.0e1, "Wh", "Energy" },
-    { 0x04, 1.0e2, "Wh", "Energy" },
-    { 0x05, 1.0e3, "Wh", "Energy" },
-    { 0x06, 1.0e4, "Wh", "Energy" },
-    { 0x07, 1.0e5, "Wh", "Energy" },
-    { 0x08, 1.0e6, "Wh", "Energy" },
-    { 0x09, 1.0e7, "Wh", "Energy" },
-    { 0x0A, 1.0e8, "Wh", "Energy" },
-
-    { 0x0B, 1.0e3, "J", "Energy" },
-    { 0x0C, 1.0e4, "J", "Energy" },
-    { 0x0D, 1.0e5, "J", "Energy" },
-    { 0x0E, 1.0e6, "J", "Energy" },
-    { 0x0F, 1.0e7, "J", "Energy" },
-    { 0x10, 1.0e8, "J", "Energy" },
-    { 0x11, 1.0e9, "J", "Energy" },
-    { 0x12, 1.0e10,"J", "Energy" },
-    { 0x13, 1.0e11,"J", "Energy" },
-
-    { 0x14, 1.0e0, "W", "Power" },
-    { 0x15, 1.0e0, "W", "Power" },
-    { 0x16, 1.0e0, "W", "Power" },
-    { 0x17, 1.0e0, "W", "Power" },
-    { 0x18, 1.0e0, "W", "Power" },
-    { 0x19, 1.0e0, "W", "Power" },
-    { 0x1A, 1.0e0, "W", "Power" },
-    { 0x1B, 1.0e0, "W", "Power" },
-    { 0x1C, 1.0e0, "W", "Power" },
-
-    { 0x1D, 1.0e3, "J/h", "Energy" },
-    { 0x1E, 1.0e4, "J/h", "Energy" },
-    { 0x1F, 1.0e5, "J/h", "Energy" },
-    { 0x20, 1.0e6, "J/h", "Energy" },
-    { 0x21, 1.0e7, "J/h", "Energy" },
-    { 0x22, 1.0e8, "J/h", "Energy" },
-    { 0x23, 1.0e9, "J/h", "Energy" },
-    { 0x24, 1.0e10,"J/h", "Energy" },
-    { 0x25, 1.0e11,"J/h", "Energy" },
-
-    { 0x26, 1.0e-6,"m^3", "Volume" },
-    { 0x27, 1.0e-5,"m^3", "Volume" },
-    { 0x28, 1.0e-4,"m^3", "Volume" },
-    { 0x29, 1.0e-3,"m^3", "Volume" },
-    { 0x2A, 1.0e-2,"m^3", "Volume" },
-    { 0x2B, 1.0e-1,"m^3", "Volume" },
-    { 0x2C, 1.0e0, "m^3", "Volume" },
-    { 0x2D, 1.0e1, "m^3", "Volume" },
-    { 0x2E, 1.0e2, "m^3", "Volume" },
-
-    { 0x2F, 1.0e-5,"m^3/h", "Volume flow" },
-    { 0x31, 1.0e-4,"m^3/h", "Volume flow" },
-    { 0x32, 1.0e-3,"m^3/h", "Volume flow" },
-    { 0x33, 1.0e-2,"m^3/h", "Volume flow" },
-    { 0x34, 1.0e-1,"m^3/h", "Volume flow" },
-    { 0x35, 1.0e0, "m^3/h", "Volume flow" },
-    { 0x36, 1.0e1, "m^3/h", "Volume flow" },
-    { 0x37, 1.0e2, "m^3/h", "Volume flow" },
-
-    { 0x38, 1.0e-3, "C", "Temperature" },
-
-    { 0x39, 1.0e0,  "Units for H.C.A.", "H.C.A." },
-
-    { 0x3A, 0.0,  "Reserved", "Reserved" },
-    { 0x3B, 0.0,  "Reserved", "Reserved" },
-    { 0x3C, 0.0,  "Reserved", "Reserved" },
-    { 0x3D, 0.0,  "Reserved", "Reserved" },
-
-    { 0x3E, 1.0e0,  "", "historic" },
-
-    { 0x3F, 1.0e0,  "", "No units" },
-
-/* end of array */
-    { 0xFFFF, 0.0, "", "" },
+    [0x02] = { 0x02, 1.0e0, "Wh", "Energy" },
+    [0x03] = { 0x03, 1.0e1, "Wh", "Energy" },
+    [0x04] = { 0x04, 1.0e2, "Wh", "Energy" },
+    [0x05] = { 0x05, 1.0e3, "Wh", "Energy" },
+    [0x06] = { 0x06, 1.0e4, "Wh", "Energy" },
+    [0x07] = { 0x07, 1.0e5, "Wh", "Energy" },
+    [0x08] = { 0x08, 1.0e6, "Wh", "Energy" },
+    [0x09] = { 0x09, 1.0e7, "Wh", "Energy" },
+    [0x0A] = { 0x0A, 1.0e8, "Wh", "Energy" },
+
+    [0x0B] = { 0x0B, 1.0e3, "J", "Energy" },
+    [0x0C] = { 0x0C, 1.0e4, "J", "Energy" },
+    [0x0D] = { 0x0D, 1.0e5, "J", "Energy" },
+    [0x0E] = { 0x0E, 1.0e6, "J", "Energy" },
+    [0x0F] = { 0x0F, 1.0e7, "J", "Energy" },
+    [0x10] = { 0x10, 1.0e8, "J", "Energy" },
+    [0x11] = { 0x11, 1.0e9, "J", "Energy" },
+    [0x12] = { 0x12, 1.0e10,"J", "Energy" },
+    [0x13] = { 0x13, 1.0e11,"J", "Energy" },
+
+    [0x14] = { 0x14, 1.0e0, "W", "Power" },
+    [0x15] = { 0x15, 1.0e0, "W", "Power" },
+    [0x16] = { 0x16, 1.0e0, "W", "Power" },
+    [0x17] = { 0x17, 1.0e0, "W", "Power" },
+    [0x18] = { 0x18, 1.0e0, "W", "Power" },
+    [0x19] = { 0x19, 1.0e0, "W", "Power" },
+    [0x1A] = { 0x1A, 1.0e0, "W", "Power" },
+    [0x1B] = { 0x1B, 1.0e0, "W", "Power" },
+    [0x1C] = { 0x1C, 1.0e0, "W", "Power" },
+
+    [0x1D] = { 0x1D, 1.0e3, "J/h", "Energy" },
+    [0x1E] = { 0x1E, 1.0e4, "J/h", "Energy" },
+    [0x1F] = { 0x1F, 1.0e5, "J/h", "Energy" },
+    [0x20] = { 0x20, 1.0e6, "J/h", "Energy" },
+    [0x21] = { 0x21, 1.0e7, "J/h", "Energy" },
+    [0x22] = { 0x22, 1.0e8, "J/h", "Energy" },
+    [0x23] = { 0x23, 1.0e9, "J/h", "Energy" },
+    [0x24] = { 0x24, 1.0e10,"J/h", "Energy" },
+    [0x25] = { 0x25, 1.0e11,"J/h", "Energy" },
+
+    [0x26] = { 0x26, 1.0e-6,"m^3", "Volume" },
+    [0x27] = { 0x27, 1.0e-5,"m^3", "Volume" },
+    [0x28] = { 0x28, 1.0e-4,"m^3", "Volume" },
+    [0x29] = { 0x29, 1.0e-3,"m^3", "Volume" },
+    [0x2A] = { 0x2A, 1.0e-2,"m^3", "Volume" },
+    [0x2B] = { 0x2B, 1.0e-1,"m^3", "Volume" },
+    [0x2C] = { 0x2C, 1.0e0, "m^3", "Volume" },
+    [0x2D] = { 0x2D, 1.0e1, "m^3", "Volume" },
+    [0x2E] = { 0x2E, 1.0e2, "m^3", "Volume" },
+
+    [0x2F] = { 0x2F, 1.0e-5,"m^3/h", "Volume flow" },
+    [0x31] = { 0x31, 1.0e-4,"m^3/h", "Volume flow" },
+    [0x32] = { 0x32, 1.0e-3,"m^3/h", "Volume flow" },
+    [0x33] = { 0x33, 1.0e-2,"m^3/h", "Volume flow" },
+    [0x34] = { 0x34, 1.0e-1,"m^3/h", "Volume flow" },
+    [0x35] = { 0x35, 1.0e0, "m^3/h", "Volume flow" },
+    [0x36] = { 0x36, 1.0e1, "m^3/h", "Volume flow" },
+    [0x37] = { 0x37, 1.0e2, "m^3/h", "Volume flow" },
+
+    [0x38] = { 0x38, 1.0e-3, "C", "Temperature" },
+
+    [0x39] = { 0x39, 1.0e0,  "Units for H.C.A.", "H.C.A." },
+
+    [0x3A] = { 0x3A, 0.0,  "Reserved", "Reserved" },
+    [0x3B] = { 0x3B, 0.0,  "Reserved", "Reserved" },
+    [0x3C] = { 0x3C, 0.0,  "Reserved", "Reserved" },
+    [0x3D] = { 0x3D, 0.0,  "Reserved", "Reserved" },
+
+    [0x3E] = { 0x3E, 1.0e0,  "", "historic" },
+
+    [0x3F] = { 0x3F, 1.0e0,  "", "No units" },
 };
 
 //------------------------------------------------------------------------------
@@ -783,10 +795,24 @@ mbus_register_found_event(mbus_handle * handle, void (*event)(mbus_handle * hand
     handle->found_event = event;
 }
 
-int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, double *value_out, char **quantity_out)
+//------------------------------------------------------------------------------
+/// Scale a value by a decimal factor. Factors below one are applied by
+/// dividing by their reciprocal, which is exact for the powers of ten:
+/// 204 * 0.1 is 20.400000000000002, 204 / 10 is 20.4.
+//------------------------------------------------------------------------------
+static double
+mbus_normalize_scale(double value, double factor)
+{
+    if (factor > 0.0 && factor < 1.0)
+    {
+        return value / round(1.0 / factor);
+    }
+
+    return value * factor;
+}
+
+int mbus_fixed_normalize(int medium_unit, long medium_value, const char **unit_out, double *value_out, const char **quantity_out)
 {
-    double exponent = 0.0;
-    int i;
     medium_unit = medium_unit & 0x3F;
 
     if (unit_out == NULL || value_out == NULL || quantity_out == NULL)
@@ -798,29 +824,25 @@ int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, do
     switch (medium_unit)
     {
         case 0x00:
-            *unit_out = strdup("h,m,s"); /*  todo convert to unix time... */
-            *quantity_out = strdup("Time");
+            *unit_out = "h,m,s"; /*  todo convert to unix time... */
+            *quantity_out = "Time";
             break;
         case 0x01:
-            *unit_out = strdup("D,M,Y"); /*  todo convert to unix time... */
-            *quantity_out = strdup("Time");
+            *unit_out = "D,M,Y"; /*  todo convert to unix time... */
+            *quantity_out = "Time";
             break;
 
     default:
-        for(i=0; fixed_table[i].vif < 0xfff; ++i)
+        if (fixed_table[medium_unit].unit != NULL)
         {
-            if (fixed_table[i].vif == medium_unit)
-            {
-                *unit_out = strdup(fixed_table[i].unit);
-                *value_out = ((double) (medium_value)) * fixed_table[i].exponent;
-                *quantity_out = strdup(fixed_table[i].quantity);
-                return 0;
-            }
+            *unit_out = fixed_table[medium_unit].unit;
+            *value_out = mbus_normalize_scale((double) (medium_value), fixed_table[medium_unit].exponent);
+            *quantity_out = fixed_table[medium_unit].quantity;
+            return 0;
         }
 
-        *unit_out = strdup("Unknown");
-        *quantity_out = strdup("Unknown");
-        exponent = 0.0;
+        *unit_out = "Unknown";
+        *quantity_out = "Unknown";
         *value_out = 0.0;
         return -1;
     }
@@ -828,217 +850,100 @@ int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, do
     return -2;
 }
 
+//------------------------------------------------------------------------------
+/// Public name of mbus_fixed_normalize, as declared in the header.
+//------------------------------------------------------------------------------
+int
+mbus_data_fixed_normalize(int medium_unit_byte, long medium_value, const char **unit_out, double *value_out, const char **quantity_out)
+{
+    return mbus_fixed_normalize(medium_unit_byte, medium_value, unit_out, value_out, quantity_out);
+}
+
 
-int mbus_variable_value_decode(mbus_data_record *record, double *value_out_real, char **value_out_str, int *value_out_str_size)
+//------------------------------------------------------------------------------
+/// Decode the value of a variable data record like mbus_variable_value_decode,
+/// a text value is formatted into buff (*value_out_str points to it).
+//------------------------------------------------------------------------------
+static int
+mbus_variable_value_decode_r(mbus_data_record *record, double *value_out_real, char *buff, size_t buff_size,
+                             char **value_out_str, int *value_out_str_size)
 {
-    int result = 0;
-    unsigned char vif, vife;
-    struct tm time;
-    int value_out_int;
-    long value_out_long;
-    long long value_out_long_long;
+    mbus_data_value value;
     *value_out_real = 0.0;
     *value_out_str = NULL;
     *value_out_str_size = 0;
 
-    if (record)
+    if (mbus_data_record_value_decode(record, &value) != 0)
     {
-        MBUS_DEBUG("coding = 0x%02X \n", record->drh.dib.dif);
-
-        // ignore extension bit
-        vif = (record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION);
-        vife = (record->drh.vib.vife[0] & MBUS_DIB_VIF_WITHOUT_EXTENSION);
-
-        switch (record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_DATA)
-        {
-            case 0x00: /* no data */
-                if ((*value_out_str = (char*) malloc(1)) == NULL)
-                {
-                    MBUS_ERROR("Unable to allocate memory");
-                    return -1;
-                }
-                *value_out_str[0] = '\0';
-                *value_out_str_size = 0;
-                result = 0;
-                break;
-
-            case 0x01: /* 1 byte integer (8 bit) */
-                result = mbus_data_int_decode(record->data, 1, &value_out_int);
-                *value_out_real = value_out_int;
-                break;
-
-            case 0x02: /* 2 byte integer (16 bit) */
-                // E110 1100  Time Point (date)
-                if (vif == 0x6C)
-                {
-                    mbus_data_tm_decode(&time, record->data, 2);
-                    if ((*value_out_str = (char*) malloc(11)) == NULL)
-                    {
-                        MBUS_ERROR("Unable to allocate memory");
-                        return -1;
-                    }
-                    *value_out_str_size = snprintf(*value_out_str, 11, "%04d-%02d-%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday);
-                    result = 0;
-                }
-                else  // normal integer
-                {
-                    result = mbus_data_int_decode(record->data, 2, &value_out_int);
-                    *value_out_real = value_out_int; 
-                }
-                break;
-
-            case 0x03: /* 3 byte integer (24 bit) */
-                result = mbus_data_int_decode(record->data, 3, &value_out_int);
-                *value_out_real = value_out_int;
-                break;
-
-            case 0x04: /* 4 byte integer (32 bit) */
-                // E110 1101  Time Point (date/time)
-                // E011 0000  Start (date/time) of tariff
-                // E111 0000  Date and time of battery change
-                if ( (vif == 0x6D) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
-                {
-                    mbus_data_tm_decode(&time, record->data, 4);
-                    if ((*value_out_str = (char*) malloc(20)) == NULL)
-                    {
-                        MBUS_ERROR("Unable to allocate memory");
-                        return -1;
-                    }
-                    *value_out_str_size = snprintf(*value_out_str, 20, "%04d-%02d-%02dT%02d:%02d:%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
-                    result = 0;
-                }
-                else  // normal integer
-                {
-                    result = mbus_data_int_decode(record->data, 4, &value_out_int);
-                    *value_out_real = value_out_int; 
-                }
-                break;
-
-            case 0x05: /* 32b real */
-                *value_out_real = mbus_data_float_decode(record->data);
-                result = 0;
-                break;
-
-            case 0x06: /* 6 byte integer (48 bit) */
-                // E110 1101  Time Point (date/time)
-                // E011 0000  Start (date/time) of tariff
-                // E111 0000  Date and time of battery change
-                if ( (vif == 0x6D) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
-                {
-                    mbus_data_tm_decode(&time, record->data, 6);
-                    if ((*value_out_str = (char*) malloc(20)) == NULL)
-                    {
-                        MBUS_ERROR("Unable to allocate memory");
-                        return -1;
-                    }
-                    *value_out_str_size = snprintf(*value_out_str, 20, "%04d-%02d-%02dT%02d:%02d:%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
-                    result = 0;
-                }
-                else  // normal integer
-                {
-                    result = mbus_data_long_long_decode(record->data, 6, &value_out_long_long);
-                    *value_out_real = value_out_long_long;
-                }
-                break;
-
-            case 0x07: /* 8 byte integer (64 bit) */
-                result = mbus_data_long_long_decode(record->data, 8, &value_out_long_long);
-                *value_out_real = value_out_long_long;
-                break;
+        MBUS_ERROR("record is null");
+        return -3;
+    }
 
-            case 0x09: /* 2 digit BCD (8 bit) */
-                *value_out_real = mbus_data_bcd_decode(record->data, 1);
-                result = 0;
-                break;
+    MBUS_DEBUG("coding = 0x%02X \n", record->drh.dib.dif);
 
-            case 0x0A: /* 4 digit BCD (16 bit) */
-                *value_out_real = mbus_data_bcd_decode(record->data, 2);
-                result = 0;
-                break;
+    switch (value.type)
+    {
+        case MBUS_DATA_VALUE_INTEGER:
+        case MBUS_DATA_VALUE_BCD:
+            *value_out_real = value.value.integer;
+            return 0;
 
-            case 0x0B: /* 6 digit BCD (24 bit) */
-                *value_out_real = mbus_data_bcd_decode(record->data, 3);
-                result = 0;
-                break;
+        case MBUS_DATA_VALUE_REAL:
+            *value_out_real = value.value.real;
+            return 0;
 
-            case 0x0C: /* 8 digit BCD (32 bit) */
-                *value_out_real = mbus_data_bcd_decode(record->data, 4);
-                result = 0;
-                break;
+        case MBUS_DATA_VALUE_NONE:
+        case MBUS_DATA_VALUE_DATE:
+        case MBUS_DATA_VALUE_DATETIME:
+        case MBUS_DATA_VALUE_STRING:
+        case MBUS_DATA_VALUE_BINARY:
+            break;
 
-            case 0x0D: /* variable length */
+        default:
+            if ((value.dif & MBUS_DATA_RECORD_DIF_MASK_DATA) == 0x0D)
             {
-                if (record->data_len <= 0xBF) {
-                    if ((*value_out_str = (char*) malloc(record->data_len + 1)) == NULL)
-                    {
-                        MBUS_ERROR("Unable to allocate memory");
-                        return -1;
-                    }
-                    *value_out_str_size = record->data_len;
-                    mbus_data_str_decode((unsigned char*)(*value_out_str), record->data, record->data_len);
-                    result = 0;
-                    break;
-                }
-                result = -2;
                 MBUS_ERROR("Non ASCII variable length not implemented yet\n");
-                break;
             }
+            else
+            {
+                MBUS_ERROR("Unknown DIF (0x%.2x)", value.dif);
+            }
+            return -2;
+    }
 
-            case 0x0E: /* 12 digit BCD (40 bit) */
-                *value_out_real = mbus_data_bcd_decode(record->data, 6);
-                result = 0;
-                break;
+    mbus_data_value_format_r(&value, buff, buff_size);
+    *value_out_str = buff;
+    *value_out_str_size = (value.type == MBUS_DATA_VALUE_STRING) ? value.data_len : strlen(buff);
 
-            case 0x0F: /* Special functions */
-                if ((*value_out_str = (char*) malloc(3 * record->data_len + 1)) == NULL)
-                {
-                    MBUS_ERROR("Unable to allocate memory");
-                    return -1;
-                }
-                *value_out_str_size = 3 * record->data_len;
-                mbus_data_bin_decode((unsigned char*)(*value_out_str), record->data, record->data_len, (3 * record->data_len + 1));
-                result = 0;
-                break;
+    return 0;
+}
 
-            default:
-                result = -2;
-                MBUS_ERROR("Unknown DIF (0x%.2x)", record->drh.dib.dif);
-                break;
-        }
+int mbus_variable_value_decode(mbus_data_record *record, double *value_out_real, char **value_out_str, int *value_out_str_size)
+{
+    char buff[768];
+    int ret;
+
+    ret = mbus_variable_value_decode_r(record, value_out_real, buff, sizeof(buff), value_out_str, value_out_str_size);
+
+    if (ret != 0 || *value_out_str == NULL)
+    {
+        return ret;
     }
-    else
+
+    if ((*value_out_str = (char*) malloc(*value_out_str_size + 1)) == NULL)
     {
-        MBUS_ERROR("record is null");
-        result = -3;
+        MBUS_ERROR("Unable to allocate memory");
+        return -1;
     }
 
-    return result;
+    memcpy(*value_out_str, buff, *value_out_str_size + 1);
+
+    return 0;
 }
 
 int
-mbus_vif_unit_normalize(int vif, double value, char **unit_out, double *value_out, char **quantity_out)
+mbus_vif_unit_normalize(int vif, double value, const char **unit_out, double *value_out, const char **quantity_out)
 {
-    int i;
-    double exponent = 1.0;
     unsigned newVif = vif & 0xF7F; /* clear extension bit */
 
     MBUS_DEBUG("vif_unit_normalize = 0x%03X \n", vif);
@@ -1049,28 +954,55 @@ mbus_vif_unit_normalize(int vif, double value, char **unit_out, double *value_ou
         return -1;
     }
 
-    for(i=0; vif_table[i].vif < 0xfff; ++i)
+    if (newVif < MBUS_VIF_TABLE_SIZE && vif_table[newVif].unit != NULL)
     {
-        if (vif_table[i].vif == newVif)
-        {
-            *unit_out = strdup(vif_table[i].unit);
-            *value_out = value * vif_table[i].exponent;
-            *quantity_out = strdup(vif_table[i].quantity);
-            return 0;
-        }
+        *unit_out = vif_table[newVif].unit;
+        *value_out = mbus_normalize_scale(value, vif_table[newVif].exponent);
+        *quantity_out = vif_table[newVif].quantity;
+        return 0;
     }
 
     MBUS_ERROR("%s: Unknown VIF 0x%03X\n", __PRETTY_FUNCTION__, newVif);
-    *unit_out = strdup("Unknown (VIF=0x%.02X)");
-    *quantity_out = strdup("Unknown");
-    exponent = 0.0;
+    *unit_out = "Unknown (VIF=0x%.02X)";
+    *quantity_out = "Unknown";
     *value_out = 0.0;
     return -1;
 }
 
 
 int
-mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, char **unit_out, double *value_out, char **quantity_out)
+mbus_vib_unit_code(mbus_value_information_block *vib)
+{
+    int code;
+
+    if (vib == NULL)
+    {
+        return -1;
+    }
+
+    if (vib->vif == 0xFD || vib->vif == 0xFB) /* VIF extension tables 8.4.4 a/b */
+    {
+        if (vib->nvife == 0)
+        {
+            return -1;
+        }
+
+        code = (vib->vife[0] & MBUS_DIB_VIF_WITHOUT_EXTENSION) | ((vib->vif == 0xFD) ? 0x100 : 0x200);
+    }
+    else if (vib->vif == 0x7C || vib->vif == 0xFC) /* custom VIF */
+    {
+        return -1;
+    }
+    else
+    {
+        code = vib->vif & MBUS_DIB_VIF_WITHOUT_EXTENSION;
+    }
+
+    return (vif_table[code].unit != NULL) ? code : -1;
+}
+
+int
+mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, const char **unit_out, double *value_out, const char **quantity_out)
 {
     int code;
 
@@ -1116,8 +1048,8 @@ mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, char **
                  (vib->vif == 0xFC))
         {
             // custom VIF
-            *unit_out = strdup("-");
-            *quantity_out = strdup(vib->custom_vif);
+            *unit_out = "-";
+            *quantity_out = (const char *) vib->custom_vif;
             *value_out = value;
         }
         else
@@ -1146,7 +1078,7 @@ mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, char **
             case 0x75:
             case 0x76:
             case 0x77: /* Multiplicative correction factor: 10^nnn-6 */
-                *value_out *= pow(10.0, (vib->vife[0] & 0x07) - 6);
+                *value_out = mbus_normalize_scale(*value_out, pow(10.0, (vib->vife[0] & 0x07) - 6));
                 break;
 
             case 0x78:
@@ -1185,6 +1117,7 @@ mbus_record_new()
     record->device = -1;
     record->tariff = -1;
     record->storage_number = 0;
+    record->custom_vif[0] = '\0';
     return record;
 }
 
@@ -1200,23 +1133,6 @@ mbus_record_free(mbus_record * rec)
             (rec->value).str_val.value = NULL;
         }
 
-        if (rec->unit)
-        {
-            free(rec->unit);
-            rec->unit = NULL;
-        }
-
-        if (rec->function_medium)
-        {
-            free(rec->function_medium);
-            rec->function_medium = NULL;
-        }
-
-        if (rec->quantity)
-        {
-            free(rec->quantity);
-            rec->quantity = NULL;
-        }
         free(rec);
     }
 }
@@ -1234,15 +1150,7 @@ mbus_parse_fixed_record(char status_byte, char medium_unit, unsigned char *data)
         return NULL;
     }
 
-    /* shared/static memory - get own copy */
-    record->function_medium = strdup(mbus_data_fixed_function((int)status_byte));  /* stored / actual */
-
-    if (record->function_medium == NULL)
-    {
-        MBUS_ERROR("%s: memory allocation error\n", __PRETTY_FUNCTION__);
-        mbus_record_free(record);
-        return NULL;
-    }
+    record->function_medium = mbus_data_fixed_function((int)status_byte);  /* stored / actual */
 
     if ((status_byte & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
     {
@@ -1266,10 +1174,15 @@ mbus_parse_fixed_record(char status_byte, char medium_unit, unsigned char *data)
 }
 
 
-mbus_record *
-mbus_parse_variable_record(mbus_data_record *data)
+//------------------------------------------------------------------------------
+/// Normalize a variable data record into a record of the caller, like
+/// mbus_parse_variable_record. A text value is formatted into buff and the
+/// quantity of a plain text VIF points into the data record, so the record is
+/// only valid as long as both are. Returns 0 when OK.
+//------------------------------------------------------------------------------
+static int
+mbus_parse_variable_record_r(mbus_data_record *data, mbus_record *record, char *buff, size_t buff_size)
 {
-    mbus_record * record = NULL;
     double value_out_real    = 0.0;  /**< raw value */
     char * value_out_str     = NULL;
     int    value_out_str_size = 0;
@@ -1278,15 +1191,15 @@ mbus_parse_variable_record(mbus_data_record *data)
     if (data == NULL)
     {
         MBUS_ERROR("%s: Invalid record.\n", __PRETTY_FUNCTION__);
-        return NULL;
+        return -1;
     }
 
-    if (!(record = mbus_record_new()))
-    {
-        MBUS_ERROR("%s: memory allocation error\n", __PRETTY_FUNCTION__);
-        return NULL;
-    }
-    
+    record->value.real_val = 0.0;
+    record->is_numeric = 1;
+    record->unit = NULL;
+    record->quantity = NULL;
+    record->custom_vif[0] = '\0';
+
     record->storage_number = mbus_data_record_storage_number(data);
     record->tariff = mbus_data_record_tariff(data);
     record->device = mbus_data_record_device(data);
@@ -1296,305 +1209,358 @@ mbus_parse_variable_record(mbus_data_record *data)
     {
         if (data->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
         {
-            record->function_medium = strdup("More records follow");
+            record->function_medium = "More records follow";
         }
         else
         {
-            record->function_medium = strdup("Manufacturer specific");
-        }
-
-        if (record->function_medium == NULL)
-        {
-            MBUS_ERROR("%s: memory allocation error\n", __PRETTY_FUNCTION__);
-            mbus_record_free(record);
-            return NULL;
+            record->function_medium = "Manufacturer specific";
         }
 
         /* parsing of data not implemented yet
            manufacturer specific data structures to end of user data */
 
-        if (mbus_variable_value_decode(data, &value_out_real, &value_out_str, &value_out_str_size) != 0)
+        if (mbus_variable_value_decode_r(data, &value_out_real, buff, buff_size, &value_out_str, &value_out_str_size) != 0)
         {
             MBUS_ERROR("%s: problem with mbus_variable_value_decode\n", __PRETTY_FUNCTION__);
-            mbus_record_free(record);
-            return NULL;
-        }
-
-        if (value_out_str != NULL)
-        {
-            record->is_numeric = 0;
-            (record->value).str_val.value = value_out_str;
-            (record->value).str_val.size = value_out_str_size;
-        }
-        else
-        {
-            record->is_numeric = 1;
-            (record->value).real_val = real_val;
+            return -1;
         }
     }
     else
     {
-        record->function_medium = strdup(mbus_data_record_function(data));
-
-        if (record->function_medium == NULL)
-        {
-            MBUS_ERROR("%s: memory allocation error\n", __PRETTY_FUNCTION__);
-            mbus_record_free(record);
-            return NULL;
-        }
+        record->function_medium = mbus_data_record_function(data);
 
         MBUS_DEBUG("record->function_medium = %s \n", record->function_medium);
 
-        if (mbus_variable_value_decode(data, &value_out_real, &value_out_str, &value_out_str_size) != 0)
+        if (mbus_variable_value_decode_r(data, &value_out_real, buff, buff_size, &value_out_str, &value_out_str_size) != 0)
         {
             MBUS_ERROR("%s: problem with mbus_variable_value_decode\n", __PRETTY_FUNCTION__);
-            mbus_record_free(record);
-            return NULL;
+            return -1;
         }
         MBUS_DEBUG("value_out_real = %lf \n", value_out_real);
 
         if (mbus_vib_unit_normalize(&(data->drh.vib), value_out_real, &(record->unit), &real_val, &(record->quantity)) != 0)
         {
             MBUS_ERROR("%s: problem with mbus_vib_unit_normalize\n", __PRETTY_FUNCTION__);
-            mbus_record_free(record);
-            record = NULL;
-            return NULL;
+            return -1;
         }
         MBUS_DEBUG("record->unit = %s \n", record->unit);
         MBUS_DEBUG("real_val = %lf \n", real_val);
+    }
 
-        if (value_out_str != NULL)
-        {
-            record->is_numeric = 0;
-            (record->value).str_val.value = value_out_str;
-            (record->value).str_val.size = value_out_str_size;
-        }
-        else
+    if (value_out_str != NULL)
+    {
+        record->is_numeric = 0;
+        (record->value).str_val.value = value_out_str;
+        (record->value).str_val.size = value_out_str_size;
+    }
+    else
+    {
+        record->is_numeric = 1;
+        (record->value).real_val = real_val;
+    }
+
+    return 0;
+}
+
+
+mbus_record *
+mbus_parse_variable_record(mbus_data_record *data)
+{
+    mbus_record * record = NULL;
+    char buff[768];
+
+    if (!(record = mbus_record_new()))
+    {
+        MBUS_ERROR("%s: memory allocation error\n", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if (mbus_parse_variable_record_r(data, record, buff, sizeof(buff)) != 0)
+    {
+        mbus_record_free(record);
+        return NULL;
+    }
+
+    if (record->quantity == (const char *) data->drh.vib.custom_vif)
+    {
+        /* the record must not refer to the data record */
+        snprintf(record->custom_vif, sizeof(record->custom_vif), "%s", data->drh.vib.custom_vif);
+        record->quantity = record->custom_vif;
+    }
+
+    if (! record->is_numeric)
+    {
+        if (((record->value).str_val.value = (char *) malloc((record->value).str_val.size + 1)) == NULL)
         {
-            record->is_numeric = 1;
-            (record->value).real_val = real_val;
+            MBUS_ERROR("%s: memory allocation error\n", __PRETTY_FUNCTION__);
+            mbus_record_free(record);
+            return NULL;
         }
+
+        memcpy((record->value).str_val.value, buff, (record->value).str_val.size + 1);
     }
 
     return record;
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML for variable-length data
+/// Write XML for normalized variable-length data to a sink
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_xml_normalized(mbus_data_variable *data)
+int
+mbus_data_variable_xml_normalized_sink(mbus_data_variable *data, mbus_sink *sink)
 {
     mbus_data_record *record;
-    mbus_record *norm_record;
-    char *buff = NULL, *new_buff = NULL;
-    char str_encoded[768] = "";
-    size_t len = 0, buff_size = 8192;
+    mbus_record norm_record;
+    char str_buff[768];
     size_t i;
 
-    if (data)
+    if (data == NULL || sink == NULL)
     {
-        buff = (char*) malloc(buff_size);
+        return -1;
+    }
 
-        if (buff == NULL)
-            return NULL;
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "<MBusData>\n\n");
 
-        len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    mbus_data_variable_header_xml_sink(&(data->header), sink);
 
-        len += snprintf(&buff[len], buff_size - len, "%s", mbus_data_variable_header_xml(&(data->header)));
+    for (record = data->record, i = 0; record; record = record->next, i++)
+    {
+        mbus_sink_printf(sink, "    <DataRecord id=\"%zu\">\n", i);
 
-        for (record = data->record, i = 0; record; record = record->next, i++)
+        if (mbus_parse_variable_record_r(record, &norm_record, str_buff, sizeof(str_buff)) == 0)
         {
-            norm_record = mbus_parse_variable_record(record);
-
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
-
-                if (new_buff == NULL)
-                {
-                    mbus_record_free(norm_record);
-                    free(buff);
-                    return NULL;
-                }
-
-                buff = new_buff;
-            }
+            mbus_sink_puts(sink, "        <Function>");
+            mbus_str_xml_encode_sink(sink, norm_record.function_medium);
+            mbus_sink_puts(sink, "</Function>\n");
 
-            len += snprintf(&buff[len], buff_size - len, "    <DataRecord id=\"%zu\">\n", i);
+            mbus_sink_printf(sink, "        <StorageNumber>%ld</StorageNumber>\n", norm_record.storage_number);
 
-            if (norm_record != NULL)
+            if (norm_record.tariff >= 0)
             {
-                mbus_str_xml_encode(str_encoded, norm_record->function_medium, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, "        <Function>%s</Function>\n", str_encoded);
-
-                len += snprintf(&buff[len], buff_size - len, "        <StorageNumber>%ld</StorageNumber>\n", norm_record->storage_number);
-
-                if (norm_record->tariff >= 0)
-                {
-                    len += snprintf(&buff[len], buff_size - len, "        <Tariff>%ld</Tariff>\n", norm_record->tariff);
-                    len += snprintf(&buff[len], buff_size - len, "        <Device>%d</Device>\n", norm_record->device);
-                }
-
-                mbus_str_xml_encode(str_encoded, norm_record->unit, sizeof(str_encoded));
-
-                len += snprintf(&buff[len], buff_size - len, "        <Unit>%s</Unit>\n", str_encoded);
-
-                mbus_str_xml_encode(str_encoded, norm_record->quantity, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, "        <Quantity>%s</Quantity>\n", str_encoded);
+                mbus_sink_printf(sink, "        <Tariff>%ld</Tariff>\n", norm_record.tariff);
+                mbus_sink_printf(sink, "        <Device>%d</Device>\n", norm_record.device);
+            }
 
+            mbus_sink_puts(sink, "        <Unit>");
+            mbus_str_xml_encode_sink(sink, norm_record.unit);
+            mbus_sink_puts(sink, "</Unit>\n");
 
-                if (norm_record->is_numeric)
-                {
-                    len += snprintf(&buff[len], buff_size - len, "        <Value>%f</Value>\n", norm_record->value.real_val);
-                }
-                else
-                {
-                    mbus_str_xml_encode(str_encoded, norm_record->value.str_val.value, sizeof(str_encoded));
-                    len += snprintf(&buff[len], buff_size - len, "        <Value>%s</Value>\n", str_encoded);
-                }
+            mbus_sink_puts(sink, "        <Quantity>");
+            mbus_str_xml_encode_sink(sink, norm_record.quantity);
+            mbus_sink_puts(sink, "</Quantity>\n");
 
-                mbus_record_free(norm_record);
+            if (norm_record.is_numeric)
+            {
+                mbus_sink_puts(sink, "        <Value>");
+                mbus_sink_put_double(sink, norm_record.value.real_val);
+                mbus_sink_puts(sink, "</Value>\n");
             }
             else
             {
+                mbus_sink_puts(sink, "        <Value>");
+                mbus_str_xml_encode_sink(sink, norm_record.value.str_val.value);
+                mbus_sink_puts(sink, "</Value>\n");
             }
-
-            len += snprintf(&buff[len], buff_size - len, "    </DataRecord>\n\n");
         }
 
-        len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
-
-        return buff;
+        mbus_sink_puts(sink, "    </DataRecord>\n\n");
     }
 
-    return NULL;
+    mbus_sink_puts(sink, "</MBusData>\n");
+
+    return sink->error ? -1 : 0;
 }
 
 //------------------------------------------------------------------------------
-/// Return a string containing an XML representation of the M-BUS frame data.
+/// Generate XML for variable-length data
 //------------------------------------------------------------------------------
 char *
-mbus_frame_data_xml_normalized(mbus_frame_data *data)
+mbus_data_variable_xml_normalized(mbus_data_variable *data)
+{
+    mbus_sink sink;
+
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
+
+        if (mbus_data_variable_xml_normalized_sink(data, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
+        }
+
+        mbus_sink_free(&sink);
+    }
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+/// Write an XML representation of the normalized M-BUS frame data to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_xml_normalized_sink(mbus_frame_data *data, mbus_sink *sink)
 {
     if (data)
     {
         if (data->type == MBUS_DATA_TYPE_FIXED)
         {
-            return mbus_data_fixed_xml(&(data->data_fix));
+            return mbus_data_fixed_xml_sink(&(data->data_fix), sink);
         }
 
         if (data->type == MBUS_DATA_TYPE_VARIABLE)
         {
-            return mbus_data_variable_xml_normalized(&(data->data_var));
+            return mbus_data_variable_xml_normalized_sink(&(data->data_var), sink);
         }
     }
 
-    return NULL;
+    return -1;
 }
 
 //------------------------------------------------------------------------------
-/// Generate JSON for variable-length data
+/// Return a string containing an XML representation of the M-BUS frame data.
 //------------------------------------------------------------------------------
 char *
-mbus_data_variable_json_normalized(mbus_data_variable *data)
+mbus_frame_data_xml_normalized(mbus_frame_data *data)
+{
+    mbus_sink sink;
+
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
+
+        if (mbus_frame_data_xml_normalized_sink(data, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
+        }
+
+        mbus_sink_free(&sink);
+    }
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+/// Write JSON for normalized variable-length data to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_json_normalized_sink(mbus_data_variable *data, mbus_sink *sink)
 {
     mbus_data_record *record;
-    mbus_record *norm_record;
-    char *buff = NULL, *new_buff = NULL;
-    char str_encoded[768] = "";
-    size_t len = 0, buff_size = 8192;
+    mbus_record norm_record;
+    char str_buff[768];
     size_t i;
 
-    if (data)
+    if (data == NULL || sink == NULL)
     {
-        buff = (char*) malloc(buff_size);
+        return -1;
+    }
 
-        if (buff == NULL)
-            return NULL;
+    mbus_sink_puts(sink, MBUS_JSON_PROCESSING_INSTRUCTION);
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_JSON_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "{");
 
-        len += snprintf(&buff[len], buff_size - len, "{");
+    mbus_data_variable_header_json_sink(&(data->header), sink);
 
-        len += snprintf(&buff[len], buff_size - len, "%s", mbus_data_variable_header_json(&(data->header)));
+    mbus_sink_puts(sink, ", \"DataRecord\": [");
 
-        len += snprintf(&buff[len], buff_size - len, ", \"DataRecord\": [");
-        for (record = data->record, i = 0; record; record = record->next, i++)
+    for (record = data->record, i = 0; record; record = record->next, i++)
+    {
+        if (i > 0)
         {
-            norm_record = mbus_parse_variable_record(record);
+            mbus_sink_puts(sink, ", ");
+        }
 
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
+        mbus_sink_printf(sink, "{\"id\": %zu", i);
 
-                if (new_buff == NULL)
-                {
-                    mbus_record_free(norm_record);
-                    free(buff);
-                    return NULL;
-                }
+        if (mbus_parse_variable_record_r(record, &norm_record, str_buff, sizeof(str_buff)) == 0)
+        {
+            mbus_sink_puts(sink, ", \"Function\": \"");
+            mbus_str_json_encode_sink(sink, norm_record.function_medium);
+            mbus_sink_puts(sink, "\"");
 
-                buff = new_buff;
-            }
+            mbus_sink_printf(sink, ", \"StorageNumber\": %ld", norm_record.storage_number);
 
-            if (i > 0)
+            if (norm_record.tariff >= 0)
             {
-                len += snprintf(&buff[len], buff_size - len, ", ");
+                mbus_sink_printf(sink, ", \"Tariff\": %ld", norm_record.tariff);
+                mbus_sink_printf(sink, ", \"Device\": %d", norm_record.device);
             }
 
-            len += snprintf(&buff[len], buff_size - len, "{\"id\": %zu", i);
+            mbus_sink_puts(sink, ", \"Unit\": \"");
+            mbus_str_json_encode_sink(sink, norm_record.unit);
+            mbus_sink_puts(sink, "\"");
 
-            if (norm_record != NULL)
+            mbus_sink_puts(sink, ", \"Quantity\": \"");
+            mbus_str_json_encode_sink(sink, norm_record.quantity);
+            mbus_sink_puts(sink, "\"");
+
+            if (norm_record.is_numeric)
+            {
+                mbus_sink_puts(sink, ", \"Value\": ");
+                mbus_sink_put_double(sink, norm_record.value.real_val);
+            }
+            else
             {
-                mbus_str_json_encode(str_encoded, norm_record->function_medium, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, ", \"Function\": \"%s\"", str_encoded);
+                mbus_sink_puts(sink, ", \"Value\": \"");
+                mbus_str_json_encode_sink(sink, norm_record.value.str_val.value);
+                mbus_sink_puts(sink, "\"");
+            }
+        }
 
-                len += snprintf(&buff[len], buff_size - len, ", \"StorageNumber\": %ld", norm_record->storage_number);
+        mbus_sink_puts(sink, "}");
+    }
 
-                if (norm_record->tariff >= 0)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ", \"Tariff\": %ld", norm_record->tariff);
-                    len += snprintf(&buff[len], buff_size - len, ", \"Device\": %d", norm_record->device);
-                }
+    // like the other JSON writers, one object per line
+    mbus_sink_puts(sink, "]}\n");
 
-                mbus_str_json_encode(str_encoded, norm_record->unit, sizeof(str_encoded));
+    return sink->error ? -1 : 0;
+}
 
-                len += snprintf(&buff[len], buff_size - len, ", \"Unit\": \"%s\"", str_encoded);
+//------------------------------------------------------------------------------
+/// Generate JSON for variable-length data
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_json_normalized(mbus_data_variable *data)
+{
+    mbus_sink sink;
 
-                mbus_str_json_encode(str_encoded, norm_record->quantity, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, ", \"Quantity\": \"%s\"", str_encoded);
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
+        if (mbus_data_variable_json_normalized_sink(data, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
+        }
 
-                if (norm_record->is_numeric)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ", \"Value\": %f", norm_record->value.real_val);
-                }
-                else
-                {
-                    mbus_str_json_encode(str_encoded, norm_record->value.str_val.value, sizeof(str_encoded));
-                    len += snprintf(&buff[len], buff_size - len, ", \"Value\": \"%s\"", str_encoded);
-                }
+        mbus_sink_free(&sink);
+    }
 
-                mbus_record_free(norm_record);
-            }
-            else
-            {
-            }
+    return NULL;
+}
 
-            len += snprintf(&buff[len], buff_size - len, "}");
+//------------------------------------------------------------------------------
+/// Write a JSON representation of the normalized M-BUS frame data to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_json_normalized_sink(mbus_frame_data *data, mbus_sink *sink)
+{
+    if (data)
+    {
+        if (data->type == MBUS_DATA_TYPE_FIXED)
+        {
+            return mbus_data_fixed_json_sink(&(data->data_fix), sink);
         }
 
-        len += snprintf(&buff[len], buff_size - len, "]}");
-
-        return buff;
+        if (data->type == MBUS_DATA_TYPE_VARIABLE)
+        {
+            return mbus_data_variable_json_normalized_sink(&(data->data_var), sink);
+        }
     }
 
-    return NULL;
+    return -1;
 }
 
 //------------------------------------------------------------------------------
@@ -1603,17 +1569,18 @@ mbus_data_variable_json_normalized(mbus_data_variable *data)
 char *
 mbus_frame_data_json_normalized(mbus_frame_data *data)
 {
+    mbus_sink sink;
+
     if (data)
     {
-        if (data->type == MBUS_DATA_TYPE_FIXED)
-        {
-            return mbus_data_fixed_json(&(data->data_fix));
-        }
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-        if (data->type == MBUS_DATA_TYPE_VARIABLE)
+        if (mbus_frame_data_json_normalized_sink(data, &sink) == 0)
         {
-            return mbus_data_variable_json_normalized(&(data->data_var));
+            return mbus_sink_detach(&sink);
         }
+
+        mbus_sink_free(&sink);
     }
 
     return NULL;
@@ -1621,129 +1588,180 @@ mbus_frame_data_json_normalized(mbus_frame_data *data)
 
 
 //------------------------------------------------------------------------------
-/// Generate InfluxDB Line Protocol for variable-length data
+/// Write InfluxDB Line Protocol for normalized variable-length data to a sink
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_influxdb_normalized(mbus_data_variable *data)
+int
+mbus_data_variable_influxdb_normalized_sink(mbus_data_variable *data, mbus_sink *sink)
 {
     mbus_data_record *record;
-    mbus_record *norm_record;
-    char *buff = NULL, *new_buff = NULL;
-    char str_encoded[768] = "";
-    size_t len = 0, buff_size = 8192;
-    size_t i;
+    mbus_record norm_record;
+    char str_buff[768];
+    size_t i, dataRecordCount;
 
-    if (data)
+    if (data == NULL || sink == NULL)
     {
-        buff = (char*) malloc(buff_size);
+        return -1;
+    }
 
-        if (buff == NULL)
-            return NULL;
+    mbus_sink_puts(sink, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "MBusData,");
 
-        len += snprintf(&buff[len], buff_size - len, "MBusData, ");
+    mbus_data_variable_header_influxdb_sink(&(data->header), sink);
 
-        len += snprintf(&buff[len], buff_size - len, "%s ", mbus_data_variable_header_influxdb(&(data->header)));
+    mbus_sink_puts(sink, " ");
 
-        for (record = data->record, i = 0; record; record = record->next, i++)
+    for (record = data->record, i = 0, dataRecordCount = 0; record; record = record->next, i++)
+    {
+        if (mbus_parse_variable_record_r(record, &norm_record, str_buff, sizeof(str_buff)) != 0)
         {
-            norm_record = mbus_parse_variable_record(record);
-
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
+            continue;
+        }
 
-                if (new_buff == NULL)
-                {
-                    mbus_record_free(norm_record);
-                    free(buff);
-                    return NULL;
-                }
+        if (dataRecordCount++ > 0)
+        {
+            mbus_sink_puts(sink, ",");
+        }
 
-                buff = new_buff;
-            }
+        mbus_sink_printf(sink, "DataRecord_%zu_Function=\"", i);
+        mbus_str_influxdb_encode_sink(sink, norm_record.function_medium);
+        mbus_sink_puts(sink, "\"");
 
-            if (norm_record != NULL)
-            {
-                if (i > 0)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ",");
-                }
+        mbus_sink_printf(sink, ",DataRecord_%zu_StorageNumber=%ld", i, norm_record.storage_number);
 
-                mbus_str_influxdb_encode(str_encoded, norm_record->function_medium, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, "DataRecord_%d_Function=\"%s\"", i, str_encoded);
+        if (norm_record.tariff >= 0)
+        {
+            mbus_sink_printf(sink, ",DataRecord_%zu_Tariff=%ld", i, norm_record.tariff);
+            mbus_sink_printf(sink, ",DataRecord_%zu_Device=%d", i, norm_record.device);
+        }
 
-                len += snprintf(&buff[len], buff_size - len, ",DataRecord_%d_StorageNumber=%ld", i, norm_record->storage_number);
+        mbus_sink_printf(sink, ",DataRecord_%zu_Unit=\"", i);
+        mbus_str_influxdb_encode_sink(sink, norm_record.unit);
+        mbus_sink_puts(sink, "\"");
 
-                if (norm_record->tariff >= 0)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ",DataRecord_%d_Tariff=%ld", norm_record->tariff);
-                    len += snprintf(&buff[len], buff_size - len, ",DataRecord_%d_Device=>%d", norm_record->device);
-                }
+        mbus_sink_printf(sink, ",DataRecord_%zu_Quantity=\"", i);
+        mbus_str_influxdb_encode_sink(sink, norm_record.quantity);
+        mbus_sink_puts(sink, "\"");
 
-                mbus_str_influxdb_encode(str_encoded, norm_record->unit, sizeof(str_encoded));
+        if (norm_record.is_numeric)
+        {
+            mbus_sink_printf(sink, ",DataRecord_%zu_Value=", i);
+            mbus_sink_put_double(sink, norm_record.value.real_val);
+        }
+        else
+        {
+            mbus_sink_printf(sink, ",DataRecord_%zu_Value=\"", i);
+            mbus_str_influxdb_encode_sink(sink, norm_record.value.str_val.value);
+            mbus_sink_puts(sink, "\"");
+        }
+    }
 
-                len += snprintf(&buff[len], buff_size - len, ",DataRecord_%d_Unit=\"%s\"", str_encoded);
+    mbus_sink_puts(sink, "\n");
 
-                mbus_str_influxdb_encode(str_encoded, norm_record->quantity, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, ",DataRecord_%d_Quantity=\"%s\"", str_encoded);
+    return sink->error ? -1 : 0;
+}
 
+//------------------------------------------------------------------------------
+/// Generate InfluxDB Line Protocol for variable-length data
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_influxdb_normalized(mbus_data_variable *data)
+{
+    mbus_sink sink;
 
-                if (norm_record->is_numeric)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ",DataRecord_%d_Value=%f", norm_record->value.real_val);
-                }
-                else
-                {
-                    mbus_str_influxdb_encode(str_encoded, norm_record->value.str_val.value, sizeof(str_encoded));
-                    len += snprintf(&buff[len], buff_size - len, ",DataRecord_%d_Value=\"%s\"", str_encoded);
-                }
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-                mbus_record_free(norm_record);
-            }
-            else
-            {
-            }
+        if (mbus_data_variable_influxdb_normalized_sink(data, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
         }
 
-        return buff;
+        mbus_sink_free(&sink);
     }
 
     return NULL;
 }
 
 //------------------------------------------------------------------------------
-/// Return a string containing an InfluxDB Line Protocol representation of the 
-/// M-BUS frame data.
+/// Write an InfluxDB Line Protocol representation of the normalized M-BUS frame
+/// data to a sink.
 //------------------------------------------------------------------------------
-char *
-mbus_frame_data_influxdb_normalized(mbus_frame_data *data)
+int
+mbus_frame_data_influxdb_normalized_sink(mbus_frame_data *data, mbus_sink *sink)
 {
     if (data)
     {
         if (data->type == MBUS_DATA_TYPE_FIXED)
         {
-            return mbus_data_fixed_influxdb(&(data->data_fix));
+            return mbus_data_fixed_influxdb_sink(&(data->data_fix), sink);
         }
 
         if (data->type == MBUS_DATA_TYPE_VARIABLE)
         {
-            return mbus_data_variable_influxdb_normalized(&(data->data_var));
+            return mbus_data_variable_influxdb_normalized_sink(&(data->data_var), sink);
         }
     }
 
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+/// Return a string containing an InfluxDB Line Protocol representation of the 
+/// M-BUS frame data.
+//------------------------------------------------------------------------------
+char *
+mbus_frame_data_influxdb_normalized(mbus_frame_data *data)
+{
+    mbus_sink sink;
+
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
+
+        if (mbus_frame_data_influxdb_normalized_sink(data, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
+        }
+
+        mbus_sink_free(&sink);
+    }
+
     return NULL;
 }
 
 
+//------------------------------------------------------------------------------
+// Set the transport independent fields of a new handle to their defaults.
+//------------------------------------------------------------------------------
+void
+mbus_context_init(mbus_handle *handle)
+{
+    handle->fd = -1;
+    handle->max_data_retry = 3;
+    handle->max_search_retry = 1;
+    handle->is_serial = 0;
+    handle->purge_first_frame = MBUS_FRAME_PURGE_M2S;
+    handle->purge_mode = MBUS_PURGE_MODE_TIMEOUT;
+    handle->purge_silence_time = 0;
+    handle->recv_event = NULL;
+    handle->send_event = NULL;
+    handle->scan_progress = NULL;
+    handle->found_event = NULL;
+    handle->capture = NULL;
+    handle->capture_id = 0;
+    handle->link_profile = NULL;
+    handle->link_baudrate = 0;
+    handle->link_switched = 0;
+    handle->link_selected[0] = '\0';
+}
+
 mbus_handle *
 mbus_context_serial(const char *device)
 {
     mbus_handle *handle;
     mbus_serial_data *serial_data;
-    char error_str[128];
 
     if ((handle = (mbus_handle *) malloc(sizeof(mbus_handle))) == NULL)
     {
@@ -1753,31 +1771,29 @@ mbus_context_serial(const char *device)
 
     if ((serial_data = (mbus_serial_data *)malloc(sizeof(mbus_serial_data))) == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
-        mbus_error_str_set(error_str);
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
         free(handle);
         return NULL;
     }
 
-    handle->max_data_retry = 3;
-    handle->max_search_retry = 1;
+    mbus_context_init(handle);
     handle->is_serial = 1;
-    handle->purge_first_frame = MBUS_FRAME_PURGE_M2S;
     handle->auxdata = serial_data;
     handle->open = mbus_serial_connect;
     handle->close = mbus_serial_disconnect;
     handle->recv = mbus_serial_recv_frame;
+    handle->wait_recv = mbus_serial_wait_recv;
+    handle->set_baudrate = mbus_serial_set_baudrate;
     handle->send = mbus_serial_send_frame;
     handle->free_auxdata = mbus_serial_data_free;
-    handle->recv_event = NULL;
-    handle->send_event = NULL;
-    handle->scan_progress = NULL;
-    handle->found_event = NULL;
+
+    serial_data->baudrate = 2400;
+    serial_data->response_timeout = 0;
+    serial_data->byte_timeout = 0;
 
     if ((serial_data->device = strdup(device)) == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for device\n", __PRETTY_FUNCTION__);
-        mbus_error_str_set(error_str);
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for device\n", __PRETTY_FUNCTION__);
         free(serial_data);
         free(handle);
         return NULL;
@@ -1791,7 +1807,6 @@ mbus_context_tcp(const char *host, uint16_t port)
 {
     mbus_handle *handle;
     mbus_tcp_data *tcp_data;
-    char error_str[128];
 
     if ((handle = (mbus_handle *) malloc(sizeof(mbus_handle))) == NULL)
     {
@@ -1801,32 +1816,30 @@ mbus_context_tcp(const char *host, uint16_t port)
 
     if ((tcp_data = (mbus_tcp_data *)malloc(sizeof(mbus_tcp_data))) == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
-        mbus_error_str_set(error_str);
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
         free(handle);
         return NULL;
     }
 
-    handle->max_data_retry = 3;
-    handle->max_search_retry = 1;
-    handle->is_serial = 0;
-    handle->purge_first_frame = MBUS_FRAME_PURGE_M2S;
+    mbus_context_init(handle);
     handle->auxdata = tcp_data;
     handle->open = mbus_tcp_connect;
     handle->close = mbus_tcp_disconnect;
     handle->recv = mbus_tcp_recv_frame;
+    handle->wait_recv = mbus_tcp_wait_recv;
+    handle->set_baudrate = NULL;
     handle->send = mbus_tcp_send_frame;
     handle->free_auxdata = mbus_tcp_data_free;
-    handle->recv_event = NULL;
-    handle->send_event = NULL;
-    handle->scan_progress = NULL;
-    handle->found_event = NULL;
 
     tcp_data->port = port;
+    tcp_data->connect_timeout = 0;
+    tcp_data->read_timeout = 0;
+    tcp_data->write_timeout = 0;
+    tcp_data->addr_list = NULL;
+    tcp_data->addr_next = NULL;
     if ((tcp_data->host = strdup(host)) == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for host\n", __PRETTY_FUNCTION__);
-        mbus_error_str_set(error_str);
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for host\n", __PRETTY_FUNCTION__);
         free(tcp_data);
         free(handle);
         return NULL;
@@ -1903,6 +1916,56 @@ mbus_context_set_option(mbus_handle * handle, mbus_context_option option, long v
                 return 0;
             }
             break;
+        case MBUS_OPTION_PURGE_MODE:
+            if ((value == MBUS_PURGE_MODE_TIMEOUT) ||
+                (value == MBUS_PURGE_MODE_SILENCE))
+            {
+                handle->purge_mode = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_PURGE_SILENCE_TIME:
+            if ((value >= 0) && (value <= 60000))
+            {
+                handle->purge_silence_time = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_TCP_CONNECT_TIMEOUT:
+            if (handle->open == mbus_tcp_connect && (value >= 0) && (value <= 3600000))
+            {
+                ((mbus_tcp_data *) handle->auxdata)->connect_timeout = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_TCP_READ_TIMEOUT:
+            if (handle->open == mbus_tcp_connect && (value >= 0) && (value <= 3600000))
+            {
+                ((mbus_tcp_data *) handle->auxdata)->read_timeout = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_TCP_WRITE_TIMEOUT:
+            if (handle->open == mbus_tcp_connect && (value >= 0) && (value <= 3600000))
+            {
+                ((mbus_tcp_data *) handle->auxdata)->write_timeout = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_SERIAL_RESPONSE_TIMEOUT:
+            if (handle->open == mbus_serial_connect && (value >= 0) && (value <= 60000))
+            {
+                ((mbus_serial_data *) handle->auxdata)->response_timeout = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_SERIAL_BYTE_TIMEOUT:
+            if (handle->open == mbus_serial_connect && (value >= 0) && (value <= 60000))
+            {
+                ((mbus_serial_data *) handle->auxdata)->byte_timeout = value;
+                return 0;
+            }
+            break;
     }
 
     return -1; // unable to set option
@@ -1948,29 +2011,184 @@ mbus_recv_frame(mbus_handle * handle, mbus_frame *frame)
     return result;
 }
 
-int mbus_purge_frames(mbus_handle *handle)
+int
+mbus_wait_recv(mbus_handle * handle, long timeout_ms)
 {
-    int err, received;
-    mbus_frame reply;
-
-    memset((void *)&reply, 0, sizeof(mbus_frame));
-
-    received = 0;
-    while (1)
+    if (handle == NULL || handle->wait_recv == NULL)
     {
-        err = mbus_recv_frame(handle, &reply);
-        if (err != MBUS_RECV_RESULT_OK &&
-            err != MBUS_RECV_RESULT_INVALID)
-            break;
-
-        received = 1;
+        MBUS_ERROR("%s: Invalid M-Bus handle for wait.\n", __PRETTY_FUNCTION__);
+        return -1;
     }
 
-    return received;
+    return handle->wait_recv(handle, timeout_ms);
 }
 
-int
-mbus_send_frame(mbus_handle * handle, mbus_frame *frame)
+long
+mbus_purge_silence_time(mbus_handle * handle)
+{
+    long baudrate = 2400, latency = MBUS_TCP_LATENCY_MS;
+    mbus_serial_data *serial_data;
+
+    if (handle == NULL)
+        return 0;
+
+    if (handle->purge_silence_time > 0)
+        return handle->purge_silence_time;
+
+    if (handle->is_serial)
+    {
+        serial_data = (mbus_serial_data *) handle->auxdata;
+
+        if (serial_data && serial_data->baudrate > 0)
+            baudrate = serial_data->baudrate;
+
+        latency = MBUS_SERIAL_LATENCY_MS;
+    }
+
+    // inter-frame gap of 33 bit periods (EN 13757-2), rounded up
+    return (MBUS_INTER_FRAME_GAP_BITS * 1000 + baudrate - 1) / baudrate + latency;
+}
+
+int mbus_purge_frames(mbus_handle *handle)
+{
+    int err, received;
+    mbus_frame reply;
+
+    memset((void *)&reply, 0, sizeof(mbus_frame));
+
+    received = 0;
+    while (1)
+    {
+        if (handle && handle->purge_mode == MBUS_PURGE_MODE_SILENCE && handle->wait_recv)
+        {
+            // a silent line after the last stop byte means there is nothing
+            // else to purge, no need to wait for a full receive timeout
+            if (handle->wait_recv(handle, mbus_purge_silence_time(handle)) <= 0)
+                break;
+        }
+
+        err = mbus_recv_frame(handle, &reply);
+        if (err != MBUS_RECV_RESULT_OK &&
+            err != MBUS_RECV_RESULT_INVALID)
+            break;
+
+        received = 1;
+    }
+
+    return received;
+}
+
+void
+mbus_recv_buffer_reset(mbus_recv_buffer *buffer)
+{
+    if (buffer)
+    {
+        buffer->head = 0;
+        buffer->count = 0;
+    }
+}
+
+ssize_t
+mbus_recv_buffer_fill(mbus_recv_buffer *buffer, int fd)
+{
+    size_t tail, space;
+    ssize_t nread;
+
+    if (buffer == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (buffer->count == 0)
+    {
+        // restart at the beginning to get the largest contiguous space
+        buffer->head = 0;
+    }
+
+    if (buffer->count >= sizeof(buffer->data))
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    // contiguous free space behind the buffered data
+    tail = (buffer->head + buffer->count) % sizeof(buffer->data);
+    space = (tail >= buffer->head) ? sizeof(buffer->data) - tail : buffer->head - tail;
+
+    if ((nread = read(fd, &buffer->data[tail], space)) > 0)
+    {
+        buffer->count += nread;
+    }
+
+    return nread;
+}
+
+int
+mbus_recv_buffer_parse(mbus_recv_buffer *buffer, mbus_parser *parser,
+                       unsigned char *raw, size_t raw_size, size_t *raw_len)
+{
+    size_t chunk, consumed, copy;
+    int result;
+
+    if (buffer == NULL || parser == NULL)
+    {
+        return -1;
+    }
+
+    result = parser->result;
+
+    while (buffer->count > 0 && result > 0)
+    {
+        chunk = sizeof(buffer->data) - buffer->head;
+        if (chunk > buffer->count)
+            chunk = buffer->count;
+
+        result = mbus_parser_feed(parser, &buffer->data[buffer->head], chunk, &consumed);
+
+        if (raw && raw_len && *raw_len < raw_size)
+        {
+            copy = raw_size - *raw_len;
+            if (copy > consumed)
+                copy = consumed;
+
+            memcpy(&raw[*raw_len], &buffer->data[buffer->head], copy);
+            *raw_len += copy;
+        }
+
+        buffer->head = (buffer->head + consumed) % sizeof(buffer->data);
+        buffer->count -= consumed;
+    }
+
+    return result;
+}
+
+int
+mbus_recv_buffer_wait(mbus_recv_buffer *buffer, int fd, long timeout_ms)
+{
+    struct pollfd pfd;
+    int ret;
+
+    if (buffer == NULL)
+        return -1;
+
+    if (buffer->count > 0)
+        return 1;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do
+    {
+        ret = poll(&pfd, 1, (int) timeout_ms);
+    } while (ret == -1 && errno == EINTR);
+
+    return ret;
+}
+
+int
+mbus_send_frame(mbus_handle * handle, mbus_frame *frame)
 {
     if (handle == NULL)
     {
@@ -2230,8 +2448,7 @@ mbus_send_user_data_frame(mbus_handle * handle, int address, const unsigned char
 int
 mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int max_frames)
 {
-    int retval = 0, more_frames = 1, retry = 0;
-    mbus_frame_data reply_data;
+    int retval = 0, more_frames = 1, more_records, retry = 0;
     mbus_frame *frame, *next_frame;
     int frame_count = 0, result;
 
@@ -2262,14 +2479,16 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
 
     frame->address = address;
 
+    // switch a selected slave to the baudrate of its link profile
+    if (address == MBUS_ADDRESS_NETWORK_LAYER)
+        mbus_link_begin(handle);
+
     //
     // continue to read until no more records are available (usually only one
     // reply frame, but can be more for so-called multi-telegram replies)
     //
     next_frame = reply;
 
-    memset((void *)&reply_data, 0, sizeof(mbus_frame_data));
-
     while (more_frames)
     {
         if (retry > handle->max_data_retry)
@@ -2323,9 +2542,10 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
 
         //
         // We need to parse the data in the received frame to be able to tell
-        // if more records are available or not.
+        // if more records are available or not (the records themselves are
+        // not needed here).
         //
-        if (mbus_frame_data_parse(next_frame, &reply_data) == -1)
+        if ((more_records = mbus_frame_more_records_follow(next_frame)) == -1)
         {
             MBUS_ERROR("%s: M-bus data parse error.\n", __PRETTY_FUNCTION__);
             retval = 1;
@@ -2335,55 +2555,43 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
         //
         // Continue a cycle of sending requests and reading replies until the
         // reply do not have DIF=0x1F in the last record (which signals that
-        // more records are available.
+        // more records are available. Only single frame replies for FIXED
+        // type frames.
         //
+        more_frames = 0;
 
-        if (reply_data.type != MBUS_DATA_TYPE_VARIABLE)
-        {
-            // only single frame replies for FIXED type frames
-            more_frames = 0;
-        }
-        else
+        if (more_records &&
+            ((max_frames > 0) && (frame_count < max_frames))) // only readout max_frames
         {
-            more_frames = 0;
-
-            if (reply_data.data_var.more_records_follow &&
-                ((max_frames > 0) && (frame_count < max_frames))) // only readout max_frames
-            {
-                if (debug)
-                    printf("%s: debug: expecting more frames\n", __PRETTY_FUNCTION__);
-
-                more_frames = 1;
+            if (debug)
+                printf("%s: debug: expecting more frames\n", __PRETTY_FUNCTION__);
 
-                // allocate new frame and increment next_frame pointer
-                next_frame->next = mbus_frame_new(MBUS_FRAME_TYPE_ANY);
+            more_frames = 1;
 
-                if (next_frame->next == NULL)
-                {
-                    MBUS_ERROR("%s: failed to allocate mbus frame.\n", __PRETTY_FUNCTION__);
-                    retval = -1;
-                    more_frames = 0;
-                }
+            // allocate new frame and increment next_frame pointer
+            next_frame->next = mbus_frame_new(MBUS_FRAME_TYPE_ANY);
 
-                next_frame = next_frame->next;
-
-                // toogle FCB bit
-                frame->control ^= MBUS_CONTROL_MASK_FCB;
-            }
-            else
+            if (next_frame->next == NULL)
             {
-                if (debug)
-                    printf("%s: debug: no more frames\n", __PRETTY_FUNCTION__);
+                MBUS_ERROR("%s: failed to allocate mbus frame.\n", __PRETTY_FUNCTION__);
+                retval = -1;
+                more_frames = 0;
             }
-        }
 
-        if (reply_data.data_var.record)
+            next_frame = next_frame->next;
+
+            // toogle FCB bit
+            frame->control ^= MBUS_CONTROL_MASK_FCB;
+        }
+        else
         {
-            // free's up the whole list
-            mbus_data_record_free(reply_data.data_var.record);
+            if (debug)
+                printf("%s: debug: no more frames\n", __PRETTY_FUNCTION__);
         }
     }
 
+    mbus_link_end(handle);
+
     mbus_frame_free(frame);
     return retval;
 }
@@ -2446,6 +2654,9 @@ mbus_select_secondary_address(mbus_handle * handle, const char *mask)
         return MBUS_PROBE_ERROR;
     }
 
+    // the slave selected for the link profile, see mbus_link_begin
+    handle->link_selected[0] = '\0';
+
     /* send select command */
     if (mbus_send_select_frame(handle, mask) == -1)
     {
@@ -2478,6 +2689,7 @@ mbus_select_secondary_address(mbus_handle * handle, const char *mask)
             return MBUS_PROBE_COLLISION;
         }
 
+        memcpy(handle->link_selected, mask, sizeof(handle->link_selected));
         return MBUS_PROBE_SINGLE;
     }
 
@@ -2487,14 +2699,13 @@ mbus_select_secondary_address(mbus_handle * handle, const char *mask)
 }
 
 //------------------------------------------------------------------------------
-// Probe for the presence of a device(s) using the supplied secondary address
-// (mask).
+/// Probe for the presence of a device(s) using the supplied secondary address
+/// (mask), the reply of a single device is returned in reply.
 //------------------------------------------------------------------------------
-int
-mbus_probe_secondary_address(mbus_handle *handle, const char *mask, char *matching_addr)
+static int
+mbus_probe_secondary_reply(mbus_handle *handle, const char *mask, char *matching_addr, mbus_frame *reply)
 {
-    int ret, i;
-    mbus_frame reply;
+    int ret = MBUS_PROBE_NOTHING, i;
 
     if (mask == NULL || matching_addr == NULL || strlen(mask) != 16)
     {
@@ -2518,8 +2729,8 @@ mbus_probe_secondary_address(mbus_handle *handle, const char *mask, char *matchi
                 return MBUS_PROBE_ERROR;
             }
 
-            memset((void *)&reply, 0, sizeof(mbus_frame));
-            ret = mbus_recv_frame(handle, &reply);
+            memset((void *)reply, 0, sizeof(mbus_frame));
+            ret = mbus_recv_frame(handle, reply);
 
             if (ret == MBUS_RECV_RESULT_TIMEOUT)
             {
@@ -2539,9 +2750,10 @@ mbus_probe_secondary_address(mbus_handle *handle, const char *mask, char *matchi
                 return MBUS_PROBE_COLLISION;
             }
 
-            if (mbus_frame_type(&reply) == MBUS_FRAME_TYPE_LONG)
+            if (mbus_frame_type(reply) == MBUS_FRAME_TYPE_LONG)
             {
-                char *addr = mbus_frame_get_secondary_address(&reply);
+                char addr_buff[32];
+                char *addr = mbus_frame_get_secondary_address_r(reply, addr_buff, sizeof(addr_buff));
 
                 if (addr == NULL)
                 {
@@ -2553,11 +2765,6 @@ mbus_probe_secondary_address(mbus_handle *handle, const char *mask, char *matchi
 
                 snprintf(matching_addr, 17, "%s", addr);
 
-                if (handle->found_event)
-                {
-                    handle->found_event(handle,&reply);
-                }
-
                 return MBUS_PROBE_SINGLE;
             }
             else
@@ -2577,6 +2784,26 @@ mbus_probe_secondary_address(mbus_handle *handle, const char *mask, char *matchi
     return ret;
 }
 
+//------------------------------------------------------------------------------
+// Probe for the presence of a device(s) using the supplied secondary address
+// (mask).
+//------------------------------------------------------------------------------
+int
+mbus_probe_secondary_address(mbus_handle *handle, const char *mask, char *matching_addr)
+{
+    int ret;
+    mbus_frame reply;
+
+    ret = mbus_probe_secondary_reply(handle, mask, matching_addr, &reply);
+
+    if (ret == MBUS_PROBE_SINGLE && handle->found_event)
+    {
+        handle->found_event(handle,&reply);
+    }
+
+    return ret;
+}
+
 
 int mbus_read_slave(mbus_handle * handle, mbus_address *address, mbus_frame * reply)
 {
@@ -2632,10 +2859,13 @@ int mbus_read_slave(mbus_handle * handle, mbus_address *address, mbus_frame * re
         }
         /* else MBUS_PROBE_SINGLE */
 
+        mbus_link_begin(handle);
+
         if (mbus_send_request_frame(handle, MBUS_ADDRESS_NETWORK_LAYER) == -1)
         {
             MBUS_ERROR("%s: Failed to send M-Bus request frame.\n",
                        __PRETTY_FUNCTION__);
+            mbus_link_end(handle);
             return -1;
         }
     }
@@ -2644,9 +2874,12 @@ int mbus_read_slave(mbus_handle * handle, mbus_address *address, mbus_frame * re
     {
         MBUS_ERROR("%s: Failed to receive M-Bus response frame.\n",
                    __PRETTY_FUNCTION__);
+        mbus_link_end(handle);
         return -1;
     }
 
+    mbus_link_end(handle);
+
     return 0;
 }
 
@@ -2688,61 +2921,951 @@ mbus_scan_2nd_address_range(mbus_handle * handle, int pos, char *addr_mask)
         i_start = 0;
         i_end   = 9;
     }
+    else if (pos < 15)
+    {
+        // mask[pos] is not a wildcard -> don't iterate, recursively check pos+1
+        mbus_scan_2nd_address_range(handle, pos+1, mask);
+        free(mask);
+        return 0;
+    }
     else
     {
-        if (pos < 15)
+        // .. except if we're at the last pos (==15) and this isn't a wildcard we still need to send the probe
+        i_start = (int)(mask[pos] - '0');
+        i_end   = (int)(mask[pos] - '0');
+    }
+
+    for (i = i_start; i <= i_end; i++)
+    {
+        mask[pos] = '0'+i;
+
+        if (handle->scan_progress)
+            handle->scan_progress(handle,mask);
+
+        probe_ret = mbus_probe_secondary_address(handle, mask, matching_mask);
+
+        if (probe_ret == MBUS_PROBE_SINGLE)
+        {
+            if (!handle->found_event)
+            {
+                printf("Found a device on secondary address %s [using address mask %s]\n", matching_mask, mask);
+            }
+        }
+        else if (probe_ret == MBUS_PROBE_COLLISION)
         {
-            // mask[pos] is not a wildcard -> don't iterate, recursively check pos+1
+            // collision, more than one device matching, restrict the search mask further
             mbus_scan_2nd_address_range(handle, pos+1, mask);
         }
-        else
+        else if (probe_ret == MBUS_PROBE_NOTHING)
+        {
+             // nothing... move on to next address mask
+        }
+        else // MBUS_PROBE_ERROR
         {
-            // .. except if we're at the last pos (==15) and this isn't a wildcard we still need to send the probe
-            i_start = (int)(mask[pos] - '0');
-            i_end   = (int)(mask[pos] - '0');
+            MBUS_ERROR("%s: Failed to probe secondary address [%s].\n", __PRETTY_FUNCTION__, mask);
+            free(mask);
+            return -1;
         }
     }
 
-    // skip the scanning if we're returning from the (pos < 15) case above
-    if (mask[pos] == 'f' || mask[pos] == 'F' || pos == 15)
+    free(mask);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Time (ms) the transport of a handle waits for the reply of a slave.
+//------------------------------------------------------------------------------
+static long
+mbus_scan_recv_timeout(mbus_handle *handle)
+{
+    if (handle->open == mbus_serial_connect)
+        return mbus_serial_recv_timeout(handle);
+
+    if (handle->open == mbus_tcp_connect)
+        return mbus_tcp_recv_timeout(handle);
+
+    // other transports time out on their own, as at 2400 baud
+    return mbus_serial_recv_timeout(NULL);
+}
+
+//------------------------------------------------------------------------------
+/// Milliseconds elapsed since start.
+//------------------------------------------------------------------------------
+static long
+mbus_scan_elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+//
+// State of a primary address scan
+//
+typedef struct _mbus_scan_primary_state {
+    struct timespec start;      // start of the scan
+    long full;                  // full response timeout (ms)
+    long slowest;               // slowest response seen (ms), -1 for none yet
+    long sent[MBUS_MAX_PRIMARY_SLAVES + 1];     // end of the last ping (ms since start)
+    char shortened[MBUS_MAX_PRIMARY_SLAVES + 1];// silent within a shortened timeout
+    int count;                  // addresses with a reply
+} mbus_scan_primary_state;
+
+//------------------------------------------------------------------------------
+/// Ping a primary address and wait up to timeout ms for a reply. The end of
+/// the ping is stored in state->sent, the time (ms since the start of the
+/// scan) the reply began in *reply_at and its response time in *elapsed. A
+/// garbled or incomplete reply (e.g. of colliding slaves) is given up at the
+/// end of the line activity and reported as collision.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_primary_probe(mbus_handle *handle, mbus_scan_primary_state *state, int address,
+                        long timeout, long *reply_at, long *elapsed)
+{
+    mbus_frame reply;
+    char progress[4];
+    int ret;
+
+    memset((void *)&reply, 0, sizeof(mbus_frame));
+
+    if (handle->scan_progress)
+    {
+        snprintf(progress, sizeof(progress), "%d", address);
+        handle->scan_progress(handle, progress);
+    }
+
+    if (mbus_send_ping_frame(handle, address, 0) != 0)
+        return MBUS_PROBE_ERROR;
+
+    state->sent[address] = mbus_scan_elapsed(&state->start);
+
+    if ((ret = mbus_wait_recv(handle, timeout)) <= 0)
+        return (ret == 0) ? MBUS_PROBE_NOTHING : MBUS_PROBE_ERROR;
+
+    *reply_at = mbus_scan_elapsed(&state->start);
+    *elapsed = *reply_at - state->sent[address];
+
+    ret = mbus_recv_frame(handle, &reply);
+
+    if (ret == MBUS_RECV_RESULT_TIMEOUT)
+        return MBUS_PROBE_NOTHING;
+
+    if (ret == MBUS_RECV_RESULT_ERROR || ret == MBUS_RECV_RESULT_RESET)
+        return MBUS_PROBE_ERROR;
+
+    if (ret == MBUS_RECV_RESULT_OK && mbus_frame_type(&reply) == MBUS_FRAME_TYPE_ACK)
+    {
+        // check for more data (collision)
+        return mbus_purge_frames(handle) ? MBUS_PROBE_COLLISION : MBUS_PROBE_SINGLE;
+    }
+
+    mbus_purge_frames(handle);
+    return MBUS_PROBE_COLLISION;
+}
+
+//------------------------------------------------------------------------------
+/// Probe a primary address, retrying only while the line shows activity.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_primary_address(mbus_handle *handle, mbus_scan_primary_state *state, int address,
+                          long timeout, long *reply_at, long *elapsed)
+{
+    int retry, ret;
+
+    for (retry = 0; ; retry++)
+    {
+        ret = mbus_scan_primary_probe(handle, state, address, timeout, reply_at, elapsed);
+
+        // nothing on the line: a retry would time out again
+        if (ret != MBUS_PROBE_COLLISION || retry >= handle->max_search_retry)
+            return ret;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Count an address with a reply and learn the response time of a single
+/// slave.
+//------------------------------------------------------------------------------
+static void
+mbus_scan_primary_found(mbus_handle *handle, mbus_scan_primary_state *state, int address,
+                        int result, long elapsed,
+                        void (*found)(mbus_handle *handle, int address, int result))
+{
+    if (result == MBUS_PROBE_SINGLE && elapsed > state->slowest)
+        state->slowest = elapsed;
+
+    state->count++;
+    if (found)
+        found(handle, address, result);
+}
+
+//------------------------------------------------------------------------------
+/// A reply at reply_at may be a late answer to any address before end that
+/// was silent within a shortened timeout and pinged less than the full timeout
+/// before: probe these again with the full timeout. Returns the number of
+/// addresses probed again, -1 on errors.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_primary_recheck(mbus_handle *handle, mbus_scan_primary_state *state,
+                          int first, int end, long reply_at,
+                          void (*found)(mbus_handle *handle, int address, int result))
+{
+    long elapsed, again_at;
+    int address, ret, rechecked = 0;
+
+    for (address = first; address < end; address++)
     {
-        for (i = i_start; i <= i_end; i++)
+        if (!state->shortened[address] || reply_at - state->sent[address] >= state->full)
+            continue;
+
+        state->shortened[address] = 0;
+        rechecked++;
+
+        elapsed = 0;
+        if ((ret = mbus_scan_primary_address(handle, state, address, state->full, &again_at, &elapsed)) == MBUS_PROBE_ERROR)
         {
-            mask[pos] = '0'+i;
+            MBUS_ERROR("%s: Failed to probe primary address %d.\n", __PRETTY_FUNCTION__, address);
+            return -1;
+        }
+
+        if (ret != MBUS_PROBE_NOTHING)
+            mbus_scan_primary_found(handle, state, address, ret, elapsed, found);
+    }
+
+    return rechecked;
+}
+
+//------------------------------------------------------------------------------
+/// Scan a range of primary addresses, see mbus_scan_primary.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_primary_range(mbus_handle *handle, int first, int last,
+                        void (*found)(mbus_handle *handle, int address, int result))
+{
+    mbus_scan_primary_state state;
+    long timeout, elapsed, reply_at, deadline, now;
+    int address, ret, rechecked;
+
+    memset((void *)&state, 0, sizeof(state));
+    clock_gettime(CLOCK_MONOTONIC, &state.start);
+    state.full = mbus_scan_recv_timeout(handle);
+    state.slowest = -1;
+
+    for (address = first; address <= last; address++)
+    {
+        // twice the slowest response seen so far, at least the line silence
+        // ending a transmission
+        timeout = state.full;
+        if (state.slowest >= 0 && 2 * state.slowest + mbus_purge_silence_time(handle) < state.full)
+            timeout = 2 * state.slowest + mbus_purge_silence_time(handle);
 
-            if (handle->scan_progress)
-                handle->scan_progress(handle,mask);
+        elapsed = reply_at = 0;
+        ret = mbus_scan_primary_address(handle, &state, address, timeout, &reply_at, &elapsed);
 
-            probe_ret = mbus_probe_secondary_address(handle, mask, matching_mask);
+        if (ret == MBUS_PROBE_ERROR)
+        {
+            MBUS_ERROR("%s: Failed to probe primary address %d.\n", __PRETTY_FUNCTION__, address);
+            return -1;
+        }
+
+        if (ret != MBUS_PROBE_NOTHING)
+        {
+            // a slave of an earlier address answering later than the
+            // shortened timeout shows up here (possibly several addresses
+            // later): probe these and this one again with the full timeout
+            // and learn the slower response time
+            if ((rechecked = mbus_scan_primary_recheck(handle, &state, first, address, reply_at, found)) == -1)
+                return -1;
 
-            if (probe_ret == MBUS_PROBE_SINGLE)
+            if (rechecked > 0)
             {
-                if (!handle->found_event)
+                elapsed = 0;
+                timeout = state.full;
+                if ((ret = mbus_scan_primary_address(handle, &state, address, timeout, &reply_at, &elapsed)) == MBUS_PROBE_ERROR)
                 {
-                    printf("Found a device on secondary address %s [using address mask %s]\n", matching_mask, mask);
+                    MBUS_ERROR("%s: Failed to probe primary address %d.\n", __PRETTY_FUNCTION__, address);
+                    return -1;
                 }
             }
-            else if (probe_ret == MBUS_PROBE_COLLISION)
-            {
-                // collision, more than one device matching, restrict the search mask further
-                mbus_scan_2nd_address_range(handle, pos+1, mask);
-            }
-            else if (probe_ret == MBUS_PROBE_NOTHING)
-            {
-                 // nothing... move on to next address mask
-            }
-            else // MBUS_PROBE_ERROR
-            {
-                MBUS_ERROR("%s: Failed to probe secondary address [%s].\n", __PRETTY_FUNCTION__, mask);
+        }
+
+        state.shortened[address] = (ret == MBUS_PROBE_NOTHING && timeout < state.full);
+
+        if (ret != MBUS_PROBE_NOTHING)
+            mbus_scan_primary_found(handle, &state, address, ret, elapsed, found);
+    }
+
+    // late answers to the last addresses
+    deadline = 0;
+    for (address = first; address <= last; address++)
+    {
+        if (state.shortened[address] && state.sent[address] + state.full > deadline)
+            deadline = state.sent[address] + state.full;
+    }
+
+    now = mbus_scan_elapsed(&state.start);
+
+    if (deadline > now && mbus_wait_recv(handle, deadline - now) > 0)
+    {
+        reply_at = mbus_scan_elapsed(&state.start);
+        mbus_purge_frames(handle);
+
+        if (mbus_scan_primary_recheck(handle, &state, first, last + 1, reply_at, found) == -1)
+            return -1;
+    }
+
+    return state.count;
+}
+
+//------------------------------------------------------------------------------
+// Scan a range of primary addresses with a timeout learned from the response
+// times of the slaves found.
+//------------------------------------------------------------------------------
+int
+mbus_scan_primary(mbus_handle *handle, int first, int last,
+                  void (*found)(mbus_handle *handle, int address, int result))
+{
+    char purge_mode;
+    int ret;
+
+    if (handle == NULL || first < 0 || last > MBUS_MAX_PRIMARY_SLAVES || first > last)
+    {
+        MBUS_ERROR("%s: Invalid handle or address range.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    // the replies of colliding slaves start at the same time, a silent line
+    // after an ACK is enough to rule out a collision
+    purge_mode = handle->purge_mode;
+    handle->purge_mode = MBUS_PURGE_MODE_SILENCE;
+
+    ret = mbus_scan_primary_range(handle, first, last, found);
+
+    handle->purge_mode = purge_mode;
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+// Secondary address cache of mbus_scan_2nd_address_cached
+//------------------------------------------------------------------------------
+typedef struct _mbus_scan_entry {
+    char address[17];
+    int present;                // confirmed or found by the current scan
+    int confirmed;              // selected and read by its full address
+} mbus_scan_entry;
+
+typedef struct _mbus_scan_cache {
+    mbus_scan_entry *entries;
+    size_t count;
+} mbus_scan_cache;
+
+//------------------------------------------------------------------------------
+/// Check if a secondary address matches an address mask: F is a wildcard for
+/// a digit of the ID, FF for a byte of manufacturer, version and medium.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_mask_match(const char *mask, const char *address)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (mask[i] != 'f' && mask[i] != 'F' && toupper(mask[i]) != toupper(address[i]))
+            return 0;
+    }
+
+    for (i = 8; i < 16; i += 2)
+    {
+        if (toupper(mask[i]) == 'F' && toupper(mask[i+1]) == 'F')
+            continue;
+
+        if (toupper(mask[i]) != toupper(address[i]) || toupper(mask[i+1]) != toupper(address[i+1]))
+            return 0;
+    }
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Add an address to the cache (or mark it present), returns the entry.
+//------------------------------------------------------------------------------
+static mbus_scan_entry *
+mbus_scan_cache_add(mbus_scan_cache *cache, const char *address, int present)
+{
+    mbus_scan_entry *entries, *entry;
+    char upper[17];
+    size_t i;
+
+    for (i = 0; i < 16; i++)
+        upper[i] = toupper(address[i]);
+    upper[16] = '\0';
+
+    for (i = 0; i < cache->count; i++)
+    {
+        if (strcmp(cache->entries[i].address, upper) == 0)
+        {
+            cache->entries[i].present |= present;
+            return &cache->entries[i];
+        }
+    }
+
+    if ((entries = (mbus_scan_entry *) realloc(cache->entries, (cache->count + 1) * sizeof(mbus_scan_entry))) == NULL)
+        return NULL;
+
+    cache->entries = entries;
+    entry = &entries[cache->count++];
+
+    memcpy(entry->address, upper, sizeof(entry->address));
+    entry->present = present;
+    entry->confirmed = 0;
+
+    return entry;
+}
+
+//------------------------------------------------------------------------------
+/// Number of present devices matching an address mask.
+//------------------------------------------------------------------------------
+static size_t
+mbus_scan_cache_known(mbus_scan_cache *cache, const char *mask)
+{
+    size_t i, known = 0;
+
+    for (i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].present && mbus_scan_mask_match(mask, cache->entries[i].address))
+            known++;
+    }
+
+    return known;
+}
+
+//------------------------------------------------------------------------------
+/// Check if an address mask is a full secondary address (no wildcard).
+//------------------------------------------------------------------------------
+static int
+mbus_scan_mask_complete(const char *mask)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (toupper(mask[i]) == 'F')
+            return 0;
+    }
+
+    for (i = 8; i < 16; i += 2)
+    {
+        if (toupper(mask[i]) == 'F' && toupper(mask[i+1]) == 'F')
+            return 0;
+    }
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Check if the only present device matching an address mask was confirmed.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_cache_confirmed(mbus_scan_cache *cache, const char *mask)
+{
+    size_t i;
+
+    if (mbus_scan_cache_known(cache, mask) != 1)
+        return 0;
+
+    for (i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].present && mbus_scan_mask_match(mask, cache->entries[i].address))
+            return cache->entries[i].confirmed;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Load a cache file, one secondary address per line ('#' starts a comment).
+/// A missing file is an empty cache.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_cache_load(mbus_scan_cache *cache, const char *path)
+{
+    FILE *fp;
+    char line[256], *p;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return (errno == ENOENT) ? 0 : -1;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        for (p = line; isspace(*p); p++)
+            ;
+
+        if (*p == '#' || *p == '\0')
+            continue;
+
+        p[strcspn(p, " \t\r\n#")] = '\0';
+
+        if (!mbus_is_secondary_address(p))
+        {
+            MBUS_ERROR("%s: Ignoring invalid secondary address [%s] in %s.\n", __PRETTY_FUNCTION__, p, path);
+            continue;
+        }
+
+        if (mbus_scan_cache_add(cache, p, 0) == NULL)
+        {
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Write the present devices and the ones outside of the scanned address mask
+/// to the cache file (replacing it only when completely written).
+//------------------------------------------------------------------------------
+static int
+mbus_scan_cache_save(mbus_scan_cache *cache, const char *path, const char *mask)
+{
+    FILE *fp;
+    char tmp_path[4096];
+    size_t i;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path) ||
+        (fp = fopen(tmp_path, "w")) == NULL)
+    {
+        return -1;
+    }
+
+    fprintf(fp, "# libmbus secondary address cache\n");
+
+    for (i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].present || !mbus_scan_mask_match(mask, cache->entries[i].address))
+            fprintf(fp, "%s\n", cache->entries[i].address);
+    }
+
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Confirm a known device with a select of its full address and read it, like
+/// a probe that found it. A full address does not collide, so there is no need
+/// to purge the line.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_confirm(mbus_handle *handle, const char *address)
+{
+    mbus_frame reply;
+    int ret;
+
+    if (mbus_send_select_frame(handle, address) == -1)
+        return MBUS_PROBE_ERROR;
+
+    memset((void *)&reply, 0, sizeof(mbus_frame));
+    ret = mbus_recv_frame(handle, &reply);
+
+    if (ret == MBUS_RECV_RESULT_INVALID)
+    {
+        // garbage in reply to a full address, e.g. two devices with the same
+        // address (or a damaged ACK)
+        mbus_purge_frames(handle);
+        return MBUS_PROBE_COLLISION;
+    }
+
+    if (ret != MBUS_RECV_RESULT_OK || mbus_frame_type(&reply) != MBUS_FRAME_TYPE_ACK)
+        return MBUS_PROBE_NOTHING;
+
+    if (mbus_send_request_frame(handle, MBUS_ADDRESS_NETWORK_LAYER) == -1)
+        return MBUS_PROBE_ERROR;
+
+    memset((void *)&reply, 0, sizeof(mbus_frame));
+    ret = mbus_recv_frame(handle, &reply);
+
+    if (ret == MBUS_RECV_RESULT_INVALID)
+    {
+        mbus_purge_frames(handle);
+        return MBUS_PROBE_COLLISION;
+    }
+
+    if (ret != MBUS_RECV_RESULT_OK || mbus_frame_type(&reply) != MBUS_FRAME_TYPE_LONG)
+        return MBUS_PROBE_NOTHING;
+
+    if (handle->found_event)
+    {
+        handle->found_event(handle, &reply);
+    }
+    else
+    {
+        printf("Found a device on secondary address %s [using address mask %s]\n", address, address);
+    }
+
+    return MBUS_PROBE_SINGLE;
+}
+
+//------------------------------------------------------------------------------
+/// Number of distinct values of a field (ID digit or header byte) among the
+/// present devices matching an address mask, counted per value in seen.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_field_distinct(mbus_scan_cache *cache, const char *mask, int offset, int len, size_t *seen)
+{
+    char value[3];
+    size_t i;
+    int v, distinct = 0;
+
+    memset((void *)seen, 0, 256 * sizeof(size_t));
+
+    for (i = 0; i < cache->count; i++)
+    {
+        if (!cache->entries[i].present || (mask && !mbus_scan_mask_match(mask, cache->entries[i].address)))
+            continue;
+
+        memcpy(value, &cache->entries[i].address[offset], len);
+        value[len] = '\0';
+        v = (int) strtol(value, NULL, 16);
+
+        if (seen[v]++ == 0)
+            distinct++;
+    }
+
+    return distinct;
+}
+
+//------------------------------------------------------------------------------
+/// Choose the field of a colliding address mask to split next, returns its
+/// offset in the mask (-1 if the mask is complete) and its length in *len.
+///
+/// ID digits come first (10 probes per split, header bytes need 255). The
+/// order is taken from the devices already known, under this mask if there
+/// are at least two, else on the whole bus: the digit with the fewest
+/// distinct values (but at least two) separates the devices with the fewest
+/// colliding probes further down, digits that never differ come last (with
+/// luck the devices are separated before). Without statistics the digits are
+/// split from left to right like mbus_scan_2nd_address_range. Of the header
+/// bytes the one with the most distinct values comes first, medium before
+/// version before manufacturer.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_split_field(mbus_scan_cache *cache, const char *mask, int *len)
+{
+    static const int header[] = { 14, 12, 10, 8 };
+    size_t seen[256];
+    const char *scope;
+    int i, n, rank, best = -1, best_rank = 0;
+
+    scope = (mbus_scan_cache_known(cache, mask) >= 2) ? mask : NULL;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (mask[i] != 'f' && mask[i] != 'F')
+            continue;
+
+        n = mbus_scan_field_distinct(cache, scope, i, 1, seen);
+        rank = (n >= 2) ? n : ((n == 0) ? 20 + i : 30 + i);
+
+        if (best < 0 || rank < best_rank)
+        {
+            best = i;
+            best_rank = rank;
+        }
+    }
+
+    if (best >= 0)
+    {
+        *len = 1;
+        return best;
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        if (toupper(mask[header[i]]) != 'F' || toupper(mask[header[i] + 1]) != 'F')
+            continue;
+
+        n = mbus_scan_field_distinct(cache, scope, header[i], 2, seen);
+
+        if (best < 0 || n > best_rank)
+        {
+            best = header[i];
+            best_rank = n;
+        }
+    }
+
+    *len = 2;
+    return best;
+}
+
+//------------------------------------------------------------------------------
+/// Probe an address mask and add the device found to the cache. A device that
+/// was confirmed before is unchanged and not reported again. When it is the
+/// only known device of the mask, a select is enough: a new device under the
+/// mask makes the ACKs collide, a single ACK is the confirmed device.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_2nd_address_probe(mbus_handle *handle, const char *mask, mbus_scan_cache *cache)
+{
+    mbus_scan_entry *entry;
+    mbus_frame reply;
+    char matching_mask[17];
+    int probe_ret = MBUS_PROBE_NOTHING, i;
+
+    if (handle->scan_progress)
+        handle->scan_progress(handle, mask);
+
+    if (mbus_scan_cache_confirmed(cache, mask))
+    {
+        for (i = 0; i <= handle->max_search_retry; i++)
+        {
+            probe_ret = mbus_select_secondary_address(handle, mask);
+
+            if (probe_ret != MBUS_PROBE_NOTHING)
+                break;
+        }
+
+        if (probe_ret == MBUS_PROBE_ERROR)
+            MBUS_ERROR("%s: Failed to probe secondary address [%s].\n", __PRETTY_FUNCTION__, mask);
+
+        return probe_ret;
+    }
+
+    probe_ret = mbus_probe_secondary_reply(handle, mask, matching_mask, &reply);
+
+    if (probe_ret == MBUS_PROBE_SINGLE)
+    {
+        if ((entry = mbus_scan_cache_add(cache, matching_mask, 1)) == NULL)
+        {
+            MBUS_ERROR("%s: Failed to allocate cache entry.\n", __PRETTY_FUNCTION__);
+            return MBUS_PROBE_ERROR;
+        }
+
+        if (entry->confirmed)
+            return probe_ret;
+
+        if (handle->found_event)
+        {
+            handle->found_event(handle, &reply);
+        }
+        else
+        {
+            printf("Found a device on secondary address %s [using address mask %s]\n", matching_mask, mask);
+        }
+    }
+    else if (probe_ret == MBUS_PROBE_ERROR)
+    {
+        MBUS_ERROR("%s: Failed to probe secondary address [%s].\n", __PRETTY_FUNCTION__, mask);
+    }
+
+    return probe_ret;
+}
+
+//------------------------------------------------------------------------------
+/// Probe the masks of a colliding address mask with one more field set. A
+/// header byte is set to the values seen on the bus first, then to all other
+/// values (FF is the wildcard). Masks that match two or more present devices
+/// are not probed, they collide anyway.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_2nd_address_split(mbus_handle *handle, const char *addr_mask, mbus_scan_cache *cache)
+{
+    size_t seen[256];
+    int values[256], count = 0, offset, len, i, v, probe_ret;
+    char mask[17];
+
+    if ((offset = mbus_scan_split_field(cache, addr_mask, &len)) < 0)
+    {
+        MBUS_ERROR("%s: Devices with the same secondary address [%s].\n", __PRETTY_FUNCTION__, addr_mask);
+        return 0;
+    }
+
+    if (len == 1)
+    {
+        for (v = 0; v <= 9; v++)
+            values[count++] = v;
+    }
+    else
+    {
+        mbus_scan_field_distinct(cache, NULL, offset, 2, seen);
+
+        for (v = 0; v < 0xFF; v++)
+            if (seen[v])
+                values[count++] = v;
+
+        for (v = 0; v < 0xFF; v++)
+            if (!seen[v])
+                values[count++] = v;
+    }
+
+    memcpy(mask, addr_mask, sizeof(mask));
+
+    for (i = 0; i < count; i++)
+    {
+        if (len == 1)
+            mask[offset] = '0' + values[i];
+        else
+            snprintf(&mask[offset], 3, "%02X", values[i]);
+
+        mask[offset + len] = addr_mask[offset + len];
+
+        if (mbus_scan_cache_known(cache, mask) >= 2)
+        {
+            if (mbus_scan_2nd_address_split(handle, mask, cache) == -1)
                 return -1;
-            }
+            continue;
+        }
+
+        if (mbus_scan_mask_complete(mask) && mbus_scan_cache_confirmed(cache, mask))
+            continue;
+
+        probe_ret = mbus_scan_2nd_address_probe(handle, mask, cache);
+
+        if (probe_ret == MBUS_PROBE_COLLISION)
+        {
+            // more than one device matching, restrict the search mask further
+            if (mbus_scan_2nd_address_split(handle, mask, cache) == -1)
+                return -1;
+        }
+        else if (probe_ret == MBUS_PROBE_ERROR)
+        {
+            return -1;
         }
     }
 
-    free(mask);
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// Scan an address mask: probe it as a whole (unless it matches two or more
+/// present devices) and split it while the probes collide.
+//------------------------------------------------------------------------------
+static int
+mbus_scan_2nd_address_adaptive_walk(mbus_handle *handle, const char *addr_mask, mbus_scan_cache *cache)
+{
+    int probe_ret;
+
+    if (mbus_scan_cache_known(cache, addr_mask) >= 2)
+        return mbus_scan_2nd_address_split(handle, addr_mask, cache);
+
+    if (mbus_scan_mask_complete(addr_mask) && mbus_scan_cache_confirmed(cache, addr_mask))
+        return 0;
+
+    probe_ret = mbus_scan_2nd_address_probe(handle, addr_mask, cache);
+
+    if (probe_ret == MBUS_PROBE_COLLISION)
+    {
+        return mbus_scan_2nd_address_split(handle, addr_mask, cache);
+    }
+    else if (probe_ret == MBUS_PROBE_ERROR)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Scan the secondary addresses, splitting colliding masks in the order
+// learned from the devices found.
+//------------------------------------------------------------------------------
+int
+mbus_scan_2nd_address_adaptive(mbus_handle *handle, const char *addr_mask)
+{
+    mbus_scan_cache cache;
+    int ret;
+
+    if (handle == NULL || !mbus_is_secondary_address(addr_mask))
+    {
+        MBUS_ERROR("%s: Invalid handle or address mask.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    memset((void *)&cache, 0, sizeof(cache));
+
+    ret = mbus_scan_2nd_address_adaptive_walk(handle, addr_mask, &cache);
+
+    free(cache.entries);
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+// Rescan the secondary addresses starting from the devices of a cache file.
+//------------------------------------------------------------------------------
+int
+mbus_scan_2nd_address_cached(mbus_handle *handle, const char *addr_mask, const char *cache_path)
+{
+    mbus_scan_cache cache;
+    mbus_scan_entry *entry;
+    size_t i;
+    int ret = 0;
+
+    if (handle == NULL || cache_path == NULL || !mbus_is_secondary_address(addr_mask))
+    {
+        MBUS_ERROR("%s: Invalid handle, address mask or cache file.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    memset((void *)&cache, 0, sizeof(cache));
+
+    if (mbus_scan_cache_load(&cache, cache_path) == -1)
+    {
+        MBUS_ERROR("%s: Failed to read cache file %s: %s\n", __PRETTY_FUNCTION__, cache_path, strerror(errno));
+        free(cache.entries);
+        return -1;
+    }
+
+    // confirm the known devices in the range of the scan
+    for (i = 0; i < cache.count && ret == 0; i++)
+    {
+        entry = &cache.entries[i];
+
+        if (!mbus_scan_mask_match(addr_mask, entry->address))
+            continue;
+
+        switch (mbus_scan_confirm(handle, entry->address))
+        {
+            case MBUS_PROBE_SINGLE:
+                entry->present = 1;
+                entry->confirmed = 1;
+                break;
+
+            case MBUS_PROBE_COLLISION:
+                entry->present = 1;
+                break;
+
+            case MBUS_PROBE_ERROR:
+                MBUS_ERROR("%s: Failed to select secondary address [%s].\n", __PRETTY_FUNCTION__, entry->address);
+                ret = -1;
+                break;
+
+            default:
+                MBUS_DEBUG("%s: Device %s is gone.\n", __PRETTY_FUNCTION__, entry->address);
+                break;
+        }
+    }
+
+    if (ret == 0)
+        ret = mbus_scan_2nd_address_adaptive_walk(handle, addr_mask, &cache);
+
+    if (ret == 0 && mbus_scan_cache_save(&cache, cache_path, addr_mask) == -1)
+    {
+        MBUS_ERROR("%s: Failed to write cache file %s: %s\n", __PRETTY_FUNCTION__, cache_path, strerror(errno));
+        ret = -1;
+    }
+
+    free(cache.entries);
+    return ret;
+}
+
 //------------------------------------------------------------------------------
 // Convert a buffer with hex values into a buffer with binary values.
 // - invalid character stops convertion
@@ -2753,7 +3876,7 @@ mbus_hex2bin(unsigned char * dst, size_t dst_len, const unsigned char * src, siz
 {
     size_t i, result = 0;
     unsigned long val;
-    unsigned char *ptr, *end, buf[3];
+    char *ptr, *end, buf[3];
 
     if (!src || !dst)
     {
@@ -2774,7 +3897,7 @@ mbus_hex2bin(unsigned char * dst, size_t dst_len, const unsigned char * src, siz
 
         end = buf;
         ptr = end;
-        val = strtoul(ptr, (char **)&end, 16);
+        val = strtoul(ptr, &end, 16);
 
         // abort at non hex value
         if (ptr == end)
@@ -65,6 +65,8 @@
 #ifndef __MBUS_PROTOCOL_AUX_H__
 #define __MBUS_PROTOCOL_AUX_H__
 
+#include <sys/types.h>
+
 #include "mbus-protocol.h"
 
 #ifdef __cplusplus
@@ -80,6 +82,22 @@ extern "C" {
 #define MBUS_FRAME_PURGE_M2S  1
 #define MBUS_FRAME_PURGE_NONE 0
 
+#define MBUS_PURGE_MODE_TIMEOUT 0
+#define MBUS_PURGE_MODE_SILENCE 1
+
+#define MBUS_RECV_BUFFER_SIZE 2048
+
+/**
+ * Receive ring buffer of a transport handle. Data is read from the connection
+ * in bulk, bytes beyond the end of the current frame are kept for the next
+ * call to mbus_recv_frame.
+ */
+typedef struct _mbus_recv_buffer {
+    unsigned char data[MBUS_RECV_BUFFER_SIZE];
+    size_t head;                /**< Index of the oldest buffered byte */
+    size_t count;               /**< Number of buffered bytes */
+} mbus_recv_buffer;
+
 /**
  * Unified MBus handle type encapsulating either Serial or TCP gateway.
  */
@@ -88,16 +106,26 @@ typedef struct _mbus_handle {
     int max_data_retry;
     int max_search_retry;
     char purge_first_frame;
+    char purge_mode;            /**< How mbus_purge_frames detects the end of a transmission */
+    long purge_silence_time;    /**< Line silence (ms) ending a purge, 0 to derive from the baudrate */
     char is_serial; /**< _handle type (non zero for serial) */
     int (*open) (struct _mbus_handle *handle);
     int (*close) (struct _mbus_handle *handle);
     int (*send) (struct _mbus_handle *handle, mbus_frame *frame);
     int (*recv) (struct _mbus_handle *handle, mbus_frame *frame);
+    int (*wait_recv) (struct _mbus_handle *handle, long timeout_ms);
+    int (*set_baudrate) (struct _mbus_handle *handle, long baudrate); /**< Switch the host port, NULL if the transport cannot */
     void (*free_auxdata) (struct _mbus_handle *handle);
     void (*recv_event) (unsigned char src_type, const char *buff, size_t len);
     void (*send_event) (unsigned char src_type, const char *buff, size_t len);
     void (*scan_progress) (struct _mbus_handle *handle, const char *mask);
     void (*found_event) (struct _mbus_handle *handle, mbus_frame *frame);    
+    struct _mbus_capture *capture; /**< Capture file recording the traffic, see mbus_capture_attach */
+    unsigned int capture_id;    /**< Handle id of the capture records */
+    struct _mbus_link_profile *link_profile; /**< Link profile, see mbus_link_attach */
+    long link_baudrate;         /**< Bus baudrate of the link profile */
+    long link_switched;         /**< Baudrate the selected slave was switched to, 0 for none */
+    char link_selected[17];     /**< Secondary address selected last */
     void *auxdata;
 } mbus_handle;
 
@@ -140,12 +168,13 @@ typedef union _mbus_value {
 typedef struct _mbus_record {
     mbus_value value;          /**< Quantity value */
     char                is_numeric;      /**< Quantity value type (nonzero is numeric) */
-    char               *unit;           /**< Quantity unit (e.g. Wh) */
-    char               *function_medium; /**< Quantity medium or function (e.g. Electricity) */
-    char               *quantity;       /**< Quantity type (e.g. Energy) */
+    const char         *unit;           /**< Quantity unit (e.g. Wh), static string */
+    const char         *function_medium; /**< Quantity medium or function (e.g. Electricity), static string */
+    const char         *quantity;       /**< Quantity type (e.g. Energy), static string or custom_vif */
     int                 device;         /**< Quantity device */
     long                tariff;         /**< Quantity tariff */
     long                storage_number; /**< Quantity storage number */
+    char                custom_vif[128]; /**< Quantity type of a plain text VIF */
 } mbus_record;
 
 /**
@@ -154,7 +183,14 @@ typedef struct _mbus_record {
 typedef enum _mbus_context_option {
     MBUS_OPTION_MAX_DATA_RETRY,  /**< option defines the maximum attempts of data request retransmission */
     MBUS_OPTION_MAX_SEARCH_RETRY,  /**< option defines the maximum attempts of search request retransmission */
-    MBUS_OPTION_PURGE_FIRST_FRAME  /**< option controls the echo cancelation for mbus_recv_frame */
+    MBUS_OPTION_PURGE_FIRST_FRAME, /**< option controls the echo cancelation for mbus_recv_frame */
+    MBUS_OPTION_PURGE_MODE,        /**< option selects timeout or line silence based collision detection in mbus_purge_frames */
+    MBUS_OPTION_PURGE_SILENCE_TIME, /**< option sets the line silence (ms) for MBUS_PURGE_MODE_SILENCE, 0 derives it from the baudrate */
+    MBUS_OPTION_TCP_CONNECT_TIMEOUT, /**< option sets the TCP connect timeout (ms) of the handle, 0 uses the mbus_tcp_set_timeout_set default */
+    MBUS_OPTION_TCP_READ_TIMEOUT,    /**< option sets the TCP read timeout (ms) of the handle, 0 uses the mbus_tcp_set_timeout_set default */
+    MBUS_OPTION_TCP_WRITE_TIMEOUT,   /**< option sets the TCP write timeout (ms) of the handle, 0 uses the mbus_tcp_set_timeout_set default */
+    MBUS_OPTION_SERIAL_RESPONSE_TIMEOUT, /**< option sets the time (ms) a serial handle waits for the first byte of a reply, 0 derives it from the baudrate */
+    MBUS_OPTION_SERIAL_BYTE_TIMEOUT  /**< option sets the longest gap (ms) between the bytes of a reply on a serial handle, 0 derives it from the baudrate */
 } mbus_context_option;
 
 /**
@@ -187,6 +223,16 @@ mbus_handle * mbus_context_serial(const char *device);
  */
 mbus_handle * mbus_context_tcp(const char *host, uint16_t port);
 
+/**
+ * Initialize the transport independent fields of a handle (retries, purge
+ * settings, events, capture and link profile) to their defaults. Used by the
+ * context constructors of the transports, which set the transport callbacks
+ * and auxdata afterwards.
+ *
+ * @param handle Handle to initialize
+ */
+void mbus_context_init(mbus_handle *handle);
+
 /**
  * Deallocate memory used by M-Bus context.
  *
@@ -243,6 +289,71 @@ int mbus_recv_frame(mbus_handle * handle, mbus_frame *frame);
  */
 int mbus_purge_frames(mbus_handle * handle);
 
+/**
+ * Wait until received data is available or the line stays silent.
+ *
+ * @param handle     Initialized handle
+ * @param timeout_ms Maximum time to wait in milliseconds
+ *
+ * @return Positive when data is available, zero on timeout, -1 on error.
+ */
+int mbus_wait_recv(mbus_handle * handle, long timeout_ms);
+
+/**
+ * Line silence after the stop byte of a frame that marks the end of a
+ * transmission (inter-frame gap according to EN 13757-2 plus transport latency).
+ *
+ * @param handle Initialized handle
+ *
+ * @return Silence time in milliseconds.
+ */
+long mbus_purge_silence_time(mbus_handle * handle);
+
+/**
+ * Discard all data kept in a transport receive buffer.
+ *
+ * @param buffer Receive buffer
+ */
+void mbus_recv_buffer_reset(mbus_recv_buffer *buffer);
+
+/**
+ * Read all currently available data from a file descriptor into the receive
+ * buffer using a single read call.
+ *
+ * @param buffer Receive buffer
+ * @param fd     File descriptor to read from
+ *
+ * @return Number of bytes read, 0 on end of file/timeout, -1 on error (errno is set).
+ */
+ssize_t mbus_recv_buffer_fill(mbus_recv_buffer *buffer, int fd);
+
+/**
+ * Feed buffered data to an incremental frame parser. Only bytes up to the end
+ * of the current frame are consumed, the rest stays buffered for the next frame.
+ *
+ * @param buffer   Receive buffer
+ * @param parser   Initialized frame parser
+ * @param raw      Optional buffer the consumed bytes are appended to (may be NULL)
+ * @param raw_size Size of raw
+ * @param raw_len  Number of bytes in raw, updated on return
+ *
+ * @return Same as mbus_parser_feed: > 0 when more data is needed, 0 when a frame was parsed, < 0 on error.
+ */
+int mbus_recv_buffer_parse(mbus_recv_buffer *buffer, mbus_parser *parser,
+                           unsigned char *raw, size_t raw_size, size_t *raw_len);
+
+/**
+ * Wait for data on a file descriptor, data already kept in the receive buffer
+ * counts as available.
+ *
+ * @param buffer     Receive buffer
+ * @param fd         File descriptor
+ * @param timeout_ms Maximum time to wait in milliseconds
+ *
+ * @return Positive when data is available, zero on timeout, -1 on error.
+ */
+int mbus_recv_buffer_wait(mbus_recv_buffer *buffer, int fd, long timeout_ms);
+
 /**
  * Sends frame using "unified" handle
  *
@@ -409,13 +520,13 @@ mbus_record * mbus_parse_variable_record(mbus_data_record *record);
  *
  * @param medium_unit_byte medium/unit byte of the fixed counter
  * @param medium_value    raw counter value
- * @param unit_out        units of the counter - use free when done
+ * @param unit_out        units of the counter (static string)
  * @param value_out       resulting counter value
- * @param quantity_out    parsed quantity, when done use "free"
+ * @param quantity_out    parsed quantity (static string)
  *
  * @return zero when OK
  */
-int mbus_data_fixed_normalize(int medium_unit_byte, long medium_value, char **unit_out, double *value_out, char **quantity_out);
+int mbus_data_fixed_normalize(int medium_unit_byte, long medium_value, const char **unit_out, double *value_out, const char **quantity_out);
 
 
 
@@ -436,26 +547,37 @@ int mbus_variable_value_decode(mbus_data_record *record, double *value_out_real,
  *
  * @param vif         VIF (including standard extensions)
  * @param value       already parsed "raw" numerical value
- * @param unit_out     parsed unit, when done use "free"
+ * @param unit_out     parsed unit (static string)
  * @param value_out    normalized value
- * @param quantity_out parsed quantity, when done use "free"
+ * @param quantity_out parsed quantity (static string)
  *
  * @return zero when OK
  */
-int mbus_vif_unit_normalize(int vif, double value, char **unit_out, double *value_out, char **quantity_out);
+int mbus_vif_unit_normalize(int vif, double value, const char **unit_out, double *value_out, const char **quantity_out);
 
 /**
  * Decode units and normalize value from VIB
  *
  * @param vib         mbus value information block of the variable record
  * @param value       already parsed "raw" numerical value
- * @param unit_out     parsed unit, when done use "free"
+ * @param unit_out     parsed unit (static string)
  * @param value_out    normalized value
- * @param quantity_out parsed quantity, when done use "free"
+ * @param quantity_out parsed quantity (static string or the custom VIF of vib)
  *
  * @return zero when OK
  */
-int mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, char **unit_out, double *value_out, char ** quantity_out);
+int mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, const char **unit_out, double *value_out, const char **quantity_out);
+
+/**
+ * Code of the unit and quantity of a value information block, as used by
+ * mbus_vif_unit_normalize.
+ *
+ * @param vib     Value information block
+ *
+ * @return Code (VIF without extension bit, | 0x100 for VIF 0xFD extensions,
+ *         | 0x200 for VIF 0xFB extensions), -1 for plain text or unknown VIFs.
+ */
+int mbus_vib_unit_code(mbus_value_information_block *vib);
 
 /**
  * Generate XML for normalized variable-length data
@@ -475,6 +597,26 @@ char * mbus_data_variable_xml_normalized(mbus_data_variable *data);
  */
 char * mbus_frame_data_xml_normalized(mbus_frame_data *data);
 
+/**
+ * Write XML for normalized variable-length data to a sink
+ *
+ * @param data    variable-length data
+ * @param sink    output sink
+ *
+ * @return Zero on success, -1 on error
+ */
+int mbus_data_variable_xml_normalized_sink(mbus_data_variable *data, mbus_sink *sink);
+
+/**
+ * Write an XML representation of the normalized M-BUS frame data to a sink.
+ *
+ * @param data    M-Bus frame data
+ * @param sink    output sink
+ *
+ * @return Zero on success, -1 on error
+ */
+int mbus_frame_data_xml_normalized_sink(mbus_frame_data *data, mbus_sink *sink);
+
 /**
  * Generate JSON for normalized variable-length data
  *
@@ -493,6 +635,27 @@ char * mbus_data_variable_json_normalized(mbus_data_variable *data);
  */
 char * mbus_frame_data_json_normalized(mbus_frame_data *data);
 
+/**
+ * Write JSON for normalized variable-length data to a sink, one object
+ * ended by a newline (as all JSON writers)
+ *
+ * @param data    variable-length data
+ * @param sink    output sink
+ *
+ * @return Zero on success, -1 on error
+ */
+int mbus_data_variable_json_normalized_sink(mbus_data_variable *data, mbus_sink *sink);
+
+/**
+ * Write a JSON representation of the normalized M-BUS frame data to a sink.
+ *
+ * @param data    M-Bus frame data
+ * @param sink    output sink
+ *
+ * @return Zero on success, -1 on error
+ */
+int mbus_frame_data_json_normalized_sink(mbus_frame_data *data, mbus_sink *sink);
+
 /**
  * Return a string containing an InfluxDB Line Protocol representation of the normalized M-BUS frame data.
  *
@@ -502,6 +665,61 @@ char * mbus_frame_data_json_normalized(mbus_frame_data *data);
  */
 char * mbus_frame_data_influxdb_normalized(mbus_frame_data *data);
 
+/**
+ * Generate InfluxDB Line Protocol for normalized variable-length data
+ *
+ * @param data    variable-length data
+ *
+ * @return string with InfluxDB Line Protocol
+ */
+char * mbus_data_variable_influxdb_normalized(mbus_data_variable *data);
+
+/**
+ * Write InfluxDB Line Protocol for normalized variable-length data to a sink
+ *
+ * @param data    variable-length data
+ * @param sink    output sink
+ *
+ * @return Zero on success, -1 on error
+ */
+int mbus_data_variable_influxdb_normalized_sink(mbus_data_variable *data, mbus_sink *sink);
+
+/**
+ * Write an InfluxDB Line Protocol representation of the normalized M-BUS frame
+ * data to a sink.
+ *
+ * @param data    M-Bus frame data
+ * @param sink    output sink
+ *
+ * @return Zero on success, -1 on error
+ */
+int mbus_frame_data_influxdb_normalized_sink(mbus_frame_data *data, mbus_sink *sink);
+
+/**
+ * Scan a range of primary addresses with SND_NKE pings. The first addresses
+ * are given the full response timeout of the transport, later ones twice the
+ * slowest response seen so far (at least the line silence of
+ * mbus_purge_silence_time). A slave answering later than that shows up at one
+ * of the next addresses: every address that was silent within a shortened
+ * timeout and pinged less than the full timeout before the reply is probed
+ * again with the full timeout, as is the address of the reply. Garbled or
+ * incomplete replies are given up at the end of the line activity, and only
+ * such addresses are retried (up to MBUS_OPTION_MAX_SEARCH_RETRY times),
+ * silent ones are not. Collisions after an ACK are detected with
+ * MBUS_PURGE_MODE_SILENCE during the scan. The scan progress event
+ * (mbus_register_scan_progress) gets the decimal address of every ping.
+ *
+ * @param handle Initialized handle
+ * @param first  first address to scan
+ * @param last   last address to scan (up to MBUS_MAX_PRIMARY_SLAVES)
+ * @param found  optional callback for every address with a reply, result
+ *               is MBUS_PROBE_SINGLE or MBUS_PROBE_COLLISION
+ *
+ * @return number of addresses with a reply, -1 on errors
+ */
+int mbus_scan_primary(mbus_handle * handle, int first, int last,
+                      void (*found)(mbus_handle *handle, int address, int result));
+
 /**
  * Iterate over secondary addresses, send a probe package to all addresses matching
  * the given addresses mask.
@@ -514,6 +732,47 @@ char * mbus_frame_data_influxdb_normalized(mbus_frame_data *data);
  */
 int mbus_scan_2nd_address_range(mbus_handle * handle, int pos, char *addr_mask);
 
+/**
+ * Scan the secondary addresses matching an address mask, splitting colliding
+ * masks on all fields of the address. The ID digits are split first (0 - 9),
+ * in the order of the fewest distinct values among the devices found so far,
+ * so that sets of similar IDs are separated with few colliding probes. Devices
+ * with the same ID are then separated by their medium, version and
+ * manufacturer bytes (00 - FE, values found on the bus first), which
+ * mbus_scan_2nd_address_range cannot do.
+ *
+ * @param handle     Initialized handle
+ * @param addr_mask  address mask ("FFFFFFFFFFFFFFFF" for all)
+ *
+ * @return zero when OK
+ */
+int mbus_scan_2nd_address_adaptive(mbus_handle * handle, const char *addr_mask);
+
+/**
+ * Rescan the secondary addresses matching an address mask, starting from the
+ * devices found by a previous scan. The devices of the cache file in the range
+ * of the mask are confirmed with a select of their address and a read first
+ * (reported through the found event). The address masks are then walked like
+ * mbus_scan_2nd_address_adaptive, except that masks matching two or more
+ * confirmed devices are split without a probe (they collide anyway) and the
+ * full address of a confirmed device is not probed again. A mask whose only
+ * known device was confirmed is probed with a select alone: a single ACK is
+ * the confirmed device (not reported again), a new device under the mask
+ * makes the probe collide and the mask is split further. Finally the
+ * cache file is rewritten with the devices found (devices outside the mask
+ * are kept).
+ *
+ * The cache file holds one secondary address per line, a missing file is an
+ * empty cache (full scan).
+ *
+ * @param handle      Initialized handle
+ * @param addr_mask   address mask ("FFFFFFFFFFFFFFFF" for all)
+ * @param cache_path  cache file
+ *
+ * @return zero when OK
+ */
+int mbus_scan_2nd_address_cached(mbus_handle * handle, const char *addr_mask, const char *cache_path);
+
 /**
  * Convert a buffer with hex values into a buffer with binary values.
  *
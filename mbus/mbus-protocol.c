@@ -10,13 +10,30 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <locale.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "mbus-protocol.h"
+#include "mbus-format.h"
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define MBUS_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define MBUS_THREAD_LOCAL __thread
+#else
+#define MBUS_THREAD_LOCAL
+#endif
 
 static int parse_debug = 0, debug = 0;
-static char error_str[512];
+
+//
+// The error state is kept per thread, so that handles which are driven from
+// different threads don't overwrite each others diagnostics.
+//
+static MBUS_THREAD_LOCAL mbus_error_code error_code = MBUS_ERR_NONE;
+static MBUS_THREAD_LOCAL char error_str[512];
 
 #define NITEMS(x) (sizeof(x)/sizeof(x[0]))
 
@@ -76,7 +93,8 @@ mbus_dump_send_event(unsigned char src_type, const char *buff, size_t len)
 }
 
 //------------------------------------------------------------------------------
-/// Return a string that contains an the latest error message.
+/// Return a string that contains an the latest error message of the calling
+/// thread.
 //------------------------------------------------------------------------------
 char *
 mbus_error_str()
@@ -89,6 +107,7 @@ mbus_error_str_set(char *message)
 {
     if (message)
     {
+        error_code = MBUS_ERR_OTHER;
         snprintf(error_str, sizeof(error_str), "%s", message);
     }
 }
@@ -96,9 +115,35 @@ mbus_error_str_set(char *message)
 void
 mbus_error_reset()
 {
+    error_code = MBUS_ERR_NONE;
     snprintf(error_str, sizeof(error_str), "no errors");
 }
 
+//------------------------------------------------------------------------------
+/// Return the code of the latest error of the calling thread.
+//------------------------------------------------------------------------------
+mbus_error_code
+mbus_error_get()
+{
+    return error_code;
+}
+
+//------------------------------------------------------------------------------
+/// Set the error code and a printf style formatted error message for the
+/// calling thread.
+//------------------------------------------------------------------------------
+void
+mbus_error_set(mbus_error_code code, const char *format, ...)
+{
+    va_list args;
+
+    error_code = code;
+
+    va_start(args, format);
+    vsnprintf(error_str, sizeof(error_str), format, args);
+    va_end(args);
+}
+
 //------------------------------------------------------------------------------
 /// Return a pointer to the slave_data register. This register can be used for
 /// storing current slave status.
@@ -349,22 +394,11 @@ mbus_frame_direction(mbus_frame *frame)
 }
 
 //------------------------------------------------------------------------------
-/// Verify that parsed frame is a valid M-bus frame.
-//
-// Possible checks:
-//
-// 1) frame type
-// 2) Start/stop bytes
-// 3) control field
-// 4) length field and actual data size
-// 5) checksum
-//
+/// Verify a parsed frame against an already known checksum. Internal.
 //------------------------------------------------------------------------------
-int
-mbus_frame_verify(mbus_frame *frame)
+static int
+frame_verify(mbus_frame *frame, unsigned char checksum)
 {
-    unsigned char checksum;
-
     if (frame)
     {
         switch (frame->type)
@@ -375,7 +409,7 @@ mbus_frame_verify(mbus_frame *frame)
             case MBUS_FRAME_TYPE_SHORT:
                 if(frame->start1 != MBUS_FRAME_SHORT_START)
                 {
-                    snprintf(error_str, sizeof(error_str), "No frame start");
+                    mbus_error_set(MBUS_ERR_FRAME_INVALID, "No frame start");
 
                     return -1;
                 }
@@ -386,7 +420,7 @@ mbus_frame_verify(mbus_frame *frame)
                     (frame->control !=  MBUS_CONTROL_MASK_REQ_UD2)                          &&
                     (frame->control != (MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_FCB)))
                 {
-                    snprintf(error_str, sizeof(error_str), "Unknown Control Code 0x%.2x", frame->control);
+                    mbus_error_set(MBUS_ERR_FRAME_INVALID, "Unknown Control Code 0x%.2x", frame->control);
 
                     return -1;
                 }
@@ -398,7 +432,7 @@ mbus_frame_verify(mbus_frame *frame)
                 if(frame->start1  != MBUS_FRAME_CONTROL_START ||
                    frame->start2  != MBUS_FRAME_CONTROL_START)
                 {
-                    snprintf(error_str, sizeof(error_str), "No frame start");
+                    mbus_error_set(MBUS_ERR_FRAME_INVALID, "No frame start");
 
                     return -1;
                 }
@@ -410,21 +444,21 @@ mbus_frame_verify(mbus_frame *frame)
                     (frame->control != (MBUS_CONTROL_MASK_RSP_UD | MBUS_CONTROL_MASK_ACD)) &&
                     (frame->control != (MBUS_CONTROL_MASK_RSP_UD | MBUS_CONTROL_MASK_DFC | MBUS_CONTROL_MASK_ACD)))
                 {
-                    snprintf(error_str, sizeof(error_str), "Unknown Control Code 0x%.2x", frame->control);
+                    mbus_error_set(MBUS_ERR_FRAME_INVALID, "Unknown Control Code 0x%.2x", frame->control);
 
                     return -1;
                 }
 
                 if (frame->length1 != frame->length2)
                 {
-                    snprintf(error_str, sizeof(error_str), "Frame length 1 != 2");
+                    mbus_error_set(MBUS_ERR_FRAME_INVALID, "Frame length 1 != 2");
 
                     return -1;
                 }
 
                 if (frame->length1 != calc_length(frame))
                 {
-                    snprintf(error_str, sizeof(error_str), "Frame length 1 != calc length");
+                    mbus_error_set(MBUS_ERR_FRAME_INVALID, "Frame length 1 != calc length");
 
                     return -1;
                 }
@@ -432,23 +466,21 @@ mbus_frame_verify(mbus_frame *frame)
                 break;
 
             default:
-                snprintf(error_str, sizeof(error_str), "Unknown frame type 0x%.2x", frame->type);
+                mbus_error_set(MBUS_ERR_FRAME_INVALID, "Unknown frame type 0x%.2x", frame->type);
 
                 return -1;
         }
 
         if(frame->stop != MBUS_FRAME_STOP)
         {
-            snprintf(error_str, sizeof(error_str), "No frame stop");
+            mbus_error_set(MBUS_ERR_FRAME_INVALID, "No frame stop");
 
             return -1;
         }
 
-        checksum = calc_checksum(frame);
-
         if(frame->checksum != checksum)
         {
-            snprintf(error_str, sizeof(error_str), "Invalid checksum (0x%.2x != 0x%.2x)", frame->checksum, checksum);
+            mbus_error_set(MBUS_ERR_FRAME_CHECKSUM, "Invalid checksum (0x%.2x != 0x%.2x)", frame->checksum, checksum);
 
             return -1;
         }
@@ -456,11 +488,35 @@ mbus_frame_verify(mbus_frame *frame)
         return 0;
     }
 
-    snprintf(error_str, sizeof(error_str), "Got null pointer to frame.");
+    mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to frame.");
 
     return -1;
 }
 
+//------------------------------------------------------------------------------
+/// Verify that parsed frame is a valid M-bus frame.
+//
+// Possible checks:
+//
+// 1) frame type
+// 2) Start/stop bytes
+// 3) control field
+// 4) length field and actual data size
+// 5) checksum
+//
+//------------------------------------------------------------------------------
+int
+mbus_frame_verify(mbus_frame *frame)
+{
+    if (frame)
+    {
+        return frame_verify(frame, calc_checksum(frame));
+    }
+
+    mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to frame.");
+
+    return -1;
+}
 
 //------------------------------------------------------------------------------
 //
@@ -864,33 +920,43 @@ mbus_data_manufacturer_encode(unsigned char *m_data, unsigned char *m_code)
 ///
 //------------------------------------------------------------------------------
 const char *
-mbus_decode_manufacturer(unsigned char byte1, unsigned char byte2)
+mbus_decode_manufacturer_r(unsigned char byte1, unsigned char byte2, char *buff, size_t buff_size)
 {
-    static char m_str[4];
-
     int m_id;
 
-    m_str[0] = byte1;
-    m_str[1] = byte2;
+    if (buff == NULL || buff_size < 4)
+        return "";
+
+    buff[0] = byte1;
+    buff[1] = byte2;
 
-    mbus_data_int_decode(m_str, 2, &m_id);
+    mbus_data_int_decode((unsigned char *) buff, 2, &m_id);
+
+    buff[0] = (char)(((m_id>>10) & 0x001F) + 64);
+    buff[1] = (char)(((m_id>>5)  & 0x001F) + 64);
+    buff[2] = (char)(((m_id)     & 0x001F) + 64);
+    buff[3] = 0;
+
+    return buff;
+}
 
-    m_str[0] = (char)(((m_id>>10) & 0x001F) + 64);
-    m_str[1] = (char)(((m_id>>5)  & 0x001F) + 64);
-    m_str[2] = (char)(((m_id)     & 0x001F) + 64);
-    m_str[3] = 0;
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_decode_manufacturer_r() using a static buffer.
+//------------------------------------------------------------------------------
+const char *
+mbus_decode_manufacturer(unsigned char byte1, unsigned char byte2)
+{
+    static char m_str[4];
 
-    return m_str;
+    return mbus_decode_manufacturer_r(byte1, byte2, m_str, sizeof(m_str));
 }
 
 const char *
 mbus_data_product_name(mbus_data_variable_header *header)
 {
-    static char buff[128];
+    const char *str = "";
     unsigned int manufacturer;
 
-    memset(buff, 0, sizeof(buff));
-
     if (header)
     {
         manufacturer = (header->manufacturer[1] << 8) + header->manufacturer[0];
@@ -902,7 +968,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x02:
-                    strcpy(buff,"ABB Delta-Meter");
+                    str = "ABB Delta-Meter";
                     break;
             }
         }
@@ -911,22 +977,22 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x09:
-                    strcpy(buff,"Itron CF Echo 2");
+                    str = "Itron CF Echo 2";
                     break;
                 case 0x0A:
-                    strcpy(buff,"Itron CF 51");
+                    str = "Itron CF 51";
                     break;
                 case 0x0B:
-                    strcpy(buff,"Itron CF 55");
+                    str = "Itron CF 55";
                     break;
                 case 0x0E:
-                    strcpy(buff,"Itron BM +m");
+                    str = "Itron BM +m";
                     break;
                 case 0x0F:
-                    strcpy(buff,"Itron CF 800");
+                    str = "Itron CF 800";
                     break;
                 case 0x14:
-                    strcpy(buff,"Itron CYBLE M-Bus 1.4");
+                    str = "Itron CYBLE M-Bus 1.4";
                     break;
             }
         }
@@ -935,10 +1001,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x80:
-                    strcpy(buff,"Aquametro CALEC MB");
+                    str = "Aquametro CALEC MB";
                     break;
                 case 0xC0:
-                    strcpy(buff,"Aquametro CALEC ST");
+                    str = "Aquametro CALEC ST";
                     break;
             }
         }
@@ -949,10 +1015,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
                 switch (header->version)
                 {
                     case 0x00:
-                        strcpy(buff,"Berg DCMi");
+                        str = "Berg DCMi";
                         break;
                     case 0x07:
-                        strcpy(buff,"Berg BLMi");
+                        str = "Berg BLMi";
                         break;
                 }
             }
@@ -961,7 +1027,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
                 switch (header->version)
                 {
                     case 0x71:
-                        strcpy(buff, "Berg BMB-10S0");
+                        str = "Berg BMB-10S0";
                         break;
                 }
             }
@@ -971,10 +1037,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x00:
-                    strcpy(buff, ((header->medium == 0x06) ? "Engelmann WaterStar" : "Engelmann / Elster SensoStar 2"));
+                    str = ((header->medium == 0x06) ? "Engelmann WaterStar" : "Engelmann / Elster SensoStar 2");
                     break;
                 case 0x01:
-                    strcpy(buff,"Engelmann SensoStar 2C");
+                    str = "Engelmann SensoStar 2C";
                     break;
             }
         }
@@ -983,13 +1049,13 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x02:
-                    strcpy(buff,"Elster TMP-A");
+                    str = "Elster TMP-A";
                     break;
                 case 0x0A:
-                    strcpy(buff,"Elster Falcon");
+                    str = "Elster Falcon";
                     break;
                 case 0x2F:
-                    strcpy(buff,"Elster F96 Plus");
+                    str = "Elster F96 Plus";
                     break;
             }
         }
@@ -1007,7 +1073,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
                 case 0x1B:
                 case 0x1C:
                 case 0x1D:
-                    strcpy(buff, "Elvaco CMa10");
+                    str = "Elvaco CMa10";
                     break;
                 case 0x32:
                 case 0x33:
@@ -1019,7 +1085,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
                 case 0x39:
                 case 0x3A:
                 case 0x3B:
-                    strcpy(buff,"Elvaco CMa11");
+                    str = "Elvaco CMa11";
                     break;
             }
         }
@@ -1028,7 +1094,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x00:
-                    strcpy(buff,"EMH DIZ");
+                    str = "EMH DIZ";
                     break;
             }
         }
@@ -1039,7 +1105,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
                 switch (header->version)
                 {
                     case 0x10:
-                        strcpy(buff,"EMU Professional 3/75 M-Bus");
+                        str = "EMU Professional 3/75 M-Bus";
                         break;
                 }
             }
@@ -1054,14 +1120,14 @@ mbus_data_product_name(mbus_data_variable_header *header)
                     case 0x2E:
                     case 0x2F:
                     case 0x30:
-                        strcpy(buff,"Carlo Gavazzi EM24");
+                        str = "Carlo Gavazzi EM24";
                         break;
                     case 0x39:
                     case 0x3A:
-                        strcpy(buff,"Carlo Gavazzi EM21");
+                        str = "Carlo Gavazzi EM21";
                         break;
                     case 0x40:
-                        strcpy(buff,"Carlo Gavazzi EM33");
+                        str = "Carlo Gavazzi EM33";
                         break;
                 }
             }
@@ -1071,7 +1137,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0xE6:
-                    strcpy(buff,"GMC-I A230 EMMOD 206");
+                    str = "GMC-I A230 EMMOD 206";
                     break;
             }
         }
@@ -1080,10 +1146,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x01:
-                    strcpy(buff,"Kamstrup 382 (6850-005)");
+                    str = "Kamstrup 382 (6850-005)";
                     break;
                 case 0x08:
-                    strcpy(buff,"Kamstrup Multical 601");
+                    str = "Kamstrup Multical 601";
                     break;
             }
         }
@@ -1092,10 +1158,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x02:
-                    strcpy(buff,"Allmess Megacontrol CF-50");
+                    str = "Allmess Megacontrol CF-50";
                     break;
                 case 0x06:
-                    strcpy(buff,"CF Compact / Integral MK MaXX");
+                    str = "CF Compact / Integral MK MaXX";
                     break;
             }
         }
@@ -1104,7 +1170,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x28:
-                    strcpy(buff,"ABB F95 Typ US770");
+                    str = "ABB F95 Typ US770";
                     break;
             }
         }
@@ -1115,7 +1181,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
                 switch (header->version)
                 {
                     case 0x09:
-                        strcpy(buff,"Janitza UMG 96S");
+                        str = "Janitza UMG 96S";
                         break;
                 }
             }
@@ -1125,16 +1191,16 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x02:
-                    strcpy(buff,"Landis & Gyr Ultraheat 2WR5");
+                    str = "Landis & Gyr Ultraheat 2WR5";
                     break;
                 case 0x03:
-                    strcpy(buff,"Landis & Gyr Ultraheat 2WR6");
+                    str = "Landis & Gyr Ultraheat 2WR6";
                     break;
                 case 0x04:
-                    strcpy(buff,"Landis & Gyr Ultraheat UH50");
+                    str = "Landis & Gyr Ultraheat UH50";
                     break;
                 case 0x07:
-                    strcpy(buff,"Landis & Gyr Ultraheat T230");
+                    str = "Landis & Gyr Ultraheat T230";
                     break;
             }
         }
@@ -1143,7 +1209,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x99:
-                    strcpy(buff,"Siemens WFH21");
+                    str = "Siemens WFH21";
                     break;
             }
         }
@@ -1152,10 +1218,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x01:
-                    strcpy(buff,"NZR DHZ 5/63");
+                    str = "NZR DHZ 5/63";
                     break;
                 case 0x50:
-                    strcpy(buff,"NZR IC-M2");
+                    str = "NZR IC-M2";
                     break;
             }
         }
@@ -1164,7 +1230,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x03:
-                    strcpy(buff, "Rossweiner ETK/ETW Modularis");
+                    str = "Rossweiner ETK/ETW Modularis";
                     break;
             }
         }
@@ -1173,19 +1239,19 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x08:
-                    strcpy(buff, "Relay PadPuls M1");
+                    str = "Relay PadPuls M1";
                     break;
                 case 0x12:
-                    strcpy(buff, "Relay PadPuls M4");
+                    str = "Relay PadPuls M4";
                     break;
                 case 0x20:
-                    strcpy(buff, "Relay Padin 4");
+                    str = "Relay Padin 4";
                     break;
                 case 0x30:
-                    strcpy(buff, "Relay AnDi 4");
+                    str = "Relay AnDi 4";
                     break;
                 case 0x40:
-                    strcpy(buff, "Relay PadPuls M2");
+                    str = "Relay PadPuls M2";
                     break;
             }
         }
@@ -1194,7 +1260,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x69:
-                    strcpy(buff,"Ista sensonic II mbus");
+                    str = "Ista sensonic II mbus";
                     break;
             }
         }
@@ -1204,10 +1270,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
             {
                 case 0x10:
                 case 0x19:
-                    strcpy(buff,"Saia-Burgess ALE3");
+                    str = "Saia-Burgess ALE3";
                     break;
                 case 0x11:
-                    strcpy(buff,"Saia-Burgess AWD3");
+                    str = "Saia-Burgess AWD3";
                     break;
             }
         }
@@ -1216,13 +1282,13 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x0B:
-                    strcpy(buff,"Sensus PolluTherm");
+                    str = "Sensus PolluTherm";
                     break;
                 case 0x0E:
-                    strcpy(buff,"Sensus PolluStat E");
+                    str = "Sensus PolluStat E";
                     break;
                 case 0x19:
-                    strcpy(buff,"Sensus PolluCom E");
+                    str = "Sensus PolluCom E";
                     break;
             }
         }
@@ -1231,7 +1297,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x0D:
-                    strcpy(buff,"Sontex Supercal 531");
+                    str = "Sontex Supercal 531";
                     break;
             }
         }
@@ -1241,7 +1307,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             {
                 case 0x31:
                 case 0x34:
-                    strcpy(buff,"Sensus PolluTherm");
+                    str = "Sensus PolluTherm";
                     break;
             }
         }
@@ -1250,10 +1316,10 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x08:
-                    strcpy(buff,"Elster F2 / Deltamess F2");
+                    str = "Elster F2 / Deltamess F2";
                     break;
                 case 0x09:
-                    strcpy(buff,"Elster F4 / Kamstrup SVM F22");
+                    str = "Elster F4 / Kamstrup SVM F22";
                     break;
             }
         }
@@ -1262,7 +1328,7 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x26:
-                    strcpy(buff,"Techem m-bus S");
+                    str = "Techem m-bus S";
                     break;
             }
         }
@@ -1271,17 +1337,17 @@ mbus_data_product_name(mbus_data_variable_header *header)
             switch (header->version)
             {
                 case 0x81:
-                    strcpy(buff,"Minol Minocal C2");
+                    str = "Minol Minocal C2";
                     break;
                 case 0x82:
-                    strcpy(buff,"Minol Minocal WR3");
+                    str = "Minol Minocal WR3";
                     break;
             }
         }
 
     }
 
-    return buff;
+    return str;
 }
 
 //------------------------------------------------------------------------------
@@ -1318,66 +1384,66 @@ mbus_data_product_name(mbus_data_variable_header *header)
 const char *
 mbus_data_fixed_medium(mbus_data_fixed *data)
 {
-    static char buff[256];
+    const char *str;
 
     if (data)
     {
         switch ( (data->cnt1_type&0xC0)>>6 | (data->cnt2_type&0xC0)>>4 )
         {
             case 0x00:
-                snprintf(buff, sizeof(buff), "Other");
+                str = "Other";
                 break;
             case 0x01:
-                snprintf(buff, sizeof(buff), "Oil");
+                str = "Oil";
                 break;
             case 0x02:
-                snprintf(buff, sizeof(buff), "Electricity");
+                str = "Electricity";
                 break;
             case 0x03:
-                snprintf(buff, sizeof(buff), "Gas");
+                str = "Gas";
                 break;
             case 0x04:
-                snprintf(buff, sizeof(buff), "Heat");
+                str = "Heat";
                 break;
             case 0x05:
-                snprintf(buff, sizeof(buff), "Steam");
+                str = "Steam";
                 break;
             case 0x06:
-                snprintf(buff, sizeof(buff), "Hot Water");
+                str = "Hot Water";
                 break;
             case 0x07:
-                snprintf(buff, sizeof(buff), "Water");
+                str = "Water";
                 break;
             case 0x08:
-                snprintf(buff, sizeof(buff), "H.C.A.");
+                str = "H.C.A.";
                 break;
             case 0x09:
-                snprintf(buff, sizeof(buff), "Reserved");
+                str = "Reserved";
                 break;
             case 0x0A:
-                snprintf(buff, sizeof(buff), "Gas Mode 2");
+                str = "Gas Mode 2";
                 break;
             case 0x0B:
-                snprintf(buff, sizeof(buff), "Heat Mode 2");
+                str = "Heat Mode 2";
                 break;
             case 0x0C:
-                snprintf(buff, sizeof(buff), "Hot Water Mode 2");
+                str = "Hot Water Mode 2";
                 break;
             case 0x0D:
-                snprintf(buff, sizeof(buff), "Water Mode 2");
+                str = "Water Mode 2";
                 break;
             case 0x0E:
-                snprintf(buff, sizeof(buff), "H.C.A. Mode 2");
+                str = "H.C.A. Mode 2";
                 break;
             case 0x0F:
-                snprintf(buff, sizeof(buff), "Reserved");
+                str = "Reserved";
                 break;
             default:
-                snprintf(buff, sizeof(buff), "unknown");
+                str = "unknown";
                 break;
         }
 
-        return buff;
+        return str;
     }
 
     return NULL;
@@ -1429,209 +1495,209 @@ mbus_data_fixed_medium(mbus_data_fixed *data)
 const char *
 mbus_data_fixed_unit(int medium_unit_byte)
 {
-    static char buff[256];
+    const char *str;
 
     switch (medium_unit_byte & 0x3F)
     {
         case 0x00:
-            snprintf(buff, sizeof(buff), "h,m,s");
+            str = "h,m,s";
             break;
         case 0x01:
-            snprintf(buff, sizeof(buff), "D,M,Y");
+            str = "D,M,Y";
             break;
 
         case 0x02:
-            snprintf(buff, sizeof(buff), "Wh");
+            str = "Wh";
             break;
         case 0x03:
-            snprintf(buff, sizeof(buff), "10 Wh");
+            str = "10 Wh";
             break;
         case 0x04:
-            snprintf(buff, sizeof(buff), "100 Wh");
+            str = "100 Wh";
             break;
         case 0x05:
-            snprintf(buff, sizeof(buff), "kWh");
+            str = "kWh";
             break;
         case 0x06:
-            snprintf(buff, sizeof(buff), "10 kWh");
+            str = "10 kWh";
             break;
         case 0x07:
-            snprintf(buff, sizeof(buff), "100 kWh");
+            str = "100 kWh";
             break;
         case 0x08:
-            snprintf(buff, sizeof(buff), "MWh");
+            str = "MWh";
             break;
         case 0x09:
-            snprintf(buff, sizeof(buff), "10 MWh");
+            str = "10 MWh";
             break;
         case 0x0A:
-            snprintf(buff, sizeof(buff), "100 MWh");
+            str = "100 MWh";
             break;
 
         case 0x0B:
-            snprintf(buff, sizeof(buff), "kJ");
+            str = "kJ";
             break;
         case 0x0C:
-            snprintf(buff, sizeof(buff), "10 kJ");
+            str = "10 kJ";
             break;
         case 0x0E:
-            snprintf(buff, sizeof(buff), "100 kJ");
+            str = "100 kJ";
             break;
         case 0x0D:
-            snprintf(buff, sizeof(buff), "MJ");
+            str = "MJ";
             break;
         case 0x0F:
-            snprintf(buff, sizeof(buff), "10 MJ");
+            str = "10 MJ";
             break;
         case 0x10:
-            snprintf(buff, sizeof(buff), "100 MJ");
+            str = "100 MJ";
             break;
         case 0x11:
-            snprintf(buff, sizeof(buff), "GJ");
+            str = "GJ";
             break;
         case 0x12:
-            snprintf(buff, sizeof(buff), "10 GJ");
+            str = "10 GJ";
             break;
         case 0x13:
-            snprintf(buff, sizeof(buff), "100 GJ");
+            str = "100 GJ";
             break;
 
         case 0x14:
-            snprintf(buff, sizeof(buff), "W");
+            str = "W";
             break;
         case 0x15:
-            snprintf(buff, sizeof(buff), "10 W");
+            str = "10 W";
             break;
         case 0x16:
-            snprintf(buff, sizeof(buff), "100 W");
+            str = "100 W";
             break;
         case 0x17:
-            snprintf(buff, sizeof(buff), "kW");
+            str = "kW";
             break;
         case 0x18:
-            snprintf(buff, sizeof(buff), "10 kW");
+            str = "10 kW";
             break;
         case 0x19:
-            snprintf(buff, sizeof(buff), "100 kW");
+            str = "100 kW";
             break;
         case 0x1A:
-            snprintf(buff, sizeof(buff), "MW");
+            str = "MW";
             break;
         case 0x1B:
-            snprintf(buff, sizeof(buff), "10 MW");
+            str = "10 MW";
             break;
         case 0x1C:
-            snprintf(buff, sizeof(buff), "100 MW");
+            str = "100 MW";
             break;
 
         case 0x1D:
-            snprintf(buff, sizeof(buff), "kJ/h");
+            str = "kJ/h";
             break;
         case 0x1E:
-            snprintf(buff, sizeof(buff), "10 kJ/h");
+            str = "10 kJ/h";
             break;
         case 0x1F:
-            snprintf(buff, sizeof(buff), "100 kJ/h");
+            str = "100 kJ/h";
             break;
         case 0x20:
-            snprintf(buff, sizeof(buff), "MJ/h");
+            str = "MJ/h";
             break;
         case 0x21:
-            snprintf(buff, sizeof(buff), "10 MJ/h");
+            str = "10 MJ/h";
             break;
         case 0x22:
-            snprintf(buff, sizeof(buff), "100 MJ/h");
+            str = "100 MJ/h";
             break;
         case 0x23:
-            snprintf(buff, sizeof(buff), "GJ/h");
+            str = "GJ/h";
             break;
         case 0x24:
-            snprintf(buff, sizeof(buff), "10 GJ/h");
+            str = "10 GJ/h";
             break;
         case 0x25:
-            snprintf(buff, sizeof(buff), "100 GJ/h");
+            str = "100 GJ/h";
             break;
 
         case 0x26:
-            snprintf(buff, sizeof(buff), "ml");
+            str = "ml";
             break;
         case 0x27:
-            snprintf(buff, sizeof(buff), "10 ml");
+            str = "10 ml";
             break;
         case 0x28:
-            snprintf(buff, sizeof(buff), "100 ml");
+            str = "100 ml";
             break;
         case 0x29:
-            snprintf(buff, sizeof(buff), "l");
+            str = "l";
             break;
         case 0x2A:
-            snprintf(buff, sizeof(buff), "10 l");
+            str = "10 l";
             break;
         case 0x2B:
-            snprintf(buff, sizeof(buff), "100 l");
+            str = "100 l";
             break;
         case 0x2C:
-            snprintf(buff, sizeof(buff), "m^3");
+            str = "m^3";
             break;
         case 0x2D:
-            snprintf(buff, sizeof(buff), "10 m^3");
+            str = "10 m^3";
             break;
         case 0x2E:
-            snprintf(buff, sizeof(buff), "m^3");
+            str = "m^3";
             break;
 
         case 0x2F:
-            snprintf(buff, sizeof(buff), "ml/h");
+            str = "ml/h";
             break;
         case 0x30:
-            snprintf(buff, sizeof(buff), "10 ml/h");
+            str = "10 ml/h";
             break;
         case 0x31:
-            snprintf(buff, sizeof(buff), "100 ml/h");
+            str = "100 ml/h";
             break;
         case 0x32:
-            snprintf(buff, sizeof(buff), "l/h");
+            str = "l/h";
             break;
         case 0x33:
-            snprintf(buff, sizeof(buff), "10 l/h");
+            str = "10 l/h";
             break;
         case 0x34:
-            snprintf(buff, sizeof(buff), "100 l/h");
+            str = "100 l/h";
             break;
         case 0x35:
-            snprintf(buff, sizeof(buff), "m^3/h");
+            str = "m^3/h";
             break;
         case 0x36:
-            snprintf(buff, sizeof(buff), "10 m^3/h");
+            str = "10 m^3/h";
             break;
         case 0x37:
-            snprintf(buff, sizeof(buff), "100 m^3/h");
+            str = "100 m^3/h";
             break;
 
         case 0x38:
-            snprintf(buff, sizeof(buff), "1e-3 °C");
+            str = "1e-3 °C";
             break;
         case 0x39:
-            snprintf(buff, sizeof(buff), "units for HCA");
+            str = "units for HCA";
             break;
         case 0x3A:
         case 0x3B:
         case 0x3C:
         case 0x3D:
-            snprintf(buff, sizeof(buff), "reserved");
+            str = "reserved";
             break;
         case 0x3E:
-            snprintf(buff, sizeof(buff), "reserved but historic");
+            str = "reserved but historic";
             break;
         case 0x3F:
-            snprintf(buff, sizeof(buff), "without units");
+            str = "without units";
             break;
         default:
-            snprintf(buff, sizeof(buff), "unknown");
+            str = "unknown";
             break;
     }
 
-    return buff;
+    return str;
 }
 
 //------------------------------------------------------------------------------
@@ -1671,117 +1737,124 @@ mbus_data_fixed_unit(int medium_unit_byte)
 /// For variable-length frames, returns a string describing the medium.
 ///
 const char *
-mbus_data_variable_medium_lookup(unsigned char medium)
+mbus_data_variable_medium_lookup_r(unsigned char medium, char *buff, size_t buff_size)
 {
-    static char buff[256];
-
     switch (medium)
     {
         case MBUS_VARIABLE_DATA_MEDIUM_OTHER:
-            snprintf(buff, sizeof(buff), "Other");
+            snprintf(buff, buff_size, "Other");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_OIL:
-            snprintf(buff, sizeof(buff), "Oil");
+            snprintf(buff, buff_size, "Oil");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_ELECTRICITY:
-            snprintf(buff, sizeof(buff), "Electricity");
+            snprintf(buff, buff_size, "Electricity");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_GAS:
-            snprintf(buff, sizeof(buff), "Gas");
+            snprintf(buff, buff_size, "Gas");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_HEAT_OUT:
-            snprintf(buff, sizeof(buff), "Heat: Outlet");
+            snprintf(buff, buff_size, "Heat: Outlet");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_STEAM:
-            snprintf(buff, sizeof(buff), "Steam");
+            snprintf(buff, buff_size, "Steam");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_HOT_WATER:
-            snprintf(buff, sizeof(buff), "Hot water");
+            snprintf(buff, buff_size, "Hot water");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_WATER:
-            snprintf(buff, sizeof(buff), "Water");
+            snprintf(buff, buff_size, "Water");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_HEAT_COST:
-            snprintf(buff, sizeof(buff), "Heat Cost Allocator");
+            snprintf(buff, buff_size, "Heat Cost Allocator");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_COMPR_AIR:
-            snprintf(buff, sizeof(buff), "Compressed Air");
+            snprintf(buff, buff_size, "Compressed Air");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_COOL_OUT:
-            snprintf(buff, sizeof(buff), "Cooling load meter: Outlet");
+            snprintf(buff, buff_size, "Cooling load meter: Outlet");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_COOL_IN:
-            snprintf(buff, sizeof(buff), "Cooling load meter: Inlet");
+            snprintf(buff, buff_size, "Cooling load meter: Inlet");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_HEAT_IN:
-            snprintf(buff, sizeof(buff), "Heat: Inlet");
+            snprintf(buff, buff_size, "Heat: Inlet");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_HEAT_COOL:
-            snprintf(buff, sizeof(buff), "Heat / Cooling load meter");
+            snprintf(buff, buff_size, "Heat / Cooling load meter");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_BUS:
-            snprintf(buff, sizeof(buff), "Bus/System");
+            snprintf(buff, buff_size, "Bus/System");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_UNKNOWN:
-            snprintf(buff, sizeof(buff), "Unknown Medium");
+            snprintf(buff, buff_size, "Unknown Medium");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_COLD_WATER:
-            snprintf(buff, sizeof(buff), "Cold water");
+            snprintf(buff, buff_size, "Cold water");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_DUAL_WATER:
-            snprintf(buff, sizeof(buff), "Dual water");
+            snprintf(buff, buff_size, "Dual water");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_PRESSURE:
-            snprintf(buff, sizeof(buff), "Pressure");
+            snprintf(buff, buff_size, "Pressure");
             break;
 
         case MBUS_VARIABLE_DATA_MEDIUM_ADC:
-            snprintf(buff, sizeof(buff), "A/D Converter");
+            snprintf(buff, buff_size, "A/D Converter");
             break;
 
         case 0x10: // - 0x15
         case 0x20: // - 0xFF
-            snprintf(buff, sizeof(buff), "Reserved");
+            snprintf(buff, buff_size, "Reserved");
             break;
 
 
         // add more ...
         default:
-            snprintf(buff, sizeof(buff), "Unknown medium (0x%.2x)", medium);
+            snprintf(buff, buff_size, "Unknown medium (0x%.2x)", medium);
             break;
     }
 
     return buff;
 }
 
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_data_variable_medium_lookup_r() using a static buffer.
+//------------------------------------------------------------------------------
+const char *
+mbus_data_variable_medium_lookup(unsigned char medium)
+{
+    static char buff[256];
+
+    return mbus_data_variable_medium_lookup_r(medium, buff, sizeof(buff));
+}
+
 //------------------------------------------------------------------------------
 ///
 /// Lookup the unit description from a VIF field in a data record
 ///
 //------------------------------------------------------------------------------
 const char *
-mbus_unit_prefix(int exp)
+mbus_unit_prefix_r(int exp, char *buff, size_t buff_size)
 {
-    static char buff[256];
-
     switch (exp)
     {
         case 0:
@@ -1789,48 +1862,59 @@ mbus_unit_prefix(int exp)
             break;
 
         case -3:
-            snprintf(buff, sizeof(buff), "m");
+            snprintf(buff, buff_size, "m");
             break;
 
         case -6:
-            snprintf(buff, sizeof(buff), "my");
+            snprintf(buff, buff_size, "my");
             break;
 
         case 1:
-            snprintf(buff, sizeof(buff), "10 ");
+            snprintf(buff, buff_size, "10 ");
             break;
 
         case 2:
-            snprintf(buff, sizeof(buff), "100 ");
+            snprintf(buff, buff_size, "100 ");
             break;
 
         case 3:
-            snprintf(buff, sizeof(buff), "k");
+            snprintf(buff, buff_size, "k");
             break;
 
         case 4:
-            snprintf(buff, sizeof(buff), "10 k");
+            snprintf(buff, buff_size, "10 k");
             break;
 
         case 5:
-            snprintf(buff, sizeof(buff), "100 k");
+            snprintf(buff, buff_size, "100 k");
             break;
 
         case 6:
-            snprintf(buff, sizeof(buff), "M");
+            snprintf(buff, buff_size, "M");
             break;
 
         case 9:
-            snprintf(buff, sizeof(buff), "T");
+            snprintf(buff, buff_size, "T");
             break;
 
         default:
-            snprintf(buff, sizeof(buff), "1e%d ", exp);
+            snprintf(buff, buff_size, "1e%d ", exp);
     }
 
     return buff;
 }
 
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_unit_prefix_r() using a static buffer.
+//------------------------------------------------------------------------------
+const char *
+mbus_unit_prefix(int exp)
+{
+    static char buff[256];
+
+    return mbus_unit_prefix_r(exp, buff, sizeof(buff));
+}
+
 //------------------------------------------------------------------------------
 /// Look up the data length from a DIF field in the data record.
 ///
@@ -1888,9 +1972,9 @@ mbus_dif_datalength_lookup(unsigned char dif)
 /// See section 8.4.3  Codes for Value Information Field (VIF) in the M-BUS spec
 //------------------------------------------------------------------------------
 const char *
-mbus_vif_unit_lookup(unsigned char vif)
+mbus_vif_unit_lookup_r(unsigned char vif, char *buff, size_t buff_size)
 {
-    static char buff[256];
+    char prefix[32];
     int n;
 
     switch (vif & MBUS_DIB_VIF_WITHOUT_EXTENSION) // ignore the extension bit in this selection
@@ -1905,7 +1989,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x00+6:
         case 0x00+7:
             n = (vif & 0x07) - 3;
-            snprintf(buff, sizeof(buff), "Energy (%sWh)", mbus_unit_prefix(n));
+            snprintf(buff, buff_size, "Energy (%sWh)", mbus_unit_prefix_r(n, prefix, sizeof(prefix)));
             break;
 
         // 0000 1nnn          Energy       10(nnn)J     (0.001kJ to 10000kJ)
@@ -1919,7 +2003,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x08+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Energy (%sJ)", mbus_unit_prefix(n));
+            snprintf(buff, buff_size, "Energy (%sJ)", mbus_unit_prefix_r(n, prefix, sizeof(prefix)));
 
             break;
 
@@ -1934,7 +2018,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x18+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Mass (%skg)", mbus_unit_prefix(n-3));
+            snprintf(buff, buff_size, "Mass (%skg)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
 
             break;
 
@@ -1949,8 +2033,8 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x28+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Power (%sW)", mbus_unit_prefix(n-3));
-            //snprintf(buff, sizeof(buff), "Power (10^%d W)", n-3);
+            snprintf(buff, buff_size, "Power (%sW)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
+            //snprintf(buff, buff_size, "Power (10^%d W)", n-3);
 
             break;
 
@@ -1965,7 +2049,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x30+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Power (%sJ/h)", mbus_unit_prefix(n));
+            snprintf(buff, buff_size, "Power (%sJ/h)", mbus_unit_prefix_r(n, prefix, sizeof(prefix)));
 
             break;
 
@@ -1980,7 +2064,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x10+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Volume (%s m^3)", mbus_unit_prefix(n-6));
+            snprintf(buff, buff_size, "Volume (%s m^3)", mbus_unit_prefix_r(n-6, prefix, sizeof(prefix)));
 
             break;
 
@@ -1995,7 +2079,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x38+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Volume flow (%s m^3/h)", mbus_unit_prefix(n-6));
+            snprintf(buff, buff_size, "Volume flow (%s m^3/h)", mbus_unit_prefix_r(n-6, prefix, sizeof(prefix)));
 
             break;
 
@@ -2010,7 +2094,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x40+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Volume flow (%s m^3/min)", mbus_unit_prefix(n-7));
+            snprintf(buff, buff_size, "Volume flow (%s m^3/min)", mbus_unit_prefix_r(n-7, prefix, sizeof(prefix)));
 
             break;
 
@@ -2025,7 +2109,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x48+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Volume flow (%s m^3/s)", mbus_unit_prefix(n-9));
+            snprintf(buff, buff_size, "Volume flow (%s m^3/s)", mbus_unit_prefix_r(n-9, prefix, sizeof(prefix)));
 
             break;
 
@@ -2040,7 +2124,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x50+7:
 
             n = (vif & 0x07);
-            snprintf(buff, sizeof(buff), "Mass flow (%s kg/h)", mbus_unit_prefix(n-3));
+            snprintf(buff, buff_size, "Mass flow (%s kg/h)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
 
             break;
 
@@ -2051,7 +2135,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x58+3:
 
             n = (vif & 0x03);
-            snprintf(buff, sizeof(buff), "Flow temperature (%sdeg C)", mbus_unit_prefix(n-3));
+            snprintf(buff, buff_size, "Flow temperature (%sdeg C)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
 
             break;
 
@@ -2062,7 +2146,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x5C+3:
 
             n = (vif & 0x03);
-            snprintf(buff, sizeof(buff), "Return temperature (%sdeg C)", mbus_unit_prefix(n-3));
+            snprintf(buff, buff_size, "Return temperature (%sdeg C)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
 
             break;
 
@@ -2073,7 +2157,7 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x68+3:
 
             n = (vif & 0x03);
-            snprintf(buff, sizeof(buff), "Pressure (%s bar)", mbus_unit_prefix(n-3));
+            snprintf(buff, buff_size, "Pressure (%s bar)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
 
             break;
 
@@ -2105,27 +2189,27 @@ mbus_vif_unit_lookup(unsigned char vif)
                 int offset;
 
                 if      ((vif & 0x7C) == 0x20)
-                    offset = snprintf(buff, sizeof(buff), "On time ");
+                    offset = snprintf(buff, buff_size, "On time ");
                 else if ((vif & 0x7C) == 0x24)
-                    offset = snprintf(buff, sizeof(buff), "Operating time ");
+                    offset = snprintf(buff, buff_size, "Operating time ");
                 else if ((vif & 0x7C) == 0x70)
-                    offset = snprintf(buff, sizeof(buff), "Averaging Duration ");
+                    offset = snprintf(buff, buff_size, "Averaging Duration ");
                 else
-                    offset = snprintf(buff, sizeof(buff), "Actuality Duration ");
+                    offset = snprintf(buff, buff_size, "Actuality Duration ");
 
                 switch (vif & 0x03)
                 {
                     case 0x00:
-                        snprintf(&buff[offset], sizeof(buff)-offset, "(seconds)");
+                        snprintf(&buff[offset], buff_size-offset, "(seconds)");
                         break;
                     case 0x01:
-                        snprintf(&buff[offset], sizeof(buff)-offset, "(minutes)");
+                        snprintf(&buff[offset], buff_size-offset, "(minutes)");
                         break;
                     case 0x02:
-                        snprintf(&buff[offset], sizeof(buff)-offset, "(hours)");
+                        snprintf(&buff[offset], buff_size-offset, "(hours)");
                         break;
                     case 0x03:
-                        snprintf(&buff[offset], sizeof(buff)-offset, "(days)");
+                        snprintf(&buff[offset], buff_size-offset, "(days)");
                         break;
                 }
             }
@@ -2140,9 +2224,9 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x6C+1:
 
             if (vif & 0x1)
-                snprintf(buff, sizeof(buff), "Time Point (time & date)");
+                snprintf(buff, buff_size, "Time Point (time & date)");
             else
-                snprintf(buff, sizeof(buff), "Time Point (date)");
+                snprintf(buff, buff_size, "Time Point (date)");
 
             break;
 
@@ -2154,7 +2238,7 @@ mbus_vif_unit_lookup(unsigned char vif)
 
             n = (vif & 0x03);
 
-            snprintf(buff, sizeof(buff), "Temperature Difference (%s deg C)", mbus_unit_prefix(n-3));
+            snprintf(buff, buff_size, "Temperature Difference (%s deg C)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
 
             break;
 
@@ -2165,43 +2249,43 @@ mbus_vif_unit_lookup(unsigned char vif)
         case 0x64+3:
 
             n = (vif & 0x03);
-            snprintf(buff, sizeof(buff), "External temperature (%s deg C)", mbus_unit_prefix(n-3));
+            snprintf(buff, buff_size, "External temperature (%s deg C)", mbus_unit_prefix_r(n-3, prefix, sizeof(prefix)));
 
             break;
 
         // E110 1110 Units for H.C.A. dimensionless
         case 0x6E:
-            snprintf(buff, sizeof(buff), "Units for H.C.A.");
+            snprintf(buff, buff_size, "Units for H.C.A.");
             break;
 
         // E110 1111 Reserved
         case 0x6F:
-            snprintf(buff, sizeof(buff), "Reserved");
+            snprintf(buff, buff_size, "Reserved");
             break;
 
         // Custom VIF in the following string: never reached...
         case 0x7C:
-            snprintf(buff, sizeof(buff), "Custom VIF");
+            snprintf(buff, buff_size, "Custom VIF");
             break;
 
         // Fabrication No
         case 0x78:
-            snprintf(buff, sizeof(buff), "Fabrication number");
+            snprintf(buff, buff_size, "Fabrication number");
             break;
 
         // Bus Address
         case 0x7A:
-            snprintf(buff, sizeof(buff), "Bus Address");
+            snprintf(buff, buff_size, "Bus Address");
             break;
 
         // Manufacturer specific: 7Fh / FF
         case 0x7F:
         case 0xFF:
-            snprintf(buff, sizeof(buff), "Manufacturer specific");
+            snprintf(buff, buff_size, "Manufacturer specific");
             break;
 
         default:
-            snprintf(buff, sizeof(buff), "Unknown (VIF=0x%.2X)", vif);
+            snprintf(buff, buff_size, "Unknown (VIF=0x%.2X)", vif);
             break;
     }
 
@@ -2209,6 +2293,17 @@ mbus_vif_unit_lookup(unsigned char vif)
     return buff;
 }
 
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_vif_unit_lookup_r() using a static buffer.
+//------------------------------------------------------------------------------
+const char *
+mbus_vif_unit_lookup(unsigned char vif)
+{
+    static char buff[256];
+
+    return mbus_vif_unit_lookup_r(vif, buff, sizeof(buff));
+}
+
 
 //------------------------------------------------------------------------------
 // Lookup the error message
@@ -2216,60 +2311,69 @@ mbus_vif_unit_lookup(unsigned char vif)
 // See section 6.6  Codes for general application errors in the M-BUS spec
 //------------------------------------------------------------------------------
 const char *
-mbus_data_error_lookup(int error)
+mbus_data_error_lookup_r(int error, char *buff, size_t buff_size)
 {
-    static char buff[256];
-
     switch (error)
     {
         case MBUS_ERROR_DATA_UNSPECIFIED:
-            snprintf(buff, sizeof(buff), "Unspecified error");
+            snprintf(buff, buff_size, "Unspecified error");
             break;
 
         case MBUS_ERROR_DATA_UNIMPLEMENTED_CI:
-            snprintf(buff, sizeof(buff), "Unimplemented CI-Field");
+            snprintf(buff, buff_size, "Unimplemented CI-Field");
             break;
 
         case MBUS_ERROR_DATA_BUFFER_TOO_LONG:
-            snprintf(buff, sizeof(buff), "Buffer too long, truncated");
+            snprintf(buff, buff_size, "Buffer too long, truncated");
             break;
 
         case MBUS_ERROR_DATA_TOO_MANY_RECORDS:
-            snprintf(buff, sizeof(buff), "Too many records");
+            snprintf(buff, buff_size, "Too many records");
             break;
 
         case MBUS_ERROR_DATA_PREMATURE_END:
-            snprintf(buff, sizeof(buff), "Premature end of record");
+            snprintf(buff, buff_size, "Premature end of record");
             break;
 
         case MBUS_ERROR_DATA_TOO_MANY_DIFES:
-            snprintf(buff, sizeof(buff), "More than 10 DIFE´s");
+            snprintf(buff, buff_size, "More than 10 DIFE´s");
             break;
 
         case MBUS_ERROR_DATA_TOO_MANY_VIFES:
-            snprintf(buff, sizeof(buff), "More than 10 VIFE´s");
+            snprintf(buff, buff_size, "More than 10 VIFE´s");
             break;
 
         case MBUS_ERROR_DATA_RESERVED:
-            snprintf(buff, sizeof(buff), "Reserved");
+            snprintf(buff, buff_size, "Reserved");
             break;
 
         case MBUS_ERROR_DATA_APPLICATION_BUSY:
-            snprintf(buff, sizeof(buff), "Application busy");
+            snprintf(buff, buff_size, "Application busy");
             break;
 
         case MBUS_ERROR_DATA_TOO_MANY_READOUTS:
-            snprintf(buff, sizeof(buff), "Too many readouts");
+            snprintf(buff, buff_size, "Too many readouts");
             break;
 
         default:
-            snprintf(buff, sizeof(buff), "Unknown error (0x%.2X)", error);
+            snprintf(buff, buff_size, "Unknown error (0x%.2X)", error);
             break;
     }
 
     return buff;
 }
 
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_data_error_lookup_r() using a static buffer.
+//------------------------------------------------------------------------------
+const char *
+mbus_data_error_lookup(int error)
+{
+    static char buff[256];
+
+    return mbus_data_error_lookup_r(error, buff, sizeof(buff));
+}
+
 
 //------------------------------------------------------------------------------
 /// Lookup the unit from the VIB (VIF or VIFE)
@@ -2285,9 +2389,9 @@ mbus_data_error_lookup(int error)
 //    E000 1111      Software version #
 //------------------------------------------------------------------------------
 const char *
-mbus_vib_unit_lookup(mbus_value_information_block *vib)
+mbus_vib_unit_lookup_r(mbus_value_information_block *vib, char *buff, size_t buff_size)
 {
-    static char buff[256];
+    char prefix[32];
     int n;
 
     if (vib == NULL)
@@ -2297,120 +2401,170 @@ mbus_vib_unit_lookup(mbus_value_information_block *vib)
     {
         if (vib->nvife == 0)
         {
-            snprintf(buff, sizeof(buff), "Missing VIF extension");
+            snprintf(buff, buff_size, "Missing VIF extension");
         }
         else if (vib->vife[0] == 0x08 || vib->vife[0] == 0x88)
         {
             // E000 1000
-            snprintf(buff, sizeof(buff), "Access Number (transmission count)");
+            snprintf(buff, buff_size, "Access Number (transmission count)");
         }
         else if (vib->vife[0] == 0x09|| vib->vife[0] == 0x89)
         {
             // E000 1001
-            snprintf(buff, sizeof(buff), "Medium (as in fixed header)");
+            snprintf(buff, buff_size, "Medium (as in fixed header)");
         }
         else if (vib->vife[0] == 0x0A || vib->vife[0] == 0x8A)
         {
             // E000 1010
-            snprintf(buff, sizeof(buff), "Manufacturer (as in fixed header)");
+            snprintf(buff, buff_size, "Manufacturer (as in fixed header)");
         }
         else if (vib->vife[0] == 0x0B || vib->vife[0] == 0x8B)
         {
             // E000 1010
-            snprintf(buff, sizeof(buff), "Parameter set identification");
+            snprintf(buff, buff_size, "Parameter set identification");
         }
         else if (vib->vife[0] == 0x0C || vib->vife[0] == 0x8C)
         {
             // E000 1100
-            snprintf(buff, sizeof(buff), "Model / Version");
+            snprintf(buff, buff_size, "Model / Version");
         }
         else if (vib->vife[0] == 0x0D || vib->vife[0] == 0x8D)
         {
             // E000 1100
-            snprintf(buff, sizeof(buff), "Hardware version");
+            snprintf(buff, buff_size, "Hardware version");
         }
         else if (vib->vife[0] == 0x0E || vib->vife[0] == 0x8E)
         {
             // E000 1101
-            snprintf(buff, sizeof(buff), "Firmware version");
+            snprintf(buff, buff_size, "Firmware version");
         }
         else if (vib->vife[0] == 0x0F || vib->vife[0] == 0x8F)
         {
             // E000 1101
-            snprintf(buff, sizeof(buff), "Software version");
+            snprintf(buff, buff_size, "Software version");
         }
         else if (vib->vife[0] == 0x16)
         {
             // VIFE = E001 0110 Password
-            snprintf(buff, sizeof(buff), "Password");
+            snprintf(buff, buff_size, "Password");
         }
         else if (vib->vife[0] == 0x17 || vib->vife[0] == 0x97)
         {
             // VIFE = E001 0111 Error flags
-            snprintf(buff, sizeof(buff), "Error flags");
+            snprintf(buff, buff_size, "Error flags");
         }
         else if (vib->vife[0] == 0x10)
         {
             // VIFE = E001 0000 Customer location
-            snprintf(buff, sizeof(buff), "Customer location");
+            snprintf(buff, buff_size, "Customer location");
         }
         else if (vib->vife[0] == 0x11)
         {
             // VIFE = E001 0001 Customer
-            snprintf(buff, sizeof(buff), "Customer");
+            snprintf(buff, buff_size, "Customer");
         }
         else if (vib->vife[0] == 0x1A)
         {
             // VIFE = E001 1010 Digital output (binary)
-            snprintf(buff, sizeof(buff), "Digital output (binary)");
+            snprintf(buff, buff_size, "Digital output (binary)");
         }
         else if (vib->vife[0] == 0x1B)
         {
             // VIFE = E001 1011 Digital input (binary)
-            snprintf(buff, sizeof(buff), "Digital input (binary)");
+            snprintf(buff, buff_size, "Digital input (binary)");
         }
         else if ((vib->vife[0] & 0x70) == 0x40)
         {
             // VIFE = E100 nnnn 10^(nnnn-9) V
             n = (vib->vife[0] & 0x0F);
-            snprintf(buff, sizeof(buff), "%s V", mbus_unit_prefix(n-9));
+            snprintf(buff, buff_size, "%s V", mbus_unit_prefix_r(n-9, prefix, sizeof(prefix)));
         }
         else if ((vib->vife[0] & 0x70) == 0x50)
         {
             // VIFE = E101 nnnn 10nnnn-12 A
             n = (vib->vife[0] & 0x0F);
-            snprintf(buff, sizeof(buff), "%s A", mbus_unit_prefix(n-12));
+            snprintf(buff, buff_size, "%s A", mbus_unit_prefix_r(n-12, prefix, sizeof(prefix)));
         }
         else if ((vib->vife[0] & 0xF0) == 0x70)
         {
             // VIFE = E111 nnn Reserved
-            snprintf(buff, sizeof(buff), "Reserved VIF extension");
+            snprintf(buff, buff_size, "Reserved VIF extension");
         }
         else
         {
-            snprintf(buff, sizeof(buff), "Unrecognized VIF extension: 0x%.2x", vib->vife[0]);
+            snprintf(buff, buff_size, "Unrecognized VIF extension: 0x%.2x", vib->vife[0]);
         }
         return buff;
     }
     else if (vib->vif == 0x7C)
     {
         // custom VIF
-        snprintf(buff, sizeof(buff), "%s", vib->custom_vif);
+        snprintf(buff, buff_size, "%s", vib->custom_vif);
         return buff;
     }
     else if (vib->vif == 0xFC && (vib->vife[0] & 0x78) == 0x70)
     {
         // custom VIF
         n = (vib->vife[0] & 0x07);
-        snprintf(buff, sizeof(buff), "%s %s", mbus_unit_prefix(n-6), vib->custom_vif);
+        snprintf(buff, buff_size, "%s %s", mbus_unit_prefix_r(n-6, prefix, sizeof(prefix)), vib->custom_vif);
         return buff;
     }
 
-    return mbus_vif_unit_lookup(vib->vif); // no extention, use VIF
+    return mbus_vif_unit_lookup_r(vib->vif, buff, buff_size); // no extention, use VIF
+}
+
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_vib_unit_lookup_r() using a static buffer.
+//------------------------------------------------------------------------------
+const char *
+mbus_vib_unit_lookup(mbus_value_information_block *vib)
+{
+    static char buff[256];
+
+    return mbus_vib_unit_lookup_r(vib, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Check for a date/time point in a 4 or 6 byte data field
+//------------------------------------------------------------------------------
+static int
+mbus_data_record_is_datetime(mbus_data_record *record)
+{
+    unsigned char vif, vife;
+
+    // ignore extension bit
+    vif = (record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION);
+    vife = (record->drh.vib.vife[0] & MBUS_DIB_VIF_WITHOUT_EXTENSION);
+
+    // E110 1101  Time Point (date/time)
+    // E011 0000  Start (date/time) of tariff
+    // E111 0000  Date and time of battery change
+    return (vif == 0x6D) ||
+           ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
+           ((record->drh.vib.vif == 0xFD) && (vife == 0x70));
+}
+
+//------------------------------------------------------------------------------
+/// Check for BCD digits A-F (which are not decoded correctly)
+//------------------------------------------------------------------------------
+static int
+mbus_data_bcd_check(const unsigned char *bcd_data, size_t bcd_data_size)
+{
+    size_t i;
+
+    for (i = 0; i < bcd_data_size; i++)
+    {
+        if (((bcd_data[i] >> 4) & 0xF) > 9 || (bcd_data[i] & 0xF) > 9)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 //------------------------------------------------------------------------------
-// Decode data and write to string
+// Decode the value of a data record
 //
 // Data format (for record->data data array)
 //
@@ -2427,248 +2581,343 @@ mbus_vib_unit_lookup(mbus_value_information_block *vib)
 // The Code is stored in record->drh.dib.dif
 //
 ///
-/// Return a string containing the data
+/// Decode the data of a record once into its native type (see
+/// MBUS_DATA_VALUE_*). Strings and binary data are not copied, the value
+/// refers to the record data.
 ///
 // Source: MBDOC48.PDF
 //
 //------------------------------------------------------------------------------
-const char *
-mbus_data_record_decode(mbus_data_record *record)
+int
+mbus_data_record_value_decode(mbus_data_record *record, mbus_data_value *value)
 {
-    static char buff[768];
-    unsigned char vif, vife;
+    unsigned char code;
+    size_t size;
+    int int_val;
 
-    if (record)
+    if (record == NULL || value == NULL)
     {
-        int int_val;
-        float float_val;
-        long long long_long_val;
-        struct tm time;
-
-        // ignore extension bit
-        vif = (record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION);
-        vife = (record->drh.vib.vife[0] & MBUS_DIB_VIF_WITHOUT_EXTENSION);
-
-        switch (record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_DATA)
-        {
-            case 0x00: // no data
+        return -1;
+    }
 
-                buff[0] = 0;
+    memset(value, 0, sizeof(mbus_data_value));
+    value->dif = record->drh.dib.dif;
 
-                break;
+    code = record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_DATA;
 
-            case 0x01: // 1 byte integer (8 bit)
+    switch (code)
+    {
+        case 0x00: // no data
 
-                mbus_data_int_decode(record->data, 1, &int_val);
+            value->type = MBUS_DATA_VALUE_NONE;
+            break;
 
-                snprintf(buff, sizeof(buff), "%d", int_val);
+        case 0x01: // 1 byte integer (8 bit)
+        case 0x03: // 3 byte integer (24 bit)
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 1 byte integer\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+            mbus_data_int_decode(record->data, code, &int_val);
+            value->type = MBUS_DATA_VALUE_INTEGER;
+            value->value.integer = int_val;
+            break;
 
-                break;
+        case 0x02: // 2 byte (16 bit)
 
+            // E110 1100  Time Point (date)
+            if ((record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION) == 0x6C)
+            {
+                mbus_data_tm_decode(&value->value.time, record->data, 2);
+                value->type = MBUS_DATA_VALUE_DATE;
+            }
+            else  // 2 byte integer
+            {
+                mbus_data_int_decode(record->data, 2, &int_val);
+                value->type = MBUS_DATA_VALUE_INTEGER;
+                value->value.integer = int_val;
+            }
+            break;
 
-            case 0x02: // 2 byte (16 bit)
+        case 0x04: // 4 byte (32 bit)
 
-                // E110 1100  Time Point (date)
-                if (vif == 0x6C)
-                {
-                    mbus_data_tm_decode(&time, record->data, 2);
-                    snprintf(buff, sizeof(buff), "%04d-%02d-%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday);
-                }
-                else  // 2 byte integer
-                {
-                    mbus_data_int_decode(record->data, 2, &int_val);
-                    snprintf(buff, sizeof(buff), "%d", int_val);
-                    if (debug)
-                        printf("%s: DIF 0x%.2x was decoded using 2 byte integer\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+            if (mbus_data_record_is_datetime(record))
+            {
+                mbus_data_tm_decode(&value->value.time, record->data, 4);
+                value->type = MBUS_DATA_VALUE_DATETIME;
+            }
+            else  // 4 byte integer
+            {
+                mbus_data_int_decode(record->data, 4, &int_val);
+                value->type = MBUS_DATA_VALUE_INTEGER;
+                value->value.integer = int_val;
+            }
+            break;
 
-                }
+        case 0x05: // 4 Byte Real (32 bit)
 
-                break;
+            value->type = MBUS_DATA_VALUE_REAL;
+            value->value.real = mbus_data_float_decode(record->data);
+            break;
 
-            case 0x03: // 3 byte integer (24 bit)
+        case 0x06: // 6 byte (48 bit)
 
-                mbus_data_int_decode(record->data, 3, &int_val);
+            if (mbus_data_record_is_datetime(record))
+            {
+                mbus_data_tm_decode(&value->value.time, record->data, 6);
+                value->type = MBUS_DATA_VALUE_DATETIME;
+            }
+            else  // 6 byte integer
+            {
+                mbus_data_long_long_decode(record->data, 6, &value->value.integer);
+                value->type = MBUS_DATA_VALUE_INTEGER;
+            }
+            break;
 
-                snprintf(buff, sizeof(buff), "%d", int_val);
+        case 0x07: // 8 byte integer (64 bit)
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 3 byte integer\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+            mbus_data_long_long_decode(record->data, 8, &value->value.integer);
+            value->type = MBUS_DATA_VALUE_INTEGER;
+            break;
 
-                break;
+        case 0x09: // 2 digit BCD (8 bit)
+        case 0x0A: // 4 digit BCD (16 bit)
+        case 0x0B: // 6 digit BCD (24 bit)
+        case 0x0C: // 8 digit BCD (32 bit)
+        case 0x0E: // 12 digit BCD (48 bit)
 
-            case 0x04: // 4 byte (32 bit)
+            size = (code == 0x0E) ? 6 : (size_t)(code - 0x08);
 
-                // E110 1101  Time Point (date/time)
-                // E011 0000  Start (date/time) of tariff
-                // E111 0000  Date and time of battery change
-                if ( (vif == 0x6D) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
-                {
-                    mbus_data_tm_decode(&time, record->data, 4);
-                    snprintf(buff, sizeof(buff), "%04d-%02d-%02dT%02d:%02d:%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
-                }
-                else  // 4 byte integer
-                {
-                    mbus_data_int_decode(record->data, 4, &int_val);
-                    snprintf(buff, sizeof(buff), "%d", int_val);
-                }
+            value->type = MBUS_DATA_VALUE_BCD;
+            value->value.integer = mbus_data_bcd_decode(record->data, size);
+            value->bcd_error = mbus_data_bcd_check(record->data, size);
+            break;
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 4 byte integer\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+        case 0x0D: // variable length
 
-                break;
+            if (record->data_len <= 0xBF)
+            {
+                value->type = MBUS_DATA_VALUE_STRING;
+                value->data = record->data;
+                value->data_len = record->data_len;
+            }
+            else
+            {
+                value->type = MBUS_DATA_VALUE_UNKNOWN;
+            }
+            break;
 
-            case 0x05: // 4 Byte Real (32 bit)
+        case 0x0F: // special functions
 
-                float_val = mbus_data_float_decode(record->data);
+            value->type = MBUS_DATA_VALUE_BINARY;
+            value->data = record->data;
+            value->data_len = record->data_len;
+            break;
 
-                snprintf(buff, sizeof(buff), "%f", float_val);
+        default:
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 4 byte Real\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+            value->type = MBUS_DATA_VALUE_UNKNOWN;
+            break;
+    }
 
-                break;
+    return 0;
+}
 
-            case 0x06: // 6 byte (48 bit)
+//------------------------------------------------------------------------------
+/// Replace the decimal separator of the current locale (printf %f) with '.'
+//------------------------------------------------------------------------------
+static void
+mbus_str_decimal_point_fix(char *buff)
+{
+    const char *point = localeconv()->decimal_point;
+    char *p;
 
-                // E110 1101  Time Point (date/time)
-                // E011 0000  Start (date/time) of tariff
-                // E111 0000  Date and time of battery change
-                if ( (vif == 0x6D) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
-                    ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
-                {
-                    mbus_data_tm_decode(&time, record->data, 6);
-                    snprintf(buff, sizeof(buff), "%04d-%02d-%02dT%02d:%02d:%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
-                }
-                else  // 6 byte integer
-                {
-                    mbus_data_long_long_decode(record->data, 6, &long_long_val);
-                    snprintf(buff, sizeof(buff), "%lld", long_long_val);
-                }
+    if (point == NULL || point[0] == '.' || point[0] == '\0' || point[1] != '\0')
+    {
+        return;
+    }
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 6 byte integer\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+    if ((p = strchr(buff, point[0])) != NULL)
+    {
+        *p = '.';
+    }
+}
 
-                break;
+//------------------------------------------------------------------------------
+/// Format a decoded record value as string
+//------------------------------------------------------------------------------
+const char *
+mbus_data_value_format_r(const mbus_data_value *value, char *buff, size_t buff_size)
+{
+    if (value == NULL || buff == NULL || buff_size == 0)
+    {
+        return NULL;
+    }
 
-            case 0x07: // 8 byte integer (64 bit)
+    switch (value->type)
+    {
+        case MBUS_DATA_VALUE_NONE:
 
-                mbus_data_long_long_decode(record->data, 8, &long_long_val);
+            buff[0] = 0;
+            break;
 
-                snprintf(buff, sizeof(buff), "%lld", long_long_val);
+        case MBUS_DATA_VALUE_INTEGER:
+        case MBUS_DATA_VALUE_BCD:
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 8 byte integer\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+            if (buff_size >= MBUS_FORMAT_INT_SIZE)
+            {
+                mbus_format_int(value->value.integer, buff);
+            }
+            else
+            {
+                snprintf(buff, buff_size, "%lld", value->value.integer);
+            }
+            break;
 
-                break;
+        case MBUS_DATA_VALUE_REAL:
 
-            //case 0x08:
+            snprintf(buff, buff_size, "%f", value->value.real);
+            mbus_str_decimal_point_fix(buff);
+            break;
 
-            case 0x09: // 2 digit BCD (8 bit)
+        case MBUS_DATA_VALUE_DATE:
 
-                int_val = (int)mbus_data_bcd_decode(record->data, 1);
-                snprintf(buff, sizeof(buff), "%d", int_val);
+            snprintf(buff, buff_size, "%04d-%02d-%02d",
+                                         (value->value.time.tm_year + 1900),
+                                         (value->value.time.tm_mon + 1),
+                                          value->value.time.tm_mday);
+            break;
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 2 digit BCD\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+        case MBUS_DATA_VALUE_DATETIME:
 
-                break;
+            snprintf(buff, buff_size, "%04d-%02d-%02dT%02d:%02d:%02d",
+                                         (value->value.time.tm_year + 1900),
+                                         (value->value.time.tm_mon + 1),
+                                          value->value.time.tm_mday,
+                                          value->value.time.tm_hour,
+                                          value->value.time.tm_min,
+                                          value->value.time.tm_sec);
+            break;
 
-            case 0x0A: // 4 digit BCD (16 bit)
+        case MBUS_DATA_VALUE_BINARY:
 
-                int_val = (int)mbus_data_bcd_decode(record->data, 2);
-                snprintf(buff, sizeof(buff), "%d", int_val);
+            mbus_data_bin_decode((unsigned char *) buff, value->data, value->data_len, buff_size);
+            break;
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 4 digit BCD\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+        case MBUS_DATA_VALUE_STRING:
 
+            if (value->data_len < buff_size)
+            {
+                mbus_data_str_decode((unsigned char *) buff, value->data, value->data_len);
                 break;
+            }
+            /*@fallthrough@*/
 
-            case 0x0B: // 6 digit BCD (24 bit)
-
-                int_val = (int)mbus_data_bcd_decode(record->data, 3);
-                snprintf(buff, sizeof(buff), "%d", int_val);
+        default:
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 6 digit BCD\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+            snprintf(buff, buff_size, "Unknown DIF (0x%.2x)", value->dif);
+            break;
+    }
 
-                break;
+    return buff;
+}
 
-            case 0x0C: // 8 digit BCD (32 bit)
+//------------------------------------------------------------------------------
+/// Return 1 if a decoded record value is numeric else 0
+//------------------------------------------------------------------------------
+int
+mbus_data_value_is_numeric(const mbus_data_value *value)
+{
+    char str[0xC0];
 
-                int_val = (int)mbus_data_bcd_decode(record->data, 4);
-                snprintf(buff, sizeof(buff), "%d", int_val);
+    if (value == NULL)
+    {
+        return 0;
+    }
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 8 digit BCD\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+    switch (value->type)
+    {
+        case MBUS_DATA_VALUE_INTEGER:
+        case MBUS_DATA_VALUE_REAL:
+        case MBUS_DATA_VALUE_BCD:
 
-                break;
+            return 1;
 
-            case 0x0E: // 12 digit BCD (48 bit)
+        case MBUS_DATA_VALUE_STRING:
 
-                long_long_val = mbus_data_bcd_decode(record->data, 6);
-                snprintf(buff, sizeof(buff), "%lld", long_long_val);
+            // some meters transmit readings as text
+            mbus_data_str_decode((unsigned char *) str, value->data, value->data_len);
+            return isnumeric(str);
 
-                if (debug)
-                    printf("%s: DIF 0x%.2x was decoded using 12 digit BCD\n", __PRETTY_FUNCTION__, record->drh.dib.dif);
+        default:
 
-                break;
+            return 0;
+    }
+}
 
-            case 0x0F: // special functions
+//------------------------------------------------------------------------------
+/// Return a string containing the data
+//------------------------------------------------------------------------------
+const char *
+mbus_data_record_decode_r(mbus_data_record *record, char *buff, size_t buff_size)
+{
+    mbus_data_value value;
 
-                mbus_data_bin_decode(buff, record->data, record->data_len, sizeof(buff));
-                break;
+    if (mbus_data_record_value_decode(record, &value) != 0)
+    {
+        return NULL;
+    }
 
-            case 0x0D: // variable length
-                if (record->data_len <= 0xBF)
-                {
-                    mbus_data_str_decode(buff, record->data, record->data_len);
-                    break;
-                }
-                /*@fallthrough@*/
+    if (debug)
+        printf("%s: DIF 0x%.2x was decoded as value type %d\n", __PRETTY_FUNCTION__, value.dif, value.type);
 
-            default:
+    return mbus_data_value_format_r(&value, buff, buff_size);
+}
 
-                snprintf(buff, sizeof(buff), "Unknown DIF (0x%.2x)", record->drh.dib.dif);
-                break;
-        }
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_data_record_decode_r() using a static buffer.
+//------------------------------------------------------------------------------
+const char *
+mbus_data_record_decode(mbus_data_record *record)
+{
+    static char buff[768];
+
+    return mbus_data_record_decode_r(record, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Return the unit description for a variable-length data record
+//------------------------------------------------------------------------------
+const char *
+mbus_data_record_unit_r(mbus_data_record *record, char *buff, size_t buff_size)
+{
+    if (record)
+    {
+        mbus_vib_unit_lookup_r(&(record->drh.vib), buff, buff_size);
 
         return buff;
     }
 
     return NULL;
 }
+
 //------------------------------------------------------------------------------
-/// Return the unit description for a variable-length data record
+/// Non-reentrant version of mbus_data_record_unit_r() using a static buffer.
 //------------------------------------------------------------------------------
 const char *
 mbus_data_record_unit(mbus_data_record *record)
 {
     static char buff[128];
 
+    return mbus_data_record_unit_r(record, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Return the value for a variable-length data record
+//------------------------------------------------------------------------------
+const char *
+mbus_data_record_value_r(mbus_data_record *record, char *buff, size_t buff_size)
+{
     if (record)
     {
-        snprintf(buff, sizeof(buff), "%s", mbus_vib_unit_lookup(&(record->drh.vib)));
+        mbus_data_record_decode_r(record, buff, buff_size);
 
         return buff;
     }
@@ -2677,21 +2926,14 @@ mbus_data_record_unit(mbus_data_record *record)
 }
 
 //------------------------------------------------------------------------------
-/// Return the value for a variable-length data record
+/// Non-reentrant version of mbus_data_record_value_r() using a static buffer.
 //------------------------------------------------------------------------------
 const char *
 mbus_data_record_value(mbus_data_record *record)
 {
     static char buff[768];
 
-    if (record)
-    {
-        snprintf(buff, sizeof(buff), "%s", mbus_data_record_decode(record));
-
-        return buff;
-    }
-
-    return NULL;
+    return mbus_data_record_value_r(record, buff, sizeof(buff));
 }
 
 //------------------------------------------------------------------------------
@@ -2772,33 +3014,33 @@ int mbus_data_record_device(mbus_data_record *record)
 const char *
 mbus_data_record_function(mbus_data_record *record)
 {
-    static char buff[128];
+    const char *str;
 
     if (record)
     {
         switch (record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_FUNCTION)
         {
             case 0x00:
-                snprintf(buff, sizeof(buff), "Instantaneous value");
+                str = "Instantaneous value";
                 break;
 
             case 0x10:
-                snprintf(buff, sizeof(buff), "Maximum value");
+                str = "Maximum value";
                 break;
 
             case 0x20:
-                snprintf(buff, sizeof(buff), "Minimum value");
+                str = "Minimum value";
                 break;
 
             case 0x30:
-                snprintf(buff, sizeof(buff), "Value during error state");
+                str = "Value during error state";
                 break;
 
             default:
-                snprintf(buff, sizeof(buff), "unknown");
+                str = "unknown";
         }
 
-        return buff;
+        return str;
     }
 
     return NULL;
@@ -2811,13 +3053,8 @@ mbus_data_record_function(mbus_data_record *record)
 const char *
 mbus_data_fixed_function(int status)
 {
-    static char buff[128];
-
-    snprintf(buff, sizeof(buff), "%s",
-            (status & MBUS_DATA_FIXED_STATUS_DATE_MASK) == MBUS_DATA_FIXED_STATUS_DATE_STORED ?
-            "Stored value" : "Actual value" );
-
-    return buff;
+    return (status & MBUS_DATA_FIXED_STATUS_DATE_MASK) == MBUS_DATA_FIXED_STATUS_DATE_STORED ?
+            "Stored value" : "Actual value";
 }
 
 //------------------------------------------------------------------------------
@@ -2827,164 +3064,208 @@ mbus_data_fixed_function(int status)
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// PARSE M-BUS frame data structures from binary data.
+/// Initialize an incremental parser to decode the next frame into frame.
 //------------------------------------------------------------------------------
-int
-mbus_parse(mbus_frame *frame, unsigned char *data, size_t data_size)
+void
+mbus_parser_init(mbus_parser *parser, mbus_frame *frame)
 {
-    size_t i, len;
-
-    if (frame && data && data_size > 0)
+    if (parser)
     {
-        frame->next = NULL;
-
-        if (parse_debug)
-            printf("%s: Attempting to parse binary data [size = %zu]\n", __PRETTY_FUNCTION__, data_size);
-
-        if (parse_debug)
-            printf("%s: ", __PRETTY_FUNCTION__);
+        parser->frame    = frame;
+        parser->pos      = 0;
+        parser->size     = 0;
+        parser->checksum = 0;
+        parser->result   = 1; // need the start byte
 
-        for (i = 0; i < data_size && parse_debug; i++)
+        if (frame)
         {
-            printf("%.2X ", data[i] & 0xFF);
+            frame->next = NULL;
         }
+    }
+}
 
-        if (parse_debug)
-            printf("\n%s: done.\n", __PRETTY_FUNCTION__);
-
-        switch (data[0])
-        {
-            case MBUS_FRAME_ACK_START:
+//------------------------------------------------------------------------------
+/// Feed data_size bytes of received data to the incremental parser. Bytes are
+/// only consumed up to the end of the current frame, the number of consumed
+/// bytes is stored in consumed (if not NULL), trailing bytes belong to the
+/// next frame.
+///
+/// Return value are the same as for mbus_parse: the number of bytes still
+/// required when > 0, 0 when a complete and verified frame was decoded and
+/// < 0 on error. Once the parser reached a final state it has to be
+/// reinitialized with mbus_parser_init.
+//------------------------------------------------------------------------------
+int
+mbus_parser_feed(mbus_parser *parser, const unsigned char *data, size_t data_size, size_t *consumed)
+{
+    mbus_frame *frame;
+    unsigned char byte;
+    size_t i = 0;
 
-                // OK, got a valid ack frame, require no more data
-                frame->start1   = data[0];
-                frame->type = MBUS_FRAME_TYPE_ACK;
-                return 0;
-                //return MBUS_FRAME_BASE_SIZE_ACK - 1; // == 0
+    if (consumed)
+        *consumed = 0;
 
-            case MBUS_FRAME_SHORT_START:
+    if (parser == NULL || parser->frame == NULL || (data == NULL && data_size > 0))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to parser, frame or data.");
+        return -1;
+    }
 
-                if (data_size < MBUS_FRAME_BASE_SIZE_SHORT)
-                {
-                    // OK, got a valid short packet start, but we need more data
-                    return MBUS_FRAME_BASE_SIZE_SHORT - data_size;
-                }
+    frame = parser->frame;
 
-                if (data_size != MBUS_FRAME_BASE_SIZE_SHORT)
-                {
-                    snprintf(error_str, sizeof(error_str), "Too much data in frame.");
+    while (i < data_size && parser->result > 0)
+    {
+        byte = data[i++];
 
-                    // too much data... ?
-                    return -2;
-                }
+        if (parser->pos == 0)
+        {
+            frame->start1 = byte;
 
-                // init frame data structure
-                frame->start1   = data[0];
-                frame->control  = data[1];
-                frame->address  = data[2];
-                frame->checksum = data[3];
-                frame->stop     = data[4];
+            switch (byte)
+            {
+                case MBUS_FRAME_ACK_START:
+                    // OK, got a valid ack frame, require no more data
+                    frame->type = MBUS_FRAME_TYPE_ACK;
+                    parser->pos = parser->size = MBUS_FRAME_BASE_SIZE_ACK;
+                    parser->result = 0;
+                    continue;
+
+                case MBUS_FRAME_SHORT_START:
+                    frame->type = MBUS_FRAME_TYPE_SHORT;
+                    parser->size = MBUS_FRAME_BASE_SIZE_SHORT;
+                    break;
 
-                frame->type = MBUS_FRAME_TYPE_SHORT;
+                case MBUS_FRAME_LONG_START: // (also CONTROL)
+                    // need the length fields to determine the frame size
+                    frame->type = MBUS_FRAME_TYPE_LONG;
+                    parser->size = 0;
+                    break;
 
-                // verify the frame
-                if (mbus_frame_verify(frame) != 0)
-                {
-                    return -3;
-                }
+                default:
+                    mbus_error_set(MBUS_ERR_FRAME_INVALID, "Invalid M-Bus frame start.");
 
-                // successfully parsed data
-                return 0;
+                    // not a valid M-Bus frame header (start byte)
+                    parser->result = -4;
+                    continue;
+            }
+        }
+        else if (frame->type == MBUS_FRAME_TYPE_SHORT)
+        {
+            switch (parser->pos)
+            {
+                case 1: frame->control  = byte; parser->checksum  = byte; break;
+                case 2: frame->address  = byte; parser->checksum += byte; break;
+                case 3: frame->checksum = byte; break;
+                case 4: frame->stop     = byte; break;
+            }
+        }
+        else if (parser->pos < 7)
+        {
+            switch (parser->pos)
+            {
+                case 1:
+                    frame->length1 = byte;
+                    break;
 
-            case MBUS_FRAME_LONG_START: // (also CONTROL)
+                case 2:
+                    frame->length2 = byte;
 
-                if (data_size < 3)
-                {
-                    // OK, got a valid long/control packet start, but we need
-                    // more data to determine the length
-                    return 3 - data_size;
-                }
+                    if (frame->length1 < 3 || frame->length1 != frame->length2)
+                    {
+                        mbus_error_set(MBUS_ERR_FRAME_INVALID, "Invalid M-Bus frame length.");
 
-                // init frame data structure
-                frame->start1   = data[0];
-                frame->length1  = data[1];
-                frame->length2  = data[2];
+                        // not a valid M-bus frame
+                        parser->result = -2;
+                        continue;
+                    }
 
-                if (frame->length1 < 3)
-                {
-                    snprintf(error_str, sizeof(error_str), "Invalid M-Bus frame length.");
+                    parser->size = MBUS_FRAME_FIXED_SIZE_LONG + frame->length1;
+                    frame->data_size = frame->length1 - 3;
+                    frame->type = (frame->data_size == 0) ? MBUS_FRAME_TYPE_CONTROL : MBUS_FRAME_TYPE_LONG;
+                    break;
 
-                    // not a valid M-bus frame
-                    return -2;
-                }
+                case 3: frame->start2  = byte; break;
+                case 4: frame->control = byte; parser->checksum  = byte; break;
+                case 5: frame->address = byte; parser->checksum += byte; break;
+                case 6: frame->control_information = byte; parser->checksum += byte; break;
+            }
+        }
+        else if (parser->pos < parser->size - 2)
+        {
+            frame->data[parser->pos - 7] = byte;
+            parser->checksum += byte;
+        }
+        else if (parser->pos == parser->size - 2)
+        {
+            frame->checksum = byte;
+        }
+        else
+        {
+            frame->stop = byte;
+        }
 
-                if (frame->length1 != frame->length2)
-                {
-                    snprintf(error_str, sizeof(error_str), "Invalid M-Bus frame length.");
+        parser->pos++;
 
-                    // not a valid M-bus frame
-                    return -2;
-                }
+        if (parser->size && parser->pos == parser->size)
+        {
+            // we got the whole packet, verify the frame
+            parser->result = (frame_verify(frame, parser->checksum) != 0) ? -3 : 0;
+        }
+        else
+        {
+            parser->result = (parser->size ? parser->size : 3) - parser->pos;
+        }
+    }
 
-                // check length of packet:
-                len = frame->length1;
+    if (consumed)
+        *consumed = i;
 
-                if (data_size < (size_t)(MBUS_FRAME_FIXED_SIZE_LONG + len))
-                {
-                    // OK, but we need more data
-                    return MBUS_FRAME_FIXED_SIZE_LONG + len - data_size;
-                }
+    return parser->result;
+}
 
-                if (data_size > (size_t)(MBUS_FRAME_FIXED_SIZE_LONG + len))
-                {
-                    snprintf(error_str, sizeof(error_str), "Too much data in frame.");
+//------------------------------------------------------------------------------
+/// PARSE M-BUS frame data structures from binary data.
+//------------------------------------------------------------------------------
+int
+mbus_parse(mbus_frame *frame, unsigned char *data, size_t data_size)
+{
+    mbus_parser parser;
+    size_t i, consumed;
+    int result;
 
-                    // too much data... ?
-                    return -2;
-                }
+    if (frame && data && data_size > 0)
+    {
+        if (parse_debug)
+            printf("%s: Attempting to parse binary data [size = %zu]\n", __PRETTY_FUNCTION__, data_size);
 
-                // we got the whole packet, continue parsing
-                frame->start2   = data[3];
-                frame->control  = data[4];
-                frame->address  = data[5];
-                frame->control_information = data[6];
+        if (parse_debug)
+            printf("%s: ", __PRETTY_FUNCTION__);
 
-                frame->data_size = len - 3;
-                for (i = 0; i < frame->data_size; i++)
-                {
-                    frame->data[i] = data[7 + i];
-                }
+        for (i = 0; i < data_size && parse_debug; i++)
+        {
+            printf("%.2X ", data[i] & 0xFF);
+        }
 
-                frame->checksum = data[data_size-2]; // data[6 + frame->data_size + 1]
-                frame->stop     = data[data_size-1]; // data[6 + frame->data_size + 2]
+        if (parse_debug)
+            printf("\n%s: done.\n", __PRETTY_FUNCTION__);
 
-                if (frame->data_size == 0)
-                {
-                    frame->type = MBUS_FRAME_TYPE_CONTROL;
-                }
-                else
-                {
-                    frame->type = MBUS_FRAME_TYPE_LONG;
-                }
+        mbus_parser_init(&parser, frame);
 
-                // verify the frame
-                if (mbus_frame_verify(frame) != 0)
-                {
-                    return -3;
-                }
+        result = mbus_parser_feed(&parser, data, data_size, &consumed);
 
-                // successfully parsed data
-                return 0;
-            default:
-                snprintf(error_str, sizeof(error_str), "Invalid M-Bus frame start.");
+        if ((result == 0 || result == -3) &&
+            frame->type != MBUS_FRAME_TYPE_ACK && consumed < data_size)
+        {
+            mbus_error_set(MBUS_ERR_FRAME_INVALID, "Too much data in frame.");
 
-                // not a valid M-Bus frame header (start byte)
-                return -4;
+            // too much data... ?
+            return -2;
         }
 
+        return result;
     }
 
-    snprintf(error_str, sizeof(error_str), "Got null pointer to frame, data or zero data_size.");
+    mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to frame, data or zero data_size.");
 
     return -1;
 }
@@ -3000,7 +3281,7 @@ mbus_data_fixed_parse(mbus_frame *frame, mbus_data_fixed *data)
     {
         if (frame->data_size != MBUS_DATA_FIXED_LENGTH)
         {
-            snprintf(error_str, sizeof(error_str), "Invalid length for fixed data.");
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "Invalid length for fixed data.");
             return -1;
         }
 
@@ -3030,12 +3311,69 @@ mbus_data_fixed_parse(mbus_frame *frame, mbus_data_fixed *data)
 
 
 //------------------------------------------------------------------------------
-/// Parse the variable-length data of a M-Bus frame
+/// Get storage for the next record: the scratch record when only scanning the
+/// frame, a record from the arena or a newly allocated record.
 //------------------------------------------------------------------------------
-int
-mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
+static mbus_data_record *
+mbus_data_record_get(mbus_record_arena *arena, mbus_data_record *scratch)
+{
+    if (scratch)
+    {
+        memset(scratch, 0, sizeof(mbus_data_record));
+        return scratch;
+    }
+
+    if (arena)
+    {
+        return mbus_record_arena_alloc(arena);
+    }
+
+    return mbus_data_record_new();
+}
+
+//------------------------------------------------------------------------------
+/// Release a record obtained with mbus_data_record_get.
+//------------------------------------------------------------------------------
+static void
+mbus_data_record_put(mbus_data_record *record, mbus_record_arena *arena, mbus_data_record *scratch)
+{
+    if (arena == NULL && scratch == NULL)
+    {
+        mbus_data_record_free(record);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Append a parsed record at the end (last) of the record list.
+//------------------------------------------------------------------------------
+static void
+mbus_data_record_link(mbus_data_variable *data, mbus_data_record **last,
+                      mbus_data_record *record, mbus_data_record *scratch)
+{
+    data->nrecords++;
+
+    if (record == scratch)
+        return;
+
+    if (*last == NULL)
+        data->record = record;
+    else
+        (*last)->next = record;
+
+    *last = record;
+}
+
+//------------------------------------------------------------------------------
+/// Parse the variable-length data of a M-Bus frame. Records are allocated
+/// one by one (arena and scratch are NULL), taken from the arena, or, when
+/// only the header and the more_records_follow flag are needed, parsed into
+/// the scratch record without building a record list.
+//------------------------------------------------------------------------------
+static int
+mbus_data_variable_parse_records(mbus_frame *frame, mbus_data_variable *data,
+                                 mbus_record_arena *arena, mbus_data_record *scratch)
 {
-    mbus_data_record *record = NULL;
+    mbus_data_record *record = NULL, *last = NULL;
     size_t i, j;
 
     if (frame && data)
@@ -3047,7 +3385,7 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
 
         if(frame->data_size < i)
         {
-            snprintf(error_str, sizeof(error_str), "Variable header too short.");
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "Variable header too short.");
             return -1;
         }
 
@@ -3076,7 +3414,7 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
               continue;
             }
 
-            if ((record = mbus_data_record_new()) == NULL)
+            if ((record = mbus_data_record_get(arena, scratch)) == NULL)
             {
                 // clean up...
                 return (-2);
@@ -3107,8 +3445,7 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
                 }
 
                 // append the record and move on to next one
-                mbus_data_record_append(data, record);
-                data->nrecords++;
+                mbus_data_record_link(data, &last, record, scratch);
                 continue;
             }
 
@@ -3124,8 +3461,8 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
 
                 if (record->drh.dib.ndife >= NITEMS(record->drh.dib.dife))
                 {
-                    mbus_data_record_free(record);
-                    snprintf(error_str, sizeof(error_str), "Too many DIFE.");
+                    mbus_data_record_put(record, arena, scratch);
+                    mbus_error_set(MBUS_ERR_DATA_INVALID, "Too many DIFE.");
                     return -1;
                 }
 
@@ -3139,8 +3476,8 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
 
             if (i > frame->data_size)
             {
-                mbus_data_record_free(record);
-                snprintf(error_str, sizeof(error_str), "Premature end of record at DIF.");
+                mbus_data_record_put(record, arena, scratch);
+                mbus_error_set(MBUS_ERR_DATA_INVALID, "Premature end of record at DIF.");
                 return -1;
             }
 
@@ -3156,15 +3493,15 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
                 var_vif_len = frame->data[i++];
                 if (var_vif_len > sizeof(record->drh.vib.custom_vif))
                 {
-                    mbus_data_record_free(record);
-                    snprintf(error_str, sizeof(error_str), "Too long variable length VIF.");
+                    mbus_data_record_put(record, arena, scratch);
+                    mbus_error_set(MBUS_ERR_DATA_INVALID, "Too long variable length VIF.");
                     return -1;
                 }
 
                 if (i + var_vif_len > frame->data_size)
                 {
-                    mbus_data_record_free(record);
-                    snprintf(error_str, sizeof(error_str), "Premature end of record at variable length VIF.");
+                    mbus_data_record_put(record, arena, scratch);
+                    mbus_error_set(MBUS_ERR_DATA_INVALID, "Premature end of record at variable length VIF.");
                     return -1;
                 }
                 mbus_data_str_decode(record->drh.vib.custom_vif, &(frame->data[i]), var_vif_len);
@@ -3186,8 +3523,8 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
 
                     if (record->drh.vib.nvife >= NITEMS(record->drh.vib.vife))
                     {
-                        mbus_data_record_free(record);
-                        snprintf(error_str, sizeof(error_str), "Too many VIFE.");
+                        mbus_data_record_put(record, arena, scratch);
+                        mbus_error_set(MBUS_ERR_DATA_INVALID, "Too many VIFE.");
                         return -1;
                     }
 
@@ -3202,8 +3539,8 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
 
             if (i > frame->data_size)
             {
-                mbus_data_record_free(record);
-                snprintf(error_str, sizeof(error_str), "Premature end of record at VIF.");
+                mbus_data_record_put(record, arena, scratch);
+                mbus_error_set(MBUS_ERR_DATA_INVALID, "Premature end of record at VIF.");
                 return -1;
             }
 
@@ -3224,8 +3561,8 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
 
             if (i + record->data_len > frame->data_size)
             {
-                mbus_data_record_free(record);
-                snprintf(error_str, sizeof(error_str), "Premature end of record at data.");
+                mbus_data_record_put(record, arena, scratch);
+                mbus_error_set(MBUS_ERR_DATA_INVALID, "Premature end of record at data.");
                 return -1;
             }
 
@@ -3236,8 +3573,7 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
             }
 
             // append the record and move on to next one
-            mbus_data_record_append(data, record);
-            data->nrecords++;
+            mbus_data_record_link(data, &last, record, scratch);
         }
 
         return 0;
@@ -3246,24 +3582,50 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
     return -1;
 }
 
+//------------------------------------------------------------------------------
+/// Parse the variable-length data of a M-Bus frame
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
+{
+    return mbus_data_variable_parse_records(frame, data, NULL, NULL);
+}
+
+//------------------------------------------------------------------------------
+/// Parse the variable-length data of a M-Bus frame, taking the records from
+/// the arena.
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_parse_arena(mbus_frame *frame, mbus_data_variable *data, mbus_record_arena *arena)
+{
+    if (arena == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to arena.");
+        return -1;
+    }
+
+    return mbus_data_variable_parse_records(frame, data, arena, NULL);
+}
+
 //------------------------------------------------------------------------------
 /// Check the stype of the frame data (error, fixed or variable) and dispatch to the
 /// corresponding parser function.
 //------------------------------------------------------------------------------
-int
-mbus_frame_data_parse(mbus_frame *frame, mbus_frame_data *data)
+static int
+mbus_frame_data_parse_records(mbus_frame *frame, mbus_frame_data *data,
+                              mbus_record_arena *arena, mbus_data_record *scratch)
 {
     char direction;
 
     if (frame == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "Got null pointer to frame.");
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to frame.");
         return -1;
     }
 
     if (data == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "Got null pointer to data.");
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to data.");
         return -1;
     }
 
@@ -3290,7 +3652,7 @@ mbus_frame_data_parse(mbus_frame *frame, mbus_frame_data *data)
         {
             if (frame->data_size == 0)
             {
-                snprintf(error_str, sizeof(error_str), "Got zero data_size.");
+                mbus_error_set(MBUS_ERR_DATA_INVALID, "Got zero data_size.");
 
                 return -1;
             }
@@ -3302,43 +3664,92 @@ mbus_frame_data_parse(mbus_frame *frame, mbus_frame_data *data)
         {
             if (frame->data_size == 0)
             {
-                snprintf(error_str, sizeof(error_str), "Got zero data_size.");
+                mbus_error_set(MBUS_ERR_DATA_INVALID, "Got zero data_size.");
 
                 return -1;
             }
 
             data->type = MBUS_DATA_TYPE_VARIABLE;
-            return mbus_data_variable_parse(frame, &(data->data_var));
+            return mbus_data_variable_parse_records(frame, &(data->data_var), arena, scratch);
         }
         else
         {
-            snprintf(error_str, sizeof(error_str), "Unknown control information 0x%.2x", frame->control_information);
+            mbus_error_set(MBUS_ERR_UNSUPPORTED, "Unknown control information 0x%.2x", frame->control_information);
 
             return -1;
         }
     }
 
-    snprintf(error_str, sizeof(error_str), "Wrong direction in frame (master to slave)");
+    mbus_error_set(MBUS_ERR_FRAME_INVALID, "Wrong direction in frame (master to slave)");
 
     return -1;
 }
 
 //------------------------------------------------------------------------------
-/// Pack the M-bus frame into a binary string representation that can be sent
-/// on the bus. The binary packet format is different for the different types
-/// of M-bus frames.
+/// Parse the data of a M-Bus frame (error, fixed or variable).
 //------------------------------------------------------------------------------
 int
-mbus_frame_pack(mbus_frame *frame, unsigned char *data, size_t data_size)
+mbus_frame_data_parse(mbus_frame *frame, mbus_frame_data *data)
 {
-    size_t i, offset = 0;
+    return mbus_frame_data_parse_records(frame, data, NULL, NULL);
+}
 
-    if (frame && data)
+//------------------------------------------------------------------------------
+/// Parse the data of a M-Bus frame, the records of variable data are taken
+/// from the arena (see mbus_record_arena_init).
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_parse_arena(mbus_frame *frame, mbus_frame_data *data, mbus_record_arena *arena)
+{
+    if (arena == NULL)
     {
-        if (mbus_frame_calc_length(frame) == -1)
-        {
-            return -2;
-        }
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Got null pointer to arena.");
+        return -1;
+    }
+
+    return mbus_frame_data_parse_records(frame, data, arena, NULL);
+}
+
+//------------------------------------------------------------------------------
+/// Check if the slave signals that more records follow in the next frame
+/// (DIF 0x1F) of a multi-telegram reply. The frame is parsed without
+/// allocating memory for the records.
+///
+/// Returns 1 if more records follow, 0 if not (also for fixed data and error
+/// frames) and -1 if the frame data could not be parsed.
+//------------------------------------------------------------------------------
+int
+mbus_frame_more_records_follow(mbus_frame *frame)
+{
+    mbus_frame_data data;
+    mbus_data_record scratch;
+
+    memset((void *)&data, 0, sizeof(mbus_frame_data));
+
+    if (mbus_frame_data_parse_records(frame, &data, NULL, &scratch) == -1)
+    {
+        return -1;
+    }
+
+    return (data.type == MBUS_DATA_TYPE_VARIABLE && data.data_var.more_records_follow) ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+/// Pack the M-bus frame into a binary string representation that can be sent
+/// on the bus. The binary packet format is different for the different types
+/// of M-bus frames.
+//------------------------------------------------------------------------------
+int
+mbus_frame_pack(mbus_frame *frame, unsigned char *data, size_t data_size)
+{
+    size_t i, offset = 0;
+
+    if (frame && data)
+    {
+        if (mbus_frame_calc_length(frame) == -1)
+        {
+            return -2;
+        }
 
         if (mbus_frame_calc_checksum(frame) == -1)
         {
@@ -3615,6 +4026,8 @@ mbus_frame_data_print(mbus_frame_data *data)
 int
 mbus_data_variable_header_print(mbus_data_variable_header *header)
 {
+    char str_buff[256];
+
     if (header)
     {
         printf("%s: ID           = %lld\n", __PRETTY_FUNCTION__,
@@ -3624,10 +4037,10 @@ mbus_data_variable_header_print(mbus_data_variable_header *header)
                header->manufacturer[1], header->manufacturer[0]);
 
         printf("%s: Manufacturer = %s\n", __PRETTY_FUNCTION__,
-               mbus_decode_manufacturer(header->manufacturer[0], header->manufacturer[1]));
+               mbus_decode_manufacturer_r(header->manufacturer[0], header->manufacturer[1], str_buff, sizeof(str_buff)));
 
         printf("%s: Version      = 0x%.2X\n", __PRETTY_FUNCTION__, header->version);
-        printf("%s: Medium       = %s (0x%.2X)\n", __PRETTY_FUNCTION__, mbus_data_variable_medium_lookup(header->medium), header->medium);
+        printf("%s: Medium       = %s (0x%.2X)\n", __PRETTY_FUNCTION__, mbus_data_variable_medium_lookup_r(header->medium, str_buff, sizeof(str_buff)), header->medium);
         printf("%s: Access #     = 0x%.2X\n", __PRETTY_FUNCTION__, header->access_no);
         printf("%s: Status       = 0x%.2X\n", __PRETTY_FUNCTION__, header->status);
         printf("%s: Signature    = 0x%.2X%.2X\n", __PRETTY_FUNCTION__,
@@ -3756,7 +4169,7 @@ void
 mbus_hex_dump(const char *label, const char *buff, size_t len)
 {
     time_t rawtime;
-    struct tm * timeinfo;
+    struct tm timeinfo;
     char timestamp[21];
     size_t i;
 
@@ -3764,9 +4177,9 @@ mbus_hex_dump(const char *label, const char *buff, size_t len)
         return;
 
     time ( &rawtime );
-    timeinfo = gmtime ( &rawtime );
+    gmtime_r(&rawtime, &timeinfo);
 
-    strftime(timestamp,20,"%Y-%m-%d %H:%M:%S",timeinfo);
+    strftime(timestamp,20,"%Y-%m-%d %H:%M:%S",&timeinfo);
     fprintf(stderr, "[%s] %s (%03zu):", timestamp, label, len);
 
     for (i = 0; i < len; i++)
@@ -3857,36 +4270,125 @@ mbus_str_xml_encode(unsigned char *dst, const unsigned char *src, size_t max_len
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML for the variable-length data header
+/// Append src to a sink, replacing the characters for which escape returns a
+/// replacement. Runs of unchanged characters are written at once.
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_header_xml(mbus_data_variable_header *header)
+static int
+mbus_str_encode_sink(mbus_sink *sink, const char *src, const char *(*escape)(unsigned char c))
 {
-    static char buff[8192];
-    char str_encoded[768];
-    size_t len = 0;
+    const char *run, *esc;
 
-    if (header)
+    if (sink == NULL)
+    {
+        return -1;
+    }
+
+    if (src == NULL)
+    {
+        return -2;
+    }
+
+    for (run = src; *src; src++)
+    {
+        if ((esc = escape((unsigned char) *src)) != NULL)
+        {
+            mbus_sink_write(sink, run, src - run);
+            mbus_sink_puts(sink, esc);
+            run = src + 1;
+        }
+    }
+
+    mbus_sink_write(sink, run, src - run);
+
+    return sink->error ? -1 : 0;
+}
+
+//------------------------------------------------------------------------------
+/// XML replacement of a character (control chars are converted into spaces)
+//------------------------------------------------------------------------------
+static const char *
+mbus_str_xml_escape(unsigned char c)
+{
+    if (iscntrl(c))
+    {
+        return " ";
+    }
+
+    switch (c)
+    {
+        case '&':
+            return "&amp;";
+        case '<':
+            return "&lt;";
+        case '>':
+            return "&gt;";
+        case '"':
+            return "&quot;";
+    }
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Encode string to XML and append it to a sink
+///
+//------------------------------------------------------------------------------
+int
+mbus_str_xml_encode_sink(mbus_sink *sink, const char *src)
+{
+    return mbus_str_encode_sink(sink, src, mbus_str_xml_escape);
+}
+
+//------------------------------------------------------------------------------
+/// Write XML for the variable-length data header to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_header_xml_sink(mbus_data_variable_header *header, mbus_sink *sink)
+{
+    char str_buff[768];
+
+    if (header == NULL || sink == NULL)
     {
-        len += snprintf(&buff[len], sizeof(buff) - len, "    <SlaveInformation>\n");
+        return -1;
+    }
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Id>%lld</Id>\n", mbus_data_bcd_decode(header->id_bcd, 4));
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Manufacturer>%s</Manufacturer>\n",
-                mbus_decode_manufacturer(header->manufacturer[0], header->manufacturer[1]));
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Version>%d</Version>\n", header->version);
+    mbus_sink_puts(sink, "    <SlaveInformation>\n");
 
-        mbus_str_xml_encode(str_encoded, mbus_data_product_name(header), sizeof(str_encoded));
+    mbus_sink_printf(sink, "        <Id>%lld</Id>\n", mbus_data_bcd_decode(header->id_bcd, 4));
+    mbus_sink_printf(sink, "        <Manufacturer>%s</Manufacturer>\n",
+            mbus_decode_manufacturer_r(header->manufacturer[0], header->manufacturer[1], str_buff, sizeof(str_buff)));
+    mbus_sink_printf(sink, "        <Version>%d</Version>\n", header->version);
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <ProductName>%s</ProductName>\n", str_encoded);
+    mbus_sink_puts(sink, "        <ProductName>");
+    mbus_str_xml_encode_sink(sink, mbus_data_product_name(header));
+    mbus_sink_puts(sink, "</ProductName>\n");
 
-        mbus_str_xml_encode(str_encoded, mbus_data_variable_medium_lookup(header->medium), sizeof(str_encoded));
+    mbus_sink_puts(sink, "        <Medium>");
+    mbus_str_xml_encode_sink(sink, mbus_data_variable_medium_lookup_r(header->medium, str_buff, sizeof(str_buff)));
+    mbus_sink_puts(sink, "</Medium>\n");
+
+    mbus_sink_printf(sink, "        <AccessNumber>%d</AccessNumber>\n", header->access_no);
+    mbus_sink_printf(sink, "        <Status>%.2X</Status>\n", header->status);
+    mbus_sink_printf(sink, "        <Signature>%.2X%.2X</Signature>\n", header->signature[1], header->signature[0]);
+
+    mbus_sink_puts(sink, "    </SlaveInformation>\n\n");
+
+    return sink->error ? -1 : 0;
+}
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Medium>%s</Medium>\n", str_encoded);
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <AccessNumber>%d</AccessNumber>\n", header->access_no);
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Status>%.2X</Status>\n", header->status);
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Signature>%.2X%.2X</Signature>\n", header->signature[1], header->signature[0]);
+//------------------------------------------------------------------------------
+/// Generate XML for the variable-length data header
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_header_xml_r(mbus_data_variable_header *header, char *buff, size_t buff_size)
+{
+    mbus_sink sink;
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "    </SlaveInformation>\n\n");
+    if (header)
+    {
+        mbus_sink_init_buffer(&sink, buff, buff_size);
+        mbus_data_variable_header_xml_sink(header, &sink);
 
         return buff;
     }
@@ -3895,85 +4397,107 @@ mbus_data_variable_header_xml(mbus_data_variable_header *header)
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML for a single variable-length data record
+/// Non-reentrant version of mbus_data_variable_header_xml_r() using a static buffer.
 //------------------------------------------------------------------------------
 char *
-mbus_data_variable_record_xml(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options)
+mbus_data_variable_header_xml(mbus_data_variable_header *header)
 {
     static char buff[8192];
-    char str_encoded[768];
-    char str_encoded_value[768];
-    size_t len = 0;
-    struct tm * timeinfo;
+
+    return mbus_data_variable_header_xml_r(header, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Write XML for a single variable-length data record to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_record_xml_sink(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options, mbus_sink *sink)
+{
+    char str_buff[768];
+    struct tm timeinfo;
     char timestamp[21];
     long tariff;
+    mbus_data_value value;
 
-    if (record)
+    if (record == NULL || sink == NULL)
     {
-        mbus_str_xml_encode(str_encoded_value, mbus_data_record_value(record), sizeof(str_encoded_value));
+        return -1;
+    }
 
-        if ((options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !isnumeric(str_encoded_value))
-        {
-          return "";
-        }
+    mbus_data_record_value_decode(record, &value);
 
-        if (frame_cnt >= 0)
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "    <DataRecord id=\"%d\" frame=\"%d\">\n",
-                            record_cnt, frame_cnt);
-        }
-        else
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "    <DataRecord id=\"%d\">\n", record_cnt);
-        }
+    if ((options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !mbus_data_value_is_numeric(&value))
+    {
+        return 0;
+    }
 
-        if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Function>Manufacturer specific</Function>\n");
-        }
-        else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    if (frame_cnt >= 0)
+    {
+        mbus_sink_printf(sink, "    <DataRecord id=\"%d\" frame=\"%d\">\n",
+                         record_cnt, frame_cnt);
+    }
+    else
+    {
+        mbus_sink_printf(sink, "    <DataRecord id=\"%d\">\n", record_cnt);
+    }
+
+    if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
+    {
+        mbus_sink_puts(sink, "        <Function>Manufacturer specific</Function>\n");
+    }
+    else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    {
+        mbus_sink_puts(sink, "        <Function>More records follow</Function>\n");
+    }
+    else
+    {
+        mbus_sink_puts(sink, "        <Function>");
+        mbus_str_xml_encode_sink(sink, mbus_data_record_function(record));
+        mbus_sink_puts(sink, "</Function>\n");
+
+        mbus_sink_printf(sink, "        <StorageNumber>%ld</StorageNumber>\n",
+                         mbus_data_record_storage_number(record));
+
+        if ((tariff = mbus_data_record_tariff(record)) >= 0)
         {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Function>More records follow</Function>\n");
+            mbus_sink_printf(sink, "        <Tariff>%ld</Tariff>\n", tariff);
+            mbus_sink_printf(sink, "        <Device>%d</Device>\n",
+                             mbus_data_record_device(record));
         }
-        else
-        {
-            mbus_str_xml_encode(str_encoded, mbus_data_record_function(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Function>%s</Function>\n", str_encoded);
 
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <StorageNumber>%ld</StorageNumber>\n",
-                            mbus_data_record_storage_number(record));
+        mbus_sink_puts(sink, "        <Unit>");
+        mbus_str_xml_encode_sink(sink, mbus_data_record_unit_r(record, str_buff, sizeof(str_buff)));
+        mbus_sink_puts(sink, "</Unit>\n");
+    }
 
-            if ((tariff = mbus_data_record_tariff(record)) >= 0)
-            {
-                len += snprintf(&buff[len], sizeof(buff) - len, "        <Tariff>%ld</Tariff>\n",
-                                tariff);
-                len += snprintf(&buff[len], sizeof(buff) - len, "        <Device>%d</Device>\n",
-                                mbus_data_record_device(record));
-            }
+    mbus_sink_puts(sink, "        <Value>");
+    mbus_str_xml_encode_sink(sink, mbus_data_value_format_r(&value, str_buff, sizeof(str_buff)));
+    mbus_sink_puts(sink, "</Value>\n");
 
-            mbus_str_xml_encode(str_encoded, mbus_data_record_unit(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Unit>%s</Unit>\n", str_encoded);
-        }
+    if (record->timestamp > 0)
+    {
+        gmtime_r(&(record->timestamp), &timeinfo);
+        strftime(timestamp,20,"%Y-%m-%dT%H:%M:%S",&timeinfo);
+        mbus_sink_printf(sink, "        <Timestamp>%s</Timestamp>\n", timestamp);
+    }
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Value>%s</Value>\n", str_encoded_value);
+    mbus_sink_puts(sink, "    </DataRecord>\n\n");
 
-        if (record->timestamp > 0)
-        {
-            timeinfo = gmtime (&(record->timestamp));
-            strftime(timestamp,20,"%Y-%m-%dT%H:%M:%S",timeinfo);
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Timestamp>%s</Timestamp>\n", timestamp);
-        }
+    return sink->error ? -1 : 1;
+}
+
+//------------------------------------------------------------------------------
+/// Generate XML for a single variable-length data record
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_record_xml_r(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options, char *buff, size_t buff_size)
+{
+    mbus_sink sink;
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "    </DataRecord>\n\n");
+    mbus_sink_init_buffer(&sink, buff, buff_size);
 
+    if (mbus_data_variable_record_xml_sink(record, record_cnt, frame_cnt, header, options, &sink) > 0)
+    {
         return buff;
     }
 
@@ -3981,339 +4505,356 @@ mbus_data_variable_record_xml(mbus_data_record *record, int record_cnt, int fram
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML for variable-length data
+/// Non-reentrant version of mbus_data_variable_record_xml_r() using a static buffer.
 //------------------------------------------------------------------------------
 char *
-mbus_data_variable_xml(mbus_data_variable *data, int options)
+mbus_data_variable_record_xml(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options)
+{
+    static char buff[8192];
+
+    return mbus_data_variable_record_xml_r(record, record_cnt, frame_cnt, header, options, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Write XML for variable-length data to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_xml_sink(mbus_data_variable *data, int options, mbus_sink *sink)
 {
     mbus_data_record *record;
-    char *buff = NULL, *new_buff, *dataRecord;
-    size_t len = 0, buff_size = 8192;
     int i;
 
-    if (data)
+    if (data == NULL || sink == NULL)
     {
-        buff = (char*) malloc(buff_size);
+        return -1;
+    }
 
-        if (buff == NULL)
-            return NULL;
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "<MBusData>\n\n");
 
-        len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    mbus_data_variable_header_xml_sink(&(data->header), sink);
 
-        len += snprintf(&buff[len], buff_size - len, "%s",
-                        mbus_data_variable_header_xml(&(data->header)));
+    for (record = data->record, i = 0; record; record = record->next, i++)
+    {
+        mbus_data_variable_record_xml_sink(record, i, -1, &(data->header), options, sink);
+    }
 
-        for (record = data->record, i = 0; record; record = record->next, i++)
-        {
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
+    mbus_sink_puts(sink, "</MBusData>\n");
 
-                if (new_buff == NULL)
-                {
-                    free(buff);
-                    return NULL;
-                }
+    return sink->error ? -1 : 0;
+}
 
-                buff = new_buff;
-            }
+//------------------------------------------------------------------------------
+/// Generate XML for variable-length data
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_xml(mbus_data_variable *data, int options)
+{
+    mbus_sink sink;
 
-            dataRecord = mbus_data_variable_record_xml(record, i, -1, &(data->header), options);
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-            if (strlen(dataRecord) > 0)
-            {
-                len += snprintf(&buff[len], buff_size - len, "%s", dataRecord);
-            }
+        if (mbus_data_variable_xml_sink(data, options, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
         }
-        len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
 
-        return buff;
+        mbus_sink_free(&sink);
     }
 
     return NULL;
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML representation of fixed-length frame.
+/// Write XML for a counter of a fixed-length frame to a sink.
 //------------------------------------------------------------------------------
-char *
-mbus_data_fixed_xml(mbus_data_fixed *data)
+static void
+mbus_data_fixed_counter_xml_sink(mbus_data_fixed *data, int id, int type, unsigned char *cnt_val, mbus_sink *sink)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
     int val;
 
-    if (data)
+    mbus_sink_printf(sink, "    <DataRecord id=\"%d\">\n", id);
+
+    mbus_sink_puts(sink, "        <Function>");
+    mbus_str_xml_encode_sink(sink, mbus_data_fixed_function(data->status));
+    mbus_sink_puts(sink, "</Function>\n");
+
+    mbus_sink_puts(sink, "        <Unit>");
+    mbus_str_xml_encode_sink(sink, mbus_data_fixed_unit(type));
+    mbus_sink_puts(sink, "</Unit>\n");
+
+    if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
     {
-        buff = (char*) malloc(buff_size);
+        mbus_sink_printf(sink, "        <Value>%lld</Value>\n", mbus_data_bcd_decode(cnt_val, 4));
+    }
+    else
+    {
+        mbus_data_int_decode(cnt_val, 4, &val);
+        mbus_sink_printf(sink, "        <Value>%d</Value>\n", val);
+    }
 
-        if (buff == NULL)
-            return NULL;
+    mbus_sink_puts(sink, "    </DataRecord>\n\n");
+}
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+//------------------------------------------------------------------------------
+/// Write XML representation of fixed-length frame to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_data_fixed_xml_sink(mbus_data_fixed *data, mbus_sink *sink)
+{
+    if (data == NULL || sink == NULL)
+    {
+        return -1;
+    }
 
-        len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
 
-        len += snprintf(&buff[len], buff_size - len, "    <SlaveInformation>\n");
-        len += snprintf(&buff[len], buff_size - len, "        <Id>%lld</Id>\n", mbus_data_bcd_decode(data->id_bcd, 4));
+    mbus_sink_puts(sink, "<MBusData>\n\n");
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_medium(data), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Medium>%s</Medium>\n", str_encoded);
+    mbus_sink_puts(sink, "    <SlaveInformation>\n");
+    mbus_sink_printf(sink, "        <Id>%lld</Id>\n", mbus_data_bcd_decode(data->id_bcd, 4));
 
-        len += snprintf(&buff[len], buff_size - len, "        <AccessNumber>%d</AccessNumber>\n", data->tx_cnt);
-        len += snprintf(&buff[len], buff_size - len, "        <Status>%.2X</Status>\n", data->status);
-        len += snprintf(&buff[len], buff_size - len, "    </SlaveInformation>\n\n");
+    mbus_sink_puts(sink, "        <Medium>");
+    mbus_str_xml_encode_sink(sink, mbus_data_fixed_medium(data));
+    mbus_sink_puts(sink, "</Medium>\n");
 
-        len += snprintf(&buff[len], buff_size - len, "    <DataRecord id=\"0\">\n");
+    mbus_sink_printf(sink, "        <AccessNumber>%d</AccessNumber>\n", data->tx_cnt);
+    mbus_sink_printf(sink, "        <Status>%.2X</Status>\n", data->status);
+    mbus_sink_puts(sink, "    </SlaveInformation>\n\n");
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Function>%s</Function>\n", str_encoded);
+    mbus_data_fixed_counter_xml_sink(data, 0, data->cnt1_type, data->cnt1_val, sink);
+    mbus_data_fixed_counter_xml_sink(data, 1, data->cnt2_type, data->cnt2_val, sink);
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_unit(data->cnt1_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Unit>%s</Unit>\n", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
-        {
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%lld</Value>\n", mbus_data_bcd_decode(data->cnt1_val, 4));
-        }
-        else
-        {
-            mbus_data_int_decode(data->cnt1_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%d</Value>\n", val);
-        }
+    mbus_sink_puts(sink, "</MBusData>\n");
 
-        len += snprintf(&buff[len], buff_size - len, "    </DataRecord>\n\n");
+    return sink->error ? -1 : 0;
+}
 
-        len += snprintf(&buff[len], buff_size - len, "    <DataRecord id=\"1\">\n");
+//------------------------------------------------------------------------------
+/// Generate XML representation of fixed-length frame.
+//------------------------------------------------------------------------------
+char *
+mbus_data_fixed_xml(mbus_data_fixed *data)
+{
+    mbus_sink sink;
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Function>%s</Function>\n", str_encoded);
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_unit(data->cnt2_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Unit>%s</Unit>\n", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
-        {
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%lld</Value>\n", mbus_data_bcd_decode(data->cnt2_val, 4));
-        }
-        else
+        if (mbus_data_fixed_xml_sink(data, &sink) == 0)
         {
-            mbus_data_int_decode(data->cnt2_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%d</Value>\n", val);
+            return mbus_sink_detach(&sink);
         }
 
-        len += snprintf(&buff[len], buff_size - len, "    </DataRecord>\n\n");
-
-        len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
-
-        return buff;
+        mbus_sink_free(&sink);
     }
 
     return NULL;
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML representation of a general application error.
+/// Write XML representation of a general application error to a sink.
 //------------------------------------------------------------------------------
-char *
-mbus_data_error_xml(int error)
+int
+mbus_data_error_xml_sink(int error, mbus_sink *sink)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
+    char str_buff[256];
 
-    buff = (char*) malloc(buff_size);
-
-    if (buff == NULL)
-        return NULL;
+    if (sink == NULL)
+    {
+        return -1;
+    }
 
-    len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
-    len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "<MBusData>\n\n");
 
-    len += snprintf(&buff[len], buff_size - len, "    <SlaveInformation>\n");
+    mbus_sink_puts(sink, "    <SlaveInformation>\n");
 
-    mbus_str_xml_encode(str_encoded, mbus_data_error_lookup(error), sizeof(str_encoded));
-    len += snprintf(&buff[len], buff_size - len, "        <Error>%s</Error>\n", str_encoded);
+    mbus_sink_puts(sink, "        <Error>");
+    mbus_str_xml_encode_sink(sink, mbus_data_error_lookup_r(error, str_buff, sizeof(str_buff)));
+    mbus_sink_puts(sink, "</Error>\n");
 
-    len += snprintf(&buff[len], buff_size - len, "    </SlaveInformation>\n\n");
+    mbus_sink_puts(sink, "    </SlaveInformation>\n\n");
 
-    len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
+    mbus_sink_puts(sink, "</MBusData>\n");
 
-    return buff;
+    return sink->error ? -1 : 0;
 }
 
 //------------------------------------------------------------------------------
-/// Return a string containing an XML representation of the M-BUS frame data.
+/// Generate XML representation of a general application error.
 //------------------------------------------------------------------------------
 char *
-mbus_frame_data_xml(mbus_frame_data *data, int options)
+mbus_data_error_xml(int error)
+{
+    mbus_sink sink;
+
+    mbus_sink_init_buffer(&sink, NULL, 0);
+
+    if (mbus_data_error_xml_sink(error, &sink) == 0)
+    {
+        return mbus_sink_detach(&sink);
+    }
+
+    mbus_sink_free(&sink);
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+/// Write an XML representation of the M-BUS frame data to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_xml_sink(mbus_frame_data *data, int options, mbus_sink *sink)
 {
     if (data)
     {
         if (data->type == MBUS_DATA_TYPE_ERROR)
         {
-            return mbus_data_error_xml(data->error);
+            return mbus_data_error_xml_sink(data->error, sink);
         }
 
         if (data->type == MBUS_DATA_TYPE_FIXED)
         {
-            return mbus_data_fixed_xml(&(data->data_fix));
+            return mbus_data_fixed_xml_sink(&(data->data_fix), sink);
         }
 
         if (data->type == MBUS_DATA_TYPE_VARIABLE)
         {
-            return mbus_data_variable_xml(&(data->data_var), options);
+            return mbus_data_variable_xml_sink(&(data->data_var), options, sink);
         }
     }
 
-    return NULL;
+    return -1;
 }
 
-
 //------------------------------------------------------------------------------
-/// Return an XML representation of the M-BUS frame.
+/// Return a string containing an XML representation of the M-BUS frame data.
 //------------------------------------------------------------------------------
 char *
-mbus_frame_xml(mbus_frame *frame, int options)
+mbus_frame_data_xml(mbus_frame_data *data, int options)
 {
-    mbus_frame_data frame_data;
-    mbus_frame *iter;
+    mbus_sink sink;
 
-    mbus_data_record *record;
-    char *buff = NULL, *new_buff;
-
-    size_t len = 0, buff_size = 8192;
-    int record_cnt = 0, frame_cnt;
-
-    if (frame)
+    if (data)
     {
-        memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
-
-        if (mbus_frame_data_parse(frame, &frame_data) == -1)
-        {
-            mbus_error_str_set("M-bus data parse error.");
-            return NULL;
-        }
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-        if (frame_data.type == MBUS_DATA_TYPE_ERROR)
+        if (mbus_frame_data_xml_sink(data, options, &sink) == 0)
         {
-            //
-            // generate XML for error
-            //
-            return mbus_data_error_xml(frame_data.error);
+            return mbus_sink_detach(&sink);
         }
 
-        if (frame_data.type == MBUS_DATA_TYPE_FIXED)
-        {
-            //
-            // generate XML for fixed data
-            //
-            return mbus_data_fixed_xml(&(frame_data.data_fix));
-        }
+        mbus_sink_free(&sink);
+    }
 
-        if (frame_data.type == MBUS_DATA_TYPE_VARIABLE)
-        {
-            //
-            // generate XML for a sequence of variable data frames
-            //
+    return NULL;
+}
 
-            buff = (char*) malloc(buff_size);
+//------------------------------------------------------------------------------
+/// Write an XML representation of the M-BUS frame (and the frames linked to
+/// it) to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_xml_sink(mbus_frame *frame, int options, mbus_sink *sink)
+{
+    mbus_frame_data frame_data;
+    mbus_record_arena arena;
+    mbus_frame *iter;
 
-            if (buff == NULL)
-            {
-                mbus_data_record_free(frame_data.data_var.record);
-                return NULL;
-            }
+    mbus_data_record *record;
+    int record_cnt = 0, frame_cnt;
 
-            // include frame counter in XML output if more than one frame
-            // is available (frame_cnt = -1 => not included in output)
-            frame_cnt = (frame->next == NULL) ? -1 : 0;
+    if (frame == NULL || sink == NULL)
+    {
+        return -1;
+    }
 
-            len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+    memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+    mbus_record_arena_init(&arena);
 
-            len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    if (mbus_frame_data_parse_arena(frame, &frame_data, &arena) == -1)
+    {
+        mbus_record_arena_free(&arena);
+        mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus data parse error.");
+        return -1;
+    }
 
-            // only print the header info for the first frame (should be
-            // the same for each frame in a sequence of a multi-telegram
-            // transfer.
-            len += snprintf(&buff[len], buff_size - len, "%s",
-                                    mbus_data_variable_header_xml(&(frame_data.data_var.header)));
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        //
+        // generate XML for error or fixed data
+        //
+        mbus_record_arena_free(&arena);
+        return mbus_frame_data_xml_sink(&frame_data, options, sink);
+    }
 
-            // loop through all records in the current frame, using a global
-            // record count as record ID in the XML output
-            for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-            {
-                if ((buff_size - len) < 1024)
-                {
-                    buff_size *= 2;
-                    new_buff = (char*) realloc(buff,buff_size);
+    //
+    // generate XML for a sequence of variable data frames
+    //
 
-                    if (new_buff == NULL)
-                    {
-                        free(buff);
-                        mbus_data_record_free(frame_data.data_var.record);
-                        return NULL;
-                    }
+    // include frame counter in XML output if more than one frame
+    // is available (frame_cnt = -1 => not included in output)
+    frame_cnt = (frame->next == NULL) ? -1 : 0;
 
-                    buff = new_buff;
-                }
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
 
-                len += snprintf(&buff[len], buff_size - len, "%s",
-                                mbus_data_variable_record_xml(record, record_cnt, frame_cnt, &(frame_data.data_var.header), options));
-            }
+    mbus_sink_puts(sink, "<MBusData>\n\n");
 
-            // free all records in the list
-            if (frame_data.data_var.record)
-            {
-                mbus_data_record_free(frame_data.data_var.record);
-            }
+    // only print the header info for the first frame (should be
+    // the same for each frame in a sequence of a multi-telegram
+    // transfer.
+    mbus_data_variable_header_xml_sink(&(frame_data.data_var.header), sink);
 
-            frame_cnt++;
+    for (iter = frame; iter; iter = iter->next, frame_cnt++)
+    {
+        if (iter != frame && mbus_frame_data_parse_arena(iter, &frame_data, &arena) == -1)
+        {
+            mbus_record_arena_free(&arena);
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus variable data parse error.");
+            return -1;
+        }
 
-            for (iter = frame->next; iter; iter = iter->next, frame_cnt++)
-            {
-                if (mbus_frame_data_parse(iter, &frame_data) == -1)
-                {
-                    mbus_error_str_set("M-bus variable data parse error.");
-                    return NULL;
-                }
+        // loop through all records in the current frame, using a global
+        // record count as record ID in the XML output
+        for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
+        {
+            mbus_data_variable_record_xml_sink(record, record_cnt, frame_cnt, &(frame_data.data_var.header), options, sink);
+        }
 
-                // loop through all records in the current frame, using a global
-                // record count as record ID in the XML output
-                for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-                {
-                    if ((buff_size - len) < 1024)
-                    {
-                        buff_size *= 2;
-                        new_buff = (char*) realloc(buff,buff_size);
+        // release all records of the frame
+        mbus_record_arena_reset(&arena);
+    }
 
-                        if (new_buff == NULL)
-                        {
-                            free(buff);
-                            mbus_data_record_free(frame_data.data_var.record);
-                            return NULL;
-                        }
+    mbus_sink_puts(sink, "</MBusData>\n");
 
-                        buff = new_buff;
-                    }
+    mbus_record_arena_free(&arena);
 
-                    len += snprintf(&buff[len], buff_size - len, "%s",
-                                    mbus_data_variable_record_xml(record, record_cnt, frame_cnt, &(frame_data.data_var.header), options));
-                }
+    return sink->error ? -1 : 0;
+}
 
-                // free all records in the list
-                if (frame_data.data_var.record)
-                {
-                    mbus_data_record_free(frame_data.data_var.record);
-                }
-            }
+//------------------------------------------------------------------------------
+/// Return an XML representation of the M-BUS frame.
+//------------------------------------------------------------------------------
+char *
+mbus_frame_xml(mbus_frame *frame, int options)
+{
+    mbus_sink sink;
 
-            len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
+    if (frame)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-            return buff;
+        if (mbus_frame_xml_sink(frame, options, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
         }
+
+        mbus_sink_free(&sink);
     }
 
     return NULL;
@@ -4386,32 +4927,84 @@ mbus_str_json_encode(unsigned char *dst, const unsigned char *src, size_t max_le
 }
 
 //------------------------------------------------------------------------------
-/// Generate JSON for the variable-length data header
+/// JSON (and InfluxDB field value) replacement of a character (control chars
+/// are converted into spaces)
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_header_json(mbus_data_variable_header *header)
+static const char *
+mbus_str_json_escape(unsigned char c)
 {
-    static char buff[8192];
-    char str_encoded[768];
-    size_t len = 0;
+    if (iscntrl(c))
+    {
+        return " ";
+    }
 
-    if (header)
+    switch (c)
+    {
+        case '\\':
+            return "\\\\";
+        case '"':
+            return "\\\"";
+    }
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Encode string to JSON and append it to a sink
+///
+//------------------------------------------------------------------------------
+int
+mbus_str_json_encode_sink(mbus_sink *sink, const char *src)
+{
+    return mbus_str_encode_sink(sink, src, mbus_str_json_escape);
+}
+
+//------------------------------------------------------------------------------
+/// Write JSON for the variable-length data header to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_header_json_sink(mbus_data_variable_header *header, mbus_sink *sink)
+{
+    char str_buff[768];
+
+    if (header == NULL || sink == NULL)
     {
-        len += snprintf(&buff[len], sizeof(buff) - len, "\"SlaveInformation_Id\": %lld", mbus_data_bcd_decode(header->id_bcd, 4));
-        len += snprintf(&buff[len], sizeof(buff) - len, ", \"SlaveInformation_Manufacturer\": \"%s\"",
-                mbus_decode_manufacturer(header->manufacturer[0], header->manufacturer[1]));
-        len += snprintf(&buff[len], sizeof(buff) - len, ", \"SlaveInformation_Version\": %d", header->version);
+        return -1;
+    }
+
+    mbus_sink_printf(sink, "\"SlaveInformation_Id\": %lld", mbus_data_bcd_decode(header->id_bcd, 4));
+    mbus_sink_printf(sink, ", \"SlaveInformation_Manufacturer\": \"%s\"",
+            mbus_decode_manufacturer_r(header->manufacturer[0], header->manufacturer[1], str_buff, sizeof(str_buff)));
+    mbus_sink_printf(sink, ", \"SlaveInformation_Version\": %d", header->version);
+
+    mbus_sink_puts(sink, ", \"SlaveInformation_ProductName\": \"");
+    mbus_str_json_encode_sink(sink, mbus_data_product_name(header));
+    mbus_sink_puts(sink, "\"");
 
-        mbus_str_json_encode(str_encoded, mbus_data_product_name(header), sizeof(str_encoded));
+    mbus_sink_puts(sink, ", \"SlaveInformation_Medium\": \"");
+    mbus_str_json_encode_sink(sink, mbus_data_variable_medium_lookup_r(header->medium, str_buff, sizeof(str_buff)));
+    mbus_sink_puts(sink, "\"");
 
-        len += snprintf(&buff[len], sizeof(buff) - len, ", \"SlaveInformation_ProductName\": \"%s\"", str_encoded);
+    mbus_sink_printf(sink, ", \"SlaveInformation_AccessNumber\": %d", header->access_no);
+    mbus_sink_printf(sink, ", \"SlaveInformation_Status\": \"%.2X\"", header->status);
+    mbus_sink_printf(sink, ", \"SlaveInformation_Signature\": \"%.2X%.2X\"", header->signature[1], header->signature[0]);
+
+    return sink->error ? -1 : 0;
+}
 
-        mbus_str_json_encode(str_encoded, mbus_data_variable_medium_lookup(header->medium), sizeof(str_encoded));
+//------------------------------------------------------------------------------
+/// Generate JSON for the variable-length data header
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_header_json_r(mbus_data_variable_header *header, char *buff, size_t buff_size)
+{
+    mbus_sink sink;
 
-        len += snprintf(&buff[len], sizeof(buff) - len, ", \"SlaveInformation_Medium\": \"%s\"", str_encoded);
-        len += snprintf(&buff[len], sizeof(buff) - len, ", \"SlaveInformation_AccessNumber\": %d", header->access_no);
-        len += snprintf(&buff[len], sizeof(buff) - len, ", \"SlaveInformation_Status\": \"%.2X\"", header->status);
-        len += snprintf(&buff[len], sizeof(buff) - len, ", \"SlaveInformation_Signature\": \"%.2X%.2X\"", header->signature[1], header->signature[0]);
+    if (header)
+    {
+        mbus_sink_init_buffer(&sink, buff, buff_size);
+        mbus_data_variable_header_json_sink(header, &sink);
 
         return buff;
     }
@@ -4420,92 +5013,133 @@ mbus_data_variable_header_json(mbus_data_variable_header *header)
 }
 
 //------------------------------------------------------------------------------
-/// Generate JSON for a single variable-length data record
+/// Non-reentrant version of mbus_data_variable_header_json_r() using a static buffer.
 //------------------------------------------------------------------------------
 char *
-mbus_data_variable_record_json(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options)
+mbus_data_variable_header_json(mbus_data_variable_header *header)
 {
     static char buff[8192];
-    char str_encoded[768];
-    char str_encoded_value[768];
-    size_t len = 0;
-    struct tm * timeinfo;
+
+    return mbus_data_variable_header_json_r(header, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Write JSON for a single variable-length data record to a sink, preceded by
+/// separator (if not NULL) when the record is not skipped.
+//------------------------------------------------------------------------------
+static int
+mbus_data_variable_record_json_write(mbus_data_record *record, int record_cnt, int frame_cnt, int options, const char *separator, mbus_sink *sink)
+{
+    char str_buff[768];
+    struct tm timeinfo;
     char timestamp[21];
     long tariff;
+    mbus_data_value value;
+    int numeric;
 
-    if (record)
+    if (record == NULL || sink == NULL)
     {
-        mbus_str_json_encode(str_encoded_value, mbus_data_record_value(record), sizeof(str_encoded_value));
+        return -1;
+    }
 
-        if ((options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !isnumeric(str_encoded_value))
-        {
-          return "";
-        }
+    mbus_data_record_value_decode(record, &value);
+    numeric = mbus_data_value_is_numeric(&value);
 
-        if (frame_cnt >= 0)
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "{\"id\": %d, \"frame\": %d",
-                            record_cnt, frame_cnt);
-        }
-        else
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "{\"id\": %d", record_cnt);
-        }
+    if ((options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !numeric)
+    {
+        return 0;
+    }
 
-        if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ", \"Function\": \"Manufacturer specific\"");
-        }
-        else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ", \"Function\": \"More records follow\"");
-        }
-        else
-        {
-            mbus_str_json_encode(str_encoded, mbus_data_record_function(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ", \"Function\": \"%s\"", str_encoded);
+    if (separator)
+    {
+        mbus_sink_puts(sink, separator);
+    }
 
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ", \"StorageNumber\": %ld",
-                            mbus_data_record_storage_number(record));
+    if (frame_cnt >= 0)
+    {
+        mbus_sink_printf(sink, "{\"id\": %d, \"frame\": %d",
+                         record_cnt, frame_cnt);
+    }
+    else
+    {
+        mbus_sink_printf(sink, "{\"id\": %d", record_cnt);
+    }
 
-            if ((tariff = mbus_data_record_tariff(record)) >= 0)
-            {
-                len += snprintf(&buff[len], sizeof(buff) - len, ", \"Tariff\": %ld",
-                                tariff);
-                len += snprintf(&buff[len], sizeof(buff) - len, ", \"Device\": %d",
-                                mbus_data_record_device(record));
-            }
+    if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
+    {
+        mbus_sink_puts(sink, ", \"Function\": \"Manufacturer specific\"");
+    }
+    else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    {
+        mbus_sink_puts(sink, ", \"Function\": \"More records follow\"");
+    }
+    else
+    {
+        mbus_sink_puts(sink, ", \"Function\": \"");
+        mbus_str_json_encode_sink(sink, mbus_data_record_function(record));
+        mbus_sink_puts(sink, "\"");
 
-            mbus_str_json_encode(str_encoded, mbus_data_record_unit(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ", \"Unit\": \"%s\"", str_encoded);
-        }
+        mbus_sink_printf(sink, ", \"StorageNumber\": %ld",
+                         mbus_data_record_storage_number(record));
 
-        if (isnumeric(str_encoded_value))
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len, ", \"Value\": %s", str_encoded_value);
-        }
-        else
+        if ((tariff = mbus_data_record_tariff(record)) >= 0)
         {
-            len += snprintf(&buff[len], sizeof(buff) - len, ", \"Value\": \"%s\"", str_encoded_value);
+            mbus_sink_printf(sink, ", \"Tariff\": %ld", tariff);
+            mbus_sink_printf(sink, ", \"Device\": %d",
+                             mbus_data_record_device(record));
         }
 
-        if (record->timestamp > 0)
-        {
-            timeinfo = gmtime (&(record->timestamp));
-            strftime(timestamp,20,"%Y-%m-%dT%H:%M:%S",timeinfo);
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ", \"Timestamp\": \"%s\"", timestamp);
-        }
+        mbus_sink_puts(sink, ", \"Unit\": \"");
+        mbus_str_json_encode_sink(sink, mbus_data_record_unit_r(record, str_buff, sizeof(str_buff)));
+        mbus_sink_puts(sink, "\"");
+    }
+
+    mbus_data_value_format_r(&value, str_buff, sizeof(str_buff));
+
+    if (numeric)
+    {
+        mbus_sink_printf(sink, ", \"Value\": %s", str_buff);
+    }
+    else
+    {
+        mbus_sink_puts(sink, ", \"Value\": \"");
+        mbus_str_json_encode_sink(sink, str_buff);
+        mbus_sink_puts(sink, "\"");
+    }
+
+    if (record->timestamp > 0)
+    {
+        gmtime_r(&(record->timestamp), &timeinfo);
+        strftime(timestamp,20,"%Y-%m-%dT%H:%M:%S",&timeinfo);
+        mbus_sink_printf(sink, ", \"Timestamp\": \"%s\"", timestamp);
+    }
+
+    mbus_sink_puts(sink, "}");
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "}");
+    return sink->error ? -1 : 1;
+}
+
+//------------------------------------------------------------------------------
+/// Write JSON for a single variable-length data record to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_record_json_sink(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options, mbus_sink *sink)
+{
+    return mbus_data_variable_record_json_write(record, record_cnt, frame_cnt, options, NULL, sink);
+}
+
+//------------------------------------------------------------------------------
+/// Generate JSON for a single variable-length data record
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_record_json_r(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options, char *buff, size_t buff_size)
+{
+    mbus_sink sink;
 
+    mbus_sink_init_buffer(&sink, buff, buff_size);
+
+    if (mbus_data_variable_record_json_sink(record, record_cnt, frame_cnt, header, options, &sink) > 0)
+    {
         return buff;
     }
 
@@ -4513,149 +5147,189 @@ mbus_data_variable_record_json(mbus_data_record *record, int record_cnt, int fra
 }
 
 //------------------------------------------------------------------------------
-/// Generate JSON for variable-length data
+/// Non-reentrant version of mbus_data_variable_record_json_r() using a static buffer.
 //------------------------------------------------------------------------------
 char *
-mbus_data_variable_json(mbus_data_variable *data, int options)
+mbus_data_variable_record_json(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options)
+{
+    static char buff[8192];
+
+    return mbus_data_variable_record_json_r(record, record_cnt, frame_cnt, header, options, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Write JSON for variable-length data to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_json_sink(mbus_data_variable *data, int options, mbus_sink *sink)
 {
     mbus_data_record *record;
-    char *buff = NULL, *new_buff, *dataRecord;
-    size_t len = 0, buff_size = 8192;
     int i, dataRecordCount;
 
-    if (data)
+    if (data == NULL || sink == NULL)
     {
-        buff = (char*) malloc(buff_size);
-
-        if (buff == NULL)
-            return NULL;
+        return -1;
+    }
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_JSON_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, MBUS_JSON_PROCESSING_INSTRUCTION);
 
-        len += snprintf(&buff[len], buff_size - len, "{");
+    mbus_sink_puts(sink, "{");
 
-        len += snprintf(&buff[len], buff_size - len, "%s",
-                        mbus_data_variable_header_json(&(data->header)));
+    mbus_data_variable_header_json_sink(&(data->header), sink);
 
-        len += snprintf(&buff[len], buff_size - len, ", \"DataRecord\": [");
+    mbus_sink_puts(sink, ", \"DataRecord\": [");
 
-        for (record = data->record, i = 0, dataRecordCount = 0; record; record = record->next, i++)
+    for (record = data->record, i = 0, dataRecordCount = 0; record; record = record->next, i++)
+    {
+        if (mbus_data_variable_record_json_write(record, i, -1, options, (dataRecordCount > 0) ? ", " : NULL, sink) > 0)
         {
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
+            dataRecordCount++;
+        }
+    }
 
-                if (new_buff == NULL)
-                {
-                    free(buff);
-                    return NULL;
-                }
+    mbus_sink_puts(sink, "]}\n");
 
-                buff = new_buff;
-            }
+    return sink->error ? -1 : 0;
+}
 
-            dataRecord = mbus_data_variable_record_json(record, i, -1, &(data->header), options);
+//------------------------------------------------------------------------------
+/// Generate JSON for variable-length data
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_json(mbus_data_variable *data, int options)
+{
+    mbus_sink sink;
 
-            if (strlen(dataRecord) > 0)
-            {
-                dataRecordCount++;
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-                if (dataRecordCount > 1)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ", %s", dataRecord);
-                }
-                else
-                {
-                    len += snprintf(&buff[len], buff_size - len, "%s", dataRecord);
-                }
-            }
+        if (mbus_data_variable_json_sink(data, options, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
         }
 
-        len += snprintf(&buff[len], buff_size - len, "]}\n");
-
-        return buff;
+        mbus_sink_free(&sink);
     }
 
     return NULL;
 }
 
-
 //------------------------------------------------------------------------------
-/// Generate JSON representation of fixed-length frame.
+/// Write JSON for a counter of a fixed-length frame to a sink.
 //------------------------------------------------------------------------------
-char *
-mbus_data_fixed_json(mbus_data_fixed *data)
+static void
+mbus_data_fixed_counter_json_sink(mbus_data_fixed *data, int id, int type, unsigned char *cnt_val, mbus_sink *sink)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
     int val;
 
-    if (data)
+    mbus_sink_printf(sink, "{\"id\": %d", id);
+
+    mbus_sink_puts(sink, ", \"Function\": \"");
+    mbus_str_json_encode_sink(sink, mbus_data_fixed_function(data->status));
+    mbus_sink_puts(sink, "\"");
+
+    mbus_sink_puts(sink, ", \"Unit\": \"");
+    mbus_str_json_encode_sink(sink, mbus_data_fixed_unit(type));
+    mbus_sink_puts(sink, "\"");
+
+    if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+    {
+        mbus_sink_printf(sink, ", \"Value\": %lld", mbus_data_bcd_decode(cnt_val, 4));
+    }
+    else
     {
-        buff = (char*) malloc(buff_size);
+        mbus_data_int_decode(cnt_val, 4, &val);
+        mbus_sink_printf(sink, ", \"Value\": %d", val);
+    }
 
-        if (buff == NULL)
-            return NULL;
+    mbus_sink_puts(sink, "}");
+}
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_JSON_PROCESSING_INSTRUCTION);
+//------------------------------------------------------------------------------
+/// Write JSON representation of fixed-length frame to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_data_fixed_json_sink(mbus_data_fixed *data, mbus_sink *sink)
+{
+    if (data == NULL || sink == NULL)
+    {
+        return -1;
+    }
 
-        len += snprintf(&buff[len], buff_size - len, "{");
+    mbus_sink_puts(sink, MBUS_JSON_PROCESSING_INSTRUCTION);
 
-        len += snprintf(&buff[len], buff_size - len, "\"SlaveInformation_Id\": %lld", mbus_data_bcd_decode(data->id_bcd, 4));
+    mbus_sink_puts(sink, "{");
 
-        mbus_str_json_encode(str_encoded, mbus_data_fixed_medium(data), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ", \"SlaveInformation_Medium\": \"%s\"", str_encoded);
+    mbus_sink_printf(sink, "\"SlaveInformation_Id\": %lld", mbus_data_bcd_decode(data->id_bcd, 4));
 
-        len += snprintf(&buff[len], buff_size - len, ", \"SlaveInformation_AccessNumber\": %d", data->tx_cnt);
-        len += snprintf(&buff[len], buff_size - len, ", \"SlaveInformation_Status\": \"%.2X\"", data->status);
-        len += snprintf(&buff[len], buff_size - len, "}, ");
+    mbus_sink_puts(sink, ", \"SlaveInformation_Medium\": \"");
+    mbus_str_json_encode_sink(sink, mbus_data_fixed_medium(data));
+    mbus_sink_puts(sink, "\"");
 
-        len += snprintf(&buff[len], buff_size - len, "\"DataRecord\": [{\"id\": 0");
+    mbus_sink_printf(sink, ", \"SlaveInformation_AccessNumber\": %d", data->tx_cnt);
+    mbus_sink_printf(sink, ", \"SlaveInformation_Status\": \"%.2X\"", data->status);
+    mbus_sink_puts(sink, "}, ");
 
-        mbus_str_json_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ", \"Function\": \"%s\"", str_encoded);
+    mbus_sink_puts(sink, "\"DataRecord\": [");
 
-        mbus_str_json_encode(str_encoded, mbus_data_fixed_unit(data->cnt1_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ", \"Unit\": \"%s\"", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
-        {
-            len += snprintf(&buff[len], buff_size - len, ", \"Value\": %lld", mbus_data_bcd_decode(data->cnt1_val, 4));
-        }
-        else
-        {
-            mbus_data_int_decode(data->cnt1_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, ", \"Value\": %d", val);
-        }
+    mbus_data_fixed_counter_json_sink(data, 0, data->cnt1_type, data->cnt1_val, sink);
+    mbus_sink_puts(sink, ", ");
+    mbus_data_fixed_counter_json_sink(data, 1, data->cnt2_type, data->cnt2_val, sink);
 
-        len += snprintf(&buff[len], buff_size - len, "}, ");
+    mbus_sink_puts(sink, "]");
 
-        len += snprintf(&buff[len], buff_size - len, "{\"id\": 1");
+    mbus_sink_puts(sink, "}\n");
 
-        mbus_str_json_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ", \"Function\": \"%s\"", str_encoded);
+    return sink->error ? -1 : 0;
+}
 
-        mbus_str_json_encode(str_encoded, mbus_data_fixed_unit(data->cnt2_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ", \"Unit\": \"%s\"", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
-        {
-            len += snprintf(&buff[len], buff_size - len, ", \"Value\": %lld", mbus_data_bcd_decode(data->cnt2_val, 4));
-        }
-        else
+//------------------------------------------------------------------------------
+/// Generate JSON representation of fixed-length frame.
+//------------------------------------------------------------------------------
+char *
+mbus_data_fixed_json(mbus_data_fixed *data)
+{
+    mbus_sink sink;
+
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
+
+        if (mbus_data_fixed_json_sink(data, &sink) == 0)
         {
-            mbus_data_int_decode(data->cnt2_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, ", \"Value\": %d", val);
+            return mbus_sink_detach(&sink);
         }
 
-        len += snprintf(&buff[len], buff_size - len, "}]");
+        mbus_sink_free(&sink);
+    }
 
-        len += snprintf(&buff[len], buff_size - len, "}\n");
+    return NULL;
+}
 
-        return buff;
+//------------------------------------------------------------------------------
+/// Write JSON representation of a general application error to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_data_error_json_sink(int error, mbus_sink *sink)
+{
+    char str_buff[256];
+
+    if (sink == NULL)
+    {
+        return -1;
     }
 
-    return NULL;
+    mbus_sink_puts(sink, MBUS_JSON_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "{");
+
+    mbus_sink_puts(sink, "\"SlaveInformation_Error\": \"");
+    mbus_str_json_encode_sink(sink, mbus_data_error_lookup_r(error, str_buff, sizeof(str_buff)));
+    mbus_sink_puts(sink, "\"");
+
+    mbus_sink_puts(sink, "}\n");
+
+    return sink->error ? -1 : 0;
 }
 
 //------------------------------------------------------------------------------
@@ -4664,24 +5338,45 @@ mbus_data_fixed_json(mbus_data_fixed *data)
 char *
 mbus_data_error_json(int error)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
+    mbus_sink sink;
 
-    buff = (char*) malloc(buff_size);
+    mbus_sink_init_buffer(&sink, NULL, 0);
 
-    if (buff == NULL)
-        return NULL;
+    if (mbus_data_error_json_sink(error, &sink) == 0)
+    {
+        return mbus_sink_detach(&sink);
+    }
+
+    mbus_sink_free(&sink);
 
-    len += snprintf(&buff[len], buff_size - len, MBUS_JSON_PROCESSING_INSTRUCTION);
-    len += snprintf(&buff[len], buff_size - len, "{");
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+/// Write a JSON representation of the M-BUS frame data to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_json_sink(mbus_frame_data *data, int options, mbus_sink *sink)
+{
+    if (data)
+    {
+        if (data->type == MBUS_DATA_TYPE_ERROR)
+        {
+            return mbus_data_error_json_sink(data->error, sink);
+        }
 
-    mbus_str_json_encode(str_encoded, mbus_data_error_lookup(error), sizeof(str_encoded));
-    len += snprintf(&buff[len], buff_size - len, "\"SlaveInformation_Error\": \"%s\"", str_encoded);
+        if (data->type == MBUS_DATA_TYPE_FIXED)
+        {
+            return mbus_data_fixed_json_sink(&(data->data_fix), sink);
+        }
 
-    len += snprintf(&buff[len], buff_size - len, "}\n");
+        if (data->type == MBUS_DATA_TYPE_VARIABLE)
+        {
+            return mbus_data_variable_json_sink(&(data->data_var), options, sink);
+        }
+    }
 
-    return buff;
+    return -1;
 }
 
 //------------------------------------------------------------------------------
@@ -4690,186 +5385,134 @@ mbus_data_error_json(int error)
 char *
 mbus_frame_data_json(mbus_frame_data *data, int options)
 {
+    mbus_sink sink;
+
     if (data)
     {
-        if (data->type == MBUS_DATA_TYPE_ERROR)
-        {
-            return mbus_data_error_json(data->error);
-        }
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-        if (data->type == MBUS_DATA_TYPE_FIXED)
+        if (mbus_frame_data_json_sink(data, options, &sink) == 0)
         {
-            return mbus_data_fixed_json(&(data->data_fix));
+            return mbus_sink_detach(&sink);
         }
 
-        if (data->type == MBUS_DATA_TYPE_VARIABLE)
-        {
-            return mbus_data_variable_json(&(data->data_var), options);
-        }
+        mbus_sink_free(&sink);
     }
 
     return NULL;
 }
 
 //------------------------------------------------------------------------------
-/// Return an JSON representation of the M-BUS frame.
+/// Write a JSON representation of the M-BUS frame (and the frames linked to
+/// it) to a sink.
 //------------------------------------------------------------------------------
-char *
-mbus_frame_json(mbus_frame *frame, int options)
+int
+mbus_frame_json_sink(mbus_frame *frame, int options, mbus_sink *sink)
 {
     mbus_frame_data frame_data;
+    mbus_record_arena arena;
     mbus_frame *iter;
 
     mbus_data_record *record;
-    char *buff = NULL, *new_buff;
-
-    size_t len = 0, buff_size = 8192;
-    int record_cnt = 0, frame_cnt;
+    int record_cnt = 0, frame_cnt, dataRecordCount = 0;
 
-    if (frame)
+    if (frame == NULL || sink == NULL)
     {
-        memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
-
-        if (mbus_frame_data_parse(frame, &frame_data) == -1)
-        {
-            mbus_error_str_set("M-bus data parse error.");
-            return NULL;
-        }
-
-        if (frame_data.type == MBUS_DATA_TYPE_ERROR)
-        {
-            //
-            // generate JSON for error
-            //
-            return mbus_data_error_json(frame_data.error);
-        }
-
-        if (frame_data.type == MBUS_DATA_TYPE_FIXED)
-        {
-            //
-            // generate JSON for fixed data
-            //
-            return mbus_data_fixed_json(&(frame_data.data_fix));
-        }
-
-        if (frame_data.type == MBUS_DATA_TYPE_VARIABLE)
-        {
-            //
-            // generate JSON for a sequence of variable data frames
-            //
-
-            buff = (char*) malloc(buff_size);
-
-            if (buff == NULL)
-            {
-                mbus_data_record_free(frame_data.data_var.record);
-                return NULL;
-            }
+        return -1;
+    }
 
-            // include frame counter in JSON output if more than one frame
-            // is available (frame_cnt = -1 => not included in output)
-            frame_cnt = (frame->next == NULL) ? -1 : 0;
+    memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+    mbus_record_arena_init(&arena);
 
-            len += snprintf(&buff[len], buff_size - len, MBUS_JSON_PROCESSING_INSTRUCTION);
+    if (mbus_frame_data_parse_arena(frame, &frame_data, &arena) == -1)
+    {
+        mbus_record_arena_free(&arena);
+        mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus data parse error.");
+        return -1;
+    }
 
-            len += snprintf(&buff[len], buff_size - len, "{");
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        //
+        // generate JSON for error or fixed data
+        //
+        mbus_record_arena_free(&arena);
+        return mbus_frame_data_json_sink(&frame_data, options, sink);
+    }
 
-            // only print the header info for the first frame (should be
-            // the same for each frame in a sequence of a multi-telegram
-            // transfer.
-            len += snprintf(&buff[len], buff_size - len, "%s",
-                                    mbus_data_variable_header_json(&(frame_data.data_var.header)));
+    //
+    // generate JSON for a sequence of variable data frames
+    //
 
-            len += snprintf(&buff[len], buff_size - len, ", \"DataRecord\": [");
+    // include frame counter in JSON output if more than one frame
+    // is available (frame_cnt = -1 => not included in output)
+    frame_cnt = (frame->next == NULL) ? -1 : 0;
 
-            // loop through all records in the current frame, using a global
-            // record count as record ID in the JSON output
-            for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-            {
-                if ((buff_size - len) < 1024)
-                {
-                    buff_size *= 2;
-                    new_buff = (char*) realloc(buff,buff_size);
+    mbus_sink_puts(sink, MBUS_JSON_PROCESSING_INSTRUCTION);
 
-                    if (new_buff == NULL)
-                    {
-                        free(buff);
-                        mbus_data_record_free(frame_data.data_var.record);
-                        return NULL;
-                    }
+    mbus_sink_puts(sink, "{");
 
-                    buff = new_buff;
-                }
+    // only print the header info for the first frame (should be
+    // the same for each frame in a sequence of a multi-telegram
+    // transfer.
+    mbus_data_variable_header_json_sink(&(frame_data.data_var.header), sink);
 
-                if (record_cnt > 0)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ", ");
-                }
+    mbus_sink_puts(sink, ", \"DataRecord\": [");
 
-                len += snprintf(&buff[len], buff_size - len, "%s",
-                                mbus_data_variable_record_json(record, record_cnt, frame_cnt, &(frame_data.data_var.header), options));
-            }
+    for (iter = frame; iter; iter = iter->next, frame_cnt++)
+    {
+        if (iter != frame && mbus_frame_data_parse_arena(iter, &frame_data, &arena) == -1)
+        {
+            mbus_record_arena_free(&arena);
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus variable data parse error.");
+            return -1;
+        }
 
-            // free all records in the list
-            if (frame_data.data_var.record)
+        // loop through all records in the current frame, using a global
+        // record count as record ID in the JSON output
+        for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
+        {
+            if (mbus_data_variable_record_json_write(record, record_cnt, frame_cnt, options, (dataRecordCount > 0) ? ", " : NULL, sink) > 0)
             {
-                mbus_data_record_free(frame_data.data_var.record);
+                dataRecordCount++;
             }
+        }
 
-            frame_cnt++;
-
-            for (iter = frame->next; iter; iter = iter->next, frame_cnt++)
-            {
-                if (mbus_frame_data_parse(iter, &frame_data) == -1)
-                {
-                    mbus_error_str_set("M-bus variable data parse error.");
-                    return NULL;
-                }
-
-                // loop through all records in the current frame, using a global
-                // record count as record ID in the JSON output
-                for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-                {
-                    if ((buff_size - len) < 1024)
-                    {
-                        buff_size *= 2;
-                        new_buff = (char*) realloc(buff,buff_size);
-
-                        if (new_buff == NULL)
-                        {
-                            free(buff);
-                            mbus_data_record_free(frame_data.data_var.record);
-                            return NULL;
-                        }
+        // release all records of the frame
+        mbus_record_arena_reset(&arena);
+    }
 
-                        buff = new_buff;
-                    }
+    mbus_sink_puts(sink, "]}\n");
 
-                    if (record_cnt > 0)
-                    {
-                        len += snprintf(&buff[len], buff_size - len, ", ");
-                    }
+    mbus_record_arena_free(&arena);
 
-                    len += snprintf(&buff[len], buff_size - len, "%s",
-                                    mbus_data_variable_record_json(record, record_cnt, frame_cnt, &(frame_data.data_var.header), options));
-                }
+    return sink->error ? -1 : 0;
+}
 
-                // free all records in the list
-                if (frame_data.data_var.record)
-                {
-                    mbus_data_record_free(frame_data.data_var.record);
-                }
-            }
+//------------------------------------------------------------------------------
+/// Return an JSON representation of the M-BUS frame.
+//------------------------------------------------------------------------------
+char *
+mbus_frame_json(mbus_frame *frame, int options)
+{
+    mbus_sink sink;
 
-            len += snprintf(&buff[len], buff_size - len, "]}\n");
+    if (frame)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-            return buff;
+        if (mbus_frame_json_sink(frame, options, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
         }
+
+        mbus_sink_free(&sink);
     }
 
     return NULL;
 }
 
+
 //------------------------------------------------------------------------------
 //
 // INFLUXDB RELATED FUNCTIONS
@@ -4964,7 +5607,7 @@ mbus_str_influxdb_encode_header(unsigned char *dst, const unsigned char *src, si
         if (iscntrl(src[i]))
         {
             // convert all control chars into spaces
-            dst[len++] = snprintf(&dst[len], max_len - len, "\\ ");
+            len += snprintf(&dst[len], max_len - len, "\\ ");
         }
         else
         {
@@ -4976,6 +5619,9 @@ mbus_str_influxdb_encode_header(unsigned char *dst, const unsigned char *src, si
                 case ' ':
                     len += snprintf(&dst[len], max_len - len, "\\ ");
                     break;
+                case ',':
+                    len += snprintf(&dst[len], max_len - len, "\\,");
+                    break;
                 case '=':
                     len += snprintf(&dst[len], max_len - len, "\\=");
                     break;
@@ -4992,41 +5638,244 @@ mbus_str_influxdb_encode_header(unsigned char *dst, const unsigned char *src, si
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// InfluxDB tag value replacement of a character
+//------------------------------------------------------------------------------
+static const char *
+mbus_str_influxdb_header_escape(unsigned char c)
+{
+    if (iscntrl(c))
+    {
+        // convert all control chars into spaces
+        return "\\ ";
+    }
+
+    switch (c)
+    {
+        case '\\':
+            return "\\\\";
+        case ' ':
+            return "\\ ";
+        case ',':
+            return "\\,";
+        case '=':
+            return "\\=";
+    }
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Encode string to an InfluxDB Line Protocol field value and append it to a
+/// sink
+///
+//------------------------------------------------------------------------------
+int
+mbus_str_influxdb_encode_sink(mbus_sink *sink, const char *src)
+{
+    return mbus_str_encode_sink(sink, src, mbus_str_json_escape);
+}
+
+//------------------------------------------------------------------------------
+///
+/// Encode string to an InfluxDB Line Protocol tag value and append it to a
+/// sink
+///
+//------------------------------------------------------------------------------
+int
+mbus_str_influxdb_encode_header_sink(mbus_sink *sink, const char *src)
+{
+    return mbus_str_encode_sink(sink, src, mbus_str_influxdb_header_escape);
+}
+//------------------------------------------------------------------------------
+/// Write InfluxDB Line Protocol for the variable-length data header to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_header_influxdb_sink(mbus_data_variable_header *header, mbus_sink *sink)
+{
+    char str_buff[768];
+    const char *str;
+
+    if (header == NULL || sink == NULL)
+    {
+        return -1;
+    }
+
+    mbus_sink_printf(sink, "SlaveInformation_Id=%lld", mbus_data_bcd_decode(header->id_bcd, 4));
+    mbus_sink_printf(sink, ",SlaveInformation_Manufacturer=%s",
+            mbus_decode_manufacturer_r(header->manufacturer[0], header->manufacturer[1], str_buff, sizeof(str_buff)));
+    mbus_sink_printf(sink, ",SlaveInformation_Version=%d", header->version);
+
+    str = mbus_data_product_name(header);
+
+    if (str && str[0] != '\0')
+    {
+        mbus_sink_puts(sink, ",SlaveInformation_ProductName=");
+        mbus_str_influxdb_encode_header_sink(sink, str);
+    }
+
+    str = mbus_data_variable_medium_lookup_r(header->medium, str_buff, sizeof(str_buff));
+
+    if (str && str[0] != '\0')
+    {
+        mbus_sink_puts(sink, ",SlaveInformation_Medium=");
+        mbus_str_influxdb_encode_header_sink(sink, str);
+    }
+
+    mbus_sink_printf(sink, ",SlaveInformation_AccessNumber=%d", header->access_no);
+    mbus_sink_printf(sink, ",SlaveInformation_Status=%.2X", header->status);
+    mbus_sink_printf(sink, ",SlaveInformation_Signature=%.2X%.2X", header->signature[1], header->signature[0]);
+
+    return sink->error ? -1 : 0;
+}
+
 //------------------------------------------------------------------------------
 /// Generate InfluxDb Line Protocol for the variable-length data header
 //------------------------------------------------------------------------------
 char *
+mbus_data_variable_header_influxdb_r(mbus_data_variable_header *header, char *buff, size_t buff_size)
+{
+    mbus_sink sink;
+
+    if (header)
+    {
+        mbus_sink_init_buffer(&sink, buff, buff_size);
+        mbus_data_variable_header_influxdb_sink(header, &sink);
+
+        return buff;
+    }
+
+    return "";
+}
+
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_data_variable_header_influxdb_r() using a static buffer.
+//------------------------------------------------------------------------------
+char *
 mbus_data_variable_header_influxdb(mbus_data_variable_header *header)
 {
     static char buff[8192];
-    char str_encoded[768];
-    size_t len = 0;
 
-    if (header)
+    return mbus_data_variable_header_influxdb_r(header, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Write InfluxDB Line Protocol for a single variable-length data record to a
+/// sink, preceded by separator (if not NULL) when the record is not skipped.
+//------------------------------------------------------------------------------
+static int
+mbus_data_variable_record_influxdb_write(mbus_data_record *record, int record_cnt, int frame_cnt, int options, const char *separator, mbus_sink *sink)
+{
+    char str_buff[768];
+    struct tm timeinfo;
+    char timestamp[21];
+    long tariff;
+    char prefix[sizeof("DataRecord_%d_%d") + 2 * 9];   // room for any two ints
+    mbus_data_value value;
+    int numeric;
+
+    if (record == NULL || sink == NULL)
     {
-        len += snprintf(&buff[len], sizeof(buff) - len, "SlaveInformation_Id=%lld", mbus_data_bcd_decode(header->id_bcd, 4));
-        len += snprintf(&buff[len], sizeof(buff) - len, ",SlaveInformation_Manufacturer=%s",
-                mbus_decode_manufacturer(header->manufacturer[0], header->manufacturer[1]));
-        len += snprintf(&buff[len], sizeof(buff) - len, ",SlaveInformation_Version=%d", header->version);
+        return -1;
+    }
 
-        mbus_str_influxdb_encode_header(str_encoded, mbus_data_product_name(header), sizeof(str_encoded));
+    mbus_data_record_value_decode(record, &value);
+    numeric = mbus_data_value_is_numeric(&value);
 
-        if (strlen(str_encoded) > 0)
-        {
-           len += snprintf(&buff[len], sizeof(buff) - len, ",SlaveInformation_ProductName=%s", str_encoded);
-        }
+    if ((options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !numeric)
+    {
+        return 0;
+    }
+
+    if (separator)
+    {
+        mbus_sink_puts(sink, separator);
+    }
+
+    if (frame_cnt >= 0)
+    {
+        snprintf(prefix, sizeof(prefix), "DataRecord_%d_%d", record_cnt, frame_cnt);
+    }
+    else
+    {
+        snprintf(prefix, sizeof(prefix), "DataRecord_%d", record_cnt);
+    }
+
+    if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
+    {
+        mbus_sink_printf(sink, "%s_Function=\"Manufacturer specific\"", prefix);
+    }
+    else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    {
+        mbus_sink_printf(sink, "%s_Function=\"More records follow\"", prefix);
+    }
+    else
+    {
+        mbus_sink_printf(sink, "%s_Function=\"", prefix);
+        mbus_str_influxdb_encode_sink(sink, mbus_data_record_function(record));
+        mbus_sink_puts(sink, "\"");
 
-        mbus_str_influxdb_encode_header(str_encoded, mbus_data_variable_medium_lookup(header->medium), sizeof(str_encoded));
+        mbus_sink_printf(sink, ",%s_StorageNumber=%ld",
+                         prefix, mbus_data_record_storage_number(record));
 
-        if (strlen(str_encoded) > 0)
+        if ((tariff = mbus_data_record_tariff(record)) >= 0)
         {
-            len += snprintf(&buff[len], sizeof(buff) - len, ",SlaveInformation_Medium=%s", str_encoded);
+            mbus_sink_printf(sink, ",%s_Tariff=%ld", prefix, tariff);
+            mbus_sink_printf(sink, ",%s_Device=%d",
+                             prefix, mbus_data_record_device(record));
         }
 
-        len += snprintf(&buff[len], sizeof(buff) - len, ",SlaveInformation_AccessNumber=%d", header->access_no);
-        len += snprintf(&buff[len], sizeof(buff) - len, ",SlaveInformation_Status=%.2X", header->status);
-        len += snprintf(&buff[len], sizeof(buff) - len, ",SlaveInformation_Signature=%.2X%.2X", header->signature[1], header->signature[0]);
+        mbus_sink_printf(sink, ",%s_Unit=\"", prefix);
+        mbus_str_influxdb_encode_sink(sink, mbus_data_record_unit_r(record, str_buff, sizeof(str_buff)));
+        mbus_sink_puts(sink, "\"");
+    }
+
+    mbus_data_value_format_r(&value, str_buff, sizeof(str_buff));
+
+    if (numeric)
+    {
+        mbus_sink_printf(sink, ",%s_Value=%s", prefix, str_buff);
+    }
+    else
+    {
+        mbus_sink_printf(sink, ",%s_Value=\"", prefix);
+        mbus_str_influxdb_encode_sink(sink, str_buff);
+        mbus_sink_puts(sink, "\"");
+    }
+
+    if (record->timestamp > 0)
+    {
+        gmtime_r(&(record->timestamp), &timeinfo);
+        strftime(timestamp,20,"%Y-%m-%dT%H:%M:%S",&timeinfo);
+        mbus_sink_printf(sink, ",%s_Timestamp=\"%s\"", prefix, timestamp);
+    }
+
+    return sink->error ? -1 : 1;
+}
+
+//------------------------------------------------------------------------------
+/// Write InfluxDB Line Protocol for a single variable-length data record to a
+/// sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_record_influxdb_sink(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options, mbus_sink *sink)
+{
+    return mbus_data_variable_record_influxdb_write(record, record_cnt, frame_cnt, options, NULL, sink);
+}
+
+//------------------------------------------------------------------------------
+/// Generate InfluxDB Line Protocol for a single variable-length data record
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_record_influxdb_r(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options, char *buff, size_t buff_size)
+{
+    mbus_sink sink;
+
+    mbus_sink_init_buffer(&sink, buff, buff_size);
 
+    if (mbus_data_variable_record_influxdb_sink(record, record_cnt, frame_cnt, header, options, &sink) > 0)
+    {
         return buff;
     }
 
@@ -5034,157 +5883,141 @@ mbus_data_variable_header_influxdb(mbus_data_variable_header *header)
 }
 
 //------------------------------------------------------------------------------
-/// Generate InfluxDB Line Protocol for a single variable-length data record
+/// Non-reentrant version of mbus_data_variable_record_influxdb_r() using a static buffer.
 //------------------------------------------------------------------------------
 char *
 mbus_data_variable_record_influxdb(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header, int options)
 {
     static char buff[8192];
-    char str_encoded[768];
-    char str_encoded_value[768];
-    size_t len = 0;
-    struct tm * timeinfo;
-    char timestamp[21];
-    long tariff;
-    char prefix[20];
 
-    if (record)
+    return mbus_data_variable_record_influxdb_r(record, record_cnt, frame_cnt, header, options, buff, sizeof(buff));
+}
+
+//------------------------------------------------------------------------------
+/// Write InfluxDB Line Protocol for variable-length data to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_influxdb_sink(mbus_data_variable *data, int options, mbus_sink *sink)
+{
+    mbus_data_record *record;
+    int i, dataRecordCount;
+
+    if (data == NULL || sink == NULL)
     {
-        mbus_str_influxdb_encode(str_encoded_value, mbus_data_record_value(record), sizeof(str_encoded_value));
+        return -1;
+    }
 
-        if ((options & MBUS_VALUE_OPTION_ONLYNUMERIC) != 0 && !isnumeric(str_encoded_value))
-        {
-          return "";
-        }
+    mbus_sink_puts(sink, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
 
-        if (frame_cnt >= 0)
-        {
-            snprintf(prefix, sizeof(prefix), "DataRecord_%d_%d", record_cnt, frame_cnt);
-        }
-        else
-        {
-            snprintf(prefix, sizeof(prefix), "DataRecord_%d", record_cnt);
-        }
+    mbus_sink_puts(sink, "MBusData,");
 
-        if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "%s_Function=\"Manufacturer specific\"", prefix);
-        }
-        else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    mbus_data_variable_header_influxdb_sink(&(data->header), sink);
+
+    mbus_sink_puts(sink, " ");
+
+    for (record = data->record, i = 0, dataRecordCount = 0; record; record = record->next, i++)
+    {
+        if (mbus_data_variable_record_influxdb_write(record, i, -1, options, (dataRecordCount > 0) ? "," : NULL, sink) > 0)
         {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "%s_Function=\"More records follow\"", prefix);
+            dataRecordCount++;
         }
-        else
-        {
-            mbus_str_influxdb_encode(str_encoded, mbus_data_record_function(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "%s_Function=\"%s\"", prefix, str_encoded);
+    }
 
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ",%s_StorageNumber=%ld",
-                            prefix, mbus_data_record_storage_number(record));
+    mbus_sink_puts(sink, "\n");
 
-            if ((tariff = mbus_data_record_tariff(record)) >= 0)
-            {
-                len += snprintf(&buff[len], sizeof(buff) - len, ",%s_Tariff=%ld",
-                                prefix, tariff);
-                len += snprintf(&buff[len], sizeof(buff) - len, ",%s_Device=%d",
-                                prefix, mbus_data_record_device(record));
-            }
+    return sink->error ? -1 : 0;
+}
 
-            mbus_str_influxdb_encode(str_encoded, mbus_data_record_unit(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ",%s_Unit=\"%s\"", prefix, str_encoded);
-        }
+//------------------------------------------------------------------------------
+/// Generate InfluxDB Line Protocol for variable-length data
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_influxdb(mbus_data_variable *data, int options)
+{
+    mbus_sink sink;
 
-        if (isnumeric(str_encoded_value))
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len, ",%s_Value=%s", prefix, str_encoded_value);
-        }
-        else
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len, ",%s_Value=\"%s\"", prefix, str_encoded_value);
-        }
-        if (record->timestamp > 0)
+    if (data)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
+
+        if (mbus_data_variable_influxdb_sink(data, options, &sink) == 0)
         {
-            timeinfo = gmtime (&(record->timestamp));
-            strftime(timestamp,20,"%Y-%m-%dT%H:%M:%S",timeinfo);
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            ",%s_Timestamp=\"%s\"", prefix, timestamp);
+            return mbus_sink_detach(&sink);
         }
 
-        return buff;
+        mbus_sink_free(&sink);
     }
 
-    return "";
+    return NULL;
 }
 
 //------------------------------------------------------------------------------
-/// Generate InfluxDB Line Protocol for variable-length data
+/// Write InfluxDB Line Protocol for a counter of a fixed-length frame to a
+/// sink.
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_influxdb(mbus_data_variable *data, int options)
+static void
+mbus_data_fixed_counter_influxdb_sink(mbus_data_fixed *data, int id, int type, unsigned char *cnt_val, mbus_sink *sink)
 {
-    mbus_data_record *record;
-    char *buff = NULL, *new_buff, *dataRecord;
-    size_t len = 0, buff_size = 8192;
-    int i, dataRecordCount;
+    int val;
 
-    if (data)
-    {
-        buff = (char*) malloc(buff_size);
+    mbus_sink_printf(sink, "DataRecord_%d_Function=\"", id);
+    mbus_str_influxdb_encode_sink(sink, mbus_data_fixed_function(data->status));
+    mbus_sink_puts(sink, "\"");
 
-        if (buff == NULL)
-            return NULL;
+    mbus_sink_printf(sink, ",DataRecord_%d_Unit=\"", id);
+    mbus_str_influxdb_encode_sink(sink, mbus_data_fixed_unit(type));
+    mbus_sink_puts(sink, "\"");
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
+    if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+    {
+        mbus_sink_printf(sink, ",DataRecord_%d_Value=%lld", id, mbus_data_bcd_decode(cnt_val, 4));
+    }
+    else
+    {
+        mbus_data_int_decode(cnt_val, 4, &val);
+        mbus_sink_printf(sink, ",DataRecord_%d_Value=%d", id, val);
+    }
+}
 
-        len += snprintf(&buff[len], buff_size - len, "MBusData,");
+//------------------------------------------------------------------------------
+/// Write InfluxDB Line Protocol representation of fixed-length frame to a
+/// sink.
+//------------------------------------------------------------------------------
+int
+mbus_data_fixed_influxdb_sink(mbus_data_fixed *data, mbus_sink *sink)
+{
+    const char *medium;
 
-        len += snprintf(&buff[len], buff_size - len, "%s ",
-                        mbus_data_variable_header_influxdb(&(data->header)));
+    if (data == NULL || sink == NULL)
+    {
+        return -1;
+    }
 
-        for (record = data->record, i = 0, dataRecordCount = 0; record; record = record->next, i++)
-        {
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
+    mbus_sink_puts(sink, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
 
-                if (new_buff == NULL)
-                {
-                    free(buff);
-                    return NULL;
-                }
+    mbus_sink_puts(sink, "MBusData,");
 
-                buff = new_buff;
-            }
+    mbus_sink_printf(sink, "SlaveInformation_Id=%lld", mbus_data_bcd_decode(data->id_bcd, 4));
 
-            dataRecord = mbus_data_variable_record_influxdb(record, i, -1, &(data->header), options);
+    medium = mbus_data_fixed_medium(data);
 
-            if (strlen(dataRecord) > 0)
-            {
-                dataRecordCount++;
+    if (medium && medium[0] != '\0')
+    {
+        mbus_sink_puts(sink, ",SlaveInformation_Medium=");
+        mbus_str_influxdb_encode_header_sink(sink, medium);
+    }
 
-                if (dataRecordCount > 1)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ",%s", dataRecord);
-                }
-                else
-                {
-                    len += snprintf(&buff[len], buff_size - len, "%s", dataRecord);
-                }
-            }
-        }
+    mbus_sink_printf(sink, ",SlaveInformation_AccessNumber=%d", data->tx_cnt);
+    mbus_sink_printf(sink, ",SlaveInformation_Status=%.2X", data->status);
+    mbus_sink_puts(sink, " ");
 
-        len += snprintf(&buff[len], buff_size - len, "\n");
+    mbus_data_fixed_counter_influxdb_sink(data, 0, data->cnt1_type, data->cnt1_val, sink);
+    mbus_sink_puts(sink, ",");
+    mbus_data_fixed_counter_influxdb_sink(data, 1, data->cnt2_type, data->cnt2_val, sink);
 
-        return buff;
-    }
+    mbus_sink_puts(sink, "\n");
 
-    return NULL;
+    return sink->error ? -1 : 0;
 }
 
 //------------------------------------------------------------------------------
@@ -5193,71 +6026,46 @@ mbus_data_variable_influxdb(mbus_data_variable *data, int options)
 char *
 mbus_data_fixed_influxdb(mbus_data_fixed *data)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
-    int val;
+    mbus_sink sink;
 
     if (data)
     {
-        buff = (char*) malloc(buff_size);
-
-        if (buff == NULL)
-            return NULL;
-
-        len += snprintf(&buff[len], buff_size - len, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
-
-        len += snprintf(&buff[len], buff_size - len, "MBusData,");
-
-        len += snprintf(&buff[len], buff_size - len, "SlaveInformation_Id=%lld", mbus_data_bcd_decode(data->id_bcd, 4));
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-        mbus_str_influxdb_encode_header(str_encoded, mbus_data_fixed_medium(data), sizeof(str_encoded));
-
-        if (strlen(str_encoded) > 0)
+        if (mbus_data_fixed_influxdb_sink(data, &sink) == 0)
         {
-            len += snprintf(&buff[len], buff_size - len, ",SlaveInformation_Medium=%s", str_encoded);
+            return mbus_sink_detach(&sink);
         }
 
-        len += snprintf(&buff[len], buff_size - len, ",SlaveInformation_AccessNumber=%d", data->tx_cnt);
-        len += snprintf(&buff[len], buff_size - len, ",SlaveInformation_Status=%.2X", data->status);
-        len += snprintf(&buff[len], buff_size - len, " ");
+        mbus_sink_free(&sink);
+    }
 
-        mbus_str_influxdb_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "DataRecord_0_Function=\"%s\"", str_encoded);
+    return NULL;
+}
 
-        mbus_str_influxdb_encode(str_encoded, mbus_data_fixed_unit(data->cnt1_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ",DataRecord_0_Unit=\"%s\"", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
-        {
-            len += snprintf(&buff[len], buff_size - len, ",DataRecord_0_Value=%lld", mbus_data_bcd_decode(data->cnt1_val, 4));
-        }
-        else
-        {
-            mbus_data_int_decode(data->cnt1_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, ",DataRecord_0_Value=%d", val);
-        }
+//------------------------------------------------------------------------------
+/// Write InfluxDB Line Protocol representation of a general application error
+/// to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_data_error_influxdb_sink(int error, mbus_sink *sink)
+{
+    char str_buff[256];
 
-        mbus_str_influxdb_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ",DataRecord_1_Function=\"%s\"", str_encoded);
+    if (sink == NULL)
+    {
+        return -1;
+    }
 
-        mbus_str_influxdb_encode(str_encoded, mbus_data_fixed_unit(data->cnt2_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, ",DataRecord_1_Unit=\"%s\"", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
-        {
-            len += snprintf(&buff[len], buff_size - len, ",DataRecord_1_Value=%lld", mbus_data_bcd_decode(data->cnt2_val, 4));
-        }
-        else
-        {
-            mbus_data_int_decode(data->cnt2_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, ",DataRecord_1_Value=%d", val);
-        }
+    mbus_sink_puts(sink, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "MBusData,");
 
-        len += snprintf(&buff[len], buff_size - len, "\n");
+    mbus_sink_puts(sink, "SlaveInformation_Error=");
+    mbus_str_influxdb_encode_header_sink(sink, mbus_data_error_lookup_r(error, str_buff, sizeof(str_buff)));
 
-        return buff;
-    }
+    mbus_sink_puts(sink, "\n");
 
-    return NULL;
+    return sink->error ? -1 : 0;
 }
 
 //------------------------------------------------------------------------------
@@ -5267,212 +6075,182 @@ mbus_data_fixed_influxdb(mbus_data_fixed *data)
 char *
 mbus_data_error_influxdb(int error)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
+    mbus_sink sink;
 
-    buff = (char*) malloc(buff_size);
+    mbus_sink_init_buffer(&sink, NULL, 0);
 
-    if (buff == NULL)
-        return NULL;
-
-    len += snprintf(&buff[len], buff_size - len, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
-    len += snprintf(&buff[len], buff_size - len, "MBusData,");
-
-    mbus_str_influxdb_encode_header(str_encoded, mbus_data_error_lookup(error), sizeof(str_encoded));
-    len += snprintf(&buff[len], buff_size - len, "SlaveInformation_Error=%s", str_encoded);
+    if (mbus_data_error_influxdb_sink(error, &sink) == 0)
+    {
+        return mbus_sink_detach(&sink);
+    }
 
-    len += snprintf(&buff[len], buff_size - len, "\n");
+    mbus_sink_free(&sink);
 
-    return buff;
+    return NULL;
 }
 
 //------------------------------------------------------------------------------
-/// Return a string containing an InfluxDB Line Protocol representation of the 
-/// M-BUS frame data.
+/// Write an InfluxDB Line Protocol representation of the M-BUS frame data to
+/// a sink.
 //------------------------------------------------------------------------------
-char *
-mbus_frame_data_influxdb(mbus_frame_data *data, int options)
+int
+mbus_frame_data_influxdb_sink(mbus_frame_data *data, int options, mbus_sink *sink)
 {
     if (data)
     {
         if (data->type == MBUS_DATA_TYPE_ERROR)
         {
-            return mbus_data_error_influxdb(data->error);
+            return mbus_data_error_influxdb_sink(data->error, sink);
         }
 
         if (data->type == MBUS_DATA_TYPE_FIXED)
         {
-            return mbus_data_fixed_influxdb(&(data->data_fix));
+            return mbus_data_fixed_influxdb_sink(&(data->data_fix), sink);
         }
 
         if (data->type == MBUS_DATA_TYPE_VARIABLE)
         {
-            return mbus_data_variable_influxdb(&(data->data_var), options);
+            return mbus_data_variable_influxdb_sink(&(data->data_var), options, sink);
         }
     }
 
-    return NULL;
+    return -1;
 }
 
 //------------------------------------------------------------------------------
-/// Return an InfluxDB Line Protocol representation of the M-BUS frame.
+/// Return a string containing an InfluxDB Line Protocol representation of the 
+/// M-BUS frame data.
 //------------------------------------------------------------------------------
 char *
-mbus_frame_influxdb(mbus_frame *frame, int options)
+mbus_frame_data_influxdb(mbus_frame_data *data, int options)
 {
-    mbus_frame_data frame_data;
-    mbus_frame *iter;
-
-    mbus_data_record *record;
-    char *buff = NULL, *new_buff;
-
-    size_t len = 0, buff_size = 8192;
-    int record_cnt = 0, frame_cnt;
+    mbus_sink sink;
 
-    if (frame)
+    if (data)
     {
-        memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
-
-        if (mbus_frame_data_parse(frame, &frame_data) == -1)
-        {
-            mbus_error_str_set("M-bus data parse error.");
-            return NULL;
-        }
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-        if (frame_data.type == MBUS_DATA_TYPE_ERROR)
+        if (mbus_frame_data_influxdb_sink(data, options, &sink) == 0)
         {
-            //
-            // generate InfluxDB Line Protocol for error
-            //
-            return mbus_data_error_influxdb(frame_data.error);
+            return mbus_sink_detach(&sink);
         }
 
-        if (frame_data.type == MBUS_DATA_TYPE_FIXED)
-        {
-            //
-            // generate InfluxDB Line Protocol for fixed data
-            //
-            return mbus_data_fixed_influxdb(&(frame_data.data_fix));
-        }
+        mbus_sink_free(&sink);
+    }
 
-        if (frame_data.type == MBUS_DATA_TYPE_VARIABLE)
-        {
-            //
-            // generate InfluxDB Line Protocol for a sequence of variable data frames
-            //
+    return NULL;
+}
 
-            buff = (char*) malloc(buff_size);
+//------------------------------------------------------------------------------
+/// Write an InfluxDB Line Protocol representation of the M-BUS frame (and the
+/// frames linked to it) to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_influxdb_sink(mbus_frame *frame, int options, mbus_sink *sink)
+{
+    mbus_frame_data frame_data;
+    mbus_record_arena arena;
+    mbus_frame *iter;
 
-            if (buff == NULL)
-            {
-                mbus_data_record_free(frame_data.data_var.record);
-                return NULL;
-            }
+    mbus_data_record *record;
+    int record_cnt = 0, frame_cnt, dataRecordCount = 0;
 
-            // include frame counter in InfluxDB Line Protocol output if more than one frame
-            // is available (frame_cnt = -1 => not included in output)
-            frame_cnt = (frame->next == NULL) ? -1 : 0;
+    if (frame == NULL || sink == NULL)
+    {
+        return -1;
+    }
 
-            len += snprintf(&buff[len], buff_size - len, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
+    memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+    mbus_record_arena_init(&arena);
 
-            len += snprintf(&buff[len], buff_size - len, "MBusData,");
+    if (mbus_frame_data_parse_arena(frame, &frame_data, &arena) == -1)
+    {
+        mbus_record_arena_free(&arena);
+        mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus data parse error.");
+        return -1;
+    }
 
-            // only print the header info for the first frame (should be
-            // the same for each frame in a sequence of a multi-telegram
-            // transfer.
-            len += snprintf(&buff[len], buff_size - len, "%s ",
-                                    mbus_data_variable_header_influxdb(&(frame_data.data_var.header)));
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        //
+        // generate InfluxDB Line Protocol for error or fixed data
+        //
+        mbus_record_arena_free(&arena);
+        return mbus_frame_data_influxdb_sink(&frame_data, options, sink);
+    }
 
-            // loop through all records in the current frame, using a global
-            // record count as record ID in the InfluxDB Line Protocol output
-            for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-            {
-                if ((buff_size - len) < 1024)
-                {
-                    buff_size *= 2;
-                    new_buff = (char*) realloc(buff,buff_size);
+    //
+    // generate InfluxDB Line Protocol for a sequence of variable data frames
+    //
 
-                    if (new_buff == NULL)
-                    {
-                        free(buff);
-                        mbus_data_record_free(frame_data.data_var.record);
-                        return NULL;
-                    }
+    // include frame counter in InfluxDB Line Protocol output if more than one frame
+    // is available (frame_cnt = -1 => not included in output)
+    frame_cnt = (frame->next == NULL) ? -1 : 0;
 
-                    buff = new_buff;
-                }
+    mbus_sink_puts(sink, MBUS_INFLUXDB_PROCESSING_INSTRUCTION);
 
-                if (record_cnt > 0)
-                {
-                    len += snprintf(&buff[len], buff_size - len, ",");
-                }
+    mbus_sink_puts(sink, "MBusData,");
 
-                len += snprintf(&buff[len], buff_size - len, "%s",
-                                mbus_data_variable_record_influxdb(record, record_cnt, frame_cnt, &(frame_data.data_var.header), options));
-            }
+    // only print the header info for the first frame (should be
+    // the same for each frame in a sequence of a multi-telegram
+    // transfer.
+    mbus_data_variable_header_influxdb_sink(&(frame_data.data_var.header), sink);
 
-            // free all records in the list
-            if (frame_data.data_var.record)
-            {
-                mbus_data_record_free(frame_data.data_var.record);
-            }
+    mbus_sink_puts(sink, " ");
 
-            frame_cnt++;
+    for (iter = frame; iter; iter = iter->next, frame_cnt++)
+    {
+        if (iter != frame && mbus_frame_data_parse_arena(iter, &frame_data, &arena) == -1)
+        {
+            mbus_record_arena_free(&arena);
+            mbus_error_set(MBUS_ERR_DATA_INVALID, "M-bus variable data parse error.");
+            return -1;
+        }
 
-            for (iter = frame->next; iter; iter = iter->next, frame_cnt++)
+        // loop through all records in the current frame, using a global
+        // record count as record ID in the InfluxDB Line Protocol output
+        for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
+        {
+            if (mbus_data_variable_record_influxdb_write(record, record_cnt, frame_cnt, options, (dataRecordCount > 0) ? "," : NULL, sink) > 0)
             {
-                if (mbus_frame_data_parse(iter, &frame_data) == -1)
-                {
-                    mbus_error_str_set("M-bus variable data parse error.");
-                    return NULL;
-                }
-
-                // loop through all records in the current frame, using a global
-                // record count as record ID in the InfluxDB Line Protocol output
-                for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-                {
-                    if ((buff_size - len) < 1024)
-                    {
-                        buff_size *= 2;
-                        new_buff = (char*) realloc(buff,buff_size);
+                dataRecordCount++;
+            }
+        }
 
-                        if (new_buff == NULL)
-                        {
-                            free(buff);
-                            mbus_data_record_free(frame_data.data_var.record);
-                            return NULL;
-                        }
+        // release all records of the frame
+        mbus_record_arena_reset(&arena);
+    }
 
-                        buff = new_buff;
-                    }
+    mbus_sink_puts(sink, "\n");
 
-                    if (record_cnt > 0)
-                    {
-                        len += snprintf(&buff[len], buff_size - len, ",");
-                    }
+    mbus_record_arena_free(&arena);
 
-                    len += snprintf(&buff[len], buff_size - len, "%s",
-                                    mbus_data_variable_record_influxdb(record, record_cnt, frame_cnt, &(frame_data.data_var.header), options));
-                }
+    return sink->error ? -1 : 0;
+}
 
-                // free all records in the list
-                if (frame_data.data_var.record)
-                {
-                    mbus_data_record_free(frame_data.data_var.record);
-                }
-            }
+//------------------------------------------------------------------------------
+/// Return an InfluxDB Line Protocol representation of the M-BUS frame.
+//------------------------------------------------------------------------------
+char *
+mbus_frame_influxdb(mbus_frame *frame, int options)
+{
+    mbus_sink sink;
 
-            len += snprintf(&buff[len], buff_size - len, "\n");
+    if (frame)
+    {
+        mbus_sink_init_buffer(&sink, NULL, 0);
 
-            return buff;
+        if (mbus_frame_influxdb_sink(frame, options, &sink) == 0)
+        {
+            return mbus_sink_detach(&sink);
         }
+
+        mbus_sink_free(&sink);
     }
 
     return NULL;
 }
 
-
 //------------------------------------------------------------------------------
 /// Allocate and initialize a new frame data structure
 //------------------------------------------------------------------------------
@@ -5551,6 +6329,118 @@ mbus_data_record_free(mbus_data_record *record)
     }
 }
 
+//------------------------------------------------------------------------------
+/// Initialize an empty record arena.
+//------------------------------------------------------------------------------
+void
+mbus_record_arena_init(mbus_record_arena *arena)
+{
+    if (arena)
+    {
+        arena->head = NULL;
+        arena->current = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Take a (zeroed) record from the arena. A new block is only allocated
+/// when all blocks are in use.
+//------------------------------------------------------------------------------
+mbus_data_record *
+mbus_record_arena_alloc(mbus_record_arena *arena)
+{
+    mbus_record_block *block;
+    mbus_data_record *record;
+
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    block = arena->current;
+
+    while (block && block->used >= block->size)
+    {
+        block = block->next;
+    }
+
+    if (block == NULL)
+    {
+        if ((block = (mbus_record_block *) malloc(sizeof(mbus_record_block) +
+                                                  MBUS_RECORD_ARENA_BLOCK_SIZE * sizeof(mbus_data_record))) == NULL)
+        {
+            mbus_error_set(MBUS_ERR_NO_MEMORY, "Failed to allocate record block.");
+            return NULL;
+        }
+
+        block->records = (mbus_data_record *) (block + 1);
+        block->size = MBUS_RECORD_ARENA_BLOCK_SIZE;
+        block->used = 0;
+        block->next = NULL;
+
+        // append the block at the end of the list
+        if (arena->current == NULL)
+        {
+            arena->head = block;
+        }
+        else
+        {
+            mbus_record_block *iter;
+
+            for (iter = arena->current; iter->next; iter = iter->next);
+
+            iter->next = block;
+        }
+    }
+
+    arena->current = block;
+
+    record = &block->records[block->used++];
+    memset(record, 0, sizeof(mbus_data_record));
+
+    return record;
+}
+
+//------------------------------------------------------------------------------
+/// Release all records of the arena at once, the blocks are kept for reuse.
+//------------------------------------------------------------------------------
+void
+mbus_record_arena_reset(mbus_record_arena *arena)
+{
+    mbus_record_block *block;
+
+    if (arena)
+    {
+        for (block = arena->head; block; block = block->next)
+        {
+            block->used = 0;
+        }
+
+        arena->current = arena->head;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Free the memory of the arena, all records taken from it become invalid.
+//------------------------------------------------------------------------------
+void
+mbus_record_arena_free(mbus_record_arena *arena)
+{
+    mbus_record_block *block, *next;
+
+    if (arena)
+    {
+        for (block = arena->head; block; block = next)
+        {
+            next = block->next;
+            free(block);
+        }
+
+        arena->head = NULL;
+        arena->current = NULL;
+    }
+}
+
 //------------------------------------------------------------------------------
 /// Return a string containing an XML representation of the M-BUS frame.
 //------------------------------------------------------------------------------
@@ -5581,23 +6471,22 @@ mbus_data_record_append(mbus_data_variable *data, mbus_data_record *record)
 // manufacturer ID (2 bytes), version (1 byte) and medium (1 byte).
 //------------------------------------------------------------------------------
 char *
-mbus_frame_get_secondary_address(mbus_frame *frame)
+mbus_frame_get_secondary_address_r(mbus_frame *frame, char *buff, size_t buff_size)
 {
-    static char addr[32];
     mbus_frame_data *data;
     unsigned long id;
 
     if (frame == NULL || (data = mbus_frame_data_new()) == NULL)
     {
-        snprintf(error_str, sizeof(error_str),
-                 "%s: Failed to allocate data structure [%p, %p].",
-                  __PRETTY_FUNCTION__, (void*)frame, (void*)data);
+        mbus_error_set(frame == NULL ? MBUS_ERR_INVALID_ARGUMENT : MBUS_ERR_NO_MEMORY,
+                       "%s: Failed to allocate data structure [%p, %p].",
+                       __PRETTY_FUNCTION__, (void*)frame, (void*)data);
         return NULL;
     }
 
     if (frame->control_information != MBUS_CONTROL_INFO_RESP_VARIABLE)
     {
-        snprintf(error_str, sizeof(error_str), "Non-variable data response (can't get secondary address from response).");
+        mbus_error_set(MBUS_ERR_UNSUPPORTED, "Non-variable data response (can't get secondary address from response).");
         mbus_frame_data_free(data);
         return NULL;
     }
@@ -5610,7 +6499,7 @@ mbus_frame_get_secondary_address(mbus_frame *frame)
 
     id = (unsigned long) mbus_data_bcd_decode(data->data_var.header.id_bcd, 4);
 
-    snprintf(addr, sizeof(addr), "%08lu%02X%02X%02X%02X",
+    snprintf(buff, buff_size, "%08lu%02X%02X%02X%02X",
              id,
              data->data_var.header.manufacturer[0],
              data->data_var.header.manufacturer[1],
@@ -5620,7 +6509,18 @@ mbus_frame_get_secondary_address(mbus_frame *frame)
     // free data
     mbus_frame_data_free(data);
 
-    return addr;
+    return buff;
+}
+
+//------------------------------------------------------------------------------
+/// Non-reentrant version of mbus_frame_get_secondary_address_r() using a static buffer.
+//------------------------------------------------------------------------------
+char *
+mbus_frame_get_secondary_address(mbus_frame *frame)
+{
+    static char buff[32];
+
+    return mbus_frame_get_secondary_address_r(frame, buff, sizeof(buff));
 }
 
 //------------------------------------------------------------------------------
@@ -5634,13 +6534,13 @@ mbus_frame_select_secondary_pack(mbus_frame *frame, char *address)
 
     if (frame == NULL || address == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: frame or address arguments are NULL.", __PRETTY_FUNCTION__);
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: frame or address arguments are NULL.", __PRETTY_FUNCTION__);
         return -1;
     }
 
     if (mbus_is_secondary_address(address) == 0)
     {
-        snprintf(error_str, sizeof(error_str), "%s: address is invalid.", __PRETTY_FUNCTION__);
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: address is invalid.", __PRETTY_FUNCTION__);
         return -1;
     }
 
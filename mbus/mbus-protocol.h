@@ -22,6 +22,8 @@
 #include <stdint.h>
 #include <time.h>
 
+#include "mbus-sink.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -104,6 +106,21 @@ typedef struct _mbus_slave_data {
 
 } mbus_slave_data;
 
+//
+// Incremental frame parser state. Bytes are fed in arbitrary chunks (as they
+// arrive from the transport) and decoded straight into the target frame, so
+// each received byte is only looked at once.
+//
+typedef struct _mbus_parser {
+
+    mbus_frame *frame;      // frame being decoded
+    size_t pos;             // number of frame bytes consumed so far
+    size_t size;            // total frame size, 0 while not yet known
+    unsigned char checksum; // running checksum of control, address, CI and data
+    int result;             // > 0: bytes still missing, 0: done, < 0: error
+
+} mbus_parser;
+
 #define NITEMS(x) (sizeof(x)/sizeof(x[0]))
 
 //
@@ -121,6 +138,26 @@ typedef struct _mbus_slave_data {
 #define MBUS_RECV_RESULT_TIMEOUT   -3
 #define MBUS_RECV_RESULT_RESET     -4
 
+//
+// Error codes of the last failed operation in the calling thread, see
+// mbus_error_get(). The message returned by mbus_error_str() gives the details.
+//
+typedef enum _mbus_error_code {
+    MBUS_ERR_NONE = 0,
+    MBUS_ERR_INVALID_ARGUMENT, // null pointer or out of range parameter
+    MBUS_ERR_NO_MEMORY,        // memory allocation failed
+    MBUS_ERR_FRAME_INVALID,    // malformed frame (start, stop, length, control)
+    MBUS_ERR_FRAME_CHECKSUM,   // frame checksum mismatch
+    MBUS_ERR_DATA_INVALID,     // malformed application data in a frame
+    MBUS_ERR_UNSUPPORTED,      // frame or data type that can not be handled
+    MBUS_ERR_CONNECT,          // failed to set up the transport connection
+    MBUS_ERR_SEND,             // failed to write to the transport
+    MBUS_ERR_RECV,             // failed to read from the transport
+    MBUS_ERR_TIMEOUT,          // transport response timeout
+    MBUS_ERR_CONNECTION_CLOSED,// connection closed by the remote host
+    MBUS_ERR_OTHER             // message set by mbus_error_str_set()
+} mbus_error_code;
+
 //------------------------------------------------------------------------------
 // MBUS FRAME DATA FORMATS
 //
@@ -173,6 +210,39 @@ typedef struct _mbus_data_record {
 
 } mbus_data_record;
 
+//
+// TYPED VALUE OF A DATA RECORD
+//
+// The value of a record decoded once from the DIF/VIF and the record data,
+// formatting is left to the output functions.
+//
+#define MBUS_DATA_VALUE_NONE            0   // no data
+#define MBUS_DATA_VALUE_INTEGER         1   // value.integer
+#define MBUS_DATA_VALUE_REAL            2   // value.real
+#define MBUS_DATA_VALUE_BCD             3   // value.integer, see bcd_error
+#define MBUS_DATA_VALUE_DATE            4   // value.time (date only)
+#define MBUS_DATA_VALUE_DATETIME        5   // value.time
+#define MBUS_DATA_VALUE_STRING          6   // data/data_len, characters in reverse order
+#define MBUS_DATA_VALUE_BINARY          7   // data/data_len
+#define MBUS_DATA_VALUE_UNKNOWN         8   // unsupported data field
+
+typedef struct _mbus_data_value {
+
+    int type;                  // MBUS_DATA_VALUE_*
+    unsigned char dif;         // DIF of the record
+    int bcd_error;             // BCD contained digits A-F
+
+    union {
+        long long integer;
+        double real;
+        struct tm time;
+    } value;
+
+    const unsigned char *data; // points into the record data
+    size_t data_len;
+
+} mbus_data_value;
+
 //
 // HEADER FOR VARIABLE LENGTH DATA FORMAT
 //
@@ -218,6 +288,33 @@ typedef struct _mbus_data_variable {
 
 } mbus_data_variable;
 
+//
+// RECORD ARENA
+//
+// Storage for the records of parsed variable data frames. Records are taken
+// from large blocks instead of being allocated one by one, resetting the
+// arena makes the blocks available for the next frame(s) and a single call
+// to mbus_record_arena_free releases everything. Records taken from an arena
+// must not be freed with mbus_data_record_free.
+//
+#define MBUS_RECORD_ARENA_BLOCK_SIZE 64 // records per block
+
+typedef struct _mbus_record_block {
+
+    struct _mbus_record_block *next;
+    size_t size;                // number of records in the block
+    size_t used;                // number of records in use
+    mbus_data_record *records;  // allocated together with the block
+
+} mbus_record_block;
+
+typedef struct _mbus_record_arena {
+
+    mbus_record_block *head;    // first block
+    mbus_record_block *current; // block new records are taken from
+
+} mbus_record_arena;
+
 //
 // FIXED LENGTH DATA FORMAT
 //
@@ -528,6 +625,11 @@ mbus_data_record *mbus_data_record_new();
 void              mbus_data_record_free(mbus_data_record *record);
 void              mbus_data_record_append(mbus_data_variable *data, mbus_data_record *record);
 
+void              mbus_record_arena_init(mbus_record_arena *arena);
+mbus_data_record *mbus_record_arena_alloc(mbus_record_arena *arena);
+void              mbus_record_arena_reset(mbus_record_arena *arena);
+void              mbus_record_arena_free(mbus_record_arena *arena);
+
 
 // XXX: Add application reset subcodes
 
@@ -548,10 +650,16 @@ int mbus_frame_calc_length  (mbus_frame *frame);
 //
 int mbus_parse(mbus_frame *frame, unsigned char *data, size_t data_size);
 
+void mbus_parser_init(mbus_parser *parser, mbus_frame *frame);
+int  mbus_parser_feed(mbus_parser *parser, const unsigned char *data, size_t data_size, size_t *consumed);
+
 int mbus_data_fixed_parse   (mbus_frame *frame, mbus_data_fixed    *data);
 int mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data);
+int mbus_data_variable_parse_arena(mbus_frame *frame, mbus_data_variable *data, mbus_record_arena *arena);
 
 int mbus_frame_data_parse   (mbus_frame *frame, mbus_frame_data *data);
+int mbus_frame_data_parse_arena(mbus_frame *frame, mbus_frame_data *data, mbus_record_arena *arena);
+int mbus_frame_more_records_follow(mbus_frame *frame);
 
 int mbus_frame_pack(mbus_frame *frame, unsigned char *data, size_t data_size);
 
@@ -562,8 +670,18 @@ int mbus_frame_internal_pack(mbus_frame *frame, mbus_frame_data *frame_data);
 //
 // data parsing
 //
+// Functions with a _r suffix write their result to the caller supplied buffer
+// and are safe to use from multiple threads, the variants without the suffix
+// return a pointer to a static buffer that is overwritten by the next call.
+//
 const char *mbus_data_record_function(mbus_data_record *record);
 const char *mbus_data_fixed_function(int status);
+const char *mbus_data_record_decode_r(mbus_data_record *record, char *buff, size_t buff_size);
+const char *mbus_data_record_unit_r(mbus_data_record *record, char *buff, size_t buff_size);
+const char *mbus_data_record_value_r(mbus_data_record *record, char *buff, size_t buff_size);
+int         mbus_data_record_value_decode(mbus_data_record *record, mbus_data_value *value);
+const char *mbus_data_value_format_r(const mbus_data_value *value, char *buff, size_t buff_size);
+int         mbus_data_value_is_numeric(const mbus_data_value *value);
 long        mbus_data_record_storage_number(mbus_data_record *record);
 long        mbus_data_record_tariff(mbus_data_record *record);
 int         mbus_data_record_device(mbus_data_record *record);
@@ -590,9 +708,29 @@ char *mbus_data_error_xml(int error);
 char *mbus_frame_data_xml(mbus_frame_data *data, int options);
 
 char *mbus_data_variable_header_xml(mbus_data_variable_header *header);
+char *mbus_data_variable_header_xml_r(mbus_data_variable_header *header, char *buff, size_t buff_size);
+char *mbus_data_variable_record_xml_r(mbus_data_record *record, int record_cnt, int frame_cnt,
+                                     mbus_data_variable_header *header, int options,
+                                     char *buff, size_t buff_size);
 
 char *mbus_frame_xml(mbus_frame *frame, int options);
 
+//
+// Streaming XML writers: append to a sink (see mbus-sink.h) instead of
+// returning allocated strings. Return 0 on success, -1 on error. The record
+// writers return 1 if the record was written, 0 if it was skipped (options).
+//
+int   mbus_str_xml_encode_sink(mbus_sink *sink, const char *src);
+int   mbus_data_variable_header_xml_sink(mbus_data_variable_header *header, mbus_sink *sink);
+int   mbus_data_variable_record_xml_sink(mbus_data_record *record, int record_cnt, int frame_cnt,
+                                     mbus_data_variable_header *header, int options,
+                                     mbus_sink *sink);
+int   mbus_data_variable_xml_sink(mbus_data_variable *data, int options, mbus_sink *sink);
+int   mbus_data_fixed_xml_sink(mbus_data_fixed *data, mbus_sink *sink);
+int   mbus_data_error_xml_sink(int error, mbus_sink *sink);
+int   mbus_frame_data_xml_sink(mbus_frame_data *data, int options, mbus_sink *sink);
+int   mbus_frame_xml_sink(mbus_frame *frame, int options, mbus_sink *sink);
+
 //
 // JSON generating functions
 //
@@ -604,9 +742,27 @@ char *mbus_data_error_json(int error);
 char *mbus_frame_data_json(mbus_frame_data *data, int options);
 
 char *mbus_data_variable_header_json(mbus_data_variable_header *header);
+char *mbus_data_variable_header_json_r(mbus_data_variable_header *header, char *buff, size_t buff_size);
+char *mbus_data_variable_record_json_r(mbus_data_record *record, int record_cnt, int frame_cnt,
+                                     mbus_data_variable_header *header, int options,
+                                     char *buff, size_t buff_size);
 
 char *mbus_frame_json(mbus_frame *frame, int options);
 
+//
+// Streaming JSON writers (as the XML writers above)
+//
+int   mbus_str_json_encode_sink(mbus_sink *sink, const char *src);
+int   mbus_data_variable_header_json_sink(mbus_data_variable_header *header, mbus_sink *sink);
+int   mbus_data_variable_record_json_sink(mbus_data_record *record, int record_cnt, int frame_cnt,
+                                     mbus_data_variable_header *header, int options,
+                                     mbus_sink *sink);
+int   mbus_data_variable_json_sink(mbus_data_variable *data, int options, mbus_sink *sink);
+int   mbus_data_fixed_json_sink(mbus_data_fixed *data, mbus_sink *sink);
+int   mbus_data_error_json_sink(int error, mbus_sink *sink);
+int   mbus_frame_data_json_sink(mbus_frame_data *data, int options, mbus_sink *sink);
+int   mbus_frame_json_sink(mbus_frame *frame, int options, mbus_sink *sink);
+
 //
 // InfluxDB Line Protocol generating functions
 //
@@ -619,9 +775,28 @@ char *mbus_data_error_influxdb(int error);
 char *mbus_frame_data_influxdb(mbus_frame_data *data, int options);
 
 char *mbus_data_variable_header_influxdb(mbus_data_variable_header *header);
+char *mbus_data_variable_header_influxdb_r(mbus_data_variable_header *header, char *buff, size_t buff_size);
+char *mbus_data_variable_record_influxdb_r(mbus_data_record *record, int record_cnt, int frame_cnt,
+                                     mbus_data_variable_header *header, int options,
+                                     char *buff, size_t buff_size);
 
 char *mbus_frame_influxdb(mbus_frame *frame, int options);
 
+//
+// Streaming InfluxDB Line Protocol writers (as the XML writers above)
+//
+int   mbus_str_influxdb_encode_sink(mbus_sink *sink, const char *src);
+int   mbus_str_influxdb_encode_header_sink(mbus_sink *sink, const char *src);
+int   mbus_data_variable_header_influxdb_sink(mbus_data_variable_header *header, mbus_sink *sink);
+int   mbus_data_variable_record_influxdb_sink(mbus_data_record *record, int record_cnt, int frame_cnt,
+                                     mbus_data_variable_header *header, int options,
+                                     mbus_sink *sink);
+int   mbus_data_variable_influxdb_sink(mbus_data_variable *data, int options, mbus_sink *sink);
+int   mbus_data_fixed_influxdb_sink(mbus_data_fixed *data, mbus_sink *sink);
+int   mbus_data_error_influxdb_sink(int error, mbus_sink *sink);
+int   mbus_frame_data_influxdb_sink(mbus_frame_data *data, int options, mbus_sink *sink);
+int   mbus_frame_influxdb_sink(mbus_frame *frame, int options, mbus_sink *sink);
+
 //
 // Debug/dump
 //
@@ -636,6 +811,13 @@ char *mbus_error_str();
 void  mbus_error_str_set(char *message);
 void  mbus_error_reset();
 
+mbus_error_code mbus_error_get();
+void  mbus_error_set(mbus_error_code code, const char *format, ...)
+#ifdef __GNUC__
+      __attribute__((format(printf, 2, 3)))
+#endif
+      ;
+
 void  mbus_parse_set_debug(int debug);
 void  mbus_hex_dump(const char *label, const char *buff, size_t len);
 
@@ -644,6 +826,7 @@ void  mbus_hex_dump(const char *label, const char *buff, size_t len);
 //
 int mbus_data_manufacturer_encode(unsigned char *m_data, unsigned char *m_code);
 const char *mbus_decode_manufacturer(unsigned char byte1, unsigned char byte2);
+const char *mbus_decode_manufacturer_r(unsigned char byte1, unsigned char byte2, char *buff, size_t buff_size);
 const char *mbus_data_product_name(mbus_data_variable_header *header);
 
 int mbus_data_bcd_encode(unsigned char *bcd_data, size_t bcd_data_size, int value);
@@ -665,16 +848,22 @@ void mbus_data_bin_decode(unsigned char *dst, const unsigned char *src, size_t l
 const char *mbus_data_fixed_medium(mbus_data_fixed *data);
 const char *mbus_data_fixed_unit(int medium_unit_byte);
 const char *mbus_data_variable_medium_lookup(unsigned char medium);
+const char *mbus_data_variable_medium_lookup_r(unsigned char medium, char *buff, size_t buff_size);
 const char *mbus_unit_prefix(int exp);
+const char *mbus_unit_prefix_r(int exp, char *buff, size_t buff_size);
 
 const char *mbus_data_error_lookup(int error);
+const char *mbus_data_error_lookup_r(int error, char *buff, size_t buff_size);
 
 const char *mbus_vib_unit_lookup(mbus_value_information_block *vib);
+const char *mbus_vib_unit_lookup_r(mbus_value_information_block *vib, char *buff, size_t buff_size);
 const char *mbus_vif_unit_lookup(unsigned char vif);
+const char *mbus_vif_unit_lookup_r(unsigned char vif, char *buff, size_t buff_size);
 
 unsigned char mbus_dif_datalength_lookup(unsigned char dif);
 
 char *mbus_frame_get_secondary_address(mbus_frame *frame);
+char *mbus_frame_get_secondary_address_r(mbus_frame *frame, char *buff, size_t buff_size);
 int   mbus_frame_select_secondary_pack(mbus_frame *frame, char *address);
 
 int mbus_is_primary_address(int value);
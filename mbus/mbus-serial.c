@@ -24,6 +24,7 @@
 #include "mbus-serial.h"
 #include "mbus-protocol-aux.h"
 #include "mbus-protocol.h"
+#include "mbus-capture.h"
 
 #define PACKET_BUFF_SIZE 2048
 
@@ -46,13 +47,15 @@ mbus_serial_connect(mbus_handle *handle)
 
     device = serial_data->device;
     term = &(serial_data->t);
+    mbus_recv_buffer_reset(&(serial_data->recv_buffer));
     //
     // create the SERIAL connection
     //
 
-    // Use blocking read and handle it by serial port VMIN/VTIME setting
+    // Reads never block, mbus_serial_recv_frame waits for the data with poll()
     if ((handle->fd = open(device, O_RDWR | O_NOCTTY)) < 0)
     {
+        mbus_error_set(MBUS_ERR_CONNECT, "%s: failed to open tty %s: %s", __PRETTY_FUNCTION__, device, strerror(errno));
         fprintf(stderr, "%s: failed to open tty.", __PRETTY_FUNCTION__);
         return -1;
     }
@@ -61,24 +64,16 @@ mbus_serial_connect(mbus_handle *handle)
     term->c_cflag |= (CS8|CREAD|CLOCAL);
     term->c_cflag |= PARENB;
 
-    // No received data still OK
+    // Return the data available, no data still OK. The timing is not left to
+    // VTIME: its 1/10 sec units are far longer than the protocol needs at
+    // most baud rates, see mbus_serial_recv_timeout and
+    // mbus_serial_byte_timeout.
     term->c_cc[VMIN] = (cc_t) 0;
-
-    // Wait at most 0.2 sec.Note that it starts after first received byte!!
-    // I.e. if CMIN>0 and there are no data we would still wait forever...
-    //
-    // The specification mentions link layer response timeout this way:
-    // The time structure of various link layer communication types is described in EN60870-5-1. The answer time
-    // between the end of a master send telegram and the beginning of the response telegram of the slave shall be
-    // between 11 bit times and (330 bit times + 50ms).
-    //
-    // For 2400Bd this means (330 + 11) / 2400 + 0.05 = 188.75 ms (added 11 bit periods to receive first byte).
-    // I.e. timeout of 0.2s seems appropriate for 2400Bd.
-
-    term->c_cc[VTIME] = (cc_t) 2; // Timeout in 1/10 sec
+    term->c_cc[VTIME] = (cc_t) 0;
 
     cfsetispeed(term, B2400);
     cfsetospeed(term, B2400);
+    serial_data->baudrate = 2400;
 
 #ifdef MBUS_SERIAL_DEBUG
     printf("%s: t.c_cflag = %x\n", __PRETTY_FUNCTION__, term->c_cflag);
@@ -113,42 +108,34 @@ mbus_serial_set_baudrate(mbus_handle *handle, long baudrate)
     {
         case 300:
             speed = B300;
-            serial_data->t.c_cc[VTIME] = (cc_t) 12; // Timeout in 1/10 sec
             break;
 
         case 600:
             speed = B600;
-            serial_data->t.c_cc[VTIME] = (cc_t) 6;  // Timeout in 1/10 sec
             break;
 
         case 1200:
             speed = B1200;
-            serial_data->t.c_cc[VTIME] = (cc_t) 4;  // Timeout in 1/10 sec
             break;
 
         case 2400:
             speed = B2400;
-            serial_data->t.c_cc[VTIME] = (cc_t) 2;  // Timeout in 1/10 sec
             break;
 
         case 4800:
             speed = B4800;
-            serial_data->t.c_cc[VTIME] = (cc_t) 2;  // Timeout in 1/10 sec
             break;
 
         case 9600:
             speed = B9600;
-            serial_data->t.c_cc[VTIME] = (cc_t) 1;  // Timeout in 1/10 sec
             break;
 
         case 19200:
             speed = B19200;
-            serial_data->t.c_cc[VTIME] = (cc_t) 1;  // Timeout in 1/10 sec
             break;
 
         case 38400:
             speed = B38400;
-            serial_data->t.c_cc[VTIME] = (cc_t) 1;  // Timeout in 1/10 sec
             break;
 
        default:
@@ -173,6 +160,8 @@ mbus_serial_set_baudrate(mbus_handle *handle, long baudrate)
         return -1;
     }
 
+    serial_data->baudrate = baudrate;
+
     return 0;
 }
 
@@ -235,6 +224,7 @@ mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame)
 
     if ((len = mbus_frame_pack(frame, buff, sizeof(buff))) == -1)
     {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: mbus_frame_pack failed", __PRETTY_FUNCTION__);
         fprintf(stderr, "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
         return -1;
     }
@@ -257,9 +247,13 @@ mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame)
         //
         if (handle->send_event)
                 handle->send_event(MBUS_HANDLE_TYPE_SERIAL, buff, len);
+
+        if (handle->capture)
+            mbus_capture_handle_data(handle, MBUS_CAPTURE_SEND, buff, len);
     }
     else
     {
+        mbus_error_set(MBUS_ERR_SEND, "M-Bus serial transport layer failed to write frame (ret = %d: %s).", ret, strerror(errno));
         fprintf(stderr, "%s: Failed to write frame to socket (ret = %d: %s)\n", __PRETTY_FUNCTION__, ret, strerror(errno));
         return -1;
     }
@@ -278,9 +272,13 @@ mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame)
 int
 mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame)
 {
-    char buff[PACKET_BUFF_SIZE];
-    int remaining, timeouts;
-    ssize_t len, nread;
+    unsigned char buff[PACKET_BUFF_SIZE];
+    mbus_serial_data *serial_data;
+    mbus_parser parser;
+    int remaining, ready;
+    long timeout;
+    size_t len;
+    ssize_t nread;
 
     if (handle == NULL || frame == NULL)
     {
@@ -295,58 +293,68 @@ mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame)
         return MBUS_RECV_RESULT_ERROR;
     }
 
-    memset((void *)buff, 0, sizeof(buff));
+    if ((serial_data = (mbus_serial_data *) handle->auxdata) == NULL)
+    {
+        return MBUS_RECV_RESULT_ERROR;
+    }
+
+    mbus_parser_init(&parser, frame);
 
     //
-    // read data until a packet is received
+    // read data until a packet is received, starting with the bytes left
+    // over from the previous read. Wait for the first byte up to the response
+    // timeout, then for each further byte up to the inter-byte timeout: a
+    // longer silence ends the transmission.
     //
-    remaining = 1; // start by reading 1 byte
     len = 0;
-    timeouts = 0;
+    ready = 0;
 
-    do {
-        if (len + remaining > PACKET_BUFF_SIZE)
-        {
-            // avoid out of bounds access
-            return MBUS_RECV_RESULT_ERROR;
-        }
+    remaining = mbus_recv_buffer_parse(&serial_data->recv_buffer, &parser, buff, sizeof(buff), &len);
 
-        //printf("%s: Attempt to read %d bytes [len = %d]\n", __PRETTY_FUNCTION__, remaining, len);
+    while (remaining > 0)
+    {
+        timeout = (len == 0) ? mbus_serial_recv_timeout(handle) : mbus_serial_byte_timeout(handle);
 
-        if ((nread = read(handle->fd, &buff[len], remaining)) == -1)
+        if ((ready = mbus_recv_buffer_wait(&serial_data->recv_buffer, handle->fd, timeout)) == -1)
         {
-       //     fprintf(stderr, "%s: aborting recv frame (remaining = %d, len = %d, nread = %d)\n",
-         //          __PRETTY_FUNCTION__, remaining, len, nread);
+            mbus_error_set(MBUS_ERR_RECV, "M-Bus serial transport layer failed to wait for data: %s", strerror(errno));
             return MBUS_RECV_RESULT_ERROR;
         }
 
-//   printf("%s: Got %d byte [remaining %d, len %d]\n", __PRETTY_FUNCTION__, nread, remaining, len);
-
-        if (nread == 0)
+        if (ready == 0)
         {
-            timeouts++;
-
-            if (timeouts >= 3)
+            if (len > 0)
             {
-                // abort to avoid endless loop
+                mbus_error_set(MBUS_ERR_TIMEOUT, "M-Bus serial transport layer timeout within a frame.");
                 fprintf(stderr, "%s: Timeout\n", __PRETTY_FUNCTION__);
-                break;
             }
+            break;
         }
 
-        if (len > (SSIZE_MAX-nread))
+        if ((nread = mbus_recv_buffer_fill(&serial_data->recv_buffer, handle->fd)) == -1)
         {
-            // avoid overflow
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+
+            mbus_error_set(MBUS_ERR_RECV, "M-Bus serial transport layer failed to read data: %s", strerror(errno));
             return MBUS_RECV_RESULT_ERROR;
         }
 
-        len += nread;
+        if (nread == 0)
+        {
+            // readable but no data, e.g. the device was unplugged
+            mbus_error_set(MBUS_ERR_RECV, "M-Bus serial transport layer got no data from the device.");
+            break;
+        }
 
-    } while ((remaining = mbus_parse(frame, buff, len)) > 0);
+        remaining = mbus_recv_buffer_parse(&serial_data->recv_buffer, &parser, buff, sizeof(buff), &len);
+    }
 
     if (len == 0)
     {
         // No data received
+        if (ready == 0)
+            mbus_error_set(MBUS_ERR_TIMEOUT, "M-Bus serial transport layer response timeout has been reached.");
         return MBUS_RECV_RESULT_TIMEOUT;
     }
 
@@ -354,7 +362,10 @@ mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame)
     // call the receive event function, if the callback function is registered
     //
     if (handle->recv_event)
-        handle->recv_event(MBUS_HANDLE_TYPE_SERIAL, buff, len);
+        handle->recv_event(MBUS_HANDLE_TYPE_SERIAL, (const char *)buff, len);
+
+    if (handle->capture)
+        mbus_capture_handle_data(handle, MBUS_CAPTURE_RECV, buff, len);
 
     if (remaining != 0)
     {
@@ -363,12 +374,69 @@ mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame)
         return MBUS_RECV_RESULT_INVALID;
     }
 
-    if (len == -1)
+    return MBUS_RECV_RESULT_OK;
+}
+
+//------------------------------------------------------------------------------
+/// Wait until data is received or the timeout (in ms) expired.
+//------------------------------------------------------------------------------
+int
+mbus_serial_wait_recv(mbus_handle *handle, long timeout_ms)
+{
+    mbus_serial_data *serial_data;
+
+    if (handle == NULL || (serial_data = (mbus_serial_data *) handle->auxdata) == NULL)
+    {
+        return -1;
+    }
+
+    return mbus_recv_buffer_wait(&serial_data->recv_buffer, handle->fd, timeout_ms);
+}
+
+//------------------------------------------------------------------------------
+/// Return the time (ms) to wait for the reply of a slave: the link layer
+/// response timeout of 330 bit times + 50ms, plus 11 bit times to receive the
+/// first byte. The answer time between the end of a master send telegram and
+/// the beginning of the response telegram of the slave shall be between 11
+/// bit times and (330 bit times + 50ms) (EN 60870-5-1), i.e. 193 ms at 2400
+/// baud, 86 ms at 9600 baud.
+//------------------------------------------------------------------------------
+long
+mbus_serial_recv_timeout(mbus_handle *handle)
+{
+    mbus_serial_data *serial_data;
+    long baudrate = 2400;
+
+    if (handle && (serial_data = (mbus_serial_data *) handle->auxdata) != NULL)
     {
-        fprintf(stderr, "%s: M-Bus layer failed to parse data.\n", __PRETTY_FUNCTION__);
-        return MBUS_RECV_RESULT_ERROR;
+        if (serial_data->response_timeout > 0)
+            return serial_data->response_timeout;
+
+        if (serial_data->baudrate > 0)
+            baudrate = serial_data->baudrate;
     }
 
-    return MBUS_RECV_RESULT_OK;
+    return ((330 + 11) * 1000 + baudrate - 1) / baudrate + 50;
 }
 
+//------------------------------------------------------------------------------
+/// Return the longest gap (ms) between two bytes of a reply: a line silence of
+/// 33 bit times ends a transmission, plus the latency of the serial adapter.
+//------------------------------------------------------------------------------
+long
+mbus_serial_byte_timeout(mbus_handle *handle)
+{
+    mbus_serial_data *serial_data;
+    long baudrate = 2400;
+
+    if (handle && (serial_data = (mbus_serial_data *) handle->auxdata) != NULL)
+    {
+        if (serial_data->byte_timeout > 0)
+            return serial_data->byte_timeout;
+
+        if (serial_data->baudrate > 0)
+            baudrate = serial_data->baudrate;
+    }
+
+    return (MBUS_INTER_FRAME_GAP_BITS * 1000 + baudrate - 1) / baudrate + MBUS_SERIAL_LATENCY_MS;
+}
@@ -27,16 +27,28 @@ extern "C" {
 #endif
 
 
+// line silence that ends a transmission (EN 13757-2) and the latency added by
+// serial adapters (e.g. USB), see mbus_serial_byte_timeout
+#define MBUS_INTER_FRAME_GAP_BITS 33
+#define MBUS_SERIAL_LATENCY_MS    20
+
 typedef struct _mbus_serial_data
 {
     char *device;
     struct termios t;
+    long baudrate;
+    long response_timeout; // ms, 0 derives it from the baudrate
+    long byte_timeout;     // ms, 0 derives it from the baudrate
+    mbus_recv_buffer recv_buffer;
 } mbus_serial_data;
 
 int  mbus_serial_connect(mbus_handle *handle);
 int  mbus_serial_disconnect(mbus_handle *handle);
 int  mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame);
 int  mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame);
+int  mbus_serial_wait_recv(mbus_handle *handle, long timeout_ms);
+long mbus_serial_recv_timeout(mbus_handle *handle);
+long mbus_serial_byte_timeout(mbus_handle *handle);
 int  mbus_serial_set_baudrate(mbus_handle *handle, long baudrate);
 void mbus_serial_data_free(mbus_handle *handle);
 
@@ -0,0 +1,932 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "mbus-sim.h"
+#include "mbus-capture.h"
+
+#define PACKET_BUFF_SIZE MBUS_SIM_PACKET_SIZE
+
+// M-Bus control field without the FCB/FCV bits
+#define MBUS_SIM_CONTROL_MASK   0xCF
+
+// Maximum number of replies that collide on the bus
+#define MBUS_SIM_MAX_REPLIES    16
+
+//------------------------------------------------------------------------------
+/// Next number of the pseudo random generator (xorshift32).
+//------------------------------------------------------------------------------
+static unsigned int
+mbus_sim_random(mbus_sim_bus *bus)
+{
+    unsigned int x = bus->random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return bus->random = x;
+}
+
+//------------------------------------------------------------------------------
+/// Let the simulated time pass (and the real time in realtime mode).
+//------------------------------------------------------------------------------
+static void
+mbus_sim_advance(mbus_sim_bus *bus, long long ns)
+{
+    struct timespec ts;
+
+    bus->time += ns;
+
+    if (bus->realtime && ns > 0)
+    {
+        ts.tv_sec = ns / 1000000000LL;
+        ts.tv_nsec = ns % 1000000000LL;
+
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+            ;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Transmission time (ns) of a number of bytes.
+//------------------------------------------------------------------------------
+static long long
+mbus_sim_byte_time(mbus_sim_bus *bus, size_t len)
+{
+    return (long long) len * 11 * 1000000000LL / bus->baudrate;
+}
+
+//------------------------------------------------------------------------------
+/// Receive timeout (ms) of the master, like mbus_serial_recv_timeout.
+//------------------------------------------------------------------------------
+static long
+mbus_sim_timeout(mbus_sim_bus *bus)
+{
+    if (bus->timeout > 0)
+        return bus->timeout;
+
+    return ((330 + 11) * 1000 + bus->baudrate - 1) / bus->baudrate + 50;
+}
+
+//------------------------------------------------------------------------------
+/// Send bytes over the bus: drop and corrupt bytes at the configured rates.
+/// Returns the number of bytes that arrive, the number of damaged bytes is
+/// added to *damaged.
+//------------------------------------------------------------------------------
+static size_t
+mbus_sim_transmit(mbus_sim_bus *bus, unsigned char *data, size_t len, size_t *damaged)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        if (bus->loss_rate > 0 && mbus_sim_random(bus) % 1000000 < (unsigned int) bus->loss_rate)
+        {
+            bus->stats.lost++;
+            (*damaged)++;
+            continue;
+        }
+
+        data[n] = data[i];
+
+        if (bus->corrupt_rate > 0 && mbus_sim_random(bus) % 1000000 < (unsigned int) bus->corrupt_rate)
+        {
+            data[n] ^= 1 << (mbus_sim_random(bus) % 8);
+            bus->stats.corrupted++;
+            (*damaged)++;
+        }
+
+        n++;
+    }
+
+    return n;
+}
+
+//------------------------------------------------------------------------------
+/// Append bytes to the receive buffer of the master, bytes that do not fit
+/// are lost.
+//------------------------------------------------------------------------------
+static void
+mbus_sim_deliver(mbus_sim_data *sim_data, const unsigned char *data, size_t len)
+{
+    mbus_recv_buffer *buffer = &sim_data->recv_buffer;
+    size_t i;
+
+    for (i = 0; i < len && buffer->count < sizeof(buffer->data); i++)
+    {
+        buffer->data[(buffer->head + buffer->count) % sizeof(buffer->data)] = data[i];
+        buffer->count++;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Put a reply on the bus, its first byte arrives at the master at the
+/// simulated time due. A reply that finds no room is lost.
+//------------------------------------------------------------------------------
+static void
+mbus_sim_queue(mbus_sim_data *sim_data, const unsigned char *data, size_t len, long long due)
+{
+    mbus_sim_reply *reply;
+
+    if (sim_data->pending_count >= MBUS_SIM_MAX_PENDING)
+    {
+        sim_data->bus->stats.lost += len;
+        return;
+    }
+
+    reply = &sim_data->pending[sim_data->pending_count++];
+
+    memcpy(reply->data, data, len);
+    reply->len = len;
+    reply->due = due;
+}
+
+//------------------------------------------------------------------------------
+/// Wait up to timeout (ns) for the next reply on the bus: let the clock run to
+/// the end of its transmission and deliver it to the master. Returns 1 if a
+/// reply arrived, 0 if the timeout passed.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_arrive(mbus_sim_data *sim_data, long long timeout)
+{
+    mbus_sim_bus *bus = sim_data->bus;
+    mbus_sim_reply *reply;
+    size_t i, next = 0;
+
+    for (i = 1; i < sim_data->pending_count; i++)
+    {
+        if (sim_data->pending[i].due < sim_data->pending[next].due)
+            next = i;
+    }
+
+    if (sim_data->pending_count == 0 || sim_data->pending[next].due > bus->time + timeout)
+    {
+        mbus_sim_advance(bus, timeout);
+        return 0;
+    }
+
+    reply = &sim_data->pending[next];
+
+    if (reply->due > bus->time)
+        mbus_sim_advance(bus, reply->due - bus->time);
+
+    mbus_sim_advance(bus, mbus_sim_byte_time(bus, reply->len));
+    mbus_sim_deliver(sim_data, reply->data, reply->len);
+
+    sim_data->pending[next] = sim_data->pending[--sim_data->pending_count];
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Reset the reply sequence of a slave.
+//------------------------------------------------------------------------------
+static void
+mbus_sim_slave_reset(mbus_sim_slave *slave)
+{
+    slave->current = 0;
+    slave->sent = 0;
+    slave->next_fcb = 1;
+}
+
+//------------------------------------------------------------------------------
+/// Check if the secondary address of a slave matches a select mask (F digits
+/// of the id and FF bytes of the other fields are wildcards).
+//------------------------------------------------------------------------------
+static int
+mbus_sim_slave_match(mbus_sim_slave *slave, const unsigned char *mask)
+{
+    int i;
+
+    if (!slave->has_secondary)
+        return 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        if ((mask[i] & 0xF0) != 0xF0 && (mask[i] & 0xF0) != (slave->secondary[i] & 0xF0))
+            return 0;
+
+        if ((mask[i] & 0x0F) != 0x0F && (mask[i] & 0x0F) != (slave->secondary[i] & 0x0F))
+            return 0;
+    }
+
+    for (i = 4; i < 8; i++)
+    {
+        if (mask[i] != 0xFF && mask[i] != slave->secondary[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Baudrate a switch baudrate request (CI 0xB8 - 0xBF) asks for, 0 for other
+/// requests.
+//------------------------------------------------------------------------------
+static long
+mbus_sim_switch_baudrate(const mbus_frame *request)
+{
+    static const long baudrates[] = { 300, 600, 1200, 2400, 4800, 9600, 19200, 38400 };
+
+    if (request->control_information < MBUS_CONTROL_INFO_SET_BAUDRATE_300 ||
+        request->control_information > MBUS_CONTROL_INFO_SET_BAUDRATE_38400)
+    {
+        return 0;
+    }
+
+    return baudrates[request->control_information - MBUS_CONTROL_INFO_SET_BAUDRATE_300];
+}
+
+//------------------------------------------------------------------------------
+/// Check if a slave is addressed by a request.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_slave_addressed(mbus_sim_slave *slave, int address)
+{
+    if (address == MBUS_ADDRESS_NETWORK_LAYER)
+        return slave->selected;
+
+    if (address == MBUS_ADDRESS_BROADCAST_REPLY || address == MBUS_ADDRESS_BROADCAST_NOREPLY)
+        return 1;
+
+    return slave->primary == address;
+}
+
+//------------------------------------------------------------------------------
+/// Pack the reply of a slave to REQ_UD2 into buff, returns its length.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_slave_reply(mbus_sim_slave *slave, const mbus_frame *request, unsigned char *buff, size_t buff_size)
+{
+    mbus_frame reply;
+    int fcb;
+
+    if (slave->frame_count == 0)
+    {
+        buff[0] = MBUS_FRAME_ACK_START;
+        return 1;
+    }
+
+    if (request->control & MBUS_CONTROL_MASK_FCV)
+    {
+        fcb = (request->control & MBUS_CONTROL_MASK_FCB) ? 1 : 0;
+
+        if (fcb == slave->next_fcb)
+        {
+            // new request: the previous reply arrived, continue the sequence
+            if (slave->sent)
+                slave->current = (slave->current + 1) % slave->frame_count;
+
+            slave->next_fcb = !fcb;
+            slave->sent = 1;
+        }
+        // else: repeated request, send the same frame again
+    }
+
+    reply = slave->frames[slave->current];
+    reply.next = NULL;
+
+    if (slave->primary != MBUS_SIM_NO_PRIMARY)
+        reply.address = slave->primary;
+
+    if (slave->patch_secondary && reply.data_size >= 8 &&
+        (reply.control_information == MBUS_CONTROL_INFO_RESP_VARIABLE ||
+         reply.control_information == MBUS_CONTROL_INFO_RESP_VARIABLE_MSB))
+    {
+        memcpy(reply.data, slave->secondary, 8);
+    }
+
+    return mbus_frame_pack(&reply, buff, buff_size);
+}
+
+//------------------------------------------------------------------------------
+/// Let the slaves process a request, put their (colliding) replies into
+/// reply and return its length. The latency (ms) of the slowest slave that
+/// answered is stored in *latency.
+//------------------------------------------------------------------------------
+static size_t
+mbus_sim_bus_request(mbus_sim_bus *bus, const mbus_frame *request, unsigned char *reply, size_t reply_size,
+                     long *latency)
+{
+    unsigned char buff[PACKET_BUFF_SIZE], byte;
+    mbus_sim_slave *slave;
+    size_t i, j, len = 0;
+    int control, address, select, replies = 0, n;
+    long baudrate;
+
+    control = request->control & MBUS_SIM_CONTROL_MASK;
+    address = request->address;
+
+    select = (control == (MBUS_CONTROL_MASK_SND_UD & MBUS_SIM_CONTROL_MASK) &&
+              address == MBUS_ADDRESS_NETWORK_LAYER &&
+              request->control_information == MBUS_CONTROL_INFO_SELECT_SLAVE &&
+              request->data_size >= 8);
+
+    for (i = 0; i < bus->slave_count; i++)
+    {
+        slave = bus->slaves[i];
+
+        // a request at another baudrate is noise to the slave
+        if (slave->baudrate != 0 && slave->baudrate != bus->baudrate)
+            continue;
+
+        if (select)
+        {
+            // slaves that do not match are deselected
+            slave->selected = mbus_sim_slave_match(slave, request->data);
+        }
+        else if (!mbus_sim_slave_addressed(slave, address))
+        {
+            continue;
+        }
+
+        switch (control)
+        {
+            case MBUS_CONTROL_MASK_SND_NKE:
+                mbus_sim_slave_reset(slave);
+
+                if (address == MBUS_ADDRESS_NETWORK_LAYER)
+                    slave->selected = 0;
+
+                buff[0] = MBUS_FRAME_ACK_START;
+                n = 1;
+                break;
+
+            case MBUS_CONTROL_MASK_REQ_UD2 & MBUS_SIM_CONTROL_MASK:
+                n = mbus_sim_slave_reply(slave, request, buff, sizeof(buff));
+                break;
+
+            case MBUS_CONTROL_MASK_SND_UD & MBUS_SIM_CONTROL_MASK:
+            case MBUS_CONTROL_MASK_REQ_UD1 & MBUS_SIM_CONTROL_MASK:
+                if (select && !slave->selected)
+                    continue;
+
+                if (!select && (baudrate = mbus_sim_switch_baudrate(request)) > 0)
+                {
+                    if (slave->max_baudrate > 0 && baudrate > slave->max_baudrate)
+                        continue;
+
+                    // the ACK still goes out at the old baudrate
+                    slave->baudrate = baudrate;
+                }
+
+                buff[0] = MBUS_FRAME_ACK_START;
+                n = 1;
+                break;
+
+            default:
+                continue; // no reply
+        }
+
+        if (address == MBUS_ADDRESS_BROADCAST_NOREPLY || n <= 0)
+            continue;
+
+        // wired AND of the replies, each further one skewed by one more bit,
+        // the idle line reads as 0xFF
+        for (j = 0; j < (size_t) n && j < reply_size; j++)
+        {
+            byte = buff[j];
+
+            if (replies > 0)
+            {
+                byte = (unsigned char) ((byte >> (replies % 8)) | (byte << (8 - replies % 8)));
+                reply[j] = (j < len) ? (reply[j] & byte) : byte;
+            }
+            else
+            {
+                reply[j] = byte;
+            }
+        }
+
+        if (j > len)
+            len = j;
+
+        // the slowest slave ends the reply
+        if (replies == 0 || (slave->latency >= 0 ? slave->latency : bus->latency) > *latency)
+            *latency = (slave->latency >= 0) ? slave->latency : bus->latency;
+
+        replies++;
+        bus->stats.replies++;
+    }
+
+    if (replies > 1)
+        bus->stats.collisions++;
+
+    return len;
+}
+
+//------------------------------------------------------------------------------
+// Allocate an empty bus.
+//------------------------------------------------------------------------------
+mbus_sim_bus *
+mbus_sim_bus_new(void)
+{
+    mbus_sim_bus *bus;
+
+    if ((bus = (mbus_sim_bus *) calloc(1, sizeof(mbus_sim_bus))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate bus.", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    bus->baudrate = 2400;
+    bus->random = 1;
+
+    return bus;
+}
+
+//------------------------------------------------------------------------------
+// Free a bus and its slaves.
+//------------------------------------------------------------------------------
+void
+mbus_sim_bus_free(mbus_sim_bus *bus)
+{
+    size_t i;
+
+    if (bus)
+    {
+        for (i = 0; i < bus->slave_count; i++)
+        {
+            free(bus->slaves[i]->frames);
+            free(bus->slaves[i]);
+        }
+
+        free(bus->slaves);
+        free(bus);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Set a bus option.
+//------------------------------------------------------------------------------
+int
+mbus_sim_bus_set_option(mbus_sim_bus *bus, mbus_sim_option option, long value)
+{
+    if (bus == NULL)
+        return -1;
+
+    switch (option)
+    {
+        case MBUS_SIM_OPTION_BAUDRATE:
+            if (value >= 300 && value <= 38400)
+            {
+                bus->baudrate = value;
+                return 0;
+            }
+            break;
+        case MBUS_SIM_OPTION_LATENCY:
+            if (value >= 0 && value <= 60000)
+            {
+                bus->latency = value;
+                return 0;
+            }
+            break;
+        case MBUS_SIM_OPTION_TIMEOUT:
+            if (value >= 0 && value <= 60000)
+            {
+                bus->timeout = value;
+                return 0;
+            }
+            break;
+        case MBUS_SIM_OPTION_LOSS_RATE:
+            if (value >= 0 && value <= 1000000)
+            {
+                bus->loss_rate = value;
+                return 0;
+            }
+            break;
+        case MBUS_SIM_OPTION_CORRUPT_RATE:
+            if (value >= 0 && value <= 1000000)
+            {
+                bus->corrupt_rate = value;
+                return 0;
+            }
+            break;
+        case MBUS_SIM_OPTION_SEED:
+            // xorshift must not start at 0
+            bus->random = (value != 0) ? (unsigned int) value : 1;
+            return 0;
+        case MBUS_SIM_OPTION_ECHO:
+            bus->echo = (value != 0);
+            return 0;
+        case MBUS_SIM_OPTION_REALTIME:
+            bus->realtime = (value != 0);
+            return 0;
+    }
+
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+// Simulated time of a bus.
+//------------------------------------------------------------------------------
+long long
+mbus_sim_bus_time(mbus_sim_bus *bus)
+{
+    return bus ? bus->time : 0;
+}
+
+//------------------------------------------------------------------------------
+// Let the slaves of a bus answer a raw request.
+//------------------------------------------------------------------------------
+int
+mbus_sim_bus_process(mbus_sim_bus *bus, const unsigned char *request, size_t len,
+                     unsigned char *reply, size_t reply_size)
+{
+    unsigned char buff[PACKET_BUFF_SIZE];
+    mbus_frame frame;
+    size_t n, damaged = 0;
+    long latency = 0;
+
+    if (bus == NULL || request == NULL || reply == NULL || len == 0 || len > sizeof(buff))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    memcpy(buff, request, len);
+
+    bus->stats.requests++;
+    mbus_sim_advance(bus, mbus_sim_byte_time(bus, len));
+
+    // a damaged request fails the checksum, no slave answers it
+    n = mbus_sim_transmit(bus, buff, len, &damaged);
+
+    if (damaged > 0)
+        return 0;
+
+    memset((void *)&frame, 0, sizeof(mbus_frame));
+
+    if (mbus_parse(&frame, buff, n) != 0)
+    {
+        mbus_error_set(MBUS_ERR_FRAME_INVALID, "%s: Invalid request frame.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((n = mbus_sim_bus_request(bus, &frame, reply, reply_size, &latency)) == 0)
+        return 0;
+
+    mbus_sim_advance(bus, (long long) latency * 1000000LL + mbus_sim_byte_time(bus, n));
+
+    return (int) mbus_sim_transmit(bus, reply, n, &damaged);
+}
+
+//------------------------------------------------------------------------------
+// Add a slave to a bus.
+//------------------------------------------------------------------------------
+mbus_sim_slave *
+mbus_sim_bus_add_slave(mbus_sim_bus *bus, int primary, const char *secondary)
+{
+    mbus_sim_slave *slave, **slaves;
+    mbus_frame select;
+
+    if (bus == NULL ||
+        (primary != MBUS_SIM_NO_PRIMARY && (primary < 0 || primary > 250)) ||
+        (secondary != NULL && !mbus_is_secondary_address(secondary)))
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid slave address.", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((slave = (mbus_sim_slave *) calloc(1, sizeof(mbus_sim_slave))) == NULL ||
+        (slaves = (mbus_sim_slave **) realloc(bus->slaves, (bus->slave_count + 1) * sizeof(mbus_sim_slave *))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate slave.", __PRETTY_FUNCTION__);
+        free(slave);
+        return NULL;
+    }
+
+    bus->slaves = slaves;
+    bus->slaves[bus->slave_count++] = slave;
+
+    slave->primary = primary;
+    slave->latency = -1;
+    mbus_sim_slave_reset(slave);
+
+    if (secondary)
+    {
+        // same byte order as in the select frame and the reply header
+        memset((void *)&select, 0, sizeof(mbus_frame));
+        mbus_frame_select_secondary_pack(&select, (char *) secondary);
+
+        memcpy(slave->secondary, select.data, 8);
+        slave->has_secondary = 1;
+        slave->patch_secondary = 1;
+    }
+
+    return slave;
+}
+
+//------------------------------------------------------------------------------
+// Append a reply frame to the sequence of a slave.
+//------------------------------------------------------------------------------
+int
+mbus_sim_slave_add_frame(mbus_sim_slave *slave, const unsigned char *data, size_t len)
+{
+    mbus_frame *frames, *frame;
+
+    if (slave == NULL || data == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((frames = (mbus_frame *) realloc(slave->frames, (slave->frame_count + 1) * sizeof(mbus_frame))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: Failed to allocate frame.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    slave->frames = frames;
+    frame = &frames[slave->frame_count];
+    memset((void *)frame, 0, sizeof(mbus_frame));
+
+    if (mbus_parse(frame, (unsigned char *) data, len) != 0)
+    {
+        mbus_error_set(MBUS_ERR_FRAME_INVALID, "%s: Invalid reply frame.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if (!slave->has_secondary && frame->type == MBUS_FRAME_TYPE_LONG && frame->data_size >= 8 &&
+        (frame->control_information == MBUS_CONTROL_INFO_RESP_VARIABLE ||
+         frame->control_information == MBUS_CONTROL_INFO_RESP_VARIABLE_MSB))
+    {
+        memcpy(slave->secondary, frame->data, 8);
+        slave->has_secondary = 1;
+    }
+
+    slave->frame_count++;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Append the reply frame of a hex file to the sequence of a slave.
+//------------------------------------------------------------------------------
+int
+mbus_sim_slave_load_hex(mbus_sim_slave *slave, const char *path)
+{
+    FILE *fp;
+    unsigned char raw_buff[4096], buff[4096];
+    size_t len;
+
+    if (slave == NULL || path == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_OTHER, "%s: Failed to open %s.", __PRETTY_FUNCTION__, path);
+        return -1;
+    }
+
+    len = fread(raw_buff, 1, sizeof(raw_buff), fp);
+    fclose(fp);
+
+    len = mbus_hex2bin(buff, sizeof(buff), raw_buff, len);
+
+    return mbus_sim_slave_add_frame(slave, buff, len);
+}
+
+//------------------------------------------------------------------------------
+/// Nothing to connect, only forget bytes left from a previous connection.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_connect(mbus_handle *handle)
+{
+    mbus_sim_data *sim_data;
+
+    if (handle == NULL || (sim_data = (mbus_sim_data *) handle->auxdata) == NULL)
+        return -1;
+
+    mbus_recv_buffer_reset(&sim_data->recv_buffer);
+    sim_data->pending_count = 0;
+
+    return 0;
+}
+
+static int
+mbus_sim_disconnect(mbus_handle *handle)
+{
+    return (handle == NULL || handle->auxdata == NULL) ? -1 : 0;
+}
+
+//------------------------------------------------------------------------------
+/// Send a frame over the bus, the replies of the slaves are queued for the
+/// master.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_send_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    unsigned char buff[PACKET_BUFF_SIZE], reply[PACKET_BUFF_SIZE];
+    mbus_sim_data *sim_data;
+    mbus_sim_bus *bus;
+    size_t len, damaged = 0;
+    long latency = 0;
+    int ret;
+
+    if (handle == NULL || frame == NULL || (sim_data = (mbus_sim_data *) handle->auxdata) == NULL)
+    {
+        return -1;
+    }
+
+    bus = sim_data->bus;
+
+    if ((ret = mbus_frame_pack(frame, buff, sizeof(buff))) < 0)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if (handle->send_event)
+        handle->send_event(MBUS_HANDLE_TYPE_SERIAL, (const char *) buff, ret);
+
+    if (handle->capture)
+        mbus_capture_handle_data(handle, MBUS_CAPTURE_SEND, buff, ret);
+
+    bus->stats.requests++;
+    mbus_sim_advance(bus, mbus_sim_byte_time(bus, ret));
+
+    if (bus->echo)
+        mbus_sim_deliver(sim_data, buff, ret);
+
+    // a damaged request fails the checksum, no slave answers it
+    mbus_sim_transmit(bus, buff, ret, &damaged);
+
+    if (damaged > 0)
+        return 0;
+
+    if ((len = mbus_sim_bus_request(bus, frame, reply, sizeof(reply), &latency)) > 0)
+    {
+        if ((len = mbus_sim_transmit(bus, reply, len, &damaged)) > 0)
+            mbus_sim_queue(sim_data, reply, len, bus->time + latency * 1000000LL);
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Receive the next frame sent by the slaves.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_recv_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    unsigned char buff[PACKET_BUFF_SIZE];
+    mbus_sim_data *sim_data;
+    mbus_parser parser;
+    int remaining;
+    size_t len = 0;
+
+    if (handle == NULL || frame == NULL || (sim_data = (mbus_sim_data *) handle->auxdata) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid parameter.", __PRETTY_FUNCTION__);
+        return MBUS_RECV_RESULT_ERROR;
+    }
+
+    mbus_parser_init(&parser, frame);
+
+    if (sim_data->recv_buffer.count == 0)
+        mbus_sim_arrive(sim_data, mbus_sim_timeout(sim_data->bus) * 1000000LL);
+
+    remaining = mbus_recv_buffer_parse(&sim_data->recv_buffer, &parser, buff, sizeof(buff), &len);
+
+    if (len == 0)
+    {
+        sim_data->bus->stats.timeouts++;
+
+        mbus_error_set(MBUS_ERR_TIMEOUT, "M-Bus simulation response timeout has been reached.");
+        return MBUS_RECV_RESULT_TIMEOUT;
+    }
+
+    if (handle->recv_event)
+        handle->recv_event(MBUS_HANDLE_TYPE_SERIAL, (const char *) buff, len);
+
+    if (handle->capture)
+        mbus_capture_handle_data(handle, MBUS_CAPTURE_RECV, buff, len);
+
+    if (remaining > 0)
+    {
+        // the rest of the frame never arrives
+        mbus_sim_advance(sim_data->bus, mbus_sim_timeout(sim_data->bus) * 1000000LL);
+        sim_data->bus->stats.timeouts++;
+
+        mbus_error_set(MBUS_ERR_FRAME_INVALID, "M-Bus simulation received an incomplete frame.");
+        return MBUS_RECV_RESULT_INVALID;
+    }
+
+    if (remaining < 0)
+    {
+        return MBUS_RECV_RESULT_INVALID;
+    }
+
+    return MBUS_RECV_RESULT_OK;
+}
+
+//------------------------------------------------------------------------------
+/// Switch the baudrate of the master, the slaves keep theirs.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_set_baudrate(mbus_handle *handle, long baudrate)
+{
+    mbus_sim_data *sim_data;
+    mbus_sim_bus *bus;
+    size_t i;
+
+    if (handle == NULL || (sim_data = (mbus_sim_data *) handle->auxdata) == NULL)
+        return -1;
+
+    bus = sim_data->bus;
+
+    for (i = 0; i < bus->slave_count; i++)
+    {
+        if (bus->slaves[i]->baudrate == 0)
+            bus->slaves[i]->baudrate = bus->baudrate;
+    }
+
+    return mbus_sim_bus_set_option(bus, MBUS_SIM_OPTION_BAUDRATE, baudrate);
+}
+
+//------------------------------------------------------------------------------
+/// Wait until data is received or the timeout (in ms) expired.
+//------------------------------------------------------------------------------
+static int
+mbus_sim_wait_recv(mbus_handle *handle, long timeout_ms)
+{
+    mbus_sim_data *sim_data;
+
+    if (handle == NULL || (sim_data = (mbus_sim_data *) handle->auxdata) == NULL)
+        return -1;
+
+    if (sim_data->recv_buffer.count > 0)
+        return 1;
+
+    return mbus_sim_arrive(sim_data, (long long) timeout_ms * 1000000LL);
+}
+
+static void
+mbus_sim_data_free(mbus_handle *handle)
+{
+    if (handle)
+    {
+        free(handle->auxdata);
+        handle->auxdata = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Allocate a handle for a simulated bus.
+//------------------------------------------------------------------------------
+mbus_handle *
+mbus_context_sim(mbus_sim_bus *bus)
+{
+    mbus_handle *handle;
+    mbus_sim_data *sim_data;
+
+    if (bus == NULL)
+    {
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: Invalid bus.", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((handle = (mbus_handle *) malloc(sizeof(mbus_handle))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((sim_data = (mbus_sim_data *) calloc(1, sizeof(mbus_sim_data))) == NULL)
+    {
+        mbus_error_set(MBUS_ERR_NO_MEMORY, "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
+        free(handle);
+        return NULL;
+    }
+
+    mbus_context_init(handle);
+    handle->auxdata = sim_data;
+    handle->open = mbus_sim_connect;
+    handle->close = mbus_sim_disconnect;
+    handle->recv = mbus_sim_recv_frame;
+    handle->wait_recv = mbus_sim_wait_recv;
+    handle->set_baudrate = mbus_sim_set_baudrate;
+    handle->send = mbus_sim_send_frame;
+    handle->free_auxdata = mbus_sim_data_free;
+
+    sim_data->bus = bus;
+
+    return handle;
+}
@@ -0,0 +1,265 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-sim.h
+ *
+ * @brief  Simulated M-Bus with slaves in the same process, for benchmarks and
+ *         regression tests of the request and scan functions without
+ *         hardware.
+ *
+ * A slave has a primary address, a secondary address and a sequence of reply
+ * frames (e.g. from test/test-frames). The slaves answer:
+ *
+ *  - SND_NKE with an ACK, restarting their reply sequence; SND_NKE to the
+ *    network layer address deselects them.
+ *  - REQ_UD2 with the next frame of the sequence if the FCB toggled, with the
+ *    previous frame again if not (multi-telegram replies).
+ *  - SND_UD select (CI 0x52) to the network layer address with an ACK if the
+ *    secondary address matches the mask, selecting them for requests to the
+ *    network layer address. Other SND_UD and REQ_UD1 with an ACK.
+ *  - SND_UD switch baudrate (CI 0xB8 - 0xBF) with an ACK if the slave supports
+ *    the baudrate (max_baudrate), switching to it afterwards. A slave only
+ *    hears requests sent at its baudrate; the master switches with
+ *    the set_baudrate function of the handle (the slaves keep theirs).
+ *
+ * If several slaves answer, their replies collide and are merged bit by bit
+ * (wired AND, each further slave skewed by one bit), so the master receives
+ * garbage. Bytes can get lost or corrupted at a configurable rate, using a
+ * seeded pseudo random generator, so every run is the same.
+ *
+ * The bus keeps a simulated clock that advances by the transmission time of
+ * every byte (11 bit at the baudrate), the response latency of the slaves and
+ * the receive timeout of the master whenever it waits in vain. By default no
+ * real time passes, so a scan of thousands of addresses takes milliseconds
+ * while mbus_sim_bus_time tells how long it would take on a real bus.
+ *
+ * A reply arrives at the master when its latency has passed. A master that
+ * stops waiting earlier receives it with a later request (like a slow slave
+ * on a real bus); replies of different requests are not merged.
+ *
+\verbatim
+mbus_sim_bus *bus = mbus_sim_bus_new();
+mbus_sim_slave *slave = mbus_sim_bus_add_slave(bus, 1, NULL);
+
+mbus_sim_slave_load_hex(slave, "test/test-frames/kamstrup_multical_601.hex");
+mbus_sim_bus_set_option(bus, MBUS_SIM_OPTION_LATENCY, 20);
+
+handle = mbus_context_sim(bus);
+mbus_connect(handle);
+mbus_sendrecv_request(handle, 1, &reply, 16);
+...
+mbus_context_free(handle);
+mbus_sim_bus_free(bus);
+\endverbatim
+ */
+
+#ifndef _MBUS_SIM_H_
+#define _MBUS_SIM_H_
+
+#include <stddef.h>
+
+#include "mbus-protocol.h"
+#include "mbus-protocol-aux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_SIM_NO_PRIMARY     -1  // slave only reachable by its secondary address
+#define MBUS_SIM_PACKET_SIZE    2048 // largest request or reply
+#define MBUS_SIM_MAX_PENDING    4   // replies on their way to the master
+
+/**
+ * Simulated slave
+ */
+typedef struct _mbus_sim_slave {
+    int primary;                /**< Primary address, MBUS_SIM_NO_PRIMARY for none */
+    unsigned char secondary[8]; /**< Secondary address (id, manufacturer, version, medium as sent) */
+    int has_secondary;          /**< secondary is known, the slave can be selected */
+    int patch_secondary;        /**< secondary was given, patch it into the reply frames */
+    mbus_frame *frames;         /**< Reply sequence */
+    size_t frame_count;         /**< Frames in the reply sequence */
+    size_t current;             /**< Frame of the sequence sent last */
+    int sent;                   /**< A frame of the sequence has been sent */
+    int next_fcb;               /**< FCB of the next new request (1 after SND_NKE) */
+    int selected;               /**< Selected by its secondary address */
+    long baudrate;              /**< Baudrate the slave listens at, 0 for the baudrate of the bus */
+    long max_baudrate;          /**< Highest baudrate the slave switches to, 0 for 38400 */
+    long latency;               /**< Response latency (ms), -1 (default) for the latency of the bus */
+} mbus_sim_slave;
+
+/**
+ * Bus statistics
+ */
+typedef struct _mbus_sim_stats {
+    unsigned long requests;     /**< Frames sent by the master */
+    unsigned long replies;      /**< Frames sent by slaves */
+    unsigned long collisions;   /**< Requests answered by more than one slave */
+    unsigned long timeouts;     /**< Receive timeouts of the master */
+    unsigned long lost;         /**< Lost bytes */
+    unsigned long corrupted;    /**< Corrupted bytes */
+} mbus_sim_stats;
+
+/**
+ * Simulated bus
+ */
+typedef struct _mbus_sim_bus {
+    mbus_sim_slave **slaves;
+    size_t slave_count;
+    long baudrate;              /**< Baudrate of the master, for the byte transmission time */
+    long latency;               /**< Response latency of the slaves (ms) */
+    long timeout;               /**< Receive timeout of the master (ms), 0 derives it from the baudrate */
+    long loss_rate;             /**< Lost bytes per million */
+    long corrupt_rate;          /**< Corrupted bytes per million */
+    int echo;                   /**< Echo the requests like a serial level converter */
+    int realtime;               /**< Let the simulated time really pass */
+    unsigned int random;        /**< State of the pseudo random generator */
+    long long time;             /**< Simulated time (ns) */
+    mbus_sim_stats stats;
+} mbus_sim_bus;
+
+/**
+ * Reply on its way to the master
+ */
+typedef struct _mbus_sim_reply {
+    unsigned char data[MBUS_SIM_PACKET_SIZE];
+    size_t len;
+    long long due;              /**< Simulated time of the first byte (ns) */
+} mbus_sim_reply;
+
+/**
+ * Transport data of a simulated bus handle
+ */
+typedef struct _mbus_sim_data {
+    mbus_sim_bus *bus;
+    mbus_recv_buffer recv_buffer; /**< Bytes that arrived at the master */
+    mbus_sim_reply pending[MBUS_SIM_MAX_PENDING]; /**< Replies still on the bus */
+    size_t pending_count;
+} mbus_sim_data;
+
+/**
+ * Bus options, see mbus_sim_bus_set_option
+ */
+typedef enum _mbus_sim_option {
+    MBUS_SIM_OPTION_BAUDRATE,     /**< baudrate, 300 - 38400 (default 2400) */
+    MBUS_SIM_OPTION_LATENCY,      /**< response latency of the slaves in ms (default 0) */
+    MBUS_SIM_OPTION_TIMEOUT,      /**< receive timeout in ms, 0 derives it from the baudrate like the serial transport */
+    MBUS_SIM_OPTION_LOSS_RATE,    /**< lost bytes per million */
+    MBUS_SIM_OPTION_CORRUPT_RATE, /**< corrupted bytes per million */
+    MBUS_SIM_OPTION_SEED,         /**< seed of the pseudo random generator (default 1) */
+    MBUS_SIM_OPTION_ECHO,         /**< non zero to echo the requests */
+    MBUS_SIM_OPTION_REALTIME      /**< non zero to sleep for the simulated time */
+} mbus_sim_option;
+
+/**
+ * Allocate an empty bus.
+ *
+ * @return Bus, NULL on errors.
+ */
+mbus_sim_bus *mbus_sim_bus_new(void);
+
+/**
+ * Free a bus and its slaves. Handles using the bus have to be freed first.
+ *
+ * @param bus Bus
+ */
+void mbus_sim_bus_free(mbus_sim_bus *bus);
+
+/**
+ * Set a bus option.
+ *
+ * @param bus    Bus
+ * @param option MBUS_SIM_OPTION_*
+ * @param value  Value
+ *
+ * @return Zero on success, -1 for invalid options or values.
+ */
+int mbus_sim_bus_set_option(mbus_sim_bus *bus, mbus_sim_option option, long value);
+
+/**
+ * Simulated time of a bus.
+ *
+ * @param bus Bus
+ *
+ * @return Nanoseconds since the bus was created.
+ */
+long long mbus_sim_bus_time(mbus_sim_bus *bus);
+
+/**
+ * Let the slaves of a bus answer a raw request, for transports outside of
+ * the library (e.g. a TCP gateway simulator). Bytes are lost and corrupted
+ * like on a handle and the simulated clock advances, but the caller has to
+ * pace the transmission itself.
+ *
+ * @param bus        Bus
+ * @param request    Raw request frame
+ * @param len        Length of the request
+ * @param reply      Buffer for the (colliding) replies of the slaves
+ * @param reply_size Size of the buffer
+ *
+ * @return Length of the reply, 0 if no slave answers, -1 if the request is no
+ *         valid frame.
+ */
+int mbus_sim_bus_process(mbus_sim_bus *bus, const unsigned char *request, size_t len,
+                         unsigned char *reply, size_t reply_size);
+
+/**
+ * Add a slave to a bus. Its fields (e.g. latency, max_baudrate) may be set
+ * afterwards.
+ *
+ * @param bus       Bus
+ * @param primary   Primary address (0 - 250), MBUS_SIM_NO_PRIMARY for none
+ * @param secondary Secondary address (16 digits), NULL to take it from the
+ *                  first reply frame
+ *
+ * @return Slave, NULL on errors.
+ */
+mbus_sim_slave *mbus_sim_bus_add_slave(mbus_sim_bus *bus, int primary, const char *secondary);
+
+/**
+ * Append a reply frame to the sequence of a slave. The address of the frame
+ * is replaced by the primary address of the slave, a variable data header by
+ * its secondary address.
+ *
+ * @param slave Slave
+ * @param data  Raw frame
+ * @param len   Length of the frame
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_sim_slave_add_frame(mbus_sim_slave *slave, const unsigned char *data, size_t len);
+
+/**
+ * Append the reply frame of a hex file (like the files in test/test-frames)
+ * to the sequence of a slave.
+ *
+ * @param slave Slave
+ * @param path  File name
+ *
+ * @return Zero on success, -1 on errors.
+ */
+int mbus_sim_slave_load_hex(mbus_sim_slave *slave, const char *path);
+
+/**
+ * Allocate a handle for a simulated bus. The bus is not owned by the handle.
+ * Simulated handles do not support the asynchronous requests (mbus-async.h).
+ *
+ * @param bus Bus
+ *
+ * @return Handle, NULL on errors.
+ */
+mbus_handle *mbus_context_sim(mbus_sim_bus *bus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_SIM_H_ */
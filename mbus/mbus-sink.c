@@ -0,0 +1,475 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "mbus-sink.h"
+#include "mbus-format.h"
+
+//------------------------------------------------------------------------------
+/// Make room for need bytes in a buffer sink, growing the buffer if allowed.
+//------------------------------------------------------------------------------
+static int
+mbus_sink_reserve(mbus_sink *sink, size_t need)
+{
+    size_t size;
+    char *buff;
+
+    if (sink->size - sink->len >= need)
+        return 0;
+
+    if (sink->fixed)
+        return -1;
+
+    size = (sink->size > 0) ? sink->size : MBUS_SINK_BUFFER_SIZE;
+
+    while (size - sink->len < need)
+        size *= 2;
+
+    if ((buff = (char *) realloc(sink->buff, size)) == NULL)
+    {
+        sink->error = 1;
+        return -1;
+    }
+
+    sink->buff = buff;
+    sink->size = size;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Pass data on to the file descriptor or callback of a sink.
+//------------------------------------------------------------------------------
+static int
+mbus_sink_pass(mbus_sink *sink, const char *data, size_t len)
+{
+    ssize_t ret;
+
+    if (sink->type == MBUS_SINK_TYPE_CALLBACK)
+    {
+        if (sink->write(sink->arg, data, len) != 0)
+        {
+            sink->error = 1;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    while (len > 0)
+    {
+        if ((ret = write(sink->fd, data, len)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            sink->error = 1;
+            return -1;
+        }
+
+        data += ret;
+        len  -= ret;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Pass the pending data of a fd/callback sink on.
+//------------------------------------------------------------------------------
+static int
+mbus_sink_drain(mbus_sink *sink)
+{
+    size_t len = sink->len;
+
+    sink->len = 0;
+
+    if (len == 0)
+        return 0;
+
+    return mbus_sink_pass(sink, sink->buff, len);
+}
+
+//------------------------------------------------------------------------------
+// Initialize a memory buffer sink.
+//------------------------------------------------------------------------------
+void
+mbus_sink_init_buffer(mbus_sink *sink, char *buff, size_t size)
+{
+    if (sink == NULL)
+        return;
+
+    sink->type  = MBUS_SINK_TYPE_BUFFER;
+    sink->error = 0;
+    sink->fixed = (buff != NULL);
+    sink->buff  = buff;
+    sink->len   = 0;
+    sink->size  = (buff != NULL) ? size : 0;
+    sink->file  = NULL;
+    sink->fd    = -1;
+    sink->write = NULL;
+    sink->arg   = NULL;
+
+    if (sink->size > 0)
+        sink->buff[0] = '\0';
+}
+
+//------------------------------------------------------------------------------
+// Initialize a sink writing to a stdio stream.
+//------------------------------------------------------------------------------
+void
+mbus_sink_init_file(mbus_sink *sink, FILE *file)
+{
+    mbus_sink_init_buffer(sink, NULL, 0);
+
+    if (sink == NULL)
+        return;
+
+    sink->type = MBUS_SINK_TYPE_FILE;
+    sink->file = file;
+}
+
+//------------------------------------------------------------------------------
+// Initialize a sink writing to a file descriptor.
+//------------------------------------------------------------------------------
+void
+mbus_sink_init_fd(mbus_sink *sink, int fd)
+{
+    mbus_sink_init_buffer(sink, NULL, 0);
+
+    if (sink == NULL)
+        return;
+
+    sink->type = MBUS_SINK_TYPE_FD;
+    sink->fd   = fd;
+    sink->buff = sink->chunk;
+    sink->size = sizeof(sink->chunk);
+}
+
+//------------------------------------------------------------------------------
+// Initialize a sink passing its data to a callback function.
+//------------------------------------------------------------------------------
+void
+mbus_sink_init_callback(mbus_sink *sink, mbus_sink_write_func write, void *arg)
+{
+    mbus_sink_init_buffer(sink, NULL, 0);
+
+    if (sink == NULL)
+        return;
+
+    sink->type  = MBUS_SINK_TYPE_CALLBACK;
+    sink->write = write;
+    sink->arg   = arg;
+    sink->buff  = sink->chunk;
+    sink->size  = sizeof(sink->chunk);
+}
+
+//------------------------------------------------------------------------------
+// Append data to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_sink_write(mbus_sink *sink, const char *data, size_t len)
+{
+    if (sink == NULL || sink->error)
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    switch (sink->type)
+    {
+        case MBUS_SINK_TYPE_FILE:
+
+            if (fwrite(data, 1, len, sink->file) != len)
+            {
+                sink->error = 1;
+                return -1;
+            }
+            return 0;
+
+        case MBUS_SINK_TYPE_BUFFER:
+
+            if (mbus_sink_reserve(sink, len + 1) != 0)
+            {
+                if (!sink->fixed || sink->size == 0)
+                    return sink->error ? -1 : 0;
+
+                // truncate the output to the caller supplied buffer
+                len = sink->size - sink->len - 1;
+            }
+
+            memcpy(sink->buff + sink->len, data, len);
+            sink->len += len;
+            sink->buff[sink->len] = '\0';
+            return 0;
+
+        default:
+
+            if (sink->size - sink->len < len)
+            {
+                if (mbus_sink_drain(sink) != 0)
+                    return -1;
+
+                if (len >= sink->size)
+                    return mbus_sink_pass(sink, data, len);
+            }
+
+            memcpy(sink->buff + sink->len, data, len);
+            sink->len += len;
+            return 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Append a zero terminated string to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_sink_puts(mbus_sink *sink, const char *str)
+{
+    if (str == NULL)
+        return -1;
+
+    return mbus_sink_write(sink, str, strlen(str));
+}
+
+//------------------------------------------------------------------------------
+// Append formatted output to a sink. The output is formatted directly into the
+// buffer of the sink, if it does not fit the buffer is grown (or drained) and
+// the output is formatted again.
+//------------------------------------------------------------------------------
+int
+mbus_sink_printf(mbus_sink *sink, const char *format, ...)
+{
+    va_list ap;
+    size_t avail;
+    char *tmp;
+    int n;
+
+    if (sink == NULL || sink->error)
+        return -1;
+
+    if (sink->type == MBUS_SINK_TYPE_FILE)
+    {
+        va_start(ap, format);
+        n = vfprintf(sink->file, format, ap);
+        va_end(ap);
+
+        if (n < 0)
+        {
+            sink->error = 1;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    avail = sink->size - sink->len;
+
+    va_start(ap, format);
+    n = vsnprintf((avail > 0) ? sink->buff + sink->len : NULL, avail, format, ap);
+    va_end(ap);
+
+    if (n < 0)
+    {
+        sink->error = 1;
+        return -1;
+    }
+
+    if ((size_t) n < avail)
+    {
+        sink->len += n;
+        return 0;
+    }
+
+    if (sink->type == MBUS_SINK_TYPE_BUFFER)
+    {
+        if (mbus_sink_reserve(sink, n + 1) != 0)
+        {
+            if (!sink->fixed)
+                return -1;
+
+            // vsnprintf already wrote the truncated output
+            sink->len = (sink->size > 0) ? sink->size - 1 : 0;
+            return 0;
+        }
+    }
+    else
+    {
+        if (mbus_sink_drain(sink) != 0)
+            return -1;
+
+        if ((size_t) n >= sink->size)
+        {
+            // larger than a chunk, pass it on directly
+            if ((tmp = (char *) malloc(n + 1)) == NULL)
+            {
+                sink->error = 1;
+                return -1;
+            }
+
+            va_start(ap, format);
+            vsnprintf(tmp, n + 1, format, ap);
+            va_end(ap);
+
+            n = mbus_sink_pass(sink, tmp, n);
+            free(tmp);
+            return n;
+        }
+    }
+
+    va_start(ap, format);
+    vsnprintf(sink->buff + sink->len, sink->size - sink->len, format, ap);
+    va_end(ap);
+
+    sink->len += n;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Append an integer in decimal to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_sink_put_int(mbus_sink *sink, long long value)
+{
+    char buff[MBUS_FORMAT_INT_SIZE];
+
+    return mbus_sink_write(sink, buff, mbus_format_int(value, buff));
+}
+
+//------------------------------------------------------------------------------
+// Append a double to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_sink_put_double(mbus_sink *sink, double value)
+{
+    char buff[MBUS_FORMAT_DOUBLE_SIZE];
+
+    return mbus_sink_write(sink, buff, mbus_format_double(value, buff));
+}
+
+//------------------------------------------------------------------------------
+// Pass pending data on.
+//------------------------------------------------------------------------------
+int
+mbus_sink_flush(mbus_sink *sink)
+{
+    if (sink == NULL)
+        return -1;
+
+    if (sink->error)
+        return -1;
+
+    switch (sink->type)
+    {
+        case MBUS_SINK_TYPE_FILE:
+
+            if (fflush(sink->file) != 0)
+                sink->error = 1;
+            break;
+
+        case MBUS_SINK_TYPE_FD:
+        case MBUS_SINK_TYPE_CALLBACK:
+
+            mbus_sink_drain(sink);
+            break;
+    }
+
+    return sink->error ? -1 : 0;
+}
+
+//------------------------------------------------------------------------------
+// Discard the data of a buffer sink.
+//------------------------------------------------------------------------------
+void
+mbus_sink_reset(mbus_sink *sink)
+{
+    if (sink == NULL)
+        return;
+
+    sink->error = 0;
+    sink->len = 0;
+
+    if (sink->type == MBUS_SINK_TYPE_BUFFER && sink->size > 0)
+        sink->buff[0] = '\0';
+}
+
+//------------------------------------------------------------------------------
+// Data of a buffer sink.
+//------------------------------------------------------------------------------
+char *
+mbus_sink_buffer(mbus_sink *sink, size_t *len)
+{
+    if (sink == NULL || sink->type != MBUS_SINK_TYPE_BUFFER)
+        return NULL;
+
+    // nothing written to a growing buffer yet
+    if (sink->size == 0)
+    {
+        if (mbus_sink_reserve(sink, 1) != 0)
+            return NULL;
+
+        sink->buff[0] = '\0';
+    }
+
+    if (len)
+        *len = sink->len;
+
+    return sink->buff;
+}
+
+//------------------------------------------------------------------------------
+// Take over the buffer of a growing buffer sink.
+//------------------------------------------------------------------------------
+char *
+mbus_sink_detach(mbus_sink *sink)
+{
+    char *buff;
+
+    if (sink == NULL || sink->type != MBUS_SINK_TYPE_BUFFER || sink->fixed)
+        return NULL;
+
+    if (sink->error || (buff = mbus_sink_buffer(sink, NULL)) == NULL)
+    {
+        mbus_sink_free(sink);
+        return NULL;
+    }
+
+    sink->buff = NULL;
+    sink->len  = 0;
+    sink->size = 0;
+
+    return buff;
+}
+
+//------------------------------------------------------------------------------
+// Flush a sink and free its buffer.
+//------------------------------------------------------------------------------
+void
+mbus_sink_free(mbus_sink *sink)
+{
+    if (sink == NULL)
+        return;
+
+    mbus_sink_flush(sink);
+
+    if (sink->type == MBUS_SINK_TYPE_BUFFER && !sink->fixed)
+    {
+        free(sink->buff);
+        sink->buff = NULL;
+        sink->len  = 0;
+        sink->size = 0;
+    }
+}
@@ -0,0 +1,225 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2011, Robert Johansson, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-sink.h
+ *
+ * @brief  Output sinks for the XML/JSON/InfluxDB writers.
+ *
+ * The *_sink variants of the writers append their output to a sink instead
+ * of returning a newly allocated string. A sink is either a buffer (grown on
+ * demand and reusable, or a fixed caller supplied buffer), a stdio stream, a
+ * file descriptor or a callback function:
+ *
+\verbatim
+mbus_sink sink;
+
+mbus_sink_init_buffer(&sink, NULL, 0);
+
+for (...)
+{
+    mbus_sink_reset(&sink);
+    mbus_frame_json_sink(&reply, 0, &sink);
+    ... use mbus_sink_buffer(&sink, &len) ...
+}
+
+mbus_sink_free(&sink);
+\endverbatim
+ */
+
+#ifndef _MBUS_SINK_H_
+#define _MBUS_SINK_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Sink types
+//
+#define MBUS_SINK_TYPE_BUFFER   0 // growing (or fixed) memory buffer
+#define MBUS_SINK_TYPE_FILE     1 // stdio stream
+#define MBUS_SINK_TYPE_FD       2 // file descriptor
+#define MBUS_SINK_TYPE_CALLBACK 3 // write callback
+
+#define MBUS_SINK_BUFFER_SIZE   8192 // initial size of a growing buffer
+#define MBUS_SINK_CHUNK_SIZE    4096 // data collected before a fd/callback write
+
+/**
+ * Write callback of a sink. Has to consume all len bytes of data.
+ *
+ * @return Zero on success, -1 on error.
+ */
+typedef int (*mbus_sink_write_func)(void *arg, const char *data, size_t len);
+
+/**
+ * Output sink
+ */
+typedef struct _mbus_sink {
+    int type;                   /**< MBUS_SINK_TYPE_* */
+    int error;                  /**< Set when a write failed (or memory ran out) */
+    char fixed;                 /**< Buffer is supplied by the caller and not grown */
+
+    char *buff;                 /**< Buffer (type BUFFER) or pending data */
+    size_t len;                 /**< Data in buff */
+    size_t size;                /**< Size of buff */
+
+    FILE *file;                 /**< Stream (type FILE) */
+    int fd;                     /**< File descriptor (type FD) */
+    mbus_sink_write_func write; /**< Callback (type CALLBACK) */
+    void *arg;                  /**< Argument of the callback */
+
+    char chunk[MBUS_SINK_CHUNK_SIZE]; /**< Pending data of fd/callback sinks */
+} mbus_sink;
+
+/**
+ * Initialize a memory buffer sink. The buffer is always zero terminated.
+ *
+ * @param sink Sink
+ * @param buff Caller supplied buffer, output is truncated to its size. NULL
+ *             for a buffer that is allocated and grown on demand.
+ * @param size Size of buff
+ */
+void mbus_sink_init_buffer(mbus_sink *sink, char *buff, size_t size);
+
+/**
+ * Initialize a sink writing to a stdio stream.
+ *
+ * @param sink Sink
+ * @param file Stream
+ */
+void mbus_sink_init_file(mbus_sink *sink, FILE *file);
+
+/**
+ * Initialize a sink writing to a file descriptor. Data is collected and
+ * written in chunks, call mbus_sink_flush when done.
+ *
+ * @param sink Sink
+ * @param fd   File descriptor
+ */
+void mbus_sink_init_fd(mbus_sink *sink, int fd);
+
+/**
+ * Initialize a sink passing its data to a callback function. Data is
+ * collected and passed in chunks, call mbus_sink_flush when done.
+ *
+ * @param sink  Sink
+ * @param write Callback
+ * @param arg   Argument passed to the callback
+ */
+void mbus_sink_init_callback(mbus_sink *sink, mbus_sink_write_func write, void *arg);
+
+/**
+ * Append data to a sink.
+ *
+ * @param sink Sink
+ * @param data Data
+ * @param len  Length of data
+ *
+ * @return Zero on success, -1 on error.
+ */
+int mbus_sink_write(mbus_sink *sink, const char *data, size_t len);
+
+/**
+ * Append a zero terminated string to a sink.
+ *
+ * @param sink Sink
+ * @param str  String
+ *
+ * @return Zero on success, -1 on error.
+ */
+int mbus_sink_puts(mbus_sink *sink, const char *str);
+
+/**
+ * Append formatted output to a sink.
+ *
+ * @param sink   Sink
+ * @param format printf format
+ *
+ * @return Zero on success, -1 on error.
+ */
+int mbus_sink_printf(mbus_sink *sink, const char *format, ...)
+#ifdef __GNUC__
+    __attribute__ ((format (printf, 2, 3)))
+#endif
+    ;
+
+/**
+ * Append an integer in decimal to a sink.
+ *
+ * @param sink  Sink
+ * @param value Value
+ *
+ * @return Zero on success, -1 on error.
+ */
+int mbus_sink_put_int(mbus_sink *sink, long long value);
+
+/**
+ * Append a double to a sink, see mbus_format_double.
+ *
+ * @param sink  Sink
+ * @param value Value
+ *
+ * @return Zero on success, -1 on error.
+ */
+int mbus_sink_put_double(mbus_sink *sink, double value);
+
+/**
+ * Pass pending data of fd/callback sinks on, flush stdio streams.
+ *
+ * @param sink Sink
+ *
+ * @return Zero on success, -1 if a write failed.
+ */
+int mbus_sink_flush(mbus_sink *sink);
+
+/**
+ * Discard the data of a buffer sink (keeping the allocated memory) and clear
+ * the error state.
+ *
+ * @param sink Sink
+ */
+void mbus_sink_reset(mbus_sink *sink);
+
+/**
+ * Data of a buffer sink.
+ *
+ * @param sink Sink
+ * @param len  Length of the data (if not NULL)
+ *
+ * @return Zero terminated data, NULL if the sink is not a buffer sink.
+ */
+char *mbus_sink_buffer(mbus_sink *sink, size_t *len);
+
+/**
+ * Take over the allocated buffer of a growing buffer sink. The sink is empty
+ * afterwards.
+ *
+ * @param sink Sink
+ *
+ * @return Zero terminated data to be freed by the caller, NULL on errors.
+ */
+char *mbus_sink_detach(mbus_sink *sink);
+
+/**
+ * Flush a sink and free its allocated buffer.
+ *
+ * @param sink Sink
+ */
+void mbus_sink_free(mbus_sink *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MBUS_SINK_H_ */
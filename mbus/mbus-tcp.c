@@ -14,6 +14,8 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <poll.h>
+#include <time.h>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -25,6 +27,7 @@
 #include <errno.h>
 
 #include "mbus-tcp.h"
+#include "mbus-capture.h"
 
 #define PACKET_BUFF_SIZE 2048
 
@@ -32,17 +35,158 @@ static int tcp_timeout_sec = 4;
 static int tcp_timeout_usec = 0;
 
 //------------------------------------------------------------------------------
-/// Setup a TCP/IP handle.
+/// Return the effective timeout (ms) for a per-handle timeout setting, 0
+/// selects the default set with mbus_tcp_set_timeout_set.
 //------------------------------------------------------------------------------
-int
-mbus_tcp_connect(mbus_handle *handle)
+static long
+mbus_tcp_timeout(long timeout_ms)
+{
+    if (timeout_ms > 0)
+        return timeout_ms;
+
+    return (long)tcp_timeout_sec * 1000 + tcp_timeout_usec / 1000;
+}
+
+//------------------------------------------------------------------------------
+/// Return the time (ms) left until the deadline start + timeout_ms is
+/// reached, or -1 (wait forever) if no timeout is used.
+//------------------------------------------------------------------------------
+static int
+mbus_tcp_remaining(const struct timespec *start, long timeout_ms)
+{
+    struct timespec now;
+    long elapsed;
+
+    if (timeout_ms <= 0)
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    elapsed = (now.tv_sec - start->tv_sec) * 1000 +
+              (now.tv_nsec - start->tv_nsec) / 1000000;
+
+    if (elapsed >= timeout_ms)
+        return 0;
+
+    return (int)(timeout_ms - elapsed);
+}
+
+//------------------------------------------------------------------------------
+/// Start to connect a new non-blocking socket to the given address. Returns
+/// 0 if the socket is connected, 1 if the connection is being established
+/// (the socket becomes writable when done) or -1 with errno set.
+//------------------------------------------------------------------------------
+static int
+mbus_tcp_connect_addr(const struct addrinfo *ai, int *fd)
+{
+    int flags, err;
+
+    if ((*fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+        return -1;
+
+    if ((flags = fcntl(*fd, F_GETFL, 0)) < 0 ||
+        fcntl(*fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        err = errno;
+    }
+    else if (connect(*fd, ai->ai_addr, ai->ai_addrlen) == 0)
+    {
+        return 0;
+    }
+    else if ((err = errno) == EINPROGRESS)
+    {
+        return 1;
+    }
+
+    close(*fd);
+    *fd = -1;
+    errno = err;
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+/// Set up a connected socket for the handle: blocking mode, read and write
+/// timeouts. Returns 0 on success or -1 with errno set.
+//------------------------------------------------------------------------------
+static int
+mbus_tcp_connected(mbus_handle *handle, mbus_tcp_data *tcp_data)
 {
-    char error_str[128], *host;
-    struct hostent *host_addr;
-    struct sockaddr_in s;
     struct timeval time_out;
+    long timeout;
+    int flags;
+
+    if ((flags = fcntl(handle->fd, F_GETFL, 0)) < 0 ||
+        fcntl(handle->fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+    {
+        return -1;
+    }
+
+    freeaddrinfo(tcp_data->addr_list);
+    tcp_data->addr_list = NULL;
+    tcp_data->addr_next = NULL;
+
+    // Set the read and write timeouts
+    timeout = mbus_tcp_timeout(tcp_data->read_timeout);
+    time_out.tv_sec  = timeout / 1000;
+    time_out.tv_usec = (timeout % 1000) * 1000;
+    setsockopt(handle->fd, SOL_SOCKET, SO_RCVTIMEO, &time_out, sizeof(time_out));
+
+    timeout = mbus_tcp_timeout(tcp_data->write_timeout);
+    time_out.tv_sec  = timeout / 1000;
+    time_out.tv_usec = (timeout % 1000) * 1000;
+    setsockopt(handle->fd, SOL_SOCKET, SO_SNDTIMEO, &time_out, sizeof(time_out));
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Try the remaining addresses of the host until a connection is established
+/// or in progress (see mbus_tcp_connect_start).
+//------------------------------------------------------------------------------
+static int
+mbus_tcp_connect_next(mbus_handle *handle, mbus_tcp_data *tcp_data, int err)
+{
+    const struct addrinfo *ai;
+    int ret;
+
+    while ((ai = tcp_data->addr_next) != NULL)
+    {
+        tcp_data->addr_next = ai->ai_next;
+
+        if ((ret = mbus_tcp_connect_addr(ai, &handle->fd)) == 1)
+            return 1;
+
+        if (ret == 0 && mbus_tcp_connected(handle, tcp_data) == 0)
+            return 0;
+
+        err = errno;
+
+        if (ret == 0)
+        {
+            close(handle->fd);
+            handle->fd = -1;
+        }
+    }
+
+    freeaddrinfo(tcp_data->addr_list);
+    tcp_data->addr_list = NULL;
+
+    mbus_error_set(err == ETIMEDOUT ? MBUS_ERR_TIMEOUT : MBUS_ERR_CONNECT,
+                   "%s: Failed to establish connection to %s:%d (%s)",
+                   __PRETTY_FUNCTION__, tcp_data->host, tcp_data->port, strerror(err));
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+/// Start to set up a TCP/IP handle without waiting for the connection.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_connect_start(mbus_handle *handle)
+{
+    char port_str[8];
+    struct addrinfo hints;
     mbus_tcp_data *tcp_data;
-    uint16_t port;
+    int ret;
 
     if (handle == NULL)
         return -1;
@@ -51,46 +195,164 @@ mbus_tcp_connect(mbus_handle *handle)
     if (tcp_data == NULL || tcp_data->host == NULL)
         return -1;
 
-    host = tcp_data->host;
-    port = tcp_data->port;
+    mbus_recv_buffer_reset(&(tcp_data->recv_buffer));
 
-    //
-    // create the TCP connection
-    //
-    if ((handle->fd = socket(AF_INET,SOCK_STREAM, 0)) < 0)
+    if (tcp_data->addr_list)
     {
-        snprintf(error_str, sizeof(error_str), "%s: failed to setup a socket.", __PRETTY_FUNCTION__);
-        mbus_error_str_set(error_str);
+        // a previous attempt was not finished
+        freeaddrinfo(tcp_data->addr_list);
+        tcp_data->addr_list = NULL;
+    }
+
+    /* resolve hostname, IPv4 and IPv6 */
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    snprintf(port_str, sizeof(port_str), "%u", tcp_data->port);
+
+    if ((ret = getaddrinfo(tcp_data->host, port_str, &hints, &tcp_data->addr_list)) != 0)
+    {
+        tcp_data->addr_list = NULL;
+        mbus_error_set(MBUS_ERR_CONNECT, "%s: unknown host: %s (%s)", __PRETTY_FUNCTION__, tcp_data->host, gai_strerror(ret));
         return -1;
     }
 
-    s.sin_family = AF_INET;
-    s.sin_port = htons(port);
+    tcp_data->addr_next = tcp_data->addr_list;
+    handle->fd = -1;
+
+    return mbus_tcp_connect_next(handle, tcp_data, ECONNREFUSED);
+}
 
-    /* resolve hostname */
-    if ((host_addr = gethostbyname(host)) == NULL)
+//------------------------------------------------------------------------------
+/// Continue to set up a TCP/IP handle once the socket became writable.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_connect_finish(mbus_handle *handle)
+{
+    mbus_tcp_data *tcp_data;
+    socklen_t len;
+    int err = 0;
+
+    if (handle == NULL || (tcp_data = (mbus_tcp_data *) handle->auxdata) == NULL ||
+        tcp_data->addr_list == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: unknown host: %s", __PRETTY_FUNCTION__, host);
-        mbus_error_str_set(error_str);
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: No connection in progress.", __PRETTY_FUNCTION__);
         return -1;
     }
 
-    memcpy((void *)(&s.sin_addr), (void *)(host_addr->h_addr), host_addr->h_length);
+    len = sizeof(err);
+
+    if (getsockopt(handle->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        err = errno;
+
+    if (err == 0 && mbus_tcp_connected(handle, tcp_data) == 0)
+        return 0;
+
+    if (err == 0)
+        err = errno;
+
+    close(handle->fd);
+    handle->fd = -1;
+
+    // try the next address of the host
+    return mbus_tcp_connect_next(handle, tcp_data, err);
+}
 
-    if (connect(handle->fd, (struct sockaddr *)&s, sizeof(s)) < 0)
+//------------------------------------------------------------------------------
+/// Give up setting up a TCP/IP handle.
+//------------------------------------------------------------------------------
+void
+mbus_tcp_connect_abort(mbus_handle *handle)
+{
+    mbus_tcp_data *tcp_data;
+
+    if (handle == NULL || (tcp_data = (mbus_tcp_data *) handle->auxdata) == NULL ||
+        tcp_data->addr_list == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: Failed to establish connection to %s:%d", __PRETTY_FUNCTION__, host, port);
-        mbus_error_str_set(error_str);
+        return;
+    }
+
+    freeaddrinfo(tcp_data->addr_list);
+    tcp_data->addr_list = NULL;
+    tcp_data->addr_next = NULL;
+
+    close(handle->fd);
+    handle->fd = -1;
+}
+
+//------------------------------------------------------------------------------
+/// Setup a TCP/IP handle.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_connect(mbus_handle *handle)
+{
+    struct pollfd pfd;
+    struct timespec start;
+    mbus_tcp_data *tcp_data;
+    long timeout;
+    int ret;
+
+    if (handle == NULL)
+        return -1;
+
+    tcp_data = (mbus_tcp_data *) handle->auxdata;
+    if (tcp_data == NULL || tcp_data->host == NULL)
         return -1;
+
+    //
+    // create the TCP connection, trying all addresses of the host until the
+    // connect timeout is reached
+    //
+    timeout = mbus_tcp_timeout(tcp_data->connect_timeout);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ret = mbus_tcp_connect_start(handle);
+
+    while (ret == 1)
+    {
+        // connection is being established, wait until the socket becomes
+        // writable or the deadline is reached
+        pfd.fd = handle->fd;
+        pfd.events = POLLOUT;
+
+        if ((ret = poll(&pfd, 1, mbus_tcp_remaining(&start, timeout))) < 0 && errno == EINTR)
+        {
+            ret = 1;
+            continue;
+        }
+
+        if (ret <= 0)
+        {
+            mbus_error_set(ret == 0 ? MBUS_ERR_TIMEOUT : MBUS_ERR_CONNECT,
+                           "%s: Failed to establish connection to %s:%d (%s)",
+                           __PRETTY_FUNCTION__, tcp_data->host, tcp_data->port,
+                           strerror(ret == 0 ? ETIMEDOUT : errno));
+            mbus_tcp_connect_abort(handle);
+            return -1;
+        }
+
+        ret = mbus_tcp_connect_finish(handle);
     }
 
-    // Set a timeout
-    time_out.tv_sec  = tcp_timeout_sec;   // seconds
-    time_out.tv_usec = tcp_timeout_usec;  // microseconds
-    setsockopt(handle->fd, SOL_SOCKET, SO_SNDTIMEO, &time_out, sizeof(time_out));
-    setsockopt(handle->fd, SOL_SOCKET, SO_RCVTIMEO, &time_out, sizeof(time_out));
+    return ret;
+}
 
-    return 0;
+//------------------------------------------------------------------------------
+/// Return the time (ms) to wait for a connection to the gateway.
+//------------------------------------------------------------------------------
+long
+mbus_tcp_connect_timeout(mbus_handle *handle)
+{
+    mbus_tcp_data *tcp_data;
+
+    if (handle == NULL || (tcp_data = (mbus_tcp_data *) handle->auxdata) == NULL)
+    {
+        return mbus_tcp_timeout(0);
+    }
+
+    return mbus_tcp_timeout(tcp_data->connect_timeout);
 }
 
 //------------------------------------------------------------------------------
@@ -110,6 +372,8 @@ mbus_tcp_data_free(mbus_handle *handle)
             return;
         }
 
+        if (tcp_data->addr_list)
+            freeaddrinfo(tcp_data->addr_list);
         free(tcp_data->host);
         free(tcp_data);
         handle->auxdata = NULL;
@@ -140,7 +404,6 @@ mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame)
 {
     unsigned char buff[PACKET_BUFF_SIZE];
     int len, ret;
-    char error_str[128];
 
     if (handle == NULL || frame == NULL)
     {
@@ -149,8 +412,7 @@ mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame)
 
     if ((len = mbus_frame_pack(frame, buff, sizeof(buff))) == -1)
     {
-        snprintf(error_str, sizeof(error_str), "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
-        mbus_error_str_set(error_str);
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
         return -1;
     }
 
@@ -161,11 +423,13 @@ mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame)
         //
         if (handle->send_event)
             handle->send_event(MBUS_HANDLE_TYPE_TCP, buff, len);
+
+        if (handle->capture)
+            mbus_capture_handle_data(handle, MBUS_CAPTURE_SEND, buff, len);
     }
     else
     {
-        snprintf(error_str, sizeof(error_str), "%s: Failed to write frame to socket (ret = %d)\n", __PRETTY_FUNCTION__, ret);
-        mbus_error_str_set(error_str);
+        mbus_error_set(MBUS_ERR_SEND, "%s: Failed to write frame to socket (ret = %d)\n", __PRETTY_FUNCTION__, ret);
         return -1;
     }
 
@@ -177,83 +441,115 @@ mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame)
 //------------------------------------------------------------------------------
 int mbus_tcp_recv_frame(mbus_handle *handle, mbus_frame *frame)
 {
-    char buff[PACKET_BUFF_SIZE];
+    unsigned char buff[PACKET_BUFF_SIZE];
+    mbus_tcp_data *tcp_data;
+    mbus_parser parser;
     int remaining;
-    ssize_t len, nread;
+    size_t len;
+    ssize_t nread;
 
-    if (handle == NULL || frame == NULL) {
+    if (handle == NULL || frame == NULL || handle->auxdata == NULL) {
         fprintf(stderr, "%s: Invalid parameter.\n", __PRETTY_FUNCTION__);
         return MBUS_RECV_RESULT_ERROR;
     }
 
-    memset((void *) buff, 0, sizeof(buff));
+    tcp_data = (mbus_tcp_data *) handle->auxdata;
+
+    mbus_parser_init(&parser, frame);
 
     //
-    // read data until a packet is received
+    // read data until a packet is received, starting with the bytes left
+    // over from the previous read
     //
-    remaining = 1; // start by reading 1 byte
     len = 0;
 
-    do {
-retry:
-        if (len + remaining > PACKET_BUFF_SIZE)
-        {
-            // avoid out of bounds access
-            return MBUS_RECV_RESULT_ERROR;
-        }
+    remaining = mbus_recv_buffer_parse(&tcp_data->recv_buffer, &parser, buff, sizeof(buff), &len);
 
-        nread = read(handle->fd, &buff[len], remaining);
+    while (remaining > 0) {
+        nread = mbus_recv_buffer_fill(&tcp_data->recv_buffer, handle->fd);
         switch (nread) {
         case -1:
             if (errno == EINTR)
-                goto retry;
+                continue;
 
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                mbus_error_str_set("M-Bus tcp transport layer response timeout has been reached.");
+                mbus_error_set(MBUS_ERR_TIMEOUT, "M-Bus tcp transport layer response timeout has been reached.");
                 return MBUS_RECV_RESULT_TIMEOUT;
             }
 
-            mbus_error_str_set("M-Bus tcp transport layer failed to read data.");
+            mbus_error_set(MBUS_ERR_RECV, "M-Bus tcp transport layer failed to read data.");
             return MBUS_RECV_RESULT_ERROR;
         case 0:
-            mbus_error_str_set("M-Bus tcp transport layer connection closed by remote host.");
+            mbus_error_set(MBUS_ERR_CONNECTION_CLOSED, "M-Bus tcp transport layer connection closed by remote host.");
             return MBUS_RECV_RESULT_RESET;
         default:
-            if (len > (SSIZE_MAX-nread))
-            {
-                // avoid overflow
-                return MBUS_RECV_RESULT_ERROR;
-            }
-
-            len += nread;
+            remaining = mbus_recv_buffer_parse(&tcp_data->recv_buffer, &parser, buff, sizeof(buff), &len);
         }
-    } while ((remaining = mbus_parse(frame, buff, len)) > 0);
+    }
 
     //
     // call the receive event function, if the callback function is registered
     //
     if (handle->recv_event)
-        handle->recv_event(MBUS_HANDLE_TYPE_TCP, buff, len);
+        handle->recv_event(MBUS_HANDLE_TYPE_TCP, (const char *)buff, len);
+
+    if (handle->capture)
+        mbus_capture_handle_data(handle, MBUS_CAPTURE_RECV, buff, len);
 
     if (remaining < 0) {
-        mbus_error_str_set("M-Bus layer failed to parse data.");
+        // the parser has set the error (invalid frame or checksum)
         return MBUS_RECV_RESULT_INVALID;
     }
 
     return MBUS_RECV_RESULT_OK;
 }
 
+//------------------------------------------------------------------------------
+/// Wait until data is received or the timeout (in ms) expired.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_wait_recv(mbus_handle *handle, long timeout_ms)
+{
+    mbus_tcp_data *tcp_data;
+
+    if (handle == NULL || (tcp_data = (mbus_tcp_data *) handle->auxdata) == NULL)
+    {
+        return -1;
+    }
+
+    return mbus_recv_buffer_wait(&tcp_data->recv_buffer, handle->fd, timeout_ms);
+}
+
+//------------------------------------------------------------------------------
+/// Return the time (ms) to wait for a reply from the gateway, i.e. the
+/// effective read timeout of the handle.
+//------------------------------------------------------------------------------
+long
+mbus_tcp_recv_timeout(mbus_handle *handle)
+{
+    mbus_tcp_data *tcp_data;
+
+    if (handle == NULL || (tcp_data = (mbus_tcp_data *) handle->auxdata) == NULL)
+    {
+        return mbus_tcp_timeout(0);
+    }
+
+    return mbus_tcp_timeout(tcp_data->read_timeout);
+}
+
 //------------------------------------------------------------------------------
 /// The the timeout in seconds that will be used as the amount of time the
-/// a read operation will wait before giving up. Note: This configuration has
-/// to be made before calling mbus_tcp_connect.
+/// a connect, read or write operation will wait before giving up. This is
+/// the default for all handles that don't set their own timeouts with the
+/// MBUS_OPTION_TCP_*_TIMEOUT options. Note: This configuration has to be made
+/// before calling mbus_tcp_connect.
 //------------------------------------------------------------------------------
 int
 mbus_tcp_set_timeout_set(double seconds)
 {
     if (seconds < 0.0)
     {
-        mbus_error_str_set("Invalid timeout (must be positive).");
+        mbus_error_set(MBUS_ERR_INVALID_ARGUMENT, "Invalid timeout (must be positive).");
         return -1;
     }
 
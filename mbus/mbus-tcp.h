@@ -30,12 +30,24 @@ typedef struct _mbus_tcp_data
 {
     char *host;
     uint16_t port;
+    long connect_timeout;  // ms, 0 uses the mbus_tcp_set_timeout_set default
+    long read_timeout;     // ms, 0 uses the mbus_tcp_set_timeout_set default
+    long write_timeout;    // ms, 0 uses the mbus_tcp_set_timeout_set default
+    mbus_recv_buffer recv_buffer;
+    struct addrinfo *addr_list;     // addresses of the host while connecting
+    struct addrinfo *addr_next;     // next address to try
 } mbus_tcp_data;
 
 int  mbus_tcp_connect(mbus_handle *handle);
+int  mbus_tcp_connect_start(mbus_handle *handle);
+int  mbus_tcp_connect_finish(mbus_handle *handle);
+void mbus_tcp_connect_abort(mbus_handle *handle);
+long mbus_tcp_connect_timeout(mbus_handle *handle);
 int  mbus_tcp_disconnect(mbus_handle *handle);
 int  mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame);
 int  mbus_tcp_recv_frame(mbus_handle *handle, mbus_frame *frame);
+int  mbus_tcp_wait_recv(mbus_handle *handle, long timeout_ms);
+long mbus_tcp_recv_timeout(mbus_handle *handle);
 void mbus_tcp_data_free(mbus_handle *handle);
 int  mbus_tcp_set_timeout_set(double seconds);
 
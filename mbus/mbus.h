@@ -37,6 +37,14 @@
 #include "mbus-protocol-aux.h"
 #include "mbus-tcp.h"
 #include "mbus-serial.h"
+#include "mbus-async.h"
+#include "mbus-sink.h"
+#include "mbus-format.h"
+#include "mbus-cbor.h"
+#include "mbus-influxdb.h"
+#include "mbus-capture.h"
+#include "mbus-sim.h"
+#include "mbus-link.h"
 
 #ifdef __cplusplus
 extern "C" {
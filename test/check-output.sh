@@ -0,0 +1,106 @@
+#!/bin/sh
+#------------------------------------------------------------------------------
+# Copyright (C) 2010-2012, Robert Johansson and contributors, Raditex AB
+# All rights reserved.
+#
+# rSCADA
+# http://www.rSCADA.se
+# info@rscada.se
+#
+#------------------------------------------------------------------------------
+
+#
+# Compare the output of the writers for the hex files of a directory with the
+# golden files next to them (name.influxdb, ...). The output is written to
+# the current directory (name.format.new) and kept if it differs or if there
+# is no golden file, which makes the script exit with 1. Formats:
+#
+#     influxdb   normalized InfluxDB line protocol (mbus_parse_hex -n -i)
+#     cbor       CBOR (mbus_parse_hex -c), compared as hex dump
+#     json       JSON lines of the bulk decoder (mbus-decode -j), which is
+#                taken from $MBUS_DECODE (default ../bin/mbus-decode)
+#
+
+# Check if mbus_parse_hex exists
+if [ ! -x ./mbus_parse_hex ]; then
+    echo "mbus_parse_hex not found"
+    exit 3
+fi
+
+decode="${MBUS_DECODE:-../bin/mbus-decode}"
+
+# Check commandline parameter
+if [ $# -lt 2 ]; then
+    echo "usage: $0 directory format..."
+    exit 3
+fi
+
+directory="$1"
+shift
+
+# Check directory
+if [ ! -d "$directory" ]; then
+    echo "usage: $0 directory format..."
+    exit 3
+fi
+
+# Check if mbus-decode exists when it is needed
+for format in "$@"; do
+    if [ "$format" = "json" ] && [ ! -x "$decode" ]; then
+        echo "mbus-decode not found ($decode)"
+        exit 3
+    fi
+done
+
+failed=0
+
+for hexfile in "$directory"/*.hex;  do
+    if [ ! -f "$hexfile" ]; then
+        continue
+    fi
+
+    filename=`basename $hexfile .hex`
+
+    for format in "$@"; do
+        golden="$directory/$filename.$format"
+        output="$filename.$format.new"
+
+        # Write the output of the format in file
+        case "$format" in
+            influxdb) ./mbus_parse_hex -n -i "$hexfile" > "$output" 2> /dev/null ;;
+            cbor)     ./mbus_parse_hex -c "$hexfile" > "$output" 2> /dev/null ;;
+            json)     "$decode" -j "$hexfile" > "$output" 2> /dev/null ;;
+            *)        echo "unknown format $format"; exit 3 ;;
+        esac
+        result=$?
+
+        # Invalid frames have no output to compare
+        if [ $result -ne 0 ]; then
+            rm "$output"
+            continue
+        fi
+
+        if [ ! -f "$golden" ]; then
+            # no golden file -> keep output
+            echo "No golden file $golden, output in $output"
+            failed=1
+        elif cmp -s "$golden" "$output"; then
+            # equal -> remove output
+            rm "$output"
+        else
+            # different -> print diff (binary output as hex dump)
+            if [ "$format" = "cbor" ]; then
+                od -A x -t x1 "$golden" > "$output.golden.dump"
+                od -A x -t x1 "$output" > "$output.dump"
+                diff -u "$output.golden.dump" "$output.dump"
+                rm "$output.golden.dump" "$output.dump"
+            else
+                diff -u "$golden" "$output"
+            fi
+            echo ""
+            failed=1
+        fi
+    done
+done
+
+exit $failed
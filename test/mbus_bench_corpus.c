@@ -0,0 +1,372 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2010, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Benchmark the decoding and serialization stages over a corpus of hex frames
+// and report ns/frame and heap allocations/frame of each stage:
+//
+//     ./mbus_bench_corpus [-i iterations] [-j] test-frames/*.hex error-frames/*.hex 2>/dev/null
+//
+// With -j every stage is reported as one JSON object per line, for comparing
+// the results of two releases.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mbus/mbus.h>
+
+typedef struct _corpus_frame {
+    const char *file;
+    unsigned char raw[2048];
+    size_t len;
+    mbus_frame frame;           // parsed once for the later stages
+    mbus_frame_data data;
+    int parsed;
+    int decoded;
+} corpus_frame;
+
+// Input of a stage
+#define INPUT_RAW   0   // all frames
+#define INPUT_FRAME 1   // frames that parse
+#define INPUT_DATA  2   // frames that decode
+
+typedef struct _stage {
+    const char *name;
+    int input;
+    void (*run)(corpus_frame *cf);
+} stage;
+
+static corpus_frame *corpus = NULL;
+static size_t corpus_count = 0;
+
+static mbus_record_arena arena;
+static mbus_sink sink;
+static volatile size_t result_sum = 0;
+
+//
+// Heap allocations of the library, counted by replacing the allocation
+// functions of glibc (the library calls these through the PLT).
+//
+static unsigned long alloc_count = 0, alloc_bytes = 0;
+
+#ifdef __GLIBC__
+#define COUNT_ALLOCS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *
+malloc(size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += nmemb * size;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+#else
+#define COUNT_ALLOCS 0
+#endif
+
+//------------------------------------------------------------------------------
+// Stages
+//------------------------------------------------------------------------------
+static void
+run_parse(corpus_frame *cf)
+{
+    mbus_frame frame;
+
+    memset((void *)&frame, 0, sizeof(frame));
+    result_sum += mbus_parse(&frame, cf->raw, cf->len);
+}
+
+static void
+run_data_parse(corpus_frame *cf)
+{
+    mbus_frame_data data;
+
+    memset((void *)&data, 0, sizeof(data));
+    result_sum += mbus_frame_data_parse(&cf->frame, &data);
+
+    if (data.data_var.record)
+        mbus_data_record_free(data.data_var.record);
+}
+
+static void
+run_data_parse_arena(corpus_frame *cf)
+{
+    mbus_frame_data data;
+
+    memset((void *)&data, 0, sizeof(data));
+    result_sum += mbus_frame_data_parse_arena(&cf->frame, &data, &arena);
+    mbus_record_arena_reset(&arena);
+}
+
+static void
+run_string(char *str)
+{
+    if (str)
+    {
+        result_sum += strlen(str);
+        free(str);
+    }
+}
+
+static void run_xml(corpus_frame *cf)      { run_string(mbus_frame_data_xml(&cf->data, 0)); }
+static void run_json(corpus_frame *cf)     { run_string(mbus_frame_data_json(&cf->data, 0)); }
+static void run_influxdb(corpus_frame *cf) { run_string(mbus_frame_data_influxdb(&cf->data, 0)); }
+
+static void run_xml_normalized(corpus_frame *cf)      { run_string(mbus_frame_data_xml_normalized(&cf->data)); }
+static void run_json_normalized(corpus_frame *cf)     { run_string(mbus_frame_data_json_normalized(&cf->data)); }
+static void run_influxdb_normalized(corpus_frame *cf) { run_string(mbus_frame_data_influxdb_normalized(&cf->data)); }
+
+static void
+run_sink(int result)
+{
+    size_t len;
+
+    mbus_sink_buffer(&sink, &len);
+    result_sum += len + result;
+    mbus_sink_reset(&sink);
+}
+
+static void run_xml_sink(corpus_frame *cf)      { run_sink(mbus_frame_data_xml_sink(&cf->data, 0, &sink)); }
+static void run_json_sink(corpus_frame *cf)     { run_sink(mbus_frame_data_json_sink(&cf->data, 0, &sink)); }
+static void run_influxdb_sink(corpus_frame *cf) { run_sink(mbus_frame_data_influxdb_sink(&cf->data, 0, &sink)); }
+
+static const stage stages[] = {
+    { "mbus_parse",                            INPUT_RAW,   run_parse },
+    { "mbus_frame_data_parse",                 INPUT_FRAME, run_data_parse },
+    { "mbus_frame_data_parse_arena",           INPUT_FRAME, run_data_parse_arena },
+    { "mbus_frame_data_xml",                   INPUT_DATA,  run_xml },
+    { "mbus_frame_data_json",                  INPUT_DATA,  run_json },
+    { "mbus_frame_data_influxdb",              INPUT_DATA,  run_influxdb },
+    { "mbus_frame_data_xml_normalized",        INPUT_DATA,  run_xml_normalized },
+    { "mbus_frame_data_json_normalized",       INPUT_DATA,  run_json_normalized },
+    { "mbus_frame_data_influxdb_normalized",   INPUT_DATA,  run_influxdb_normalized },
+    { "mbus_frame_data_xml_sink",              INPUT_DATA,  run_xml_sink },
+    { "mbus_frame_data_json_sink",             INPUT_DATA,  run_json_sink },
+    { "mbus_frame_data_influxdb_sink",         INPUT_DATA,  run_influxdb_sink },
+};
+
+//------------------------------------------------------------------------------
+// Load a hex frame file into the corpus, parse and decode it once.
+//------------------------------------------------------------------------------
+static int
+load_frame(const char *file)
+{
+    FILE *fp;
+    unsigned char raw_buff[4096];
+    corpus_frame *cf;
+    size_t len;
+
+    if ((fp = fopen(file, "r")) == NULL)
+    {
+        fprintf(stderr, "failed to open '%s'\n", file);
+        return -1;
+    }
+
+    len = fread(raw_buff, 1, sizeof(raw_buff), fp);
+    fclose(fp);
+
+    if ((cf = (corpus_frame *) realloc(corpus, (corpus_count + 1) * sizeof(corpus_frame))) == NULL)
+    {
+        fprintf(stderr, "failed to allocate memory\n");
+        return -1;
+    }
+
+    corpus = cf;
+    cf = &corpus[corpus_count++];
+    memset((void *)cf, 0, sizeof(corpus_frame));
+
+    cf->file = file;
+    cf->len = mbus_hex2bin(cf->raw, sizeof(cf->raw), raw_buff, len);
+    cf->parsed = (mbus_parse(&cf->frame, cf->raw, cf->len) == 0);
+    cf->decoded = cf->parsed && (mbus_frame_data_parse(&cf->frame, &cf->data) == 0);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Monotonic time in nanoseconds
+//------------------------------------------------------------------------------
+static double
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// Check if a stage runs on a frame of the corpus
+//------------------------------------------------------------------------------
+static int
+stage_applies(const stage *st, const corpus_frame *cf)
+{
+    switch (st->input)
+    {
+        case INPUT_FRAME: return cf->parsed;
+        case INPUT_DATA:  return cf->decoded;
+        default:          return 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Run a stage over the corpus, returns the number of frames per iteration.
+//------------------------------------------------------------------------------
+static size_t
+bench_stage(const stage *st, int iterations, double *ns, double *allocs, double *bytes)
+{
+    unsigned long count, bytes_start;
+    size_t frames = 0, i;
+    double start;
+    int n;
+
+    for (i = 0; i < corpus_count; i++)
+    {
+        if (stage_applies(st, &corpus[i]))
+            frames++;
+    }
+
+    if (frames == 0)
+        return 0;
+
+    // warm up (the first call of a sink grows its buffer)
+    for (i = 0; i < corpus_count; i++)
+    {
+        if (stage_applies(st, &corpus[i]))
+            st->run(&corpus[i]);
+    }
+
+    count = alloc_count;
+    bytes_start = alloc_bytes;
+    start = now_ns();
+
+    for (n = 0; n < iterations; n++)
+    {
+        for (i = 0; i < corpus_count; i++)
+        {
+            if (stage_applies(st, &corpus[i]))
+                st->run(&corpus[i]);
+        }
+    }
+
+    *ns = (now_ns() - start) / ((double) iterations * frames);
+    *allocs = (double) (alloc_count - count) / ((double) iterations * frames);
+    *bytes = (double) (alloc_bytes - bytes_start) / ((double) iterations * frames);
+
+    return frames;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, iterations = 100, json = 0;
+    size_t s, frames, parsed = 0, decoded = 0;
+    double ns, allocs, bytes;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-j") == 0)
+        {
+            json = 1;
+        }
+        else if (load_frame(argv[i]) != 0)
+        {
+            return 1;
+        }
+    }
+
+    if (corpus_count == 0 || iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [-i iterations] [-j] hex-file...\n", argv[0]);
+        return 1;
+    }
+
+    for (s = 0; s < corpus_count; s++)
+    {
+        parsed += corpus[s].parsed;
+        decoded += corpus[s].decoded;
+    }
+
+    mbus_record_arena_init(&arena);
+    mbus_sink_init_buffer(&sink, NULL, 0);
+
+    if (!json)
+    {
+        printf("%zu frames (%zu parsed, %zu decoded), %d iterations\n\n",
+               corpus_count, parsed, decoded, iterations);
+        printf("%-38s %8s %12s %14s %14s\n", "stage", "frames", "ns/frame", "allocs/frame", "bytes/frame");
+    }
+
+    for (s = 0; s < sizeof(stages) / sizeof(stages[0]); s++)
+    {
+        if ((frames = bench_stage(&stages[s], iterations, &ns, &allocs, &bytes)) == 0)
+            continue;
+
+        if (json)
+        {
+            if (COUNT_ALLOCS)
+                printf("{\"stage\":\"%s\",\"frames\":%zu,\"iterations\":%d,\"ns_per_frame\":%.1f,"
+                       "\"allocs_per_frame\":%.2f,\"bytes_per_frame\":%.1f}\n",
+                       stages[s].name, frames, iterations, ns, allocs, bytes);
+            else
+                printf("{\"stage\":\"%s\",\"frames\":%zu,\"iterations\":%d,\"ns_per_frame\":%.1f,"
+                       "\"allocs_per_frame\":null,\"bytes_per_frame\":null}\n",
+                       stages[s].name, frames, iterations, ns);
+        }
+        else if (COUNT_ALLOCS)
+        {
+            printf("%-38s %8zu %12.1f %14.2f %14.1f\n", stages[s].name, frames, ns, allocs, bytes);
+        }
+        else
+        {
+            printf("%-38s %8zu %12.1f %14s %14s\n", stages[s].name, frames, ns, "-", "-");
+        }
+    }
+
+    mbus_sink_free(&sink);
+    mbus_record_arena_free(&arena);
+
+    for (s = 0; s < corpus_count; s++)
+    {
+        if (corpus[s].data.data_var.record)
+            mbus_data_record_free(corpus[s].data.data_var.record);
+    }
+
+    free(corpus);
+
+    return 0;
+}
@@ -0,0 +1,257 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2010, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Benchmark the number formatting of the XML/JSON/InfluxDB writers against
+// snprintf, using the (normalized) record values of a set of hex frames:
+//
+//     ./mbus_bench_format [-i iterations] test-frames/*.hex
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mbus/mbus.h>
+
+#define MAX_VALUES 65536
+
+static double real_values[MAX_VALUES];
+static long long int_values[MAX_VALUES];
+static size_t real_count = 0, int_count = 0;
+
+//------------------------------------------------------------------------------
+// Collect the numeric values of all records of a hex frame file.
+//------------------------------------------------------------------------------
+static int
+collect_values(const char *file)
+{
+    FILE *fp;
+    unsigned char raw_buff[4096], buff[4096];
+    size_t len, buff_len;
+    mbus_frame reply;
+    mbus_frame_data frame_data;
+    mbus_data_record *record;
+    mbus_data_value value;
+    mbus_record *norm_record;
+
+    if ((fp = fopen(file, "r")) == NULL)
+    {
+        fprintf(stderr, "failed to open '%s'\n", file);
+        return -1;
+    }
+
+    memset(raw_buff, 0, sizeof(raw_buff));
+    len = fread(raw_buff, 1, sizeof(raw_buff), fp);
+    fclose(fp);
+
+    buff_len = mbus_hex2bin(buff, sizeof(buff), raw_buff, len);
+
+    memset(&reply, 0, sizeof(reply));
+    memset(&frame_data, 0, sizeof(frame_data));
+
+    if (mbus_parse(&reply, buff, buff_len) != 0 ||
+        mbus_frame_data_parse(&reply, &frame_data) != 0)
+    {
+        return -1;
+    }
+
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        return 0;
+    }
+
+    for (record = frame_data.data_var.record; record; record = record->next)
+    {
+        if (mbus_data_record_value_decode(record, &value) == 0 &&
+            (value.type == MBUS_DATA_VALUE_INTEGER || value.type == MBUS_DATA_VALUE_BCD) &&
+            int_count < MAX_VALUES)
+        {
+            int_values[int_count++] = value.value.integer;
+        }
+
+        if ((norm_record = mbus_parse_variable_record(record)) != NULL)
+        {
+            if (norm_record->is_numeric && real_count < MAX_VALUES)
+            {
+                real_values[real_count++] = norm_record->value.real_val;
+            }
+
+            mbus_record_free(norm_record);
+        }
+    }
+
+    mbus_data_record_free(frame_data.data_var.record);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Monotonic time in nanoseconds
+//------------------------------------------------------------------------------
+static double
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// Time snprintf with the given format over all real values, count the values
+// that do not read back unchanged.
+//------------------------------------------------------------------------------
+static double
+bench_real_snprintf(const char *format, int iterations, size_t *errors)
+{
+    char buff[MBUS_FORMAT_DOUBLE_SIZE * 2];
+    volatile size_t sum = 0;
+    double start;
+    size_t i;
+    int n;
+
+    start = now_ns();
+
+    for (n = 0; n < iterations; n++)
+        for (i = 0; i < real_count; i++)
+            sum += snprintf(buff, sizeof(buff), format, real_values[i]);
+
+    start = now_ns() - start;
+
+    for (*errors = 0, i = 0; i < real_count; i++)
+    {
+        snprintf(buff, sizeof(buff), format, real_values[i]);
+
+        if (strtod(buff, NULL) != real_values[i])
+            (*errors)++;
+    }
+
+    return start / ((double) iterations * real_count);
+}
+
+//------------------------------------------------------------------------------
+// Time mbus_format_double over all real values
+//------------------------------------------------------------------------------
+static double
+bench_real_format(int iterations, size_t *errors)
+{
+    char buff[MBUS_FORMAT_DOUBLE_SIZE];
+    volatile size_t sum = 0;
+    double start;
+    size_t i;
+    int n;
+
+    start = now_ns();
+
+    for (n = 0; n < iterations; n++)
+        for (i = 0; i < real_count; i++)
+            sum += mbus_format_double(real_values[i], buff);
+
+    start = now_ns() - start;
+
+    for (*errors = 0, i = 0; i < real_count; i++)
+    {
+        mbus_format_double(real_values[i], buff);
+
+        if (strtod(buff, NULL) != real_values[i])
+            (*errors)++;
+    }
+
+    return start / ((double) iterations * real_count);
+}
+
+//------------------------------------------------------------------------------
+// Time snprintf (format != NULL) or mbus_format_int over all integer values
+//------------------------------------------------------------------------------
+static double
+bench_int(const char *format, int iterations, size_t *errors)
+{
+    char buff[MBUS_FORMAT_INT_SIZE], check[MBUS_FORMAT_INT_SIZE];
+    volatile size_t sum = 0;
+    double start;
+    size_t i;
+    int n;
+
+    start = now_ns();
+
+    for (n = 0; n < iterations; n++)
+        for (i = 0; i < int_count; i++)
+            sum += format ? (size_t) snprintf(buff, sizeof(buff), format, int_values[i])
+                          : mbus_format_int(int_values[i], buff);
+
+    start = now_ns() - start;
+
+    for (*errors = 0, i = 0; i < int_count; i++)
+    {
+        mbus_format_int(int_values[i], buff);
+        snprintf(check, sizeof(check), "%lld", int_values[i]);
+
+        if (strcmp(buff, check) != 0)
+            (*errors)++;
+    }
+
+    return start / ((double) iterations * int_count);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, iterations = 1000, files = 0;
+    size_t errors;
+    double ns;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (collect_values(argv[i]) == 0)
+        {
+            files++;
+        }
+    }
+
+    if (files == 0 || iterations <= 0 || (real_count == 0 && int_count == 0))
+    {
+        fprintf(stderr, "usage: %s [-i iterations] hex-file...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%d files, %zu real values, %zu integer values, %d iterations\n\n",
+           files, real_count, int_count, iterations);
+    printf("%-22s %10s %18s\n", "formatter", "ns/value", "round-trip errors");
+
+    if (real_count > 0)
+    {
+        ns = bench_real_snprintf("%f", iterations, &errors);
+        printf("%-22s %10.1f %18zu\n", "snprintf %f", ns, errors);
+
+        ns = bench_real_snprintf("%.17g", iterations, &errors);
+        printf("%-22s %10.1f %18zu\n", "snprintf %.17g", ns, errors);
+
+        ns = bench_real_format(iterations, &errors);
+        printf("%-22s %10.1f %18zu\n", "mbus_format_double", ns, errors);
+    }
+
+    if (int_count > 0)
+    {
+        ns = bench_int("%lld", iterations, &errors);
+        printf("%-22s %10.1f %18s\n", "snprintf %lld", ns, "-");
+
+        ns = bench_int(NULL, iterations, &errors);
+        printf("%-22s %10.1f %18zu\n", "mbus_format_int", ns, errors);
+    }
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2010, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Time the request and scan functions on a simulated bus. Every argument is
+// one slave with the primary address 1, 2, ...; several hex frames separated
+// by commas form a multi-telegram reply:
+//
+//     ./mbus_bench_sim [-b baudrate] [-l latency] test-frames/*.hex
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mbus/mbus.h>
+
+static unsigned long found = 0;
+
+//------------------------------------------------------------------------------
+// Count the devices found by the secondary scan.
+//------------------------------------------------------------------------------
+static void
+found_event(mbus_handle *handle, mbus_frame *frame)
+{
+    (void) handle;
+    (void) frame;
+
+    found++;
+}
+
+//------------------------------------------------------------------------------
+// Seconds elapsed since start
+//------------------------------------------------------------------------------
+static double
+elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+print_stats(const char *what, mbus_sim_bus *bus, long long bus_start, const struct timespec *start)
+{
+    printf("%-8s bus time %10.3f s, wall time %8.3f ms, requests %lu, replies %lu, "
+           "collisions %lu, timeouts %lu, lost %lu, corrupted %lu\n",
+           what, (mbus_sim_bus_time(bus) - bus_start) / 1e9, elapsed(start) * 1e3,
+           bus->stats.requests, bus->stats.replies, bus->stats.collisions,
+           bus->stats.timeouts, bus->stats.lost, bus->stats.corrupted);
+
+    memset((void *)&bus->stats, 0, sizeof(bus->stats));
+}
+
+int
+main(int argc, char **argv)
+{
+    mbus_sim_bus *bus;
+    mbus_sim_slave *slave;
+    mbus_handle *handle;
+    mbus_frame reply, *frame;
+    struct timespec start;
+    long long bus_start;
+    char *file, *save;
+    unsigned long frames = 0, failed = 0;
+    int c, address, slaves;
+
+    if ((bus = mbus_sim_bus_new()) == NULL)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        return 1;
+    }
+
+    for (c = 1; c < argc && argv[c][0] == '-'; c += 2)
+    {
+        mbus_sim_option option;
+
+        if (c + 1 >= argc)
+            break;
+
+        if      (strcmp(argv[c], "-b") == 0) option = MBUS_SIM_OPTION_BAUDRATE;
+        else if (strcmp(argv[c], "-l") == 0) option = MBUS_SIM_OPTION_LATENCY;
+        else if (strcmp(argv[c], "-L") == 0) option = MBUS_SIM_OPTION_LOSS_RATE;
+        else if (strcmp(argv[c], "-C") == 0) option = MBUS_SIM_OPTION_CORRUPT_RATE;
+        else if (strcmp(argv[c], "-s") == 0) option = MBUS_SIM_OPTION_SEED;
+        else if (strcmp(argv[c], "-e") == 0) option = MBUS_SIM_OPTION_ECHO;
+        else if (strcmp(argv[c], "-r") == 0) option = MBUS_SIM_OPTION_REALTIME;
+        else break;
+
+        if (mbus_sim_bus_set_option(bus, option, atol(argv[c + 1])) == -1)
+        {
+            fprintf(stderr, "invalid value for %s\n", argv[c]);
+            return 1;
+        }
+    }
+
+    if (c >= argc)
+    {
+        fprintf(stderr, "usage: %s [-b baudrate] [-l latency_ms] [-L loss_ppm] [-C corrupt_ppm] "
+                        "[-s seed] [-e echo] [-r realtime] frame.hex[,frame.hex...] ...\n", argv[0]);
+        return 1;
+    }
+
+    for (slaves = 0; c < argc; c++)
+    {
+        if ((slave = mbus_sim_bus_add_slave(bus, (slaves % 250) + 1, NULL)) == NULL)
+        {
+            fprintf(stderr, "%s\n", mbus_error_str());
+            return 1;
+        }
+
+        slaves++;
+
+        for (file = strtok_r(argv[c], ",", &save); file; file = strtok_r(NULL, ",", &save))
+        {
+            if (mbus_sim_slave_load_hex(slave, file) == -1)
+            {
+                // e.g. the invalid frames of test-frames, the slave only acknowledges
+                fprintf(stderr, "%s: %s\n", file, mbus_error_str());
+            }
+        }
+    }
+
+    if ((handle = mbus_context_sim(bus)) == NULL || mbus_connect(handle) == -1)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        return 1;
+    }
+
+    handle->found_event = found_event;
+
+    //
+    // read out every slave by its primary address
+    //
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bus_start = mbus_sim_bus_time(bus);
+
+    for (address = 1; address <= slaves && address <= 250; address++)
+    {
+        memset((void *)&reply, 0, sizeof(mbus_frame));
+
+        if (mbus_sendrecv_request(handle, address, &reply, 16) != 0)
+        {
+            failed++;
+        }
+
+        for (frame = &reply; frame; frame = frame->next)
+            frames++;
+
+        mbus_frame_free(reply.next);
+    }
+
+    print_stats("request", bus, bus_start, &start);
+    printf("         %d slaves, %lu frames, %lu failed readouts\n", slaves, frames, failed);
+
+    //
+    // secondary scan of the whole bus
+    //
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bus_start = mbus_sim_bus_time(bus);
+
+    mbus_scan_2nd_address_range(handle, 0, "FFFFFFFFFFFFFFFF");
+
+    print_stats("scan", bus, bus_start, &start);
+    printf("         %lu devices found\n", found);
+
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+    mbus_sim_bus_free(bus);
+
+    return 0;
+}
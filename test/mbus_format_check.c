@@ -0,0 +1,207 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2010, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Check the number formatting of the XML/JSON/InfluxDB writers: every double
+// has to read back to the same value with no more significant digits than
+// the shortest "%.<n>g" that does, every integer has to match "%lld". Uses
+// edge cases and pseudo random values (bit patterns and meter readings of
+// the form integer * 10^exponent):
+//
+//     ./mbus_format_check [-n count]
+//
+// Exits with 1 on the first mismatch.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+
+#include <mbus/mbus.h>
+
+static unsigned long long random_state = 88172645463325252ULL;
+
+//------------------------------------------------------------------------------
+// Next number of the pseudo random generator (xorshift64), the same sequence
+// in every run.
+//------------------------------------------------------------------------------
+static unsigned long long
+next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+
+    return random_state;
+}
+
+//------------------------------------------------------------------------------
+// Number of significant digits of a formatted double.
+//------------------------------------------------------------------------------
+static int
+significant_digits(const char *str)
+{
+    int digits = 0, zeros = 0, leading = 1;
+
+    for (; *str && *str != 'e' && *str != 'E'; str++)
+    {
+        if (*str < '0' || *str > '9')
+            continue;
+
+        if (*str == '0')
+        {
+            // leading zeros do not count, trailing ones only if followed
+            // by another digit
+            if (!leading)
+                zeros++;
+            continue;
+        }
+
+        digits += zeros + 1;
+        zeros = 0;
+        leading = 0;
+    }
+
+    return digits;
+}
+
+//------------------------------------------------------------------------------
+// Check the formatting of a double.
+//------------------------------------------------------------------------------
+static int
+check_double(double value)
+{
+    char buff[MBUS_FORMAT_DOUBLE_SIZE], shortest[64];
+    double parsed;
+    size_t len;
+    int precision;
+
+    len = mbus_format_double(value, buff);
+
+    if (len != strlen(buff))
+    {
+        fprintf(stderr, "%.17g: length %zu of \"%s\" is wrong\n", value, len, buff);
+        return -1;
+    }
+
+    parsed = strtod(buff, NULL);
+
+    if (memcmp(&parsed, &value, sizeof(double)) != 0)
+    {
+        fprintf(stderr, "%.17g: \"%s\" reads back as %.17g\n", value, buff, parsed);
+        return -1;
+    }
+
+    for (precision = 1; precision < 17; precision++)
+    {
+        snprintf(shortest, sizeof(shortest), "%.*g", precision, value);
+
+        if (strtod(shortest, NULL) == value)
+            break;
+    }
+
+    snprintf(shortest, sizeof(shortest), "%.*g", precision, value);
+
+    if (significant_digits(buff) > significant_digits(shortest))
+    {
+        fprintf(stderr, "%.17g: \"%s\" is longer than \"%s\"\n", value, buff, shortest);
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Check the formatting of an integer.
+//------------------------------------------------------------------------------
+static int
+check_int(long long value)
+{
+    char buff[MBUS_FORMAT_INT_SIZE], expected[MBUS_FORMAT_INT_SIZE];
+    size_t len;
+
+    len = mbus_format_int(value, buff);
+    snprintf(expected, sizeof(expected), "%lld", value);
+
+    if (len != strlen(expected) || strcmp(buff, expected) != 0)
+    {
+        fprintf(stderr, "%s: formatted as \"%s\"\n", expected, buff);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const double doubles[] = {
+        0.0, -0.0, 1.0, -1.0, 0.1, 0.2, 0.3, 1.0 / 3.0, 2.0 / 3.0, 100.0, 123.456,
+        1e-6, 1.5e-6, 1e-7, 1e21, 1e22, 1.5e22, 5e-324, DBL_MIN, DBL_MAX, DBL_EPSILON,
+        9007199254740992.0, 9007199254740993.0, 4294967295.0, 0.001, 561.08, 101.69
+    };
+    static const long long ints[] = {
+        0, 1, -1, 9, 10, -10, 99, 100, 12345678, 4294967295LL, -4294967296LL,
+        LLONG_MAX, LLONG_MIN, LLONG_MIN + 1
+    };
+    unsigned long long bits;
+    long i, count = 1000000;
+    double value;
+
+    if (argc == 3 && strcmp(argv[1], "-n") == 0)
+    {
+        count = atol(argv[2]);
+    }
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [-n count]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < (long) NITEMS(doubles); i++)
+    {
+        if (check_double(doubles[i]) == -1 || check_double(-doubles[i]) == -1)
+            return 1;
+    }
+
+    for (i = 0; i < (long) NITEMS(ints); i++)
+    {
+        if (check_int(ints[i]) == -1)
+            return 1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        // any finite double
+        bits = next_random();
+        memcpy(&value, &bits, sizeof(double));
+
+        if (isfinite(value) && check_double(value) == -1)
+            return 1;
+
+        // a scaled meter reading
+        value = (double) (long long) (next_random() % 100000000) * pow(10.0, (int) (next_random() % 19) - 9);
+
+        if (check_double(value) == -1)
+            return 1;
+
+        if (check_int((long long) next_random()) == -1 ||
+            check_int((long long) (next_random() % 2000000) - 1000000) == -1)
+            return 1;
+    }
+
+    printf("%ld doubles and %ld integers formatted correctly\n",
+           (long) (2 * NITEMS(doubles) + 2 * count), (long) (NITEMS(ints) + 2 * count));
+
+    return 0;
+}
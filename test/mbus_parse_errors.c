@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2010, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Check that mbus_frame_data_parse (without record arena) releases every
+// record it allocated, also when the data of a frame is broken:
+//
+//     ./mbus_parse_errors error-frames/*.hex
+//
+// Exits with 1 if the records of a frame are not all released.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mbus/mbus.h>
+
+//
+// Heap blocks of the library still in use, counted by replacing the
+// allocation functions of glibc (the library calls these through the PLT).
+//
+static long alloc_blocks = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *
+malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+
+    if (ptr)
+        alloc_blocks++;
+    return ptr;
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    void *ptr = __libc_calloc(nmemb, size);
+
+    if (ptr)
+        alloc_blocks++;
+    return ptr;
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    void *new_ptr = __libc_realloc(ptr, size);
+
+    if (ptr == NULL && new_ptr)
+        alloc_blocks++;
+    return new_ptr;
+}
+
+void
+free(void *ptr)
+{
+    if (ptr)
+        alloc_blocks--;
+    __libc_free(ptr);
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Parse the data of a hex frame file, store the number of blocks left over.
+//------------------------------------------------------------------------------
+static int
+check_frame(const char *file, long *left)
+{
+    FILE *fp;
+    unsigned char raw_buff[4096], buff[4096];
+    mbus_frame frame;
+    mbus_frame_data data;
+    size_t len;
+    long blocks;
+    int result;
+
+    if ((fp = fopen(file, "r")) == NULL)
+    {
+        fprintf(stderr, "failed to open '%s'\n", file);
+        return -1;
+    }
+
+    memset(raw_buff, 0, sizeof(raw_buff));
+    len = fread(raw_buff, 1, sizeof(raw_buff), fp);
+    fclose(fp);
+
+    len = mbus_hex2bin(buff, sizeof(buff), raw_buff, len);
+
+    memset((void *)&frame, 0, sizeof(frame));
+    memset((void *)&data, 0, sizeof(data));
+
+    if (mbus_parse(&frame, buff, len) != 0)
+    {
+        // nothing to decode
+        *left = 0;
+        return 0;
+    }
+
+    blocks = alloc_blocks;
+    result = mbus_frame_data_parse(&frame, &data);
+
+    if (data.data_var.record)
+        mbus_data_record_free(data.data_var.record);
+
+    *left = alloc_blocks - blocks;
+
+    return result;
+}
+
+int
+main(int argc, char **argv)
+{
+    long left;
+    int i, result, failed = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s hex-file ...\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        result = check_frame(argv[i], &left);
+
+        if (left != 0)
+        {
+            fprintf(stderr, "%s: %ld blocks not released (result %d)\n", argv[i], left, result);
+            failed = 1;
+        }
+    }
+
+    if (!failed)
+        printf("%d frames parsed without leaks\n", argc - 1);
+
+    return failed;
+}
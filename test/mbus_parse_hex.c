@@ -19,11 +19,12 @@ main(int argc, char *argv[])
 {
     FILE *fp = NULL;
     size_t buff_len, len, i;
-    int result, normalized = 0, json = 0, influxdb = 0, options = 0;
-    unsigned char raw_buff[4096], buff[4096];
+    int result, normalized = 0, json = 0, influxdb = 0, cbor = 0, batch = 0, options = 0;
+    unsigned char raw_buff[4096], buff[4096], cbor_buff[16384];
     mbus_frame reply;
     mbus_frame_data frame_data;
     char *result_str = NULL, *file = NULL;
+    mbus_influxdb_batch influxdb_batch;
 
     for (i = 1; i < argc; i++)
     {
@@ -35,11 +36,23 @@ main(int argc, char *argv[])
         {
             json = 1;
             influxdb = 0;
+            cbor = 0;
         }
         else if (strcmp(argv[i], "-i") == 0)
         {
             influxdb = 1;
             json = 0;
+            cbor = 0;
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            cbor = 1;
+            influxdb = 0;
+            json = 0;
+        }
+        else if (strcmp(argv[i], "-b") == 0)
+        {
+            batch = 1;
         }
         else if (strcmp(argv[i], "--onlynumval") == 0)
         {
@@ -53,10 +66,12 @@ main(int argc, char *argv[])
 
     if (file == NULL) 
     {
-        fprintf(stderr, "usage: %s [-n] [-j|-i] [--onlynumval] hex-file\n", argv[0]);
+        fprintf(stderr, "usage: %s [-n] [-j|-i|-c] [-b] [--onlynumval] hex-file\n", argv[0]);
         fprintf(stderr, "    optional flag -n for normalized values\n");
         fprintf(stderr, "    optional flag -j for result as json string\n");
         fprintf(stderr, "    optional flag -i for result as InfluxDB Line Protocol string\n");
+        fprintf(stderr, "    optional flag -c for result as CBOR (binary)\n");
+        fprintf(stderr, "    optional flag -b for result as InfluxDB batch (one line per record)\n");
         fprintf(stderr, "    optional flag --onlynumval for supressing records with non-numeric values\n");
         return 1;
     }
@@ -110,7 +125,31 @@ main(int argc, char *argv[])
     //mbus_frame_print(&reply);
     //mbus_frame_data_print(&frame_data);
 
-    if (influxdb)
+    if (batch)
+    {
+        mbus_influxdb_batch_init(&influxdb_batch, NULL, options, normalized);
+
+        if (mbus_influxdb_batch_add_frame_data(&influxdb_batch, &frame_data, 0) < 0)
+        {
+            fprintf(stderr, "Failed to generate InfluxDB batch of MBUS frame: %s\n", mbus_error_str());
+            return 1;
+        }
+        printf("%s", mbus_influxdb_batch_buffer(&influxdb_batch, NULL));
+        mbus_influxdb_batch_free(&influxdb_batch);
+    }
+    else if (cbor)
+    {
+        result = normalized ? mbus_frame_data_cbor_normalized(&frame_data, options, cbor_buff, sizeof(cbor_buff))
+                            : mbus_frame_data_cbor(&frame_data, options, cbor_buff, sizeof(cbor_buff));
+
+        if (result < 0 || (size_t) result > sizeof(cbor_buff))
+        {
+            fprintf(stderr, "Failed to generate CBOR representation of MBUS frame: %s\n", mbus_error_str());
+            return 1;
+        }
+        fwrite(cbor_buff, 1, result, stdout);
+    }
+    else if (influxdb)
     {
         result_str = normalized ? mbus_frame_data_influxdb_normalized(&frame_data) : mbus_frame_data_influxdb(&frame_data, options);
 
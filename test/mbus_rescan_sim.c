@@ -0,0 +1,173 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2010, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Check that the cached secondary rescan finds meters added after the first
+// scan, also under the masks of the meters in the cache, on a simulated bus:
+//
+//     ./mbus_rescan_sim frame.hex cache-file
+//
+// Exits with 1 if a meter is missed, reported twice or missing in the cache.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mbus/mbus.h>
+
+static const char *first_scan[] = { "1234567024230907", "5555555524230907", NULL };
+static const char *added[]      = { "1999999924230907", "7777777724230907", NULL };
+static const char *single[]     = { "1234567024230907", NULL };
+
+static char reported[8][17];
+static int reported_count = 0;
+
+//------------------------------------------------------------------------------
+// Remember the secondary addresses reported by the scan.
+//------------------------------------------------------------------------------
+static void
+found_event(mbus_handle *handle, mbus_frame *frame)
+{
+    char buff[32], *addr;
+
+    (void) handle;
+
+    if ((addr = mbus_frame_get_secondary_address_r(frame, buff, sizeof(buff))) == NULL)
+        return;
+
+    if (reported_count < (int) NITEMS(reported))
+        snprintf(reported[reported_count], sizeof(reported[0]), "%s", addr);
+    reported_count++;
+}
+
+//------------------------------------------------------------------------------
+// Check if a secondary address is listed in the cache file.
+//------------------------------------------------------------------------------
+static int
+cache_has(const char *cache_path, const char *address)
+{
+    FILE *fp;
+    char line[256];
+    int found = 0;
+
+    if ((fp = fopen(cache_path, "r")) == NULL)
+        return 0;
+
+    while (!found && fgets(line, sizeof(line), fp))
+        found = (strncmp(line, address, 16) == 0);
+
+    fclose(fp);
+    return found;
+}
+
+//------------------------------------------------------------------------------
+// Rescan a bus with the meters of two lists, check that each is reported once
+// and kept in the cache.
+//------------------------------------------------------------------------------
+static int
+rescan(const char *hex_file, const char *cache_path, const char **meters, const char **more)
+{
+    const char **lists[2], **list;
+    mbus_sim_bus *bus;
+    mbus_sim_slave *slave;
+    mbus_handle *handle;
+    int i, j, count, failed = 0;
+
+    lists[0] = meters;
+    lists[1] = more;
+    reported_count = 0;
+
+    if ((bus = mbus_sim_bus_new()) == NULL)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        return -1;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        for (list = lists[i]; list && *list; list++)
+        {
+            if ((slave = mbus_sim_bus_add_slave(bus, MBUS_SIM_NO_PRIMARY, *list)) == NULL ||
+                mbus_sim_slave_load_hex(slave, hex_file) == -1)
+            {
+                fprintf(stderr, "%s\n", mbus_error_str());
+                mbus_sim_bus_free(bus);
+                return -1;
+            }
+        }
+    }
+
+    if ((handle = mbus_context_sim(bus)) == NULL || mbus_connect(handle) == -1)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        mbus_sim_bus_free(bus);
+        return -1;
+    }
+
+    mbus_register_found_event(handle, found_event);
+
+    if (mbus_scan_2nd_address_cached(handle, "FFFFFFFFFFFFFFFF", cache_path) == -1)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        failed = 1;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        for (list = lists[i]; list && *list; list++)
+        {
+            for (j = 0, count = 0; j < reported_count && j < (int) NITEMS(reported); j++)
+                count += (strcmp(reported[j], *list) == 0);
+
+            if (count != 1 || !cache_has(cache_path, *list))
+            {
+                fprintf(stderr, "%s: reported %d times, %s the cache\n", *list, count,
+                        cache_has(cache_path, *list) ? "in" : "not in");
+                failed = 1;
+            }
+        }
+    }
+
+    printf("%d meters reported, bus time %.3f s\n", reported_count, mbus_sim_bus_time(bus) / 1e9);
+
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+    mbus_sim_bus_free(bus);
+
+    return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+    int failed = 0;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s frame.hex cache-file\n", argv[0]);
+        return 1;
+    }
+
+    // two meters in the cache, two new ones under their masks
+    remove(argv[2]);
+    failed |= rescan(argv[1], argv[2], first_scan, NULL);
+    failed |= rescan(argv[1], argv[2], first_scan, added);
+    failed |= rescan(argv[1], argv[2], first_scan, added);
+
+    // a single meter in the cache matches the whole bus
+    remove(argv[2]);
+    failed |= rescan(argv[1], argv[2], single, NULL);
+    failed |= rescan(argv[1], argv[2], single, added);
+
+    remove(argv[2]);
+
+    return (failed != 0);
+}
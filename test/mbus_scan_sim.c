@@ -0,0 +1,133 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2010, Raditex AB
+// All rights reserved.
+//
+// rSCADA
+// http://www.rSCADA.se
+// info@rscada.se
+//
+//------------------------------------------------------------------------------
+
+//
+// Check the primary scan against slow slaves on a simulated bus (in real
+// time, the scan learns the response times from the clock). Fast slaves
+// answer at the primary addresses 1 - 4, slow ones after an empty address
+// and at the last address. The line silence is that of a serial line, so
+// the reply of a slow slave arrives two addresses later, after the shortened
+// timeouts of its own and of the next address:
+//
+//     ./mbus_scan_sim [-b baudrate] [-f fast_ms] [-s slow_ms] frame.hex
+//
+// Exits with 1 if an address is missed or reported twice.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mbus/mbus.h>
+
+#define LAST_ADDRESS 12
+
+static const int slow_addresses[] = { 6, LAST_ADDRESS };
+
+static int reported[LAST_ADDRESS + 1];
+
+//------------------------------------------------------------------------------
+// Count the reports of every address.
+//------------------------------------------------------------------------------
+static void
+found_event(mbus_handle *handle, int address, int result)
+{
+    (void) handle;
+
+    printf("%s at address %d\n", (result == MBUS_PROBE_COLLISION) ? "collision" : "slave", address);
+
+    if (address >= 0 && address <= LAST_ADDRESS)
+        reported[address]++;
+}
+
+int
+main(int argc, char **argv)
+{
+    mbus_sim_bus *bus;
+    mbus_sim_slave *slave;
+    mbus_handle *handle;
+    long baudrate = 2400, fast = 5, slow = 170;
+    int c, i, address, expected[LAST_ADDRESS + 1], count, failed = 0;
+
+    for (c = 1; c + 1 < argc && argv[c][0] == '-'; c += 2)
+    {
+        if      (strcmp(argv[c], "-b") == 0) baudrate = atol(argv[c + 1]);
+        else if (strcmp(argv[c], "-f") == 0) fast = atol(argv[c + 1]);
+        else if (strcmp(argv[c], "-s") == 0) slow = atol(argv[c + 1]);
+        else break;
+    }
+
+    if (c != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-b baudrate] [-f fast_ms] [-s slow_ms] frame.hex\n", argv[0]);
+        return 1;
+    }
+
+    if ((bus = mbus_sim_bus_new()) == NULL ||
+        mbus_sim_bus_set_option(bus, MBUS_SIM_OPTION_BAUDRATE, baudrate) == -1 ||
+        mbus_sim_bus_set_option(bus, MBUS_SIM_OPTION_LATENCY, fast) == -1 ||
+        mbus_sim_bus_set_option(bus, MBUS_SIM_OPTION_REALTIME, 1) == -1)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        return 1;
+    }
+
+    memset((void *)expected, 0, sizeof(expected));
+
+    for (address = 1; address <= 4; address++)
+        expected[address] = 1;
+
+    for (i = 0; i < (int) NITEMS(slow_addresses); i++)
+        expected[slow_addresses[i]] = 1;
+
+    for (address = 0; address <= LAST_ADDRESS; address++)
+    {
+        if (!expected[address])
+            continue;
+
+        if ((slave = mbus_sim_bus_add_slave(bus, address, NULL)) == NULL ||
+            mbus_sim_slave_load_hex(slave, argv[c]) == -1)
+        {
+            fprintf(stderr, "%s\n", mbus_error_str());
+            return 1;
+        }
+
+        if (address > 4)
+            slave->latency = slow;
+    }
+
+    if ((handle = mbus_context_sim(bus)) == NULL || mbus_connect(handle) == -1 ||
+        mbus_context_set_option(handle, MBUS_OPTION_PURGE_SILENCE_TIME,
+                                (MBUS_INTER_FRAME_GAP_BITS * 1000 + baudrate - 1) / baudrate + MBUS_SERIAL_LATENCY_MS) == -1)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        return 1;
+    }
+
+    count = mbus_scan_primary(handle, 0, LAST_ADDRESS, found_event);
+
+    for (address = 0; address <= LAST_ADDRESS; address++)
+    {
+        if (reported[address] != expected[address])
+        {
+            fprintf(stderr, "address %d: reported %d times, expected %d\n",
+                    address, reported[address], expected[address]);
+            failed = 1;
+        }
+    }
+
+    printf("%d addresses with a reply, bus time %.3f s\n", count, mbus_sim_bus_time(bus) / 1e9);
+
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+    mbus_sim_bus_free(bus);
+
+    return failed;
+}